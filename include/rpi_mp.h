@@ -2,6 +2,8 @@
  * File: video.h
  * Description: Public interface to mediaplayer.
  * ----------------------------------------------------------------------------------- */
+#ifndef RPI_MP_H
+#define RPI_MP_H
 #include <stdint.h>
 #include <pthread.h>
 
@@ -10,9 +12,58 @@ enum _flags
 {
 	RENDER_VIDEO_TO_TEXTURE = 0x1,
 	ANALOG_AUDIO            = 0x2,
+	LOCKFREE_PACKET_BUFFERS = 0x4,
+	READ_AHEAD_INPUT        = 0x8,
+	MMAP_INPUT              = 0x10,
+	DECODE_AHEAD_AUDIO      = 0x40,
+	PASSTHROUGH_AUDIO       = 0x80,
+	KEYFRAME_INDEX          = 0x100,
+	SCAN_KEYFRAMES          = 0x200,
+	ACCURATE_SEEK           = 0x400,
 }
 rpi_mp_open_flags;
 
+/*  STREAMS */
+enum _streams
+{
+	VIDEO_STREAM = 0,
+	AUDIO_STREAM = 1,
+};
+
+/*  ROUTES */
+enum _routes
+{
+	ROUTE_NONE            = 0,
+	ROUTE_HARDWARE_DECODE = 1,
+	ROUTE_SOFTWARE_DECODE = 2,
+	ROUTE_PASSTHROUGH     = 3,
+};
+
+/*  VIDEO SINKS, where software decoded video goes */
+enum _video_sinks
+{
+	VIDEO_SINK_RENDER        = 0,
+	VIDEO_SINK_SHARED_MEMORY = 1,
+	VIDEO_SINK_NULL          = 2,
+};
+
+/*  AUDIO LAYOUTS, decoded audio is mixed into */
+enum _audio_layouts
+{
+	AUDIO_LAYOUT_AUTO    = 0,
+	AUDIO_LAYOUT_STEREO  = 1,
+	AUDIO_LAYOUT_5POINT1 = 2,
+	AUDIO_LAYOUT_7POINT1 = 3,
+};
+
+/*  RESAMPLING QUALITIES, filters of 16, 32 and 64 taps */
+enum _resample_qualities
+{
+	RESAMPLE_LOW    = 0,
+	RESAMPLE_MEDIUM = 1,
+	RESAMPLE_HIGH   = 2,
+};
+
 /**
  *	Initialize the mediaplayer.
  * 	This function is required to be called before any operations on the media player
@@ -34,6 +85,22 @@ void rpi_mp_deinit () ;
  */
 int rpi_mp_open (const char* /* file */, int* /* width */, int* /* height */, int64_t* /* duration */, int /* flags */) ;
 
+/**
+ *  Set how much media is buffered ahead of the decoders for a stream (VIDEO_STREAM or AUDIO_STREAM).
+ *  Demuxing pauses when high_ms milliseconds are queued and resumes when it has drained below low_ms.
+ *  A high_ms of 0 only limits the buffers by size. Takes effect on the next call to rpi_mp_open.
+ *  Returns 0 on success, non-zero for an unknown stream.
+ */
+int rpi_mp_set_buffering (int /* stream */, unsigned int /* low_ms */, unsigned int /* high_ms */) ;
+
+/**
+ *  Set the read ahead used for local files opened with the READ_AHEAD_INPUT flag:
+ *  depth blocks of block_size bytes are kept read ahead of the demuxer.
+ *  Takes effect on the next call to rpi_mp_open.
+ *  Returns 0 on success, non-zero if either is 0.
+ */
+int rpi_mp_set_read_ahead (unsigned int /* block_size */, unsigned int /* depth */) ;
+
 /**
  *  If rendering to a texture this function needs to be called to setup.
  *  Input parameters are a pointer to the EGL Render Buffer and pointers that are set
@@ -67,11 +134,101 @@ uint64_t rpi_mp_current_time () ;
 
 /**
  *	Seeks to the specified position (in seconds) in the media.
+ *	Returns at once, the seek is carried out by the thread in rpi_mp_start. A seek asked for
+ *	before an earlier one is done replaces it. Playback restarts at the keyframe before position,
+ *	or at position itself for media opened with ACCURATE_SEEK. After the end of the file has been
+ *	read it still rewinds it, until what was read has played out.
+ *	Returns non-zero if nothing is playing.
  */
 int	rpi_mp_seek (int64_t /* position */) ;
 
+/**
+ *	Fast-forwards (2 to 32) or rewinds (-2 to -32) by showing only keyframes, with audio muted.
+ *	1 returns to normal playback from the keyframe shown last. Returns at once like rpi_mp_seek.
+ *	Returns non-zero for any other speed, or if nothing with video is playing.
+ */
+int rpi_mp_set_speed (int /* speed */) ;
+
+/**
+ *	Set the layout audio decoded on the CPU is mixed into: AUDIO_LAYOUT_STEREO, AUDIO_LAYOUT_5POINT1,
+ *	AUDIO_LAYOUT_7POINT1, or AUDIO_LAYOUT_AUTO for the smallest of them that holds the channels of the
+ *	stream (stereo up to 3). Takes effect on the next call to rpi_mp_open.
+ *	Returns non-zero for an unknown layout.
+ */
+int rpi_mp_set_audio_layout (int /* layout */) ;
+
+/**
+ *	Set the rate audio decoded on the CPU is played at, resampling it when it differs, and the
+ *	quality of the resampling (RESAMPLE_LOW, RESAMPLE_MEDIUM or RESAMPLE_HIGH). A rate of 0
+ *	resamples only rates the sink does not take, to 48 kHz. Takes effect on the next call to rpi_mp_open.
+ *	Returns non-zero for a rate outside 8 to 192 kHz or an unknown quality.
+ */
+int rpi_mp_set_audio_rate (unsigned int /* rate */, int /* quality */) ;
+
+/**
+ *	Plays at a tempo from 0.5 to 2, with the audio time-stretched so it keeps its pitch.
+ *	Returns non-zero for any other tempo, if nothing is playing, or if the audio is not
+ *	decoded on the CPU (hardware decoding and passthrough can't be stretched).
+ */
+int rpi_mp_set_tempo (double /* tempo */) ;
+
+/**
+ *	Set the volume of audio decoded on the CPU, a gain from 0 to 4, ramping to it over ramp_ms
+ *	(5 ms at least) so it does not click. Holds across calls to rpi_mp_open.
+ *	The gain is applied as PCM is handed to the renderer, what it holds already (a few
+ *	buffers) plays at the volume before. Pausing, seeking and stopping fade the audio out
+ *	the same way and wait, 250 ms at most, until the fade has played before the clock
+ *	stops or the renderer is flushed: rpi_mp_pause and rpi_mp_stop return after it, a
+ *	seek waits on the demuxing thread.
+ *	Returns non-zero for a volume out of range, or if the audio playing is decoded by the
+ *	renderer or passed through, which has no volume of its own.
+ */
+int rpi_mp_set_volume (double /* volume */, unsigned int /* ramp_ms */) ;
+
+/**
+ *	Fade audio decoded on the CPU out to silence, or back in to the volume when mute is 0.
+ *	Returns non-zero like rpi_mp_set_volume if the audio playing is not decoded on the CPU.
+ */
+int rpi_mp_set_mute (int /* mute */) ;
+
+/**
+ *  Get how many seeks were carried out, how many were replaced by later ones before that,
+ *  and how long it took from asking for a seek to its first frame being on the way.
+ */
+int rpi_mp_seek_status (unsigned int* /* seeks */, unsigned int* /* coalesced */, double* /* average_ms */, double* /* max_ms */) ;
+
+/**
+ *  Get how many milliseconds of audio are decoded ahead of the renderer and how often
+ *  it ran dry, for media opened with the DECODE_AHEAD_AUDIO flag.
+ *  Returns non-zero if audio is not decoded ahead.
+ */
+int rpi_mp_audio_ring_status (unsigned int* /* fill_ms */, unsigned int* /* underruns */) ;
+
+/**
+ *  Make streams of a codec, by its FFmpeg name (e.g. "ac3"), take a route when they can.
+ *  ROUTE_NONE goes back to the default route. Takes effect on the next call to rpi_mp_open.
+ *  Returns non-zero for a codec the player has no routes for, or a route the codec can't take.
+ */
+int rpi_mp_set_codec_route (const char* /* codec */, int /* route */) ;
+
+/**
+ *  Pick the sink for video taking the software decode route: the video renderer (or the
+ *  texture with RENDER_VIDEO_TO_TEXTURE), a POSIX shared memory object of the given name
+ *  (laid out as in rpi_mp_video_sink.h), or none, to measure the decoder.
+ *  Takes effect on the next call to rpi_mp_open. Returns non-zero for an unknown sink.
+ */
+int rpi_mp_set_video_sink (int /* sink */, const char* /* name */) ;
+
+/**
+ *  Get the route a stream (VIDEO_STREAM or AUDIO_STREAM) of the open media takes, and the CPU
+ *  that route has cost for its codec in seconds per second of media, over everything played so far.
+ *  Returns non-zero if there is no such stream.
+ */
+int rpi_mp_codec_route (int /* stream */, int* /* route */, double* /* cpu_per_second */) ;
+
 /**
  *  Get title of stream.
  *  Returns non-zero if there is none.
  */
 int rpi_mp_metadata (const char* /* key */, char** /* title */) ;
+#endif
@@ -0,0 +1,59 @@
+#ifndef RPI_MP_ANNEXB_H
+#define RPI_MP_ANNEXB_H
+#include <stdint.h>
+#include <sys/types.h>
+#include <libavcodec/avcodec.h>
+
+/**
+ *	Turns H.264 and HEVC from MP4 and Matroska, where NAL units are prefixed with their
+ *	length and the parameter sets are in an avcC or hvcC record, into the Annex-B byte
+ *	stream the VideoCore decoder expects, with a start code in front of each NAL unit.
+ *	4 byte prefixes are as long as a start code, so they can be rewritten in place and
+ *	the packet still passed on without a copy; 1, 2 and 3 byte prefixes are converted
+ *	while copying. Nothing is allocated per packet.
+ */
+typedef struct
+{
+	// bytes of the length prefixes, 0 if packets need no conversion
+	uint 				length_size;
+	int 				hevc;
+	// what the decoder is set up with: the parameter sets with start codes, or the
+	// extradata as it is for streams that need no conversion
+	uint8_t 		  * parameter_sets;
+	uint 				parameter_sets_size;
+	// NAL units converted, and keyframes the parameter sets were put in front of
+	uint64_t 			units;
+	uint64_t 			injected;
+} annexb_converter ;
+
+
+/**
+ *	@param annexb_converter * converter
+ *		struct to initialize
+ *	@param enum AVCodecID codec_id
+ *		of the stream, only H.264 and HEVC are converted
+ *	@param uint8_t * extradata
+ *		of the stream, or NULL
+ *	@return int ret
+ *		0 on success, non-zero if the avcC or hvcC record is malformed or memory ran out
+ */
+int init_annexb_converter ( annexb_converter * converter, enum AVCodecID codec_id, const uint8_t * extradata, uint size ) ;
+
+void destroy_annexb_converter ( annexb_converter * converter ) ;
+
+/**
+ *	Check the NAL units of a packet and get its size once converted.
+ *	@param int * parameter_sets
+ *		set to whether the packet carries its own sequence parameter set
+ *	@return int size
+ *		bytes of the converted packet, negative if the lengths run past its end
+ */
+int annexb_size ( annexb_converter * converter, const uint8_t * data, uint size, int * parameter_sets ) ;
+
+/**
+ *	Convert a packet checked with annexb_size. out may be data when the prefixes are 4 bytes.
+ *	@return int size
+ *		bytes written to out
+ */
+int annexb_convert ( annexb_converter * converter, uint8_t * out, const uint8_t * data, uint size ) ;
+#endif
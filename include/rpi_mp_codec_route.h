@@ -0,0 +1,74 @@
+#ifndef RPI_MP_CODEC_ROUTE_H
+#define RPI_MP_CODEC_ROUTE_H
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include "rpi_mp.h"
+
+#define ROUTES 4
+#define ROUTE_BIT(route) (1 << (route))
+
+/**
+ *	How streams of a codec are played: decoded by the VideoCore, decoded by FFmpeg
+ *	or passed through to the receiver (ROUTE_* in rpi_mp.h).
+ *	Routes needing a licence are probed once per process, and the CPU each route costs
+ *	is added up over everything played on it, so routes can be compared per content type.
+ */
+typedef struct
+{
+	enum AVCodecID 		codec_id;
+	enum AVMediaType 	type;
+	// OMX_VIDEO_CODINGTYPE or OMX_AUDIO_CODINGTYPE for hardware decode
+	int 				coding;
+	// codec_enabled name hardware decode needs to be licensed under, or NULL
+	const char 		  * licence;
+	// bit per route the codec can take, and the one taken unless something else is asked for
+	int 				routes;
+	int 				route;
+	// set at runtime, ROUTE_NONE if not
+	int 				override;
+	int 				licensed;
+	// CPU time and media time spent on each route
+	int64_t 			cpu_ns[ROUTES];
+	int64_t 			media_us[ROUTES];
+} codec_route ;
+
+
+/**
+ *	Find how to play a codec, probing the hardware on the first call.
+ *	Codecs missing from the table get a default for their media type.
+ *	@return codec_route * route, NULL if there is nothing for the media type
+ */
+codec_route * find_codec_route ( enum AVCodecID codec_id, enum AVMediaType type ) ;
+
+/**
+ *	Pick the route for a stream: the runtime override, then the route the caller prefers,
+ *	then the one in the table, then hardware and software decode, whichever is first
+ *	among the available ones.
+ *	@param int available
+ *		ROUTE_BIT of every route the player can offer the stream right now
+ *	@param int preferred
+ *		route asked for by the open flags, ROUTE_NONE for none
+ *	@return int route, ROUTE_NONE if none is available
+ */
+int select_codec_route ( codec_route * route, int available, int preferred ) ;
+
+/**
+ *	Make a codec, by its FFmpeg name, take a route when it can. ROUTE_NONE removes the override.
+ *	@return int ret
+ *		0 on success, non-zero for a codec not in the table or a route it can't take
+ */
+int set_codec_route ( const char * codec, int route ) ;
+
+/**
+ *	Account CPU time spent on a route for an amount of media. Thread safe.
+ */
+void add_codec_route_cost ( codec_route * route, int taken, int64_t cpu_ns, int64_t media_us ) ;
+
+/**
+ *	@return double cost
+ *		seconds of CPU per second of media on a route, 0 before anything was measured
+ */
+double codec_route_cost ( codec_route * route, int taken ) ;
+
+const char * codec_route_name ( int route ) ;
+#endif
@@ -0,0 +1,32 @@
+#ifndef RPI_MP_CPU_H
+#define RPI_MP_CPU_H
+#include <stdint.h>
+
+/**
+ *	Sets of vector kernels the PCM conversion, time stretching and resampling come in,
+ *	each of them picks the best one this CPU runs, and the CPU time their work is timed by.
+ */
+enum cpu_kernels
+{
+	CPU_KERNELS_C,
+	CPU_KERNELS_NEON,
+	CPU_KERNELS_SSE2,
+	CPU_KERNELS_AVX2
+};
+
+
+/**
+ *	Best kernels this CPU runs: NEON on ARM when it has it, AVX2 or else SSE2 on x86.
+ */
+enum cpu_kernels best_cpu_kernels ( void ) ;
+
+/**
+ *	Whether this CPU runs the kernels of a name: c, neon, sse2 or avx2.
+ */
+int cpu_runs_kernels ( const char * name ) ;
+
+/**
+ *	CPU time of the calling thread, in nanoseconds.
+ */
+int64_t thread_cpu_time ( void ) ;
+#endif
@@ -0,0 +1,83 @@
+#ifndef RPI_MP_DEMUX_SCHEDULER_H
+#define RPI_MP_DEMUX_SCHEDULER_H
+#include "rpi_mp_packet_buffer.h"
+
+#define DEMUX_MAX_LANES 2
+
+/**
+ *	A stream handled by the scheduler.
+ */
+typedef struct
+{
+	packet_buffer * fifo;
+	packet_buffer   overflow;
+} demux_lane ;
+
+/**
+ *	Sorts demuxed packets into the fifos of the decoding threads while looking at all
+ *	of them. If a packet's fifo is full while another fifo is running dry, the packet is
+ *	put aside in an overflow queue instead of blocking demuxing, so badly interleaved
+ *	input does not starve one decoder while the other one is full.
+ *	Only the demuxing thread may call schedule_packet and drain_demux_scheduler.
+ */
+typedef struct
+{
+	demux_lane 		lanes[DEMUX_MAX_LANES];
+	int 			n_lanes;
+	uint 			overflow_size;
+	// number of packets put aside because their fifo was full while another starved
+	uint 			overflowed;
+	// number of times demuxing had to wait for a full fifo
+	uint 			stalls;
+	int 			_flush;
+} demux_scheduler ;
+
+
+/**
+ *	Initialize the scheduler.
+ *
+ *	@param demux_scheduler * scheduler
+ *	@param uint overflow_size
+ *		maximum size in bytes of packets put aside, per lane
+ */
+void init_demux_scheduler ( demux_scheduler * scheduler, uint overflow_size ) ;
+
+/**
+ *	Frees packets left in the overflow queues.
+ */
+void destroy_demux_scheduler ( demux_scheduler * scheduler ) ;
+
+/**
+ *	Add a stream with the fifo its packets go to.
+ *
+ *	@return int lane
+ *		index to pass to schedule_packet, negative on failure
+ */
+int add_demux_lane ( demux_scheduler * scheduler, packet_buffer * fifo ) ;
+
+/**
+ *	Hand a demuxed packet to the scheduler. The packet is owned by the scheduler afterwards.
+ *	Blocks only if its fifo is full and no other fifo is running dry, or the overflow
+ *	queue is full as well.
+ *
+ *	@return int ret
+ *		0 on success, CANCELLED_BUFFER if the fifo was cancelled and the packet was dropped
+ */
+int schedule_packet ( demux_scheduler * scheduler, int lane, AVPacket p ) ;
+
+/**
+ *	Waits until all packets put aside have been moved to their fifos, at end of input.
+ *
+ *	@return int ret
+ *		0 on success, CANCELLED_BUFFER if a fifo was cancelled
+ */
+int drain_demux_scheduler ( demux_scheduler * scheduler ) ;
+
+/**
+ *	Drops all packets put aside, e.g. when seeking.
+ *	May be called from any thread, the packets are dropped by the demuxing thread the
+ *	next time it hands over a packet.
+ */
+void flush_demux_scheduler ( demux_scheduler * scheduler ) ;
+
+#endif
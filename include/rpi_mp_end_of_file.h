@@ -0,0 +1,59 @@
+#ifndef RPI_MP_END_OF_FILE_H
+#define RPI_MP_END_OF_FILE_H
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ *	Where the demuxing thread and the decoding threads meet at the end of the file. The
+ *	decoders play out what was read and wait; a request that rewinds the file, a seek or a
+ *	change of speed, sends them on, otherwise playback ends once all of them are done.
+ *	Requests, the stop and the end of reading are bits of the caller's flags, changed and
+ *	read under mutex, which every function here must be called with held.
+ */
+typedef struct
+{
+	pthread_mutex_t* mutex;
+	pthread_cond_t*  condition;
+	const int32_t*   flags;
+	// bits of flags that end playback, that mark nothing more is read and that rewind the file
+	int32_t 		 stop;
+	int32_t 		 done;
+	int32_t 		 rewind;
+	int 			 decoders;
+	// the demuxer is at the end of the file, and decoders done with what it read
+	int 			 end_of_file;
+	int 			 idle;
+} end_of_file_sync ;
+
+
+/**
+ *	@param end_of_file_sync * sync
+ *		struct to initialize, not at the end of the file
+ *	@param int decoders
+ *		number of decoding threads that call decoder_at_end_of_file
+ */
+void init_end_of_file_sync ( end_of_file_sync * sync, pthread_mutex_t * mutex, pthread_cond_t * condition,
+                             const int32_t * flags, int32_t stop, int32_t done, int32_t rewind, int decoders ) ;
+
+/**
+ *	On the demuxing thread once the last packet was read, before the packet buffers are
+ *	closed so a decoder that finds them closed also finds the end of the file.
+ */
+void reach_end_of_file ( end_of_file_sync * sync ) ;
+
+/**
+ *	On the demuxing thread, once the end of the file is reached and the packet buffers closed:
+ *	waits for a request or for every decoder to be done. On a rewind the end of the file is
+ *	left and the caller reopens the buffers, otherwise it sets done in flags, in both cases
+ *	before it releases mutex and wakes the decoders with condition.
+ *	@return int 1 to go on reading, 0 once playback has ended
+ */
+int demuxer_at_end_of_file ( end_of_file_sync * sync ) ;
+
+/**
+ *	On a decoding thread, once it has decoded everything read up to the end of the file or
+ *	when it ends. If drained, waits for the file to be rewound or for playback to end.
+ *	@return int 1 to go on decoding after a rewind, 0 to end the thread
+ */
+int decoder_at_end_of_file ( end_of_file_sync * sync, int drained ) ;
+#endif
@@ -0,0 +1,41 @@
+#ifndef RPI_MP_GAIN_H
+#define RPI_MP_GAIN_H
+#include <stdint.h>
+
+/**
+ *	Gain of interleaved S16 audio, ramping linearly from one value to the next over a given
+ *	number of samples so a change of volume does not click. Samples are scaled in place with
+ *	the gain kernel of the PCM conversion; at a gain of 1 they are not touched at all.
+ */
+typedef struct
+{
+	int 		channels;
+	int 		sample_rate;
+	// gain of the next sample, the one ramped to and the samples per channel left to get there
+	float 		gain;
+	float 		target;
+	int 		remaining;
+} gain_ramp ;
+
+
+/**
+ *	@param gain_ramp * ramp
+ *		struct to initialize, at gain with no ramp under way
+ *	@param int channels
+ *		of the interleaved samples
+ *	@param int sample_rate
+ *		in Hz, to time the ramps
+ */
+void init_gain_ramp ( gain_ramp * ramp, int channels, int sample_rate, float gain ) ;
+
+/**
+ *	Ramp from the gain reached so far to target over ms, a ramp under way is cut short.
+ *	A ms of 0 jumps to it.
+ */
+void ramp_gain ( gain_ramp * ramp, float target, unsigned int ms ) ;
+
+/**
+ *	Apply the gain, and the ramp under way, to samples per channel of data.
+ */
+void apply_gain ( gain_ramp * ramp, int16_t * data, int samples ) ;
+#endif
@@ -0,0 +1,58 @@
+#ifndef RPI_MP_IEC61937_H
+#define RPI_MP_IEC61937_H
+#include <stdint.h>
+#include <sys/types.h>
+#include <libavcodec/avcodec.h>
+
+/**
+ *	Packs compressed audio frames into IEC 61937 bursts, to be played as 16-bit PCM
+ *	so an AV receiver on the other end of HDMI decodes them.
+ *	A burst is a preamble, the frame data as little endian 16-bit words and zeros up to
+ *	the repetition period of the format. The bursts are byte for byte what the FFmpeg
+ *	spdif muxer writes, so they can be checked against it on any host.
+ *	AC3 and DTS (core only) give a burst per frame, E-AC3 gathers the frames of 1536
+ *	samples and TrueHD gathers 24 frames into one MAT frame per burst.
+ */
+typedef struct
+{
+	enum AVCodecID 		codec_id;
+	// the burst, valid when iec61937_pack returned 1
+	uint8_t 		  * burst;
+	uint 				burst_size;
+	// frames gathered into the burst under way
+	uint 				frames;
+	// bytes of E-AC3 and TrueHD frames gathered in place in the burst
+	uint 				gathered;
+	// what the renderer has to be set up with to carry the bursts
+	uint 				sample_rate;
+	uint 				channels;
+} iec61937_packer ;
+
+
+/**
+ *	@param iec61937_packer * packer
+ *		struct to initialize
+ *	@param enum AVCodecID codec_id
+ *		AV_CODEC_ID_AC3, AV_CODEC_ID_EAC3, AV_CODEC_ID_DTS or AV_CODEC_ID_TRUEHD
+ *	@param int sample_rate
+ *		of the compressed stream
+ *	@return int ret
+ *		0 on success, non-zero if the codec can't be passed through or memory ran out
+ */
+int init_iec61937_packer ( iec61937_packer * packer, enum AVCodecID codec_id, int sample_rate ) ;
+
+void destroy_iec61937_packer ( iec61937_packer * packer ) ;
+
+/**
+ *	Add one compressed frame.
+ *	@return int ret
+ *		1 when a burst of burst_size bytes is ready, 0 when more frames are needed,
+ *		negative if the frame can't be packed (it is dropped)
+ */
+int iec61937_pack ( iec61937_packer * packer, const uint8_t * frame, uint size ) ;
+
+/**
+ *	Drop frames gathered for a burst, e.g. on seek.
+ */
+void reset_iec61937_packer ( iec61937_packer * packer ) ;
+#endif
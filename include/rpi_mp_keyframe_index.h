@@ -0,0 +1,139 @@
+#ifndef RPI_MP_KEYFRAME_INDEX_H
+#define RPI_MP_KEYFRAME_INDEX_H
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <libavformat/avformat.h>
+
+/**
+ *	Index of the keyframes of the video stream of a file, by media time and byte offset,
+ *	so seeking goes straight to a keyframe, even in formats without an index of their own
+ *	(MPEG-TS, Matroska without cues). Formats that can't be seeked by byte are indexed by
+ *	time only.
+ *	It is built as the file is demuxed, by the player or a background scanner, and once
+ *	it covers the whole file it is saved in a sidecar next to it. Opening the sidecar
+ *	later maps it as it is, no matter how many keyframes it holds.
+ */
+typedef struct
+{
+	// microseconds (AV_TIME_BASE) of media, and byte offset or -1 if it can't be seeked to
+	int64_t 	time;
+	int64_t 	position;
+} keyframe ;
+
+#define KEYFRAME_INDEX_MAGIC   0x584B5052  // "RPKX"
+#define KEYFRAME_INDEX_VERSION 2
+#define KEYFRAME_INDEX_SUFFIX  ".keyframes"
+// demuxers that find the next packet from any byte offset, e.g. not Matroska, where packets
+// lie inside clusters, or MP4, which refuses to seek by byte
+#define BYTE_SEEKABLE_FORMATS  "mpegts,mpeg,mpegvideo,h264,hevc"
+
+/**
+ *	Start of the sidecar, the keyframes follow sorted by time. The size and modification
+ *	time of the file it was built from tell whether it is stale.
+ */
+typedef struct
+{
+	uint32_t 	magic;
+	uint32_t 	version;
+	uint32_t 	count;
+	// id of the video stream, e.g. the PID in MPEG-TS
+	int32_t 	stream_id;
+	int64_t 	file_size;
+	int64_t 	file_mtime;
+} keyframe_index_header ;
+
+typedef struct
+{
+	pthread_mutex_t 	mutex;
+	keyframe 		  * keyframes;
+	uint 				count;
+	uint 				capacity;
+	// every keyframe up to covered is in the index, all of them once complete
+	int64_t 			covered;
+	int 				complete;
+	int 				stream_id;
+	char 			  * source;
+	// no sidecar for anything but regular files
+	char 			  * sidecar;
+	int64_t 			file_size;
+	int64_t 			file_mtime;
+	// the keyframes are those of the mapped sidecar
+	void 			  * map;
+	size_t 				map_size;
+	// background scanner
+	pthread_t 			scanner;
+	int 				scanning;
+	volatile int 		stop_scan;
+} keyframe_index ;
+
+
+/**
+ *	@param keyframe_index * index
+ *		struct to initialize, empty
+ *	@param char * source
+ *		the file indexed
+ *	@param int stream_id
+ *		id of its video stream
+ *	@return int ret
+ *		0 on success, non-zero if memory ran out
+ */
+int init_keyframe_index ( keyframe_index * index, const char * source, int stream_id ) ;
+
+/**
+ *	Stops the scanner and frees the index.
+ */
+void destroy_keyframe_index ( keyframe_index * index ) ;
+
+/**
+ *	Map the sidecar of the file, if there is one that is up to date.
+ *	@return int ret
+ *		0 if the index was loaded and is complete, non-zero otherwise
+ */
+int load_keyframe_index ( keyframe_index * index ) ;
+
+/**
+ *	Write the sidecar, if the index is complete and was not loaded from it.
+ *	@return int ret
+ *		0 on success or if there was nothing to save, non-zero on error
+ */
+int save_keyframe_index ( keyframe_index * index ) ;
+
+/**
+ *	Whether the byte offsets of the packets of ctx can be seeked to with AVSEEK_FLAG_BYTE.
+ *	Where they can't keyframes are indexed without them and found by their time.
+ */
+int byte_seekable ( AVFormatContext * ctx ) ;
+
+/**
+ *	Add a keyframe, unless it is in the index already.
+ *	@param int contiguous
+ *		the caller has seen every keyframe from a point already covered up to this one,
+ *		e.g. it has been demuxing since the start of the file
+ */
+void add_keyframe ( keyframe_index * index, int64_t time, int64_t position, int contiguous ) ;
+
+/**
+ *	Mark the index as complete, by a caller that demuxed contiguously to the end of the file.
+ */
+void finish_keyframe_index ( keyframe_index * index ) ;
+
+/**
+ *	Find the last keyframe at or before time.
+ *	@return int ret
+ *		0 if found, non-zero if the index does not cover time
+ */
+int find_keyframe ( keyframe_index * index, int64_t time, keyframe * found ) ;
+
+/**
+ *	Index the file in a thread with a demuxer of its own, reading only the video stream.
+ *	@return int ret
+ *		0 if the scanner started, non-zero otherwise
+ */
+int start_keyframe_scanner ( keyframe_index * index ) ;
+
+/**
+ *	Stop the scanner, wherever it got to.
+ */
+void stop_keyframe_scanner ( keyframe_index * index ) ;
+#endif
@@ -0,0 +1,42 @@
+#ifndef RPI_MP_MIX_H
+#define RPI_MP_MIX_H
+#include <stdint.h>
+#include "rpi_mp_pcm.h"
+
+/**
+ *	Matrices mixing the channels of any FFmpeg layout into the output layout (stereo, 5.1 or
+ *	7.1): channels the output has are passed on, the others are folded into their neighbours
+ *	(centre into the fronts, sides into the backs, ...) and the LFE is dropped when there is
+ *	no LFE out. Rows are scaled down together when a sum could clip.
+ *	Matrices are built once per layout pair and stay cached for the life of the process.
+ */
+typedef struct mix_matrix
+{
+	uint64_t 			in_layout;
+	int 				in_channels;
+	int 				out_layout;
+	// channels handed to the renderer, which takes 1, 2, 4 or 8
+	int 				out_channels;
+	// FFmpeg speaker of each output channel, 0 for a silent one
+	uint64_t 			speakers[PCM_MAX_CHANNELS];
+	// gain of each input channel in each output channel, [out][in]
+	float 				gains[PCM_MAX_CHANNELS][PCM_MAX_CHANNELS];
+	// input channel an output channel is a copy of, -1 if it is mixed or silent
+	int 				sources[PCM_MAX_CHANNELS];
+	struct mix_matrix * next;
+} mix_matrix ;
+
+
+/**
+ *	The matrix from a layout to an output layout, built on first use.
+ *	@param uint64_t in_layout
+ *		FFmpeg channel layout; 0, or one that disagrees with in_channels, takes the default
+ *		layout for in_channels
+ *	@param int out_layout
+ *		AUDIO_LAYOUT_STEREO, AUDIO_LAYOUT_5POINT1 or AUDIO_LAYOUT_7POINT1 of rpi_mp.h, or
+ *		AUDIO_LAYOUT_AUTO for stereo up to 3 channels, 5.1 up to 6 and 7.1 above
+ *	@return mix_matrix * matrix
+ *		NULL for more than PCM_MAX_CHANNELS channels or if memory ran out
+ */
+const mix_matrix * get_mix_matrix ( uint64_t in_layout, int in_channels, int out_layout ) ;
+#endif
@@ -0,0 +1,43 @@
+#ifndef RPI_MP_MMAP_INPUT_H
+#define RPI_MP_MMAP_INPUT_H
+#include <libavformat/avformat.h>
+
+/**
+ *	Input for libavformat served straight from a memory mapping of a local file.
+ *	The file is mapped a chunk at a time so large files fit in a 32-bit address space,
+ *	and the kernel is told to read ahead of, and may drop pages behind, the position.
+ */
+typedef struct
+{
+	int 			fd;
+	int64_t 		file_size;
+	uint8_t 	  * chunk;
+	int64_t 		chunk_offset;
+	size_t 			chunk_size;
+	int64_t 		position;
+	// end of the range already advised to be read in
+	int64_t 		advised;
+	uint 			window;
+	AVIOContext   * avio;
+} mmap_input ;
+
+
+/**
+ *	Open and map a regular file.
+ *
+ *	@param mmap_input * input
+ *		struct to initialize
+ *	@param const char * file
+ *	@param uint window
+ *		bytes ahead of the position to keep advised as needed soon
+ *	@return int ret
+ *		0 on success, non-zero if the file could not be opened, mapped or is not a regular file
+ */
+int open_mmap_input ( mmap_input * input, const char * file, uint window ) ;
+
+/**
+ *	Unmap the file and free the AVIOContext.
+ *	Must be called after the AVFormatContext using it has been closed.
+ */
+void close_mmap_input ( mmap_input * input ) ;
+#endif
@@ -0,0 +1,84 @@
+#ifndef RPI_MP_OMX_PORT_H
+#define RPI_MP_OMX_PORT_H
+#include <stdint.h>
+#include <sys/types.h>
+#include "IL/OMX_Core.h"
+
+struct omx_port;
+
+/**
+ *	Operations on the component behind an input port.
+ *	The player implements these on top of ilclient, a host build can drive the port
+ *	with a stub component instead.
+ */
+typedef struct
+{
+	// allocate the port buffers and their memory
+	int 					(* enable)       ( struct omx_port * port ) ;
+	// release the port buffers and their memory
+	void 					(* disable)      ( struct omx_port * port ) ;
+	OMX_BUFFERHEADERTYPE  * (* get_buffer)   ( struct omx_port * port, int block ) ;
+	int 					(* empty_buffer) ( struct omx_port * port, OMX_BUFFERHEADERTYPE * header ) ;
+} omx_port_ops ;
+
+/**
+ *	Input port of an OMX component with the buffers the component allocates for it.
+ *	A header's pBuffer never changes: data is copied into it, OMX does not allow pointing
+ *	a header somewhere else once the buffer is in use.
+ */
+typedef struct omx_port
+{
+	const omx_port_ops    * ops;
+	void 				  * component;
+	int 					index;
+	int 					enabled;
+	// bytes passed to the component
+	uint64_t 				copied;
+} omx_port ;
+
+
+/**
+ *	Enable the buffers of an input port.
+ *
+ *	@param omx_port * port
+ *		port to initialize
+ *	@param const omx_port_ops * ops
+ *		operations on the component
+ *	@param void * component
+ *		component handle passed through to ops
+ *	@param int index
+ *		port index on the component
+ *	@return int ret
+ *		0 on success, non-zero if the port buffers could not be enabled
+ */
+int open_omx_port ( omx_port * port, const omx_port_ops * ops, void * component, int index ) ;
+
+/**
+ *	Disable the port buffers, which frees their memory.
+ *	The component must have returned every buffer, i.e. it has been flushed.
+ */
+void close_omx_port ( omx_port * port ) ;
+
+/**
+ *	Get a free buffer header, emptied.
+ *	@param int block
+ *		wait for the component to return a buffer if none is free
+ *	@return OMX_BUFFERHEADERTYPE * header, NULL if none is free or on error
+ */
+OMX_BUFFERHEADERTYPE * get_omx_buffer ( omx_port * port, int block ) ;
+
+/**
+ *	Fill a buffer header with size bytes at data, copied into the buffer memory.
+ *	@return uint filled
+ *		number of bytes put in the buffer, at most nAllocLen
+ */
+uint fill_omx_buffer ( omx_port * port, OMX_BUFFERHEADERTYPE * header, const uint8_t * data, uint size ) ;
+
+/**
+ *	Hand a filled buffer header to the component.
+ *	@return int ret
+ *		0 on success, non-zero on error
+ */
+int empty_omx_buffer ( omx_port * port, OMX_BUFFERHEADERTYPE * header ) ;
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef RPI_MP_OMX_SUBMIT_H
+#define RPI_MP_OMX_SUBMIT_H
+#include "rpi_mp_omx_port.h"
+
+/**
+ *	Submission stage in front of an input port.
+ *	Small units of data are packed into one buffer instead of costing an
+ *	OMX_EmptyThisBuffer round trip each, large ones are passed through as before.
+ *	A buffer keeps the timestamp of the first unit in it, so only units that do not
+ *	need their own are appended: any unit on a continuous port (PCM, where the time
+ *	follows from the samples), otherwise only units with unknown time or the time of the
+ *	buffer that carry on a frame, e.g. a keyframe after its parameter sets. A frame always
+ *	ends its buffer there.
+ */
+typedef struct
+{
+	omx_port 			  * port;
+	int 					continuous;
+	OMX_BUFFERHEADERTYPE  * pending;
+	// buffers emptied, bytes in them and their capacity, and when the first and last were
+	uint64_t 				calls;
+	uint64_t 				filled;
+	uint64_t 				capacity;
+	int64_t 				first_call;
+	int64_t 				last_call;
+} omx_submitter ;
+
+
+/**
+ *	@param omx_submitter * submitter
+ *		struct to initialize
+ *	@param omx_port * port
+ *		opened port to submit to
+ *	@param int continuous
+ *		units carry on from each other in time, e.g. PCM frames
+ */
+void init_omx_submitter ( omx_submitter * submitter, omx_port * port, int continuous ) ;
+
+/**
+ *	Submit a unit of data, splitting it over several buffers if needed.
+ *	@param OMX_TICKS ticks
+ *		timestamp of the unit
+ *	@param OMX_U32 flags
+ *		buffer flags of the unit, ENDOFFRAME applies to its end
+ *	@return int ret
+ *		0 on success, non-zero on error
+ */
+int submit_omx_data ( omx_submitter * submitter, const uint8_t * data, uint size, OMX_TICKS ticks, OMX_U32 flags ) ;
+
+/**
+ *	Empty the buffer being packed, if any.
+ *	Call before waiting for more data, so nothing is held back from the component.
+ *	@return int ret
+ *		0 on success, non-zero on error
+ */
+int flush_omx_submitter ( omx_submitter * submitter ) ;
+
+/**
+ *	Empty what is being packed, then an empty buffer carrying flags, e.g. EOS.
+ *	Afterwards the submitter holds no buffer, so the port can be closed.
+ *	@return int ret
+ *		0 on success, non-zero on error
+ */
+int end_omx_submitter ( omx_submitter * submitter, OMX_U32 flags ) ;
+
+/**
+ *	Drop what is being packed, e.g. when seeking. The buffer is kept for the next unit.
+ */
+void discard_omx_submitter ( omx_submitter * submitter ) ;
+
+/**
+ *	Average fill of the emptied buffers, 0 to 1, and buffers emptied per second.
+ */
+double omx_submitter_fill_ratio ( omx_submitter * submitter ) ;
+double omx_submitter_call_rate ( omx_submitter * submitter ) ;
+#endif
@@ -1,10 +1,26 @@
+#ifndef RPI_MP_PACKET_BUFFER_H
+#define RPI_MP_PACKET_BUFFER_H
 #include <libavformat/avformat.h>
 #include <pthread.h>
+#include "rpi_mp_packet_pool.h"
 
 enum FIFO_STATUS
 {
-	EMPTY_BUFFER,
-	FULL_BUFFER
+	EMPTY_BUFFER = 1,
+	FULL_BUFFER,
+	CANCELLED_BUFFER
+};
+
+/**
+ *	Synchronization used by a FIFO.
+ *	PACKET_BUFFER_MUTEX takes a mutex around every operation and may be shared by any
+ *	number of threads. PACKET_BUFFER_SPSC is a lock-free ring that is only safe with
+ *	exactly one pushing and one popping thread.
+ */
+enum packet_buffer_type
+{
+	PACKET_BUFFER_MUTEX,
+	PACKET_BUFFER_SPSC
 };
 
 /**
@@ -12,14 +28,37 @@ enum FIFO_STATUS
  */
 typedef struct
 {
+	enum packet_buffer_type type;
 	uint 	 		size;
 	uint 			capacity;
 	uint 	 		n_packets;
 	uint 			size_packets;
-	AVPacket      * packets;
-	AVPacket      * _front;
-	AVPacket      * _back;
 	pthread_mutex_t mutex;
+	// mutex version, a list of slots taken from the pool
+	packet_pool 	pool;
+	packet_slot   * _first;
+	packet_slot   * _last;
+	// lock-free ring, indices are free running and masked with capacity - 1
+	AVPacket      * packets;
+	uint 			_head;
+	uint 			_tail;
+	// number of times a push or pop had to wait for the mutex
+	uint 			contended;
+	// blocking push/pop
+	pthread_cond_t  not_empty;
+	pthread_cond_t  not_full;
+	int 			cancelled;
+	int 			push_cancelled;
+	int 			closed;
+	int 			_push_waiting;
+	int 			_pop_waiting;
+	// queued media in microseconds and watermarks (milliseconds) for when the fifo is full
+	AVRational 		time_base;
+	uint 			duration;
+	uint 			low_ms;
+	uint 			high_ms;
+	int 			_filled;
+	int64_t 		_last_ts;
 } packet_buffer ;
 
 
@@ -31,10 +70,42 @@ typedef struct
  *		pointer to a struct to perform initialization on
  *	@param size
  *		maximum size of the fifo in bytes.
+ *	@param slots
+ *		number of packet slots allocated up front. The mutex version grows in steps of
+ *		this many slots, the lock-free ring can never hold more than this (rounded up to
+ *		a power of two).
+ *	@param type
+ *		synchronization to use, see packet_buffer_type
  *	@return int ret
  *		0 on success, or non-zero on failure
  */
-int init_packet_buffer ( packet_buffer * buffer, uint size ) ;
+int init_packet_buffer ( packet_buffer * buffer, uint size, uint slots, enum packet_buffer_type type ) ;
+
+/**
+ *	Let the mutex version release slots allocated during a burst.
+ *	Whenever the fifo drains, unused slabs are freed until at most slabs remain.
+ *
+ *	@param packet_buffer * buffer
+ *	@param uint slabs
+ *		number of slabs to keep, 0 (the default) never shrinks
+ */
+void set_packet_buffer_high_water ( packet_buffer * buffer, uint slabs ) ;
+
+/**
+ *	Limit the FIFO by the duration of media it holds in addition to its size in bytes.
+ *	Once the queued duration reaches the high watermark pushing fails (or waits) until
+ *	the consumer has drained it below the low watermark.
+ *	Durations are taken from the packets, or from the distance between their timestamps.
+ *
+ *	@param packet_buffer * buffer
+ *	@param AVRational time_base
+ *		time base of the packets' timestamps and durations
+ *	@param uint low_ms
+ *		resume filling once below this many milliseconds
+ *	@param uint high_ms
+ *		considered full at this many milliseconds, 0 to only limit by size
+ */
+void set_packet_buffer_watermarks ( packet_buffer * buffer, AVRational time_base, uint low_ms, uint high_ms ) ;
 
 /**
  *	Destroys a FIFO buffer.
@@ -54,7 +125,7 @@ void destroy_packet_buffer ( packet_buffer * buffer ) ;
  *		pointer to fifo queue
  *	@param AVPacket p
  *	@return int ret
- *		0 on success, non-zero on failure.
+ *		0 on success, FULL_BUFFER if there is no room for the packet.
  */
 int push_packet ( packet_buffer * buffer, AVPacket   p ) ;
 
@@ -67,11 +138,82 @@ int push_packet ( packet_buffer * buffer, AVPacket   p ) ;
  *	@param AVPacket * p
  *		pointer that will be set to the poped packet
  *	@return int ret
- *		zero on success, non-zero on failure
+ *		zero on success, EMPTY_BUFFER if there was nothing to pop.
  */
 int pop_packet ( packet_buffer * buffer, AVPacket * p ) ;
 
 /**
- *	Pops any packets that are left in the buffer and thereby reseting it
+ *	Copies the first packet of the fifo queue without removing it.
+ *	The packet is still owned by the fifo. For PACKET_BUFFER_SPSC only the consumer may peek.
+ *
+ *	@return int ret
+ *		zero on success, EMPTY_BUFFER if there is no packet.
+ */
+int peek_packet ( packet_buffer * buffer, AVPacket * p ) ;
+
+/**
+ *	Pushes AVPacket into the FIFO buffer, waiting for room if it is full.
+ *
+ *	@param packet_buffer * buffer
+ *		pointer to fifo queue
+ *	@param AVPacket p
+ *	@param int timeout
+ *		maximum time to wait in milliseconds, negative to wait until there is room
+ *	@return int ret
+ *		0 on success, FULL_BUFFER on timeout or CANCELLED_BUFFER if the fifo was cancelled.
+ */
+int push_packet_wait ( packet_buffer * buffer, AVPacket   p, int timeout ) ;
+
+/**
+ *	Pops the first packet from the fifo queue, waiting for one if it is empty.
+ *
+ *	@param packet_buffer * buffer
+ *		pointer to buffer from which to perform pop
+ *	@param AVPacket * p
+ *		pointer that will be set to the poped packet
+ *	@param int timeout
+ *		maximum time to wait in milliseconds, negative to wait until there is a packet
+ *	@return int ret
+ *		zero on success, EMPTY_BUFFER on timeout or if the fifo is closed and empty,
+ *		CANCELLED_BUFFER if the fifo was cancelled.
+ */
+int pop_packet_wait ( packet_buffer * buffer, AVPacket * p, int timeout ) ;
+
+/**
+ *	Wakes up every thread waiting on the fifo and makes all waiting calls return
+ *	CANCELLED_BUFFER until resume_packet_buffer is called.
+ *	Non-blocking push and pop are not affected.
+ */
+void cancel_packet_buffer ( packet_buffer * buffer ) ;
+
+/**
+ *	Wakes up the thread waiting to push and makes waiting pushes return CANCELLED_BUFFER
+ *	until resume_packet_buffer is called. Popping threads go on waiting for packets.
+ */
+void cancel_packet_buffer_push ( packet_buffer * buffer ) ;
+
+/**
+ *	Lets waiting calls block again after cancel_packet_buffer or cancel_packet_buffer_push.
+ */
+void resume_packet_buffer ( packet_buffer * buffer ) ;
+
+/**
+ *	Marks that no more packets will be pushed.
+ *	pop_packet_wait will return EMPTY_BUFFER instead of waiting once the fifo has been drained.
+ */
+void close_packet_buffer ( packet_buffer * buffer ) ;
+
+/**
+ *	Lets packets be pushed again after close_packet_buffer, e.g. when a seek rewinds the input.
+ *	pop_packet_wait waits for them again once it has returned EMPTY_BUFFER.
+ */
+void reopen_packet_buffer ( packet_buffer * buffer ) ;
+
+/**
+ *	Pops any packets that are left in the buffer and thereby reseting it.
+ *	For PACKET_BUFFER_SPSC this acts as the consumer and must not run at the same
+ *	time as pop_packet.
  */
 void flush_buffer ( packet_buffer * buffer ) ;
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef RPI_MP_PACKET_POOL_H
+#define RPI_MP_PACKET_POOL_H
+#include <libavformat/avformat.h>
+
+/**
+ *	A queued packet, linked into either a fifo or the pool's free list.
+ */
+typedef struct packet_slot
+{
+	AVPacket             packet;
+	struct packet_slot * next;
+	struct packet_slab * slab;
+} packet_slot ;
+
+/**
+ *	Block of slots allocated in one go.
+ */
+typedef struct packet_slab
+{
+	struct packet_slab * next;
+	uint 				 n_used;
+	packet_slot 		 slots[];
+} packet_slab ;
+
+/**
+ *	Pool of packet slots.
+ *	Grows by whole slabs when it runs out of free slots, never moving slots that are
+ *	in use. Not thread safe, the owner is responsible for locking.
+ */
+typedef struct
+{
+	uint 			slab_size;
+	uint 			n_slabs;
+	uint 			high_water;
+	uint 			n_free;
+	packet_slab   * slabs;
+	packet_slot   * free_slots;
+} packet_pool ;
+
+
+/**
+ *	Initialize the pool and allocate the first slab.
+ *
+ *	@param packet_pool * pool
+ *		pool to initialize
+ *	@param uint slab_size
+ *		number of slots allocated every time the pool grows
+ *	@return int ret
+ *		0 on success, non-zero on failure
+ */
+int init_packet_pool ( packet_pool * pool, uint slab_size ) ;
+
+/**
+ *	Frees all slabs. Any slots still in use are invalid afterwards.
+ */
+void destroy_packet_pool ( packet_pool * pool ) ;
+
+/**
+ *	Get a free slot, growing the pool by one slab if needed.
+ *
+ *	@return packet_slot * slot
+ *		free slot or NULL if no more memory could be allocated
+ */
+packet_slot * get_packet_slot ( packet_pool * pool ) ;
+
+/**
+ *	Return a slot to the pool for recycling.
+ */
+void put_packet_slot ( packet_pool * pool, packet_slot * slot ) ;
+
+/**
+ *	Frees slabs that have no slots in use until the pool is down to its high water mark.
+ *	Does nothing if the high water mark is 0.
+ */
+void shrink_packet_pool ( packet_pool * pool ) ;
+
+#endif
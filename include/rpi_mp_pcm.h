@@ -0,0 +1,102 @@
+#ifndef RPI_MP_PCM_H
+#define RPI_MP_PCM_H
+#include <stdint.h>
+#include <libavutil/samplefmt.h>
+
+/**
+ *	Conversion of decoded audio to the interleaved signed 16-bit PCM audio_render takes.
+ *	Interleaving and sample conversion are done in one pass, with kernels for NEON on
+ *	ARMv7 and later and SSE2/AVX2 on x86, picked at runtime from what the CPU supports.
+ *	Float input is rounded to nearest and saturated, wider integers keep their top 16 bits.
+ */
+
+#define PCM_MAX_CHANNELS 8
+
+struct mix_matrix;
+
+/**
+ *	Convert a frame of samples to interleaved S16.
+ *
+ *	@param int16_t * out
+ *		room for samples * out_channels values
+ *	@param uint8_t * const * in
+ *		one plane per channel for planar formats, else a single plane
+ *	@param enum AVSampleFormat format
+ *		U8, S16, S32, FLT or DBL, packed or planar
+ *	@param int channels
+ *		channels in the input
+ *	@param int out_channels
+ *		channels in the output, the ones beyond the input are silent and extra input
+ *		channels are dropped
+ *	@param int samples
+ *		samples per channel
+ *	@return int size
+ *		bytes written to out, negative if the format is not supported
+ */
+int pcm_to_s16 ( int16_t * out, uint8_t * const * in, enum AVSampleFormat format, int channels, int out_channels, int samples ) ;
+
+/**
+ *	Convert a frame of samples to interleaved S16 in the output layout of a mix matrix,
+ *	mixing the channels through it in the same pass.
+ *
+ *	@param int16_t * out
+ *		room for samples * matrix->out_channels values
+ *	@param struct mix_matrix * matrix
+ *		from get_mix_matrix, for the channels of the input
+ *	@return int size
+ *		bytes written to out, negative if the format is not supported
+ */
+int pcm_mix_to_s16 ( int16_t * out, uint8_t * const * in, enum AVSampleFormat format, const struct mix_matrix * matrix, int samples ) ;
+
+/**
+ *	Scale interleaved S16 samples in place by a gain that changes by step from one sample
+ *	to the next, rounding to nearest and saturating.
+ *
+ *	@param int n
+ *		values in data, a multiple of channels
+ *	@param float gain
+ *		of the first sample, sample f gets gain + f * step
+ */
+void pcm_gain ( int16_t * data, int n, int channels, float gain, float step ) ;
+
+/**
+ *	Name of the kernels pcm_to_s16 uses on this CPU.
+ */
+const char * pcm_kernel_name ( void ) ;
+
+
+/**
+ *	Kernels converting n contiguous values.
+ *	The vector ones handle the bulk of the data and leave the tail to the scalar ones.
+ */
+typedef struct
+{
+	const char * name;
+	void 		 (* flt) ( int16_t * out, const float   * in, int n ) ;
+	void 		 (* s32) ( int16_t * out, const int32_t * in, int n ) ;
+	// out += in * gain
+	void 		 (* mix) ( float * out, const float * in, float gain, int n ) ;
+	// data *= gain + f * step, f the sample of the value; vectorized for 1, 2, 4 or 8 channels
+	void 		 (* gain) ( int16_t * data, int n, int channels, float gain, float step ) ;
+} pcm_kernels ;
+
+void pcm_flt_to_s16_c ( int16_t * out, const float   * in, int n ) ;
+void pcm_s32_to_s16_c ( int16_t * out, const int32_t * in, int n ) ;
+void pcm_mix_c        ( float   * out, const float   * in, float gain, int n ) ;
+void pcm_gain_c       ( int16_t * data, int n, int channels, float gain, float step ) ;
+
+/**
+ *	Use other kernels than those picked for this CPU, e.g. to compare them.
+ *	They must run on it, and no conversion may be running meanwhile.
+ */
+void set_pcm_kernels ( const pcm_kernels * kernels ) ;
+
+extern const pcm_kernels pcm_kernels_c;
+#if defined(__arm__) || defined(__aarch64__)
+extern const pcm_kernels pcm_kernels_neon;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+extern const pcm_kernels pcm_kernels_sse2;
+extern const pcm_kernels pcm_kernels_avx2;
+#endif
+#endif
@@ -0,0 +1,112 @@
+#ifndef RPI_MP_PCM_RING_H
+#define RPI_MP_PCM_RING_H
+#include <stdint.h>
+#include <pthread.h>
+#include "rpi_mp_packet_buffer.h"
+
+/**
+ *	Ring of decoded PCM frames between one decoding thread and one submitting thread.
+ *	Frames are written in place: the producer reserves room, converts into it and
+ *	commits, the consumer peeks at the oldest frame and releases it once submitted.
+ *	Positions are only ever advanced by their owner, so neither side takes a lock
+ *	unless it has to sleep.
+ */
+typedef struct
+{
+	uint8_t 		  * data;
+	uint 				size;
+	// bytes written and read since the start, positions are these modulo size
+	uint 				_head;
+	uint 				_tail;
+	// producer side state between reserve and commit
+	uint 				_reserved;
+	uint 				_skip;
+	// consumer side, length of the record being looked at
+	uint 				_peeked;
+	// bytes of PCM queued, excluding record headers
+	uint 				queued;
+	// times the consumer found the ring empty after it had started playing
+	uint 				underruns;
+	int 				_started;
+	int 				cancelled;
+	int 				closed;
+	int 				_push_waiting;
+	int 				_pop_waiting;
+	pthread_mutex_t 	mutex;
+	pthread_cond_t 		not_empty;
+	pthread_cond_t 		not_full;
+} pcm_ring ;
+
+/**
+ *	A frame taken from the ring.
+ */
+typedef struct
+{
+	uint8_t   * data;
+	uint 		size;
+	int64_t 	time;
+	uint 		flags;
+} pcm_frame ;
+
+
+/**
+ *	@param pcm_ring * ring
+ *		struct to initialize
+ *	@param uint size
+ *		bytes of memory for frames and their headers, rounded up to a power of two.
+ *		A frame may take up to half of it.
+ *	@return int ret
+ *		0 on success, non-zero if the memory could not be allocated
+ */
+int init_pcm_ring ( pcm_ring * ring, uint size ) ;
+
+void destroy_pcm_ring ( pcm_ring * ring ) ;
+
+/**
+ *	Reserve room for a frame of size bytes, producer side.
+ *	@param int timeout
+ *		milliseconds to wait for room, negative waits until there is room or the ring is cancelled
+ *	@return uint8_t * data
+ *		where to write the frame, NULL if the ring is full, cancelled or the frame can never fit
+ */
+uint8_t * pcm_ring_reserve ( pcm_ring * ring, uint size, int timeout ) ;
+
+/**
+ *	Queue the frame written to the reserved room.
+ *	@param int64_t time
+ *	@param uint flags
+ *		passed on to the consumer untouched
+ */
+void pcm_ring_commit ( pcm_ring * ring, int64_t time, uint flags ) ;
+
+/**
+ *	Look at the oldest frame, consumer side. It stays in the ring until released.
+ *	@param int timeout
+ *		milliseconds to wait for a frame, negative waits until one arrives
+ *	@return int ret
+ *		0 on success, EMPTY_BUFFER if there is none (for good once the ring is closed),
+ *		CANCELLED_BUFFER if the wait was cancelled
+ */
+int pcm_ring_peek ( pcm_ring * ring, pcm_frame * frame, int timeout ) ;
+
+/**
+ *	Drop the frame returned by pcm_ring_peek, making room for the producer.
+ */
+void pcm_ring_release ( pcm_ring * ring ) ;
+
+/**
+ *	Makes waiting calls return until resume_pcm_ring, as with the packet buffers.
+ */
+void cancel_pcm_ring ( pcm_ring * ring ) ;
+void resume_pcm_ring ( pcm_ring * ring ) ;
+
+/**
+ *	Marks that no more frames will be written.
+ */
+void close_pcm_ring ( pcm_ring * ring ) ;
+
+/**
+ *	Drop every queued frame. Neither side may be using the ring meanwhile.
+ */
+void flush_pcm_ring ( pcm_ring * ring ) ;
+#endif
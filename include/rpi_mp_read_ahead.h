@@ -0,0 +1,61 @@
+#ifndef RPI_MP_READ_AHEAD_H
+#define RPI_MP_READ_AHEAD_H
+#include <libavformat/avformat.h>
+#include <pthread.h>
+
+/**
+ *	Input for libavformat that reads a local file ahead of the demuxer.
+ *	A thread keeps a ring of blocks filled from the file, so the demuxer reads from
+ *	memory and a slow SD card or network share only stalls it once the ring runs dry.
+ */
+typedef struct
+{
+	int 			fd;
+	int64_t 		file_size;
+	uint 			block_size;
+	uint 			depth;
+	uint8_t 	  * blocks;
+	int64_t 	  * offsets;
+	int 		  * lengths;
+	// ring of filled blocks, the demuxer reads from tail and the reading thread fills head
+	uint 			head;
+	uint 			tail;
+	uint 			count;
+	uint 			read_offset;
+	int64_t 		fill_position;
+	int 			eof;
+	int 			error;
+	int 			stop;
+	uint 			generation;
+	pthread_t 		thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+	// time in microseconds the demuxer spent waiting for data, and how many times
+	int64_t 		stall_time;
+	uint 			stalls;
+	AVIOContext   * avio;
+} read_ahead ;
+
+
+/**
+ *	Open a file and start reading ahead.
+ *
+ *	@param read_ahead * input
+ *		struct to initialize
+ *	@param const char * file
+ *		path of a regular file
+ *	@param uint block_size
+ *		size in bytes of every read from the file
+ *	@param uint depth
+ *		number of blocks to keep read ahead
+ *	@return int ret
+ *		0 on success, non-zero if the file could not be opened or is not a regular file
+ */
+int open_read_ahead ( read_ahead * input, const char * file, uint block_size, uint depth ) ;
+
+/**
+ *	Stop the reading thread and free all buffers, including the AVIOContext.
+ *	Must be called after the AVFormatContext using it has been closed.
+ */
+void close_read_ahead ( read_ahead * input ) ;
+#endif
@@ -0,0 +1,125 @@
+#ifndef RPI_MP_RESAMPLE_H
+#define RPI_MP_RESAMPLE_H
+#include <stdint.h>
+
+/**
+ *	Polyphase resampling of interleaved S16 audio, for rates the HDMI sink or the firmware
+ *	don't handle well (e.g. 11025, 22050, 96000).
+ *	Rates reduce to out / in = L / M; a Kaiser windowed sinc is split into L phases, and
+ *	each output sample is one dot product of the input with the phase it falls on.
+ *	Filter banks are computed once per rate pair and quality and stay cached for the life
+ *	of the process. The dot products have kernels for NEON on ARMv7 and later and SSE2/AVX2
+ *	on x86, picked at runtime like those of the PCM conversion.
+ */
+
+#define RESAMPLE_MAX_CHANNELS 8
+// with more phases than this an output sample takes the phase before it
+#define RESAMPLE_MAX_PHASES   1024
+
+/**
+ *	Filter bank for a pair of rates and a quality, shared by the resamplers using it.
+ */
+typedef struct resample_bank
+{
+	int 					in_rate;
+	int 					out_rate;
+	int 					quality;
+	// L and M of out / in = L / M
+	int 					up;
+	int 					down;
+	int 					phases;
+	int 					taps;
+	// phases * taps, a phase is applied to taps consecutive input samples
+	float 				  * coefficients;
+	struct resample_bank  * next;
+} resample_bank ;
+
+typedef struct
+{
+	int 				channels;
+	const resample_bank * bank;
+	// planar input not yet used, and the next output's place in it: index and phase in 1/up
+	float 			  * input[RESAMPLE_MAX_CHANNELS];
+	int 				input_samples;
+	int 				input_capacity;
+	int 				index;
+	int 				phase;
+	// media time (microseconds) of input[0][0], AV_NOPTS_VALUE until known
+	int64_t 			input_time;
+	float 			  * output;
+	int16_t 		  * output_s16;
+	int 				output_capacity;
+	uint64_t 			samples_in;
+	uint64_t 			samples_out;
+	// CPU time spent resampling, in nanoseconds
+	int64_t 			cpu;
+} resampler ;
+
+
+/**
+ *	@param resampler * resampler
+ *		struct to initialize
+ *	@param int channels
+ *		of the interleaved samples
+ *	@param int quality
+ *		RESAMPLE_LOW, RESAMPLE_MEDIUM or RESAMPLE_HIGH of rpi_mp.h: 16, 32 or 64 taps
+ *	@return int ret
+ *		0 on success, non-zero for a bad rate or quality, or if memory ran out
+ */
+int init_resampler ( resampler * resampler, int channels, int in_rate, int out_rate, int quality ) ;
+
+void destroy_resampler ( resampler * resampler ) ;
+
+/**
+ *	Drop the audio held back, e.g. on seek.
+ */
+void reset_resampler ( resampler * resampler ) ;
+
+/**
+ *	Resample samples. Output lags the input by half the filter.
+ *	@param int16_t * in
+ *		samples * channels interleaved values
+ *	@param int64_t time
+ *		media time (microseconds) of the first sample, AV_NOPTS_VALUE if unknown
+ *	@param int16_t ** out
+ *		set to the resampled samples, valid until the next call
+ *	@param int64_t * out_time
+ *		set to the media time of the first of them
+ *	@return int samples
+ *		samples per channel in *out, negative if memory ran out
+ */
+int resample ( resampler * resampler, const int16_t * in, int samples, int64_t time,
+               const int16_t ** out, int64_t * out_time ) ;
+
+/**
+ *	Name of the kernels resample uses on this CPU.
+ */
+const char * resample_kernel_name ( void ) ;
+
+
+/**
+ *	Dot product of n contiguous values, n a multiple of 16.
+ */
+typedef struct
+{
+	const char * name;
+	float 		 (* dot) ( const float * a, const float * b, int n ) ;
+} resample_kernels ;
+
+float resample_dot_c ( const float * a, const float * b, int n ) ;
+
+/**
+ *	Use other kernels than those picked for this CPU, e.g. to compare them.
+ *	They must run on it, and no resampler may be running meanwhile.
+ */
+void set_resample_kernels ( const resample_kernels * kernels ) ;
+
+extern const resample_kernels resample_kernels_c;
+#if defined(__arm__) || defined(__aarch64__)
+extern const resample_kernels resample_kernels_neon;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+extern const resample_kernels resample_kernels_sse2;
+extern const resample_kernels resample_kernels_avx2;
+#endif
+#endif
@@ -0,0 +1,53 @@
+#ifndef RPI_MP_SCRATCH_H
+#define RPI_MP_SCRATCH_H
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ *	Memory that lives until the arena is reset, e.g. for the duration of one frame.
+ *	Allocations are carved out of one block. When a round needs more, the excess comes
+ *	from the heap and the block grows to fit the whole round at the next reset, so
+ *	once the largest round has been seen no heap calls are made at all.
+ *	Not thread safe, an arena belongs to one decoding thread.
+ */
+typedef struct scratch_arena
+{
+	uint8_t 			  * block;
+	size_t 					size;
+	size_t 					used;
+	// bytes asked for since the last reset, including what did not fit
+	size_t 					wanted;
+	struct scratch_chunk  * overflow;
+	// heap allocations made after init
+	uint 					allocations;
+} scratch_arena ;
+
+
+/**
+ *	@param scratch_arena * arena
+ *		struct to initialize
+ *	@param size_t size
+ *		expected bytes needed per round
+ *	@return int ret
+ *		0 on success, non-zero if the block could not be allocated
+ */
+int init_scratch_arena ( scratch_arena * arena, size_t size ) ;
+
+/**
+ *	Frees the block and anything still allocated from the heap.
+ */
+void destroy_scratch_arena ( scratch_arena * arena ) ;
+
+/**
+ *	Get size bytes, aligned for SIMD, valid until the next reset.
+ *	@return void * memory, NULL if the heap is exhausted
+ */
+void * scratch_alloc ( scratch_arena * arena, size_t size ) ;
+
+/**
+ *	Release everything allocated since the last reset, growing the block if the
+ *	round did not fit.
+ */
+void reset_scratch_arena ( scratch_arena * arena ) ;
+#endif
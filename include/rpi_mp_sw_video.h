@@ -0,0 +1,56 @@
+#ifndef RPI_MP_SW_VIDEO_H
+#define RPI_MP_SW_VIDEO_H
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include "rpi_mp_video_sink.h"
+
+/**
+ *	Video decoded by libavcodec on the CPU, for codecs the VideoCore can't decode.
+ *	Frame and slice threading are spread over every core, frames go to a video sink.
+ *	Needs nothing from the VideoCore, so with the null or shared memory sink it runs
+ *	and can be measured on any Linux host.
+ */
+typedef struct
+{
+	AVCodecContext 	  * codec_ctx;
+	// of the packet timestamps
+	AVRational 			time_base;
+	AVFrame 		  * frame;
+	video_sink 		  * sink;
+	uint64_t 			frames;
+	// frames before this time (microseconds) are decoded but not written, e.g. after an
+	// accurate seek; AV_NOPTS_VALUE once a frame at or after it came out
+	int64_t 			discard_until;
+	uint64_t 			discarded;
+} sw_video_decoder ;
+
+
+/**
+ *	@param sw_video_decoder * decoder
+ *		struct to initialize
+ *	@param AVCodecContext * codec_ctx
+ *		context of the stream, opened or not; it is (re)opened with threading
+ *	@param AVRational time_base
+ *		of the stream
+ *	@param video_sink * sink
+ *		opened sink to write frames to, stays owned by the caller
+ *	@return int ret
+ *		0 on success, non-zero if the decoder could not be opened
+ */
+int open_sw_video_decoder ( sw_video_decoder * decoder, AVCodecContext * codec_ctx, AVRational time_base, video_sink * sink ) ;
+
+/**
+ *	Decode a packet and write every frame it yields to the sink.
+ *	A NULL packet drains the frames the decoder still holds at the end of the stream.
+ *	@return int ret
+ *		0 on success, negative if the packet was refused, positive if the sink failed
+ */
+int sw_video_decode ( sw_video_decoder * decoder, const AVPacket * packet ) ;
+
+/**
+ *	Drop the frames the decoder holds, e.g. on seek.
+ */
+void flush_sw_video_decoder ( sw_video_decoder * decoder ) ;
+
+void close_sw_video_decoder ( sw_video_decoder * decoder ) ;
+#endif
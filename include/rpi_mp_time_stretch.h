@@ -0,0 +1,121 @@
+#ifndef RPI_MP_TIME_STRETCH_H
+#define RPI_MP_TIME_STRETCH_H
+#include <stdint.h>
+
+/**
+ *	Time-stretching of interleaved S16 audio by WSOLA, changing the tempo and keeping the pitch.
+ *	Input is cut into overlapping segments; each one is taken from the offset, within a
+ *	search window around where the tempo puts it, that best matches the end of the segment
+ *	before, and the two are cross-faded. Matching is the costly part and has kernels for
+ *	NEON on ARMv7 and later and SSE2/AVX2 on x86, picked at runtime like those of the PCM
+ *	conversion.
+ */
+typedef struct
+{
+	int 		channels;
+	int 		sample_rate;
+	// 1 leaves the audio as it is, 2 plays it twice as fast
+	double 		tempo;
+	// samples per channel of a segment, of the overlap between two and of the window searched
+	int 		sequence;
+	int 		overlap;
+	int 		search;
+	// interleaved input not yet used, and where the next segment is taken from in it
+	float 	  * input;
+	int 		input_samples;
+	int 		input_capacity;
+	double 		position;
+	// media time (microseconds) of input[0], AV_NOPTS_VALUE until known
+	int64_t 	input_time;
+	// end of the last segment, faded into the next one
+	float 	  * tail;
+	int 		has_tail;
+	// fade-in ramp over the overlap, one value per sample of each channel
+	float 	  * fade;
+	float 	  * output;
+	int16_t   * output_s16;
+	int 		output_capacity;
+	uint64_t 	samples_in;
+	uint64_t 	samples_out;
+	// CPU time spent stretching, in nanoseconds
+	int64_t 	cpu;
+} time_stretcher ;
+
+
+/**
+ *	@param time_stretcher * stretcher
+ *		struct to initialize, at a tempo of 1
+ *	@param int channels
+ *		of the interleaved samples
+ *	@param int sample_rate
+ *		in Hz, sets the length of the segments
+ *	@return int ret
+ *		0 on success, non-zero if memory ran out
+ */
+int init_time_stretcher ( time_stretcher * stretcher, int channels, int sample_rate ) ;
+
+void destroy_time_stretcher ( time_stretcher * stretcher ) ;
+
+/**
+ *	Drop the audio held back, e.g. on seek.
+ */
+void reset_time_stretcher ( time_stretcher * stretcher ) ;
+
+/**
+ *	Change the tempo, from the next segment on.
+ */
+void set_time_stretch_tempo ( time_stretcher * stretcher, double tempo ) ;
+
+/**
+ *	Stretch samples. Audio is held back until there is a segment and its search window,
+ *	so the output lags the input by some 60 ms.
+ *	@param int16_t * in
+ *		samples * channels interleaved values
+ *	@param int64_t time
+ *		media time (microseconds) of the first sample, AV_NOPTS_VALUE if unknown
+ *	@param int16_t ** out
+ *		set to the stretched samples, valid until the next call
+ *	@param int64_t * out_time
+ *		set to the media time the first of them was taken from
+ *	@return int samples
+ *		samples per channel in *out, 0 if none are ready yet, negative if memory ran out
+ */
+int time_stretch ( time_stretcher * stretcher, const int16_t * in, int samples, int64_t time,
+                   const int16_t ** out, int64_t * out_time ) ;
+
+/**
+ *	Name of the kernels time_stretch uses on this CPU.
+ */
+const char * time_stretch_kernel_name ( void ) ;
+
+
+/**
+ *	Kernels working on n contiguous values.
+ */
+typedef struct
+{
+	const char * name;
+	// dot product of a and b, and the energy of b
+	float 		 (* correlate)  ( const float * a, const float * b, int n, float * energy ) ;
+	// out = a + (b - a) * fade
+	void 		 (* cross_fade) ( float * out, const float * a, const float * b, const float * fade, int n ) ;
+} time_stretch_kernels ;
+
+float time_stretch_correlate_c  ( const float * a, const float * b, int n, float * energy ) ;
+void  time_stretch_cross_fade_c ( float * out, const float * a, const float * b, const float * fade, int n ) ;
+
+/**
+ *	Use other kernels than those picked for this CPU, e.g. to compare them.
+ *	They must run on it, and no stretcher may be running meanwhile.
+ */
+void set_time_stretch_kernels ( const time_stretch_kernels * kernels ) ;
+
+extern const time_stretch_kernels time_stretch_kernels_c;
+#if defined(__arm__) || defined(__aarch64__)
+extern const time_stretch_kernels time_stretch_kernels_neon;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+extern const time_stretch_kernels time_stretch_kernels_sse2;
+extern const time_stretch_kernels time_stretch_kernels_avx2;
+#endif
+#endif
@@ -1,3 +0,0 @@
-#include <stdint.h>
-
-void flt_to_s16 (uint8_t *flt, uint8_t **s16, int size) ;
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef RPI_MP_VIDEO_SINK_H
+#define RPI_MP_VIDEO_SINK_H
+#include <stdint.h>
+#include <sys/types.h>
+#include <libavutil/avutil.h>
+
+/**
+ *	Where software decoded video frames go, e.g. the OMX renderer, a shared memory ring
+ *	other processes read, or nowhere when only decoding is measured.
+ *	Frames are handed over as planar YUV 4:2:0 with 8 bits per sample.
+ */
+struct video_sink;
+
+typedef struct
+{
+	const char * name;
+	/** Set up for frames of the width and height of the sink, target is sink specific (e.g. a shared memory name) */
+	int 		 (* open)  ( struct video_sink * sink, const char * target ) ;
+	/** Take a frame due at time (microseconds of media, AV_NOPTS_VALUE if unknown) */
+	int 		 (* write) ( struct video_sink * sink, const AVFrame * frame, int64_t time ) ;
+	void 		 (* close) ( struct video_sink * sink ) ;
+} video_sink_ops ;
+
+typedef struct video_sink
+{
+	const video_sink_ops  * ops;
+	void 				  * context;
+	uint 					width;
+	uint 					height;
+	// frames taken, and dropped for being late or not fitting
+	uint64_t 				frames;
+	uint64_t 				dropped;
+} video_sink ;
+
+/**
+ *	Frames are not written anywhere, for measuring the decoder.
+ */
+extern const video_sink_ops null_video_sink;
+
+/**
+ *	Frames are written to a POSIX shared memory object laid out as below, newest frame
+ *	winning: the writer never waits for readers, so a slow reader skips frames.
+ */
+extern const video_sink_ops shm_video_sink;
+
+
+#define VIDEO_SHM_MAGIC 0x564D5052  // "RPMV"
+#define VIDEO_SHM_SLOTS 4
+
+/**
+ *	Start of the shared memory object, the slots follow at data_offset, each frame_size
+ *	bytes of Y, U and V planes with strides of stride and stride / 2.
+ *	A slot's sequence is odd while the frame in it is written: a reader takes the slot of
+ *	latest, copies the frame and keeps it if the sequence was even and did not change.
+ */
+typedef struct
+{
+	uint32_t 	magic;
+	uint32_t 	width;
+	uint32_t 	height;
+	uint32_t 	stride;
+	uint32_t 	frame_size;
+	uint32_t 	data_offset;
+	uint32_t 	slots;
+	// frames written since the start, the newest is in slot (latest - 1) % slots
+	uint32_t 	latest;
+	struct
+	{
+		uint32_t 	sequence;
+		uint32_t 	reserved;
+		int64_t 	time;
+	} slot[VIDEO_SHM_SLOTS];
+} video_shm_header ;
+
+
+/**
+ *	@param video_sink * sink
+ *		struct to initialize
+ *	@param video_sink_ops * ops
+ *	@param uint width, height
+ *		of the frames
+ *	@param char * target
+ *		passed on to the sink
+ *	@return int ret
+ *		0 on success, non-zero if the sink could not be set up
+ */
+int open_video_sink ( video_sink * sink, const video_sink_ops * ops, uint width, uint height, const char * target ) ;
+
+/**
+ *	@return int ret
+ *		0 when the frame was taken or dropped, non-zero if the sink failed
+ */
+int write_video_sink ( video_sink * sink, const AVFrame * frame, int64_t time ) ;
+
+void close_video_sink ( video_sink * sink ) ;
+
+/**
+ *	Copy a frame as planar YUV 4:2:0, 8-bit, converting 10-bit frames.
+ *	@param uint stride
+ *		of the luma plane, the chroma planes take half
+ *	@param uint slice_height
+ *		rows from the start of one plane to the next
+ *	@return int ret
+ *		0 on success, non-zero if the pixel format is not supported
+ */
+int copy_video_frame ( uint8_t * out, uint stride, uint slice_height, const AVFrame * frame ) ;
+#endif
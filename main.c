@@ -1,5 +1,7 @@
 #include "rpi_mp.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <pthread.h>
 #include "GLES/gl.h"
 #include "EGL/egl.h"
@@ -112,6 +114,10 @@ static void* listen_stdin (void* thread_id)
 	char command;
     char* title;
     uint64_t t;
+    int speed = 1;
+    double tempo = 1;
+    double volume = 1;
+    int mute = 0;
 	// read input from stdin
 	printf (">> ");
 	while (!done)
@@ -140,6 +146,45 @@ static void* listen_stdin (void* thread_id)
                 rpi_mp_seek (rpi_mp_current_time() - 60);
                 break;
 
+            case 'f':
+                speed = speed < 2 ? 2 : (speed < 32 ? speed * 2 : speed);
+                if (rpi_mp_set_speed (speed) != 0)
+                    speed = 1;
+                break;
+
+            case 'r':
+                speed = speed > -2 ? -2 : (speed > -32 ? speed * 2 : speed);
+                if (rpi_mp_set_speed (speed) != 0)
+                    speed = 1;
+                break;
+
+            case 'o':
+                speed = 1;
+                rpi_mp_set_speed (speed);
+                break;
+
+            case '[':
+            case ']':
+                // a quarter slower or faster, from half to double speed
+                if (rpi_mp_set_tempo (tempo + (command == ']' ? 0.25 : -0.25)) == 0)
+                    tempo += command == ']' ? 0.25 : -0.25;
+                printf ("tempo: %.2fx\n", tempo);
+                break;
+
+            case '+':
+            case '-':
+                // a tenth up or down, ramped over 50 ms
+                if (rpi_mp_set_volume (volume + (command == '+' ? 0.1 : -0.1), 50) == 0)
+                    volume += command == '+' ? 0.1 : -0.1;
+                printf ("volume: %.1f\n", volume);
+                break;
+
+            case 'm':
+                if (rpi_mp_set_mute (!mute) == 0)
+                    mute = !mute;
+                printf (mute ? "muted\n" : "unmuted\n");
+                break;
+
             case 't':
                 t = rpi_mp_current_time();
                 printf ("current time is : %.2d:%.2d:%.2d\n", (int) t / 3600, (int) (t % 3600) / 60, (int) t % 60);
@@ -359,14 +404,35 @@ static void* play_video ()
 }
 
 
+/**
+ *  Route argument of the form route:<codec>=<hardware|software|passthrough>
+ */
+static int set_route (const char* arg)
+{
+    char codec[32];
+    const char* route = strchr (arg, '=');
+
+    if (!route || route - arg - 6 >= (int) sizeof (codec))
+        return 1;
+    memcpy (codec, arg + 6, route - arg - 6);
+    codec[route - arg - 6] = '\0';
+    route ++;
+    return rpi_mp_set_codec_route (codec, strcmp (route, "hardware")    == 0 ? ROUTE_HARDWARE_DECODE :
+                                          strcmp (route, "software")    == 0 ? ROUTE_SOFTWARE_DECODE :
+                                          strcmp (route, "passthrough") == 0 ? ROUTE_PASSTHROUGH : -1);
+}
+
+
 static int check_arguments (int argc, char** argv)
 {
     flags = 0;
+    unsigned int audio_rate = 0;
+    int resample_quality = RESAMPLE_MEDIUM;
     int i;
 
     if (argc < 2)
     {
-        printf ("Usage: \n%s [texture] [analog-audio] <source>\n", argv[0]);
+        printf ("Usage: \n%s [texture] [analog-audio] [lockfree] [readahead] [mmap] [decodeahead] [passthrough] [index] [scan] [accurate] [route:<codec>=<hardware|software|passthrough>] [sink:<null|shm[=name]>] [layout:<stereo|5.1|7.1>] [rate:<hz>] [resample:<low|medium|high>] <source>\n", argv[0]);
         return 1;
     }
 
@@ -376,7 +442,44 @@ static int check_arguments (int argc, char** argv)
             flags |= RENDER_VIDEO_TO_TEXTURE;
         else if (strcmp (argv[i], "analog-audio") == 0)
             flags |= ANALOG_AUDIO;
+        else if (strcmp (argv[i], "lockfree") == 0)
+            flags |= LOCKFREE_PACKET_BUFFERS;
+        else if (strcmp (argv[i], "readahead") == 0)
+            flags |= READ_AHEAD_INPUT;
+        else if (strcmp (argv[i], "mmap") == 0)
+            flags |= MMAP_INPUT;
+        else if (strcmp (argv[i], "decodeahead") == 0)
+            flags |= DECODE_AHEAD_AUDIO;
+        else if (strcmp (argv[i], "passthrough") == 0)
+            flags |= PASSTHROUGH_AUDIO;
+        else if (strcmp (argv[i], "index") == 0)
+            flags |= KEYFRAME_INDEX;
+        else if (strcmp (argv[i], "scan") == 0)
+            flags |= SCAN_KEYFRAMES;
+        else if (strcmp (argv[i], "accurate") == 0)
+            flags |= ACCURATE_SEEK;
+        else if (strncmp (argv[i], "route:", 6) == 0 && set_route (argv[i]) != 0)
+            fprintf (stderr, "Ignoring %s\n", argv[i]);
+        else if (strcmp (argv[i], "layout:stereo") == 0)
+            rpi_mp_set_audio_layout (AUDIO_LAYOUT_STEREO);
+        else if (strcmp (argv[i], "layout:5.1") == 0)
+            rpi_mp_set_audio_layout (AUDIO_LAYOUT_5POINT1);
+        else if (strcmp (argv[i], "layout:7.1") == 0)
+            rpi_mp_set_audio_layout (AUDIO_LAYOUT_7POINT1);
+        else if (strncmp (argv[i], "rate:", 5) == 0)
+            audio_rate = atoi (argv[i] + 5);
+        else if (strncmp (argv[i], "resample:", 9) == 0)
+            resample_quality = strcmp (argv[i] + 9, "low")  == 0 ? RESAMPLE_LOW  :
+                               strcmp (argv[i] + 9, "high") == 0 ? RESAMPLE_HIGH : RESAMPLE_MEDIUM;
+        else if (strcmp (argv[i], "sink:null") == 0)
+            rpi_mp_set_video_sink (VIDEO_SINK_NULL, NULL);
+        else if (strcmp (argv[i], "sink:shm") == 0)
+            rpi_mp_set_video_sink (VIDEO_SINK_SHARED_MEMORY, NULL);
+        else if (strncmp (argv[i], "sink:shm=", 9) == 0)
+            rpi_mp_set_video_sink (VIDEO_SINK_SHARED_MEMORY, argv[i] + 9);
     }
+    if (rpi_mp_set_audio_rate (audio_rate, resample_quality) != 0)
+        fprintf (stderr, "Ignoring rate:%u\n", audio_rate);
     return 0;
 }
 
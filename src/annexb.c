@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rpi_mp_annexb.h"
+
+#define START_CODE_SIZE 4
+#define H264_NAL_SPS    7
+#define HEVC_NAL_SPS    33
+
+static const uint8_t start_code[START_CODE_SIZE] = { 0, 0, 0, 1 };
+
+
+static inline uint read_length (const uint8_t* data, uint length_size)
+{
+	uint length = 0, i;
+	for (i = 0; i < length_size; i ++)
+		length = length << 8 | data[i];
+	return length;
+}
+
+
+/**
+ *	Append the NAL units of one array of a record, each prefixed with 2 bytes of length,
+ *	to the parameter sets. p is moved past them.
+ *	@return int 0 on success, non-zero if the array runs past the end of the record
+ */
+static int add_parameter_sets (annexb_converter* converter, const uint8_t** p, const uint8_t* end, uint count)
+{
+	uint length;
+	uint8_t* out;
+
+	while (count --)
+	{
+		if (end - *p < 2 || (uint) (end - *p - 2) < (length = read_length (*p, 2)))
+			return 1;
+		if ((out = realloc (converter->parameter_sets, converter->parameter_sets_size + START_CODE_SIZE + length)) == NULL)
+			return 1;
+		converter->parameter_sets = out;
+		out += converter->parameter_sets_size;
+		memcpy (out, start_code, START_CODE_SIZE);
+		memcpy (out + START_CODE_SIZE, *p + 2, length);
+		converter->parameter_sets_size += START_CODE_SIZE + length;
+		*p += 2 + length;
+	}
+	return 0;
+}
+
+
+/**
+ *	avcC: version, profile, compatibility, level, 6 bits reserved and 2 of length size - 1,
+ *	3 bits reserved and 5 of SPS count, the SPSs, PPS count, the PPSs.
+ */
+static int parse_avcc (annexb_converter* converter, const uint8_t* data, uint size)
+{
+	const uint8_t* p = data + 6;
+	const uint8_t* end = data + size;
+
+	if (size < 7 || data[0] != 1)
+		return 1;
+	converter->length_size = (data[4] & 0x03) + 1;
+	if (add_parameter_sets (converter, &p, end, data[5] & 0x1f) != 0 || p >= end)
+		return 1;
+	p ++;
+	return add_parameter_sets (converter, &p, end, p[-1]);
+}
+
+
+/**
+ *	hvcC: 21 bytes of profile and format, 6 bits reserved and 2 of length size - 1, array
+ *	count, then per array a byte of NAL unit type, 2 of count and the NAL units.
+ */
+static int parse_hvcc (annexb_converter* converter, const uint8_t* data, uint size)
+{
+	const uint8_t* p = data + 23;
+	const uint8_t* end = data + size;
+	uint arrays;
+
+	if (size < 23)
+		return 1;
+	converter->length_size = (data[21] & 0x03) + 1;
+	for (arrays = data[22]; arrays > 0; arrays --)
+	{
+		if (end - p < 3)
+			return 1;
+		p += 3;
+		if (add_parameter_sets (converter, &p, end, read_length (p - 2, 2)) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+
+int init_annexb_converter (annexb_converter* converter, enum AVCodecID codec_id, const uint8_t* extradata, uint size)
+{
+	int ret = 0;
+
+	memset (converter, 0, sizeof (annexb_converter));
+	converter->hevc = codec_id == AV_CODEC_ID_HEVC;
+	if (!extradata || size == 0)
+		return 0;
+
+	// Annex-B already when the extradata starts with a start code
+	if ((codec_id == AV_CODEC_ID_H264 || codec_id == AV_CODEC_ID_HEVC) && size > 3 &&
+	    extradata[0] == 0 && extradata[1] == 0 && (extradata[2] == 1 || (extradata[2] == 0 && extradata[3] == 1)))
+		codec_id = AV_CODEC_ID_NONE;
+
+	if (codec_id == AV_CODEC_ID_H264)
+		ret = parse_avcc (converter, extradata, size);
+	else if (codec_id == AV_CODEC_ID_HEVC)
+		ret = parse_hvcc (converter, extradata, size);
+	else if ((converter->parameter_sets = malloc (size)) != NULL)
+	{
+		memcpy (converter->parameter_sets, extradata, size);
+		converter->parameter_sets_size = size;
+	}
+	else
+		ret = 1;
+
+	if (ret != 0)
+		destroy_annexb_converter (converter);
+	return ret;
+}
+
+
+void destroy_annexb_converter (annexb_converter* converter)
+{
+	free (converter->parameter_sets);
+	converter->parameter_sets      = NULL;
+	converter->parameter_sets_size = 0;
+	converter->length_size         = 0;
+}
+
+
+int annexb_size (annexb_converter* converter, const uint8_t* data, uint size, int* parameter_sets)
+{
+	uint l = converter->length_size;
+	uint out = 0, length, type;
+	const uint8_t* end = data + size;
+
+	*parameter_sets = 0;
+	while (data < end)
+	{
+		if ((uint) (end - data) < l || (uint) (end - data) - l < (length = read_length (data, l)))
+			return -1;
+		data += l;
+		if (length > 0)
+		{
+			type = converter->hevc ? (data[0] >> 1) & 0x3f : data[0] & 0x1f;
+			if (type == (converter->hevc ? HEVC_NAL_SPS : H264_NAL_SPS))
+				*parameter_sets = 1;
+		}
+		data += length;
+		out  += START_CODE_SIZE + length;
+	}
+	return out;
+}
+
+
+int annexb_convert (annexb_converter* converter, uint8_t* out, const uint8_t* data, uint size)
+{
+	uint l = converter->length_size;
+	uint length;
+	const uint8_t* end = data + size;
+	uint8_t* start = out;
+
+	while (data < end)
+	{
+		length = read_length (data, l);
+		// in place the prefix is overwritten, so it is read first
+		memcpy (out, start_code, START_CODE_SIZE);
+		if (out != data)
+			memcpy (out + START_CODE_SIZE, data + l, length);
+		out  += START_CODE_SIZE + length;
+		data += l + length;
+		converter->units ++;
+	}
+	return out - start;
+}
@@ -0,0 +1,149 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "bcm_host.h"
+#include "ilclient.h"
+#include "rpi_mp_codec_route.h"
+
+#define HARDWARE    ROUTE_BIT (ROUTE_HARDWARE_DECODE)
+#define SOFTWARE    ROUTE_BIT (ROUTE_SOFTWARE_DECODE)
+#define PASSTHROUGH ROUTE_BIT (ROUTE_PASSTHROUGH)
+
+/**
+ *	Every codec the player knows a route for, AV_CODEC_ID_NONE rows are the defaults
+ *	for codecs not listed.
+ */
+static codec_route routes[] =
+{
+	{ AV_CODEC_ID_H264,       AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingAVC,        NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_MPEG4,      AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingMPEG4,      NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_H263,       AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingH263,       NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_MPEG2VIDEO, AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingMPEG2,      "MPG2", HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_MPEG1VIDEO, AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingMPEG2,      "MPG2", HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_VC1,        AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingWMV,        "WVC1", HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_WMV3,       AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingWMV,        "WVC1", HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_MJPEG,      AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingMJPEG,      NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_VP6,        AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingVP6,        NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_VP8,        AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingVP8,        NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_THEORA,     AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingTheora,     NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+	// beyond the VideoCore, decoded on the CPU
+	{ AV_CODEC_ID_HEVC,       AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingUnused,     NULL,   SOFTWARE,            ROUTE_SOFTWARE_DECODE },
+	{ AV_CODEC_ID_VP9,        AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingUnused,     NULL,   SOFTWARE,            ROUTE_SOFTWARE_DECODE },
+#if LIBAVCODEC_VERSION_MAJOR >= 58
+	{ AV_CODEC_ID_AV1,        AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingUnused,     NULL,   SOFTWARE,            ROUTE_SOFTWARE_DECODE },
+#endif
+	// the decoder finds out for itself
+	{ AV_CODEC_ID_NONE,       AVMEDIA_TYPE_VIDEO, OMX_VIDEO_CodingAutoDetect, NULL,   HARDWARE | SOFTWARE, ROUTE_HARDWARE_DECODE },
+
+	{ AV_CODEC_ID_MP2,        AVMEDIA_TYPE_AUDIO, OMX_AUDIO_CodingMP3,        NULL,   HARDWARE | SOFTWARE,               ROUTE_SOFTWARE_DECODE },
+	{ AV_CODEC_ID_MP3,        AVMEDIA_TYPE_AUDIO, OMX_AUDIO_CodingMP3,        NULL,   HARDWARE | SOFTWARE,               ROUTE_SOFTWARE_DECODE },
+	{ AV_CODEC_ID_AC3,        AVMEDIA_TYPE_AUDIO, OMX_AUDIO_CodingDDP,        "DDP",  HARDWARE | SOFTWARE | PASSTHROUGH, ROUTE_SOFTWARE_DECODE },
+	{ AV_CODEC_ID_EAC3,       AVMEDIA_TYPE_AUDIO, OMX_AUDIO_CodingDDP,        "DDP",  HARDWARE | SOFTWARE | PASSTHROUGH, ROUTE_SOFTWARE_DECODE },
+	{ AV_CODEC_ID_DTS,        AVMEDIA_TYPE_AUDIO, OMX_AUDIO_CodingDTS,        NULL,   HARDWARE | SOFTWARE | PASSTHROUGH, ROUTE_HARDWARE_DECODE },
+	{ AV_CODEC_ID_TRUEHD,     AVMEDIA_TYPE_AUDIO, OMX_AUDIO_CodingUnused,     NULL,   SOFTWARE | PASSTHROUGH,            ROUTE_SOFTWARE_DECODE },
+	{ AV_CODEC_ID_NONE,       AVMEDIA_TYPE_AUDIO, OMX_AUDIO_CodingUnused,     NULL,   SOFTWARE,                          ROUTE_SOFTWARE_DECODE },
+};
+
+#define N_ROUTES (sizeof (routes) / sizeof (routes[0]))
+
+static pthread_once_t probe_once = PTHREAD_ONCE_INIT;
+static const char*    route_names[ROUTES] = { "none", "hardware decode", "software decode", "passthrough" };
+
+
+/**
+ *	Ask the firmware which licensed decoders are enabled.
+ */
+static void probe_routes ()
+{
+	char response[64];
+	uint i;
+
+	for (i = 0; i < N_ROUTES; i ++)
+	{
+		routes[i].licensed = 1;
+		if (!routes[i].licence)
+			continue;
+		// answers e.g. MPG2=enabled
+		if (vc_gencmd (response, sizeof (response), "codec_enabled %s", routes[i].licence) != 0 ||
+		    !strstr (response, "=enabled"))
+		{
+			routes[i].licensed = 0;
+			printf ("Hardware decode of %s is not licensed\n", avcodec_get_name (routes[i].codec_id));
+		}
+	}
+}
+
+
+codec_route* find_codec_route (enum AVCodecID codec_id, enum AVMediaType type)
+{
+	codec_route* fallback = NULL;
+	uint i;
+
+	pthread_once (&probe_once, probe_routes);
+	for (i = 0; i < N_ROUTES; i ++)
+	{
+		if (routes[i].type != type)
+			continue;
+		if (routes[i].codec_id == codec_id)
+			return &routes[i];
+		if (routes[i].codec_id == AV_CODEC_ID_NONE)
+			fallback = &routes[i];
+	}
+	return fallback;
+}
+
+
+int select_codec_route (codec_route* route, int available, int preferred)
+{
+	const int order[] = { route->override, preferred, route->route, ROUTE_HARDWARE_DECODE, ROUTE_SOFTWARE_DECODE };
+	uint i;
+
+	available &= route->routes;
+	if (!route->licensed)
+		available &= ~HARDWARE;
+	for (i = 0; i < sizeof (order) / sizeof (order[0]); i ++)
+		if (order[i] != ROUTE_NONE && (available & ROUTE_BIT (order[i])))
+			return order[i];
+	return ROUTE_NONE;
+}
+
+
+int set_codec_route (const char* codec, int route)
+{
+	uint i;
+
+	if (route < ROUTE_NONE || route >= ROUTES)
+		return 1;
+	for (i = 0; i < N_ROUTES; i ++)
+	{
+		if (routes[i].codec_id == AV_CODEC_ID_NONE || strcmp (avcodec_get_name (routes[i].codec_id), codec) != 0)
+			continue;
+		if (route != ROUTE_NONE && !(routes[i].routes & ROUTE_BIT (route)))
+			return 1;
+		routes[i].override = route;
+		return 0;
+	}
+	return 1;
+}
+
+
+void add_codec_route_cost (codec_route* route, int taken, int64_t cpu_ns, int64_t media_us)
+{
+	__atomic_add_fetch (&route->cpu_ns[taken],   cpu_ns,   __ATOMIC_RELAXED);
+	__atomic_add_fetch (&route->media_us[taken], media_us, __ATOMIC_RELAXED);
+}
+
+
+double codec_route_cost (codec_route* route, int taken)
+{
+	int64_t media_us = __atomic_load_n (&route->media_us[taken], __ATOMIC_RELAXED);
+	if (media_us <= 0)
+		return 0;
+	return (double) __atomic_load_n (&route->cpu_ns[taken], __ATOMIC_RELAXED) / 1000 / media_us;
+}
+
+
+const char* codec_route_name (int route)
+{
+	return route >= ROUTE_NONE && route < ROUTES ? route_names[route] : "unknown";
+}
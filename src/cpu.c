@@ -0,0 +1,48 @@
+#include <string.h>
+#include <time.h>
+#if defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#include "rpi_mp_cpu.h"
+
+static const char* const names[] = { "c", "neon", "sse2", "avx2" };
+
+
+enum cpu_kernels best_cpu_kernels ()
+{
+#if defined(__aarch64__)
+	return CPU_KERNELS_NEON;
+#elif defined(__arm__)
+	if (getauxval (AT_HWCAP) & HWCAP_NEON)
+		return CPU_KERNELS_NEON;
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2"))
+		return CPU_KERNELS_AVX2;
+	if (__builtin_cpu_supports ("sse2"))
+		return CPU_KERNELS_SSE2;
+#endif
+	return CPU_KERNELS_C;
+}
+
+
+int cpu_runs_kernels (const char* name)
+{
+	enum cpu_kernels best = best_cpu_kernels ();
+	int k;
+
+	for (k = 0; k < (int) (sizeof (names) / sizeof (names[0])); k ++)
+		if (strcmp (name, names[k]) == 0)
+			// a CPU with AVX2 has SSE2 as well
+			return k == CPU_KERNELS_C || k == best || (k == CPU_KERNELS_SSE2 && best == CPU_KERNELS_AVX2);
+	return 0;
+}
+
+
+int64_t thread_cpu_time ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,187 @@
+#include "rpi_mp_demux_scheduler.h"
+
+#define OVERFLOW_SLOTS      256
+#define MIN_WAIT_MS          10
+#define UNKNOWN_WAIT_MS     100
+
+
+/**
+ *	A fifo is starving when it is empty or has drained below its low watermark.
+ */
+static inline int starving (packet_buffer* fifo)
+{
+	if (__atomic_load_n (&fifo->n_packets, __ATOMIC_RELAXED) == 0)
+		return 1;
+	return fifo->high_ms && __atomic_load_n (&fifo->duration, __ATOMIC_RELAXED) < fifo->low_ms * 1000;
+}
+
+
+/**
+ *	How long a lane may block on its fifo before another lane could start starving,
+ *	based on how much media the other fifos hold above their low watermarks.
+ */
+static int wait_time (demux_scheduler* scheduler, int lane)
+{
+	int i, ms, wait = -1;
+	uint queued_ms;
+	for (i = 0; i < scheduler->n_lanes; i ++)
+	{
+		packet_buffer* fifo = scheduler->lanes[i].fifo;
+		if (i == lane)
+			continue;
+		// unsigned, so only what lies above the low watermark is subtracted
+		if (fifo->high_ms)
+		{
+			queued_ms = __atomic_load_n (&fifo->duration, __ATOMIC_RELAXED) / 1000;
+			ms = queued_ms > fifo->low_ms ? (int) (queued_ms - fifo->low_ms) : 0;
+		}
+		else
+			ms = UNKNOWN_WAIT_MS;
+		if (ms < MIN_WAIT_MS)
+			ms = MIN_WAIT_MS;
+		if (wait < 0 || ms < wait)
+			wait = ms;
+	}
+	return wait;
+}
+
+
+/**
+ *	Drop packets put aside if a flush has been requested.
+ */
+static inline void take_flush (demux_scheduler* scheduler)
+{
+	int i;
+	if (!__atomic_exchange_n (&scheduler->_flush, 0, __ATOMIC_ACQUIRE))
+		return;
+	for (i = 0; i < scheduler->n_lanes; i ++)
+		flush_buffer (&scheduler->lanes[i].overflow);
+}
+
+
+/**
+ *	Move packets put aside into their fifos for as long as there is room, oldest first.
+ */
+static void refill (demux_scheduler* scheduler)
+{
+	int i;
+	AVPacket p;
+	for (i = 0; i < scheduler->n_lanes; i ++)
+	{
+		demux_lane* l = &scheduler->lanes[i];
+		// the fifo takes over the packet, so the overflow's copy is simply dropped
+		while (peek_packet (&l->overflow, &p) == 0 && push_packet (l->fifo, p) == 0)
+			pop_packet (&l->overflow, &p);
+	}
+}
+
+
+void init_demux_scheduler (demux_scheduler* scheduler, uint overflow_size)
+{
+	memset (scheduler, 0x0, sizeof (demux_scheduler));
+	scheduler->overflow_size = overflow_size;
+}
+
+
+void destroy_demux_scheduler (demux_scheduler* scheduler)
+{
+	int i;
+	for (i = 0; i < scheduler->n_lanes; i ++)
+		destroy_packet_buffer (&scheduler->lanes[i].overflow);
+	scheduler->n_lanes = 0;
+}
+
+
+int add_demux_lane (demux_scheduler* scheduler, packet_buffer* fifo)
+{
+	demux_lane* l;
+	if (scheduler->n_lanes == DEMUX_MAX_LANES)
+		return -1;
+
+	l = &scheduler->lanes[scheduler->n_lanes];
+	if (init_packet_buffer (&l->overflow, scheduler->overflow_size, OVERFLOW_SLOTS, PACKET_BUFFER_MUTEX) != 0)
+		return -1;
+	l->fifo = fifo;
+	return scheduler->n_lanes ++;
+}
+
+
+/**
+ *	Block until the oldest packet of a lane fits into its fifo, or the timeout expires.
+ *	Packets put aside go first, p may be NULL if there is no new packet.
+ */
+static int wait_for_room (demux_lane* l, AVPacket* p, int timeout)
+{
+	AVPacket q;
+	int ret;
+	if (peek_packet (&l->overflow, &q) != 0)
+		return p ? push_packet_wait (l->fifo, *p, timeout) : 0;
+
+	// the fifo takes over the packet, so the overflow's copy is simply dropped
+	if ((ret = push_packet_wait (l->fifo, q, timeout)) == 0)
+		pop_packet (&l->overflow, &q);
+	// a new packet still needs a place
+	return ret == 0 && p ? FULL_BUFFER : ret;
+}
+
+
+int schedule_packet (demux_scheduler* scheduler, int lane, AVPacket p)
+{
+	int i, ret;
+	demux_lane* l = &scheduler->lanes[lane];
+
+	while (1)
+	{
+		take_flush (scheduler);
+		refill (scheduler);
+		// keep the order, nothing may overtake packets already put aside
+		if (!l->overflow.n_packets && push_packet (l->fifo, p) == 0)
+			return 0;
+
+		// put the packet aside if another decoder is about to run dry
+		for (i = 0; i < scheduler->n_lanes; i ++)
+			if (i != lane && starving (scheduler->lanes[i].fifo))
+				break;
+		if (i < scheduler->n_lanes && push_packet (&l->overflow, p) == 0)
+		{
+			scheduler->overflowed ++;
+			return 0;
+		}
+
+		// wait for room, but not longer than it takes for another fifo to start starving
+		scheduler->stalls ++;
+		if ((ret = wait_for_room (l, &p, wait_time (scheduler, lane))) == 0)
+			return 0;
+		if (ret == CANCELLED_BUFFER)
+		{
+			av_packet_unref (&p);
+			return ret;
+		}
+	}
+}
+
+
+int drain_demux_scheduler (demux_scheduler* scheduler)
+{
+	int i, ret;
+	while (1)
+	{
+		take_flush (scheduler);
+		refill (scheduler);
+		for (i = 0; i < scheduler->n_lanes; i ++)
+			if (scheduler->lanes[i].overflow.n_packets)
+				break;
+		if (i == scheduler->n_lanes)
+			return 0;
+
+		// one lane may only drain once the other has been fed, so don't block on it for long
+		if ((ret = wait_for_room (&scheduler->lanes[i], NULL, wait_time (scheduler, i))) == CANCELLED_BUFFER)
+			return ret;
+	}
+}
+
+
+void flush_demux_scheduler (demux_scheduler* scheduler)
+{
+	__atomic_store_n (&scheduler->_flush, 1, __ATOMIC_RELEASE);
+}
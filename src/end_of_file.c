@@ -0,0 +1,52 @@
+#include "rpi_mp_end_of_file.h"
+
+
+void init_end_of_file_sync (end_of_file_sync* sync, pthread_mutex_t* mutex, pthread_cond_t* condition,
+                            const int32_t* flags, int32_t stop, int32_t done, int32_t rewind, int decoders)
+{
+	sync->mutex       = mutex;
+	sync->condition   = condition;
+	sync->flags       = flags;
+	sync->stop        = stop;
+	sync->done        = done;
+	sync->rewind      = rewind;
+	sync->decoders    = decoders;
+	sync->end_of_file = 0;
+	sync->idle        = 0;
+}
+
+
+void reach_end_of_file (end_of_file_sync* sync)
+{
+	__atomic_store_n (&sync->end_of_file, 1, __ATOMIC_RELEASE);
+}
+
+
+int demuxer_at_end_of_file (end_of_file_sync* sync)
+{
+	int rewound;
+
+	while (!(*sync->flags & (sync->rewind | sync->stop)) && sync->idle < sync->decoders)
+		pthread_cond_wait (sync->condition, sync->mutex);
+	// a request accepted before the decoders were done is still carried out
+	if ((rewound = (*sync->flags & sync->rewind) && !(*sync->flags & sync->stop)))
+		__atomic_store_n (&sync->end_of_file, 0, __ATOMIC_RELEASE);
+	return rewound;
+}
+
+
+int decoder_at_end_of_file (end_of_file_sync* sync, int drained)
+{
+	int rewound = 0;
+
+	sync->idle ++;
+	pthread_cond_broadcast (sync->condition);
+	if (drained)
+	{
+		while (sync->end_of_file && !(*sync->flags & (sync->stop | sync->done)))
+			pthread_cond_wait (sync->condition, sync->mutex);
+		if ((rewound = !sync->end_of_file && !(*sync->flags & (sync->stop | sync->done))))
+			sync->idle --;
+	}
+	return rewound;
+}
@@ -0,0 +1,49 @@
+#include <string.h>
+#include "rpi_mp_pcm.h"
+#include "rpi_mp_gain.h"
+
+
+void init_gain_ramp (gain_ramp* ramp, int channels, int sample_rate, float gain)
+{
+	ramp->channels    = channels;
+	ramp->sample_rate = sample_rate;
+	ramp->gain        = gain;
+	ramp->target      = gain;
+	ramp->remaining   = 0;
+}
+
+
+void ramp_gain (gain_ramp* ramp, float target, unsigned int ms)
+{
+	ramp->target    = target;
+	ramp->remaining = (int) ((int64_t) ramp->sample_rate * ms / 1000);
+	if (ramp->remaining == 0)
+		ramp->gain = target;
+}
+
+
+void apply_gain (gain_ramp* ramp, int16_t* data, int samples)
+{
+	int n;
+	float step;
+
+	// the part of the ramp that falls in these samples
+	if (ramp->remaining > 0 && samples > 0)
+	{
+		n    = samples < ramp->remaining ? samples : ramp->remaining;
+		step = (ramp->target - ramp->gain) / ramp->remaining;
+		pcm_gain (data, n * ramp->channels, ramp->channels, ramp->gain, step);
+		ramp->remaining -= n;
+		ramp->gain       = ramp->remaining > 0 ? ramp->gain + n * step : ramp->target;
+		data            += n * ramp->channels;
+		samples         -= n;
+	}
+
+	// and the rest at the gain it got to, untouched at 1
+	if (samples <= 0 || ramp->gain == 1)
+		return;
+	if (ramp->gain == 0)
+		memset (data, 0, (size_t) samples * ramp->channels * sizeof (int16_t));
+	else
+		pcm_gain (data, samples * ramp->channels, ramp->channels, ramp->gain, 0);
+}
@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rpi_mp_iec61937.h"
+
+#define BURST_HEADER           8
+#define SYNC_WORD_1            0xF872
+#define SYNC_WORD_2            0x4E1F
+
+// burst data types
+#define IEC61937_AC3           1
+#define IEC61937_DTS1          11
+#define IEC61937_DTS2          12
+#define IEC61937_DTS3          13
+#define IEC61937_EAC3          21
+#define IEC61937_TRUEHD        22
+
+// repetition periods in bytes, four per sample of the stream
+#define AC3_PERIOD             (1536 * 4)
+#define EAC3_PERIOD            (6144 * 4)
+#define DTS_MAX_PERIOD         (2048 * 4)
+#define TRUEHD_PERIOD          (15360 * 4)
+
+// TrueHD frames are spread over a MAT frame at fixed offsets, with codes marking its start, middle and end
+#define MAT_FRAME_SIZE         61424
+#define MAT_FRAMES             24
+#define TRUEHD_FRAME_OFFSET    2560
+#define MAT_MIDDLE_CODE_OFFSET -4
+
+static const uint8_t mat_start_code[20]  = { 0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00,
+                                             0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0 };
+static const uint8_t mat_middle_code[12] = { 0xC3, 0xC1, 0x42, 0x49, 0x3B, 0xFA, 0x82, 0x83, 0x49, 0x80, 0x77, 0xE0 };
+static const uint8_t mat_end_code[16]    = { 0xC3, 0xC2, 0xC0, 0xC4, 0x00, 0x00, 0x00, 0x00,
+                                             0x00, 0x00, 0x97, 0x11, 0x00, 0x00, 0x00, 0x00 };
+
+// E-AC3 frames per burst by number of audio blocks
+static const uint8_t eac3_repeat[4] = { 6, 3, 2, 1 };
+
+
+static inline void put_le16 (uint8_t* p, uint value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+
+/**
+ *	Turn the length bytes at the start of the payload into a burst of period bytes:
+ *	preamble in front, big endian words swapped and zeros after.
+ */
+static void finish_burst (iec61937_packer* packer, uint data_type, uint length_code, uint length, uint period)
+{
+	uint8_t* payload = packer->burst + BURST_HEADER;
+	uint8_t  byte;
+	uint i;
+
+	put_le16 (packer->burst,     SYNC_WORD_1);
+	put_le16 (packer->burst + 2, SYNC_WORD_2);
+	put_le16 (packer->burst + 4, data_type);
+	put_le16 (packer->burst + 6, length_code);
+
+	for (i = 0; i + 1 < length; i += 2)
+	{
+		byte           = payload[i];
+		payload[i]     = payload[i + 1];
+		payload[i + 1] = byte;
+	}
+	// an odd last byte goes in the high half of its word
+	if (length & 1)
+	{
+		payload[length]     = payload[length - 1];
+		payload[length - 1] = 0;
+		length ++;
+	}
+	memset (payload + length, 0, period - BURST_HEADER - length);
+	packer->burst_size = period;
+	packer->frames     = 0;
+	packer->gathered   = 0;
+}
+
+
+static int pack_ac3 (iec61937_packer* packer, const uint8_t* frame, uint size)
+{
+	if (size < 6 || size > AC3_PERIOD - BURST_HEADER)
+		return -1;
+	memcpy (packer->burst + BURST_HEADER, frame, size);
+	// bitstream mode goes along with the data type
+	finish_burst (packer, IEC61937_AC3 | (frame[5] & 0x7) << 8, ((size + 1) & ~1) << 3, size, AC3_PERIOD);
+	return 1;
+}
+
+
+static int pack_eac3 (iec61937_packer* packer, const uint8_t* frame, uint size)
+{
+	uint repeat = 1;
+
+	if (size < 6)
+		return -1;
+	// frames with fewer than 6 blocks are gathered up to 1536 samples
+	if (frame[5] >> 3 > 10 && (frame[4] & 0xC0) != 0xC0)
+		repeat = eac3_repeat[(frame[4] & 0x30) >> 4];
+	if (packer->gathered + size > EAC3_PERIOD - BURST_HEADER)
+	{
+		reset_iec61937_packer (packer);
+		return -1;
+	}
+	memcpy (packer->burst + BURST_HEADER + packer->gathered, frame, size);
+	packer->gathered += size;
+	if (++ packer->frames < repeat)
+		return 0;
+	finish_burst (packer, IEC61937_EAC3, packer->gathered, packer->gathered, EAC3_PERIOD);
+	return 1;
+}
+
+
+static int pack_dts (iec61937_packer* packer, const uint8_t* frame, uint size)
+{
+	uint blocks, core_size, data_type, period, length_code;
+
+	// 16-bit big endian core sync word, other forms are not passed through
+	if (size < 11 || frame[0] != 0x7F || frame[1] != 0xFE || frame[2] != 0x80 || frame[3] != 0x01)
+		return -1;
+	blocks    = ((frame[4] << 8 | frame[5]) >> 2 & 0x7F) + 1;
+	core_size = ((frame[5] << 16 | frame[6] << 8 | frame[7]) >> 4 & 0x3FFF) + 1;
+	switch (blocks)
+	{
+		case 512 >> 5:  data_type = IEC61937_DTS1; break;
+		case 1024 >> 5: data_type = IEC61937_DTS2; break;
+		case 2048 >> 5: data_type = IEC61937_DTS3; break;
+		default:        return -1;
+	}
+	// extensions (DTS-HD) after the core are dropped, the length is then the core's, unaligned
+	length_code = ((size + 1) & ~1) << 3;
+	if (core_size < size)
+	{
+		size        = core_size;
+		length_code = size << 3;
+	}
+	period = blocks << 7;
+
+	// a frame filling its period goes without preamble
+	if (size == period)
+	{
+		memcpy (packer->burst + BURST_HEADER, frame, size);
+		finish_burst (packer, data_type, length_code, size, period + BURST_HEADER);
+		packer->burst_size = period;
+		memmove (packer->burst, packer->burst + BURST_HEADER, period);
+		return 1;
+	}
+	if (size > period - BURST_HEADER)
+		return -1;
+	memcpy (packer->burst + BURST_HEADER, frame, size);
+	finish_burst (packer, data_type, length_code, size, period);
+	return 1;
+}
+
+
+static int pack_truehd (iec61937_packer* packer, const uint8_t* frame, uint size)
+{
+	uint8_t* mat = packer->burst + BURST_HEADER;
+	int code_length = 0;
+	uint offset;
+
+	if (packer->frames == 0)
+	{
+		code_length = sizeof (mat_start_code) + BURST_HEADER;
+		memcpy (mat, mat_start_code, sizeof (mat_start_code));
+	}
+	else if (packer->frames == MAT_FRAMES / 2)
+	{
+		code_length = sizeof (mat_middle_code) + MAT_MIDDLE_CODE_OFFSET;
+		memcpy (mat + MAT_FRAMES / 2 * TRUEHD_FRAME_OFFSET - BURST_HEADER + MAT_MIDDLE_CODE_OFFSET,
+		        mat_middle_code, sizeof (mat_middle_code));
+	}
+	if (size > TRUEHD_FRAME_OFFSET - code_length)
+	{
+		reset_iec61937_packer (packer);
+		return -1;
+	}
+	// every frame starts at a multiple of the offset, counted from the preamble
+	offset = packer->frames * TRUEHD_FRAME_OFFSET - BURST_HEADER + code_length;
+	memcpy (mat + offset, frame, size);
+	memset (mat + offset + size, 0, TRUEHD_FRAME_OFFSET - code_length - size);
+
+	if (++ packer->frames < MAT_FRAMES)
+		return 0;
+	memcpy (mat + MAT_FRAME_SIZE - sizeof (mat_end_code), mat_end_code, sizeof (mat_end_code));
+	finish_burst (packer, IEC61937_TRUEHD, MAT_FRAME_SIZE, MAT_FRAME_SIZE, TRUEHD_PERIOD);
+	return 1;
+}
+
+
+int init_iec61937_packer (iec61937_packer* packer, enum AVCodecID codec_id, int sample_rate)
+{
+	uint size;
+
+	memset (packer, 0, sizeof (iec61937_packer));
+	packer->codec_id    = codec_id;
+	packer->sample_rate = sample_rate;
+	packer->channels    = 2;
+	switch (codec_id)
+	{
+		case AV_CODEC_ID_AC3:
+			size = AC3_PERIOD;
+		break;
+
+		// carried at four times the rate of the stream
+		case AV_CODEC_ID_EAC3:
+			size                 = EAC3_PERIOD;
+			packer->sample_rate *= 4;
+		break;
+
+		case AV_CODEC_ID_DTS:
+			size = DTS_MAX_PERIOD + BURST_HEADER;
+		break;
+
+		// high bit rate, eight channels at 192 (or 176.4) kHz whatever the stream rate
+		case AV_CODEC_ID_TRUEHD:
+			size                = TRUEHD_PERIOD;
+			packer->sample_rate = sample_rate % 44100 == 0 ? 176400 : 192000;
+			packer->channels    = 8;
+		break;
+
+		default:
+			return 1;
+	}
+	if ((packer->burst = malloc (size)) == NULL)
+		return 1;
+	return 0;
+}
+
+
+void destroy_iec61937_packer (iec61937_packer* packer)
+{
+	free (packer->burst);
+	packer->burst = NULL;
+}
+
+
+int iec61937_pack (iec61937_packer* packer, const uint8_t* frame, uint size)
+{
+	switch (packer->codec_id)
+	{
+		case AV_CODEC_ID_AC3:    return pack_ac3    (packer, frame, size);
+		case AV_CODEC_ID_EAC3:   return pack_eac3   (packer, frame, size);
+		case AV_CODEC_ID_DTS:    return pack_dts    (packer, frame, size);
+		case AV_CODEC_ID_TRUEHD: return pack_truehd (packer, frame, size);
+		default:                 return -1;
+	}
+}
+
+
+void reset_iec61937_packer (iec61937_packer* packer)
+{
+	packer->frames   = 0;
+	packer->gathered = 0;
+}
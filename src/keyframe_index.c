@@ -0,0 +1,286 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libavutil/avstring.h>
+#include "rpi_mp_keyframe_index.h"
+
+#define KEYFRAMES_INITIAL 1024
+
+
+/**
+ *	First keyframe later than time.
+ */
+static uint upper_bound (keyframe_index* index, int64_t time)
+{
+	uint low = 0, high = index->count, middle;
+	while (low < high)
+	{
+		middle = low + (high - low) / 2;
+		if (index->keyframes[middle].time <= time)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+
+int init_keyframe_index (keyframe_index* index, const char* source, int stream_id)
+{
+	struct stat st;
+
+	memset (index, 0, sizeof (keyframe_index));
+	pthread_mutex_init (&index->mutex, NULL);
+	index->covered   = AV_NOPTS_VALUE;
+	index->stream_id = stream_id;
+	if ((index->source = strdup (source)) == NULL)
+		return 1;
+	// only local files get a sidecar
+	if (stat (source, &st) == 0 && S_ISREG (st.st_mode))
+	{
+		index->file_size  = st.st_size;
+		index->file_mtime = st.st_mtime;
+		if ((index->sidecar = malloc (strlen (source) + sizeof (KEYFRAME_INDEX_SUFFIX))) == NULL)
+			return 1;
+		sprintf (index->sidecar, "%s%s", source, KEYFRAME_INDEX_SUFFIX);
+	}
+	return 0;
+}
+
+
+void destroy_keyframe_index (keyframe_index* index)
+{
+	stop_keyframe_scanner (index);
+	if (index->map)
+		munmap (index->map, index->map_size);
+	else
+		free (index->keyframes);
+	free (index->source);
+	free (index->sidecar);
+	pthread_mutex_destroy (&index->mutex);
+	index->keyframes = NULL;
+	index->map       = NULL;
+	index->source    = NULL;
+	index->sidecar   = NULL;
+	index->count     = 0;
+}
+
+
+int load_keyframe_index (keyframe_index* index)
+{
+	keyframe_index_header* header;
+	struct stat st;
+	int fd;
+
+	if (!index->sidecar || (fd = open (index->sidecar, O_RDONLY)) < 0)
+		return 1;
+	if (fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (keyframe_index_header) ||
+	    (header = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		close (fd);
+		return 1;
+	}
+	close (fd);
+	// built from this very file, and not cut short
+	if (header->magic != KEYFRAME_INDEX_MAGIC || header->version != KEYFRAME_INDEX_VERSION ||
+	    header->stream_id != index->stream_id || header->file_size != index->file_size || header->file_mtime != index->file_mtime ||
+	    (uint64_t) st.st_size != sizeof (keyframe_index_header) + (uint64_t) header->count * sizeof (keyframe))
+	{
+		fprintf (stderr, "Ignoring stale keyframe index %s\n", index->sidecar);
+		munmap (header, st.st_size);
+		return 1;
+	}
+
+	pthread_mutex_lock (&index->mutex);
+	free (index->keyframes);
+	index->map       = header;
+	index->map_size  = st.st_size;
+	index->keyframes = (keyframe*) (header + 1);
+	index->count     = index->capacity = header->count;
+	index->complete  = 1;
+	pthread_mutex_unlock (&index->mutex);
+	return 0;
+}
+
+
+int save_keyframe_index (keyframe_index* index)
+{
+	keyframe_index_header header;
+	char* temporary;
+	FILE* file;
+	int ret = 0;
+
+	pthread_mutex_lock (&index->mutex);
+	if (!index->sidecar || !index->complete || index->map)
+	{
+		pthread_mutex_unlock (&index->mutex);
+		return 0;
+	}
+	memset (&header, 0, sizeof (header));
+	header.magic      = KEYFRAME_INDEX_MAGIC;
+	header.version    = KEYFRAME_INDEX_VERSION;
+	header.count      = index->count;
+	header.stream_id  = index->stream_id;
+	header.file_size  = index->file_size;
+	header.file_mtime = index->file_mtime;
+
+	// written aside and renamed, so a sidecar is never seen half written
+	if ((temporary = malloc (strlen (index->sidecar) + 5)) == NULL)
+		ret = 1;
+	else
+	{
+		sprintf (temporary, "%s.tmp", index->sidecar);
+		if ((file = fopen (temporary, "wb")) == NULL)
+			ret = 1;
+		else
+		{
+			if (fwrite (&header, sizeof (header), 1, file) != 1 ||
+			    fwrite (index->keyframes, sizeof (keyframe), index->count, file) != index->count)
+				ret = 1;
+			if (fclose (file) != 0)
+				ret = 1;
+			if (ret == 0 && rename (temporary, index->sidecar) != 0)
+				ret = 1;
+			if (ret != 0)
+				unlink (temporary);
+		}
+		free (temporary);
+	}
+	pthread_mutex_unlock (&index->mutex);
+	if (ret != 0)
+		fprintf (stderr, "Could not save keyframe index %s\n", index->sidecar);
+	return ret;
+}
+
+
+int byte_seekable (AVFormatContext* ctx)
+{
+	return !(ctx->iformat->flags & AVFMT_NO_BYTE_SEEK) && av_match_name (ctx->iformat->name, BYTE_SEEKABLE_FORMATS);
+}
+
+
+void add_keyframe (keyframe_index* index, int64_t time, int64_t position, int contiguous)
+{
+	keyframe* keyframes;
+	uint i;
+
+	pthread_mutex_lock (&index->mutex);
+	if (index->complete)
+	{
+		pthread_mutex_unlock (&index->mutex);
+		return;
+	}
+	// keyframes mostly come in order and are appended
+	i = index->count > 0 && index->keyframes[index->count - 1].time >= time ? upper_bound (index, time) : index->count;
+	if (i == 0 || index->keyframes[i - 1].time != time)
+	{
+		if (index->count == index->capacity)
+		{
+			uint capacity = index->capacity ? index->capacity * 2 : KEYFRAMES_INITIAL;
+			if ((keyframes = realloc (index->keyframes, capacity * sizeof (keyframe))) == NULL)
+			{
+				pthread_mutex_unlock (&index->mutex);
+				return;
+			}
+			index->keyframes = keyframes;
+			index->capacity  = capacity;
+		}
+		memmove (index->keyframes + i + 1, index->keyframes + i, (index->count - i) * sizeof (keyframe));
+		index->keyframes[i].time     = time;
+		index->keyframes[i].position = position;
+		index->count ++;
+	}
+	if (contiguous && time > index->covered)
+		index->covered = time;
+	pthread_mutex_unlock (&index->mutex);
+}
+
+
+void finish_keyframe_index (keyframe_index* index)
+{
+	pthread_mutex_lock (&index->mutex);
+	index->complete = 1;
+	pthread_mutex_unlock (&index->mutex);
+}
+
+
+int find_keyframe (keyframe_index* index, int64_t time, keyframe* found)
+{
+	uint i;
+	int ret = 1;
+
+	pthread_mutex_lock (&index->mutex);
+	if ((index->complete || time <= index->covered) && (i = upper_bound (index, time)) > 0)
+	{
+		*found = index->keyframes[i - 1];
+		ret    = 0;
+	}
+	pthread_mutex_unlock (&index->mutex);
+	return ret;
+}
+
+
+/**
+ *	Demux the file from the start, keeping the keyframes of the video stream.
+ */
+static void* scan_keyframes (void* arg)
+{
+	keyframe_index* index = arg;
+	AVFormatContext* ctx = NULL;
+	AVStream* stream;
+	AVPacket packet;
+	int64_t time;
+	int by_byte, ret = 0;
+
+	if (avformat_open_input (&ctx, index->source, NULL, NULL) < 0)
+	{
+		fprintf (stderr, "Keyframe scanner could not open %s\n", index->source);
+		return NULL;
+	}
+	by_byte = byte_seekable (ctx);
+	av_init_packet (&packet);
+	while (!index->stop_scan && (ret = av_read_frame (ctx, &packet)) >= 0)
+	{
+		stream = ctx->streams[packet.stream_index];
+		// streams may turn up while reading, e.g. in MPEG-TS, the others are left unread from then on
+		if (stream->id != index->stream_id)
+			stream->discard = AVDISCARD_ALL;
+		else if ((packet.flags & AV_PKT_FLAG_KEY) &&
+		         (time = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts) != AV_NOPTS_VALUE)
+			add_keyframe (index, av_rescale_q (time, stream->time_base, AV_TIME_BASE_Q), by_byte ? packet.pos : -1, 1);
+		av_packet_unref (&packet);
+	}
+	if (ret == AVERROR_EOF)
+	{
+		finish_keyframe_index (index);
+		printf ("Keyframe scanner indexed %u keyframes\n", index->count);
+	}
+	avformat_close_input (&ctx);
+	return NULL;
+}
+
+
+int start_keyframe_scanner (keyframe_index* index)
+{
+	if (index->scanning)
+		return 0;
+	index->stop_scan = 0;
+	if (pthread_create (&index->scanner, NULL, scan_keyframes, index) != 0)
+		return 1;
+	index->scanning = 1;
+	return 0;
+}
+
+
+void stop_keyframe_scanner (keyframe_index* index)
+{
+	if (!index->scanning)
+		return;
+	index->stop_scan = 1;
+	pthread_join (index->scanner, NULL);
+	index->scanning = 0;
+}
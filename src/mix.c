@@ -0,0 +1,216 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <libavutil/avutil.h>
+#include "rpi_mp.h"
+#include "rpi_mp_mix.h"
+
+static mix_matrix*     matrices;
+static pthread_mutex_t matrices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// speakers of the output channels, in the order audio_render maps them:
+// LF RF CF LFE LR RR LS RS
+static const uint64_t stereo_speakers[PCM_MAX_CHANNELS] =
+{
+	AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT
+};
+static const uint64_t surround_5_1_speakers[PCM_MAX_CHANNELS] =
+{
+	AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, AV_CH_FRONT_CENTER, AV_CH_LOW_FREQUENCY,
+	AV_CH_BACK_LEFT, AV_CH_BACK_RIGHT
+};
+static const uint64_t surround_7_1_speakers[PCM_MAX_CHANNELS] =
+{
+	AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, AV_CH_FRONT_CENTER, AV_CH_LOW_FREQUENCY,
+	AV_CH_BACK_LEFT, AV_CH_BACK_RIGHT, AV_CH_SIDE_LEFT, AV_CH_SIDE_RIGHT
+};
+
+
+/**
+ *	Output channel of a speaker, -1 if the output has none.
+ */
+static int find_speaker (mix_matrix* matrix, uint64_t speaker)
+{
+	int o;
+	for (o = 0; o < matrix->out_channels; o ++)
+		if (matrix->speakers[o] == speaker)
+			return o;
+	return -1;
+}
+
+
+/**
+ *	Add input channel i to the output channel of speaker, if there is one.
+ *  @return int 0 if added, non-zero if the output has no such speaker
+ */
+static int route (mix_matrix* matrix, int i, uint64_t speaker, float gain)
+{
+	int o = find_speaker (matrix, speaker);
+	if (o < 0)
+		return 1;
+	matrix->gains[o][i] += gain;
+	return 0;
+}
+
+
+/**
+ *	Add input channel i to a pair of output speakers, if the output has both.
+ */
+static int route_pair (mix_matrix* matrix, int i, uint64_t left, uint64_t right, float gain)
+{
+	if (find_speaker (matrix, left) < 0 || find_speaker (matrix, right) < 0)
+		return 1;
+	route (matrix, i, left, gain);
+	route (matrix, i, right, gain);
+	return 0;
+}
+
+
+/**
+ *	Fold an input speaker the output lacks into those nearest to it.
+ */
+static void fold (mix_matrix* matrix, int i, uint64_t speaker)
+{
+	switch (speaker)
+	{
+		case AV_CH_FRONT_CENTER:
+			route_pair (matrix, i, AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, M_SQRT1_2);
+			break;
+
+		case AV_CH_FRONT_LEFT_OF_CENTER:
+			route (matrix, i, AV_CH_FRONT_LEFT, 1);
+			break;
+
+		case AV_CH_FRONT_RIGHT_OF_CENTER:
+			route (matrix, i, AV_CH_FRONT_RIGHT, 1);
+			break;
+
+		// sides and backs stand in for each other, and fold into the fronts on stereo
+		case AV_CH_SIDE_LEFT:
+			if (route (matrix, i, AV_CH_BACK_LEFT, 1) != 0)
+				route (matrix, i, AV_CH_FRONT_LEFT, M_SQRT1_2);
+			break;
+
+		case AV_CH_SIDE_RIGHT:
+			if (route (matrix, i, AV_CH_BACK_RIGHT, 1) != 0)
+				route (matrix, i, AV_CH_FRONT_RIGHT, M_SQRT1_2);
+			break;
+
+		case AV_CH_BACK_LEFT:
+			if (route (matrix, i, AV_CH_SIDE_LEFT, 1) != 0)
+				route (matrix, i, AV_CH_FRONT_LEFT, M_SQRT1_2);
+			break;
+
+		case AV_CH_BACK_RIGHT:
+			if (route (matrix, i, AV_CH_SIDE_RIGHT, 1) != 0)
+				route (matrix, i, AV_CH_FRONT_RIGHT, M_SQRT1_2);
+			break;
+
+		case AV_CH_BACK_CENTER:
+			if (route_pair (matrix, i, AV_CH_BACK_LEFT, AV_CH_BACK_RIGHT, M_SQRT1_2) != 0)
+				route_pair (matrix, i, AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, 0.5f);
+			break;
+
+		// the LFE has nowhere to go without a subwoofer
+		case AV_CH_LOW_FREQUENCY:
+			break;
+
+		// heights and the rest are spread over the fronts
+		default:
+			route_pair (matrix, i, AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, 0.5f);
+			break;
+	}
+}
+
+
+static mix_matrix* build_matrix (uint64_t in_layout, int in_channels, int out_layout)
+{
+	const uint64_t* speakers;
+	mix_matrix* matrix;
+	uint64_t speaker;
+	float sum, loudest = 0;
+	int i, o, count;
+
+	if ((matrix = calloc (1, sizeof (mix_matrix))) == NULL)
+		return NULL;
+	matrix->in_layout   = in_layout;
+	matrix->in_channels = in_channels;
+	matrix->out_layout  = out_layout;
+	if (out_layout == AUDIO_LAYOUT_AUTO)
+		out_layout = in_channels <= 3 ? AUDIO_LAYOUT_STEREO : in_channels <= 6 ? AUDIO_LAYOUT_5POINT1 : AUDIO_LAYOUT_7POINT1;
+	switch (out_layout)
+	{
+		case AUDIO_LAYOUT_5POINT1: speakers = surround_5_1_speakers; count = 6; break;
+		case AUDIO_LAYOUT_7POINT1: speakers = surround_7_1_speakers; count = 8; break;
+		default:                   speakers = stereo_speakers;       count = 2; break;
+	}
+	matrix->out_channels = count > 4 ? 8 : count;
+	for (o = 0; o < count; o ++)
+		matrix->speakers[o] = speakers[o];
+
+	// input channels come in the order of the bits of their layout, without one they go
+	// to the output channels in turn
+	if (in_layout == 0)
+		for (i = 0; i < in_channels; i ++)
+			matrix->gains[i % count][i] = 1;
+	for (i = 0, speaker = 1; in_layout != 0 && i < in_channels && speaker != 0; speaker <<= 1)
+	{
+		if (~in_layout & speaker)
+			continue;
+		// mono is played on both fronts as it is
+		if (in_channels == 1)
+			route_pair (matrix, i, AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, 1);
+		else if (route (matrix, i, speaker, 1) != 0)
+			fold (matrix, i, speaker);
+		i ++;
+	}
+
+	for (o = 0; o < matrix->out_channels; o ++)
+	{
+		for (i = 0, sum = 0; i < in_channels; i ++)
+			sum += fabsf (matrix->gains[o][i]);
+		if (sum > loudest)
+			loudest = sum;
+	}
+	if (loudest > 1)
+		for (o = 0; o < matrix->out_channels; o ++)
+			for (i = 0; i < in_channels; i ++)
+				matrix->gains[o][i] /= loudest;
+
+	for (o = 0; o < matrix->out_channels; o ++)
+	{
+		matrix->sources[o] = -1;
+		for (i = 0, count = 0; i < in_channels; i ++)
+			if (matrix->gains[o][i] != 0)
+			{
+				matrix->sources[o] = matrix->gains[o][i] == 1 ? i : -1;
+				count ++;
+			}
+		if (count > 1)
+			matrix->sources[o] = -1;
+	}
+	return matrix;
+}
+
+
+const mix_matrix* get_mix_matrix (uint64_t in_layout, int in_channels, int out_layout)
+{
+	mix_matrix* matrix;
+
+	if (in_channels <= 0 || in_channels > PCM_MAX_CHANNELS)
+		return NULL;
+	if (in_layout == 0 || av_get_channel_layout_nb_channels (in_layout) != in_channels)
+		in_layout = av_get_default_channel_layout (in_channels);
+
+	pthread_mutex_lock (&matrices_mutex);
+	for (matrix = matrices; matrix; matrix = matrix->next)
+		if (matrix->in_layout == in_layout && matrix->in_channels == in_channels && matrix->out_layout == out_layout)
+			break;
+	if (!matrix && (matrix = build_matrix (in_layout, in_channels, out_layout)) != NULL)
+	{
+		matrix->next = matrices;
+		matrices     = matrix;
+	}
+	pthread_mutex_unlock (&matrices_mutex);
+	return matrix;
+}
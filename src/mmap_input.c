@@ -0,0 +1,171 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rpi_mp_mmap_input.h"
+
+#define MMAP_CHUNK_SIZE  (1024 * 1024 * 64)
+// libavformat only copies small reads through this buffer
+#define AVIO_BUFFER_SIZE (1024 * 32)
+
+
+static inline int64_t page_align (int64_t offset)
+{
+	static long page_size = 0;
+	if (!page_size)
+		page_size = sysconf (_SC_PAGESIZE);
+	return offset & ~((int64_t) page_size - 1);
+}
+
+
+/**
+ *	Map the chunk of the file containing position.
+ */
+static int map_chunk (mmap_input* input, int64_t position)
+{
+	int64_t offset = page_align (position);
+	size_t  size   = input->file_size - offset < MMAP_CHUNK_SIZE ? input->file_size - offset : MMAP_CHUNK_SIZE;
+	uint8_t* chunk;
+
+	if ((chunk = mmap (NULL, size, PROT_READ, MAP_SHARED, input->fd, offset)) == MAP_FAILED)
+		return 1;
+	if (input->chunk)
+		munmap (input->chunk, input->chunk_size);
+
+	input->chunk        = chunk;
+	input->chunk_offset = offset;
+	input->chunk_size   = size;
+	input->advised      = position;
+	madvise (chunk, size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+
+/**
+ *	Keep the window ahead of the position advised and drop what is well behind it.
+ */
+static void follow_playhead (mmap_input* input)
+{
+	int64_t chunk_end = input->chunk_offset + input->chunk_size;
+	int64_t start, end;
+
+	if (input->position + input->window / 2 < input->advised || input->advised >= chunk_end)
+		return;
+
+	start = page_align (input->advised);
+	end   = input->position + input->window < chunk_end ? input->position + input->window : chunk_end;
+	madvise (input->chunk + (start - input->chunk_offset), end - start, MADV_WILLNEED);
+	input->advised = end;
+
+	// read-only file pages are simply faulted in again if needed
+	end = page_align (input->position - input->window);
+	if (end > input->chunk_offset)
+		madvise (input->chunk, end - input->chunk_offset, MADV_DONTNEED);
+}
+
+
+/**
+ *	AVIOContext read callback.
+ *	With the context in direct mode libavformat passes its own destination, e.g. the
+ *	packet data, so this is the only copy of the file data in user space.
+ */
+static int read_packet (void* opaque, uint8_t* buf, int size)
+{
+	mmap_input* input = (mmap_input*) opaque;
+	int64_t available;
+
+	if (input->position >= input->file_size)
+		return AVERROR_EOF;
+	if ((input->position <  input->chunk_offset ||
+		 input->position >= input->chunk_offset + (int64_t) input->chunk_size) &&
+		map_chunk (input, input->position) != 0)
+		return AVERROR (EIO);
+
+	available = input->chunk_offset + input->chunk_size - input->position;
+	if (size > available)
+		size = available;
+	memcpy (buf, input->chunk + (input->position - input->chunk_offset), size);
+	input->position += size;
+	follow_playhead (input);
+	return size;
+}
+
+
+/**
+ *	AVIOContext seek callback, only moves the position.
+ */
+static int64_t seek (void* opaque, int64_t offset, int whence)
+{
+	mmap_input* input = (mmap_input*) opaque;
+	int64_t position;
+
+	switch (whence & ~AVSEEK_FORCE)
+	{
+		case AVSEEK_SIZE:
+			return input->file_size;
+		case SEEK_SET:
+			position = offset;
+			break;
+		case SEEK_CUR:
+			position = input->position + offset;
+			break;
+		case SEEK_END:
+			position = input->file_size + offset;
+			break;
+		default:
+			return AVERROR (EINVAL);
+	}
+	if (position < 0)
+		return AVERROR (EINVAL);
+	// start advising from the new position
+	if (position < input->position || position > input->advised)
+		input->advised = position;
+	input->position = position;
+	return position;
+}
+
+
+int open_mmap_input (mmap_input* input, const char* file, uint window)
+{
+	struct stat st;
+	unsigned char* avio_buffer;
+
+	memset (input, 0x0, sizeof (mmap_input));
+	if ((input->fd = open (file, O_RDONLY)) < 0)
+		return 1;
+	input->window = window;
+	if (fstat (input->fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size == 0)
+	{
+		close (input->fd);
+		return 1;
+	}
+	input->file_size = st.st_size;
+	if (map_chunk (input, 0) != 0)
+	{
+		close (input->fd);
+		return 1;
+	}
+	if (!(avio_buffer = (unsigned char*) av_malloc (AVIO_BUFFER_SIZE)) ||
+		!(input->avio = avio_alloc_context (avio_buffer, AVIO_BUFFER_SIZE, 0, input, read_packet, NULL, seek)))
+	{
+		av_free (avio_buffer);
+		munmap (input->chunk, input->chunk_size);
+		close (input->fd);
+		return 1;
+	}
+	// large reads go straight from the mapping to their destination
+	input->avio->direct = 1;
+	follow_playhead (input);
+	return 0;
+}
+
+
+void close_mmap_input (mmap_input* input)
+{
+	if (!input->avio)
+		return;
+	av_freep (&input->avio->buffer);
+	av_freep (&input->avio);
+	munmap (input->chunk, input->chunk_size);
+	close (input->fd);
+}
@@ -0,0 +1,55 @@
+#include <string.h>
+#include "rpi_mp_omx_port.h"
+
+
+int open_omx_port (omx_port* port, const omx_port_ops* ops, void* component, int index)
+{
+	memset (port, 0, sizeof (omx_port));
+	port->ops       = ops;
+	port->component = component;
+	port->index     = index;
+
+	if (ops->enable (port) != 0)
+		return 1;
+	port->enabled = 1;
+	return 0;
+}
+
+
+void close_omx_port (omx_port* port)
+{
+	if (port->ops && port->enabled)
+		port->ops->disable (port);
+	port->enabled = 0;
+}
+
+
+OMX_BUFFERHEADERTYPE* get_omx_buffer (omx_port* port, int block)
+{
+	OMX_BUFFERHEADERTYPE* header;
+
+	if ((header = port->ops->get_buffer (port, block)) == NULL)
+		return NULL;
+	header->nOffset    = 0;
+	header->nFilledLen = 0;
+	header->nFlags     = 0;
+	return header;
+}
+
+
+uint fill_omx_buffer (omx_port* port, OMX_BUFFERHEADERTYPE* header, const uint8_t* data, uint size)
+{
+	if (size > header->nAllocLen)
+		size = header->nAllocLen;
+	memcpy (header->pBuffer, data, size);
+	port->copied      += size;
+	header->nOffset    = 0;
+	header->nFilledLen = size;
+	return size;
+}
+
+
+int empty_omx_buffer (omx_port* port, OMX_BUFFERHEADERTYPE* header)
+{
+	return port->ops->empty_buffer (port, header);
+}
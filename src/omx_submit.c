@@ -0,0 +1,155 @@
+#include <string.h>
+#include <time.h>
+#include "rpi_mp_omx_submit.h"
+
+
+static inline int64_t now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/**
+ *	Hand a buffer to the port and count it.
+ */
+static int empty (omx_submitter* submitter, OMX_BUFFERHEADERTYPE* header)
+{
+	int64_t t = now ();
+	if (submitter->calls == 0)
+		submitter->first_call = t;
+	submitter->last_call = t;
+	submitter->calls    ++;
+	submitter->filled   += header->nFilledLen;
+	submitter->capacity += header->nAllocLen;
+	return empty_omx_buffer (submitter->port, header);
+}
+
+
+/**
+ *	Take the buffer left over by discard_omx_submitter, or get a free one.
+ */
+static OMX_BUFFERHEADERTYPE* next_buffer (omx_submitter* submitter)
+{
+	OMX_BUFFERHEADERTYPE* header = submitter->pending;
+	if (header)
+	{
+		submitter->pending = NULL;
+		return header;
+	}
+	return get_omx_buffer (submitter->port, 1);
+}
+
+
+/**
+ *	Whether a unit may join the buffer being packed. Apart from a continuous port, where
+ *	the buffer marks where it ends, a buffer holding the end of a frame is never appended to:
+ *	the decoder finds frames by their ENDOFFRAME. Otherwise the unit must not need a time of
+ *	its own, having none or that of the buffer, as a keyframe after its parameter sets.
+ */
+static inline int can_append (omx_submitter* submitter, uint size, OMX_TICKS ticks, OMX_U32 flags)
+{
+	OMX_BUFFERHEADERTYPE* header = submitter->pending;
+	return header && header->nFilledLen > 0 && header->nFilledLen + size <= header->nAllocLen &&
+	       !(flags & OMX_BUFFERFLAG_STARTTIME) &&
+	       (submitter->continuous ||
+	        (!(header->nFlags & OMX_BUFFERFLAG_ENDOFFRAME) &&
+	         ((flags & OMX_BUFFERFLAG_TIME_UNKNOWN) ||
+	          (header->nTimeStamp.nLowPart == ticks.nLowPart && header->nTimeStamp.nHighPart == ticks.nHighPart))));
+}
+
+
+void init_omx_submitter (omx_submitter* submitter, omx_port* port, int continuous)
+{
+	memset (submitter, 0, sizeof (omx_submitter));
+	submitter->port       = port;
+	submitter->continuous = continuous;
+}
+
+
+int submit_omx_data (omx_submitter* submitter, const uint8_t* data, uint size, OMX_TICKS ticks, OMX_U32 flags)
+{
+	OMX_BUFFERHEADERTYPE* header;
+	uint n;
+
+	if (can_append (submitter, size, ticks, flags))
+	{
+		header = submitter->pending;
+		memcpy (header->pBuffer + header->nFilledLen, data, size);
+		header->nFilledLen += size;
+		header->nFlags      = (header->nFlags & ~OMX_BUFFERFLAG_ENDOFFRAME) | (flags & OMX_BUFFERFLAG_ENDOFFRAME);
+		return header->nFilledLen == header->nAllocLen ? flush_omx_submitter (submitter) : 0;
+	}
+	if (flush_omx_submitter (submitter) != 0)
+		return 1;
+
+	while (size > 0)
+	{
+		if ((header = next_buffer (submitter)) == NULL)
+			return 1;
+		header->nTimeStamp = ticks;
+
+		// hold small units back for the next ones to join
+		if (size < header->nAllocLen / 2)
+		{
+			memcpy (header->pBuffer, data, size);
+			header->nOffset    = 0;
+			header->nFilledLen = size;
+			header->nFlags     = flags;
+			submitter->pending = header;
+			return 0;
+		}
+		n     = fill_omx_buffer (submitter->port, header, data, size);
+		data += n;
+		size -= n;
+		// the end of the unit is in the last buffer, its start time in the first
+		header->nFlags = size > 0 ? flags & ~OMX_BUFFERFLAG_ENDOFFRAME : flags;
+		flags         &= ~OMX_BUFFERFLAG_STARTTIME;
+		if (empty (submitter, header) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+
+int flush_omx_submitter (omx_submitter* submitter)
+{
+	OMX_BUFFERHEADERTYPE* header = submitter->pending;
+	if (!header || header->nFilledLen == 0)
+		return 0;
+	submitter->pending = NULL;
+	return empty (submitter, header);
+}
+
+
+int end_omx_submitter (omx_submitter* submitter, OMX_U32 flags)
+{
+	OMX_BUFFERHEADERTYPE* header;
+	if (flush_omx_submitter (submitter) != 0 || (header = next_buffer (submitter)) == NULL)
+		return 1;
+	header->nOffset    = 0;
+	header->nFilledLen = 0;
+	header->nFlags     = flags;
+	return empty_omx_buffer (submitter->port, header);
+}
+
+
+void discard_omx_submitter (omx_submitter* submitter)
+{
+	if (submitter->pending)
+		submitter->pending->nFilledLen = 0;
+}
+
+
+double omx_submitter_fill_ratio (omx_submitter* submitter)
+{
+	return submitter->capacity ? (double) submitter->filled / submitter->capacity : 0;
+}
+
+
+double omx_submitter_call_rate (omx_submitter* submitter)
+{
+	int64_t elapsed = submitter->last_call - submitter->first_call;
+	return elapsed > 0 ? (double) submitter->calls * 1000000 / elapsed : 0;
+}
@@ -1,84 +1,275 @@
+#include <time.h>
 #include "rpi_mp_packet_buffer.h"
 
-#define FIFO_ALLOC_SIZE 1000
+#define MAX_DERIVED_DURATION 1000000 // microseconds
 
 
-int init_packet_buffer (packet_buffer* buffer, uint size)
+/**
+ *	Take the buffer mutex, keeping count of how often another thread already held it.
+ */
+static inline void lock_buffer (packet_buffer* buffer)
 {
-	buffer->n_packets 	= 0;
-	buffer->size  		= size;
-	buffer->capacity	= FIFO_ALLOC_SIZE;
-	buffer->packets 	= (AVPacket*) malloc (FIFO_ALLOC_SIZE * sizeof (AVPacket));
+	if (pthread_mutex_trylock (&buffer->mutex) != 0)
+	{
+		pthread_mutex_lock (&buffer->mutex);
+		buffer->contended ++;
+	}
+}
+
+
+/**
+ *	Wake up threads blocked on the other end of the fifo.
+ *	Waiters announce themselves before re-checking the fifo, so the mutex is only
+ *	taken when somebody is actually sleeping.
+ */
+static inline void wake_waiters (packet_buffer* buffer, int* waiting, pthread_cond_t* cond)
+{
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	if (__atomic_load_n (waiting, __ATOMIC_RELAXED))
+	{
+		pthread_mutex_lock (&buffer->mutex);
+		pthread_cond_broadcast (cond);
+		pthread_mutex_unlock (&buffer->mutex);
+	}
+}
+
+
+/**
+ *	Queued duration of a packet in microseconds.
+ */
+static inline uint packet_duration (packet_buffer* buffer, const AVPacket* p)
+{
+	if (!buffer->time_base.den || p->duration <= 0)
+		return 0;
+	return (uint) av_rescale_q (p->duration, buffer->time_base, AV_TIME_BASE_Q);
+}
+
+
+/**
+ *	True while the fifo has gone over its high watermark and not yet drained below
+ *	the low one.
+ */
+static inline int above_watermark (packet_buffer* buffer)
+{
+	return __atomic_load_n (&buffer->_filled, __ATOMIC_RELAXED) &&
+		   __atomic_load_n (&buffer->duration, __ATOMIC_RELAXED) > buffer->low_ms * 1000;
+}
+
+
+/**
+ *	Check the duration watermarks before a push, producer side only.
+ *	Packets without a duration get the distance to the previous packet, unless the
+ *	timestamps jumped (seek or discontinuity).
+ */
+static inline int check_watermarks (packet_buffer* buffer, AVPacket* p)
+{
+	int64_t ts = p->dts != AV_NOPTS_VALUE ? p->dts : p->pts;
+	if (p->duration <= 0 && ts != AV_NOPTS_VALUE && buffer->_last_ts != AV_NOPTS_VALUE && ts > buffer->_last_ts &&
+		buffer->time_base.den && av_rescale_q (ts - buffer->_last_ts, buffer->time_base, AV_TIME_BASE_Q) < MAX_DERIVED_DURATION)
+		p->duration = ts - buffer->_last_ts;
+
+	if (!buffer->high_ms)
+		return 0;
+	if (above_watermark (buffer))
+		return FULL_BUFFER;
+	// drained below the low watermark, start filling again
+	__atomic_store_n (&buffer->_filled, 0, __ATOMIC_RELAXED);
+	return 0;
+}
+
+
+/**
+ *	Account for a pushed packet, producer side only.
+ */
+static inline void add_duration (packet_buffer* buffer, const AVPacket* p)
+{
+	uint queued = __atomic_add_fetch (&buffer->duration, packet_duration (buffer, p), __ATOMIC_RELAXED);
+	if (p->dts != AV_NOPTS_VALUE || p->pts != AV_NOPTS_VALUE)
+		buffer->_last_ts = p->dts != AV_NOPTS_VALUE ? p->dts : p->pts;
+	if (buffer->high_ms && queued >= buffer->high_ms * 1000)
+		__atomic_store_n (&buffer->_filled, 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ *	Absolute deadline on the monotonic clock, timeout milliseconds from now.
+ */
+static void deadline (struct timespec* ts, int timeout)
+{
+	clock_gettime (CLOCK_MONOTONIC, ts);
+	ts->tv_sec  += timeout / 1000;
+	ts->tv_nsec += (timeout % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec  ++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+
+int init_packet_buffer (packet_buffer* buffer, uint size, uint slots, enum packet_buffer_type type)
+{
+	pthread_condattr_t cond_attr;
+
+	buffer->type         = type;
+	buffer->n_packets 	 = 0;
+	buffer->size_packets = 0;
+	buffer->size  		 = size;
+	buffer->capacity     = 0;
+	buffer->packets 	 = NULL;
+	buffer->_first       = NULL;
+	buffer->_last        = NULL;
+	buffer->_head        = 0;
+	buffer->_tail        = 0;
+	buffer->contended    = 0;
+	buffer->cancelled    = 0;
+	buffer->push_cancelled = 0;
+	buffer->closed       = 0;
+	buffer->_push_waiting = 0;
+	buffer->_pop_waiting  = 0;
+	buffer->time_base    = (AVRational) { 0, 1 };
+	buffer->duration     = 0;
+	buffer->low_ms       = 0;
+	buffer->high_ms      = 0;
+	buffer->_filled      = 0;
+	buffer->_last_ts     = AV_NOPTS_VALUE;
 	pthread_mutex_init (&buffer->mutex, NULL);
+	pthread_condattr_init (&cond_attr);
+	pthread_condattr_setclock (&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init (&buffer->not_empty, &cond_attr);
+	pthread_cond_init (&buffer->not_full,  &cond_attr);
+	pthread_condattr_destroy (&cond_attr);
+
+	if (type == PACKET_BUFFER_MUTEX)
+		return init_packet_pool (&buffer->pool, slots);
 
+	// the lock-free ring can not grow, round it up to a power of two for masking
+	for (buffer->capacity = 1; buffer->capacity < slots; buffer->capacity <<= 1);
+	buffer->packets = (AVPacket*) malloc (buffer->capacity * sizeof (AVPacket));
 	// error
 	if (!buffer->packets)
 		return 1;
 
-	memset (buffer->packets, 0x0, FIFO_ALLOC_SIZE * sizeof (AVPacket));
-	buffer->_front = buffer->_back = buffer->packets;
+	memset (buffer->packets, 0x0, buffer->capacity * sizeof (AVPacket));
 	return 0;
 }
 
 
+void set_packet_buffer_high_water (packet_buffer* buffer, uint slabs)
+{
+	pthread_mutex_lock (&buffer->mutex);
+	buffer->pool.high_water = slabs;
+	pthread_mutex_unlock (&buffer->mutex);
+}
+
+
+void set_packet_buffer_watermarks (packet_buffer* buffer, AVRational time_base, uint low_ms, uint high_ms)
+{
+	pthread_mutex_lock (&buffer->mutex);
+	buffer->time_base = time_base;
+	buffer->low_ms    = low_ms < high_ms ? low_ms : high_ms;
+	buffer->high_ms   = high_ms;
+	pthread_mutex_unlock (&buffer->mutex);
+}
+
+
 void destroy_packet_buffer (packet_buffer* buffer)
 {
 	flush_buffer (buffer);
+	if (buffer->type == PACKET_BUFFER_MUTEX)
+		destroy_packet_pool (&buffer->pool);
 	free (buffer->packets);
 	buffer->n_packets = 0;
 	buffer->size 	  = 0;
 	pthread_mutex_destroy (&buffer->mutex);
+	pthread_cond_destroy (&buffer->not_empty);
+	pthread_cond_destroy (&buffer->not_full);
 }
 
 
-int push_packet (packet_buffer* buffer, AVPacket p)
+/**
+ *	Lock-free push, only to be called from the single producer thread.
+ *	The packet slot is written before the head index is published, so the consumer
+ *	never sees a half written packet.
+ */
+static int push_packet_spsc (packet_buffer* buffer, AVPacket p)
+{
+	uint head = buffer->_head;
+	uint tail = __atomic_load_n (&buffer->_tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail == buffer->capacity ||
+		__atomic_load_n (&buffer->size_packets, __ATOMIC_RELAXED) + p.size > buffer->size ||
+		check_watermarks (buffer, &p))
+		return FULL_BUFFER;
+
+	buffer->packets[head & (buffer->capacity - 1)] = p;
+	add_duration (buffer, &p);
+	__atomic_add_fetch (&buffer->size_packets, p.size, __ATOMIC_RELAXED);
+	__atomic_add_fetch (&buffer->n_packets, 1, __ATOMIC_RELAXED);
+	__atomic_store_n (&buffer->_head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+
+/**
+ *	Lock-free pop, only to be called from the single consumer thread.
+ */
+static int pop_packet_spsc (packet_buffer* buffer, AVPacket* p)
+{
+	uint tail = buffer->_tail;
+	uint head = __atomic_load_n (&buffer->_head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return EMPTY_BUFFER;
+
+	*p = buffer->packets[tail & (buffer->capacity - 1)];
+	__atomic_sub_fetch (&buffer->duration, packet_duration (buffer, p), __ATOMIC_RELAXED);
+	__atomic_sub_fetch (&buffer->size_packets, p->size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch (&buffer->n_packets, 1, __ATOMIC_RELAXED);
+	__atomic_store_n (&buffer->_tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+
+/**
+ *	Push for the mutex version, buffer->mutex must be held.
+ */
+static int push_packet_locked (packet_buffer* buffer, AVPacket p)
 {
-	pthread_mutex_lock (&buffer->mutex);
 	int ret = 0;
-	// check if size would be too large
-	if (buffer->size_packets + p.size > buffer->size)
+	// check if size would be too large, or we are holding enough media already
+	if (buffer->size_packets + p.size > buffer->size || check_watermarks (buffer, &p))
 	{
 		ret = FULL_BUFFER;
 		goto end;
 	}
-	// we might need to increment the size of the allocated buffer
-	if (buffer->n_packets == buffer->capacity - 1)
+	// slots are recycled through the pool, which grows by whole slabs when needed
+	// without touching the packets already queued
+	packet_slot* slot = get_packet_slot (&buffer->pool);
+	if (!slot)
 	{
-		// allocate new larger buffer
-		AVPacket* tmp = (AVPacket*) malloc (sizeof (AVPacket) * (buffer->capacity + FIFO_ALLOC_SIZE));
-		memset (tmp, 0x0, sizeof (AVPacket) * (buffer->capacity + FIFO_ALLOC_SIZE));
-		// copy packets
-		if (buffer->_front < buffer->_back)
-			memcpy (tmp, buffer->_front, sizeof (AVPacket) * (buffer->n_packets - 1));
-		else
-		{
-			int n = buffer->capacity - (buffer->_front - buffer->packets);
-			memcpy (tmp,     buffer->_front,  sizeof (AVPacket) * n);
-			memcpy (tmp + n, buffer->packets, sizeof (AVPacket) * (buffer->n_packets - n));
-		}
-		// free old buffer and set pointers
-		free (buffer->packets);
-		buffer->capacity += FIFO_ALLOC_SIZE;
-		buffer->packets = tmp;
-		buffer->_front = buffer->packets;
-		buffer->_back  = buffer->packets + buffer->n_packets;
+		ret = FULL_BUFFER;
+		goto end;
 	}
-	*buffer->_back = p;
+	slot->packet = p;
+	if (buffer->_last)
+		buffer->_last->next = slot;
+	else
+		buffer->_first = slot;
+	buffer->_last = slot;
 	buffer->n_packets ++;
-	buffer->_back ++;
 	buffer->size_packets += p.size;
-	// loop the back pointer back to the beginning of the buffer
-	if (buffer->_back - buffer->packets == buffer->capacity)
-		buffer->_back = buffer->packets;
+	add_duration (buffer, &p);
 end:
-	pthread_mutex_unlock (&buffer->mutex);
 	return ret;
 }
 
 
-int pop_packet (packet_buffer* buffer, AVPacket* p)
+/**
+ *	Pop for the mutex version, buffer->mutex must be held.
+ */
+static int pop_packet_locked (packet_buffer* buffer, AVPacket* p)
 {
-	pthread_mutex_lock (&buffer->mutex);
 	int ret = 0;
 	// empty buffer
 	if (buffer->n_packets == 0)
@@ -86,33 +277,207 @@ int pop_packet (packet_buffer* buffer, AVPacket* p)
 		ret = EMPTY_BUFFER;
 		goto end;
 	}
-	*p = *buffer->_front;
+	packet_slot* slot = buffer->_first;
+	*p = slot->packet;
 
-	buffer->_front ++;
+	buffer->_first = slot->next;
+	if (!buffer->_first)
+		buffer->_last = NULL;
 	buffer->n_packets --;
 	buffer->size_packets -= p->size;
-	// loop front pointer back to beginning of the buffer
-	if (buffer->_front - buffer->packets == buffer->capacity)
-		buffer->_front = buffer->packets;
+	__atomic_sub_fetch (&buffer->duration, packet_duration (buffer, p), __ATOMIC_RELAXED);
+	put_packet_slot (&buffer->pool, slot);
+	// give memory from a burst back once the queue has drained
+	if (buffer->n_packets == 0)
+		shrink_packet_pool (&buffer->pool);
 end:
+	return ret;
+}
+
+
+int push_packet (packet_buffer* buffer, AVPacket p)
+{
+	int ret;
+	if (buffer->type == PACKET_BUFFER_SPSC)
+		ret = push_packet_spsc (buffer, p);
+	else
+	{
+		lock_buffer (buffer);
+		ret = push_packet_locked (buffer, p);
+		pthread_mutex_unlock (&buffer->mutex);
+	}
+	if (ret == 0)
+		wake_waiters (buffer, &buffer->_pop_waiting, &buffer->not_empty);
+	return ret;
+}
+
+
+int pop_packet (packet_buffer* buffer, AVPacket* p)
+{
+	int ret;
+	if (buffer->type == PACKET_BUFFER_SPSC)
+		ret = pop_packet_spsc (buffer, p);
+	else
+	{
+		lock_buffer (buffer);
+		ret = pop_packet_locked (buffer, p);
+		pthread_mutex_unlock (&buffer->mutex);
+	}
+	// a producer held back by the watermarks sleeps on until the low one is reached
+	if (ret == 0 && !above_watermark (buffer))
+		wake_waiters (buffer, &buffer->_push_waiting, &buffer->not_full);
+	return ret;
+}
+
+
+int peek_packet (packet_buffer* buffer, AVPacket* p)
+{
+	int ret = 0;
+	if (buffer->type == PACKET_BUFFER_SPSC)
+	{
+		uint tail = buffer->_tail;
+		if (__atomic_load_n (&buffer->_head, __ATOMIC_ACQUIRE) == tail)
+			return EMPTY_BUFFER;
+		*p = buffer->packets[tail & (buffer->capacity - 1)];
+		return 0;
+	}
+
+	lock_buffer (buffer);
+	if (buffer->_first)
+		*p = buffer->_first->packet;
+	else
+		ret = EMPTY_BUFFER;
 	pthread_mutex_unlock (&buffer->mutex);
 	return ret;
 }
 
 
-void flush_buffer (packet_buffer* buffer)
+int push_packet_wait (packet_buffer* buffer, AVPacket p, int timeout)
 {
+	struct timespec ts;
+	int ret;
+	// fast path, no need to touch the mutex for the lock-free ring
+	if ((ret = push_packet (buffer, p)) != FULL_BUFFER || timeout == 0)
+		return ret;
+
+	deadline (&ts, timeout);
 	pthread_mutex_lock (&buffer->mutex);
-	while (buffer->_front != buffer->_back)
+	__atomic_add_fetch (&buffer->_push_waiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	while (!buffer->cancelled && !buffer->push_cancelled)
 	{
-		av_packet_unref (buffer->_front);
-		buffer->_front ++;
-		if (buffer->_front - buffer->packets == buffer->capacity)
-			buffer->_front = buffer->packets;
+		ret = buffer->type == PACKET_BUFFER_SPSC ? push_packet_spsc (buffer, p) : push_packet_locked (buffer, p);
+		if (ret != FULL_BUFFER)
+			break;
+		if (timeout < 0)
+			pthread_cond_wait (&buffer->not_full, &buffer->mutex);
+		else if (pthread_cond_timedwait (&buffer->not_full, &buffer->mutex, &ts) != 0)
+			break;
 	}
-	// reset
-	buffer->size_packets = 0;
-	buffer->n_packets    = 0;
-	buffer->_front = buffer->_back = buffer->packets;
+	if (ret != 0 && (buffer->cancelled || buffer->push_cancelled))
+		ret = CANCELLED_BUFFER;
+	__atomic_sub_fetch (&buffer->_push_waiting, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock (&buffer->mutex);
+
+	if (ret == 0)
+		wake_waiters (buffer, &buffer->_pop_waiting, &buffer->not_empty);
+	return ret;
+}
+
+
+int pop_packet_wait (packet_buffer* buffer, AVPacket* p, int timeout)
+{
+	struct timespec ts;
+	int ret;
+	if ((ret = pop_packet (buffer, p)) != EMPTY_BUFFER || timeout == 0)
+		return ret;
+
+	deadline (&ts, timeout);
+	pthread_mutex_lock (&buffer->mutex);
+	__atomic_add_fetch (&buffer->_pop_waiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	while (!buffer->cancelled)
+	{
+		ret = buffer->type == PACKET_BUFFER_SPSC ? pop_packet_spsc (buffer, p) : pop_packet_locked (buffer, p);
+		// nothing more will arrive once the producer has closed the fifo
+		if (ret != EMPTY_BUFFER || buffer->closed)
+			break;
+		if (timeout < 0)
+			pthread_cond_wait (&buffer->not_empty, &buffer->mutex);
+		else if (pthread_cond_timedwait (&buffer->not_empty, &buffer->mutex, &ts) != 0)
+			break;
+	}
+	if (ret != 0 && buffer->cancelled)
+		ret = CANCELLED_BUFFER;
+	__atomic_sub_fetch (&buffer->_pop_waiting, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock (&buffer->mutex);
+
+	if (ret == 0 && !above_watermark (buffer))
+		wake_waiters (buffer, &buffer->_push_waiting, &buffer->not_full);
+	return ret;
+}
+
+
+void cancel_packet_buffer (packet_buffer* buffer)
+{
+	pthread_mutex_lock (&buffer->mutex);
+	buffer->cancelled = 1;
+	pthread_cond_broadcast (&buffer->not_empty);
+	pthread_cond_broadcast (&buffer->not_full);
+	pthread_mutex_unlock (&buffer->mutex);
+}
+
+
+void cancel_packet_buffer_push (packet_buffer* buffer)
+{
+	pthread_mutex_lock (&buffer->mutex);
+	buffer->push_cancelled = 1;
+	pthread_cond_broadcast (&buffer->not_full);
+	pthread_mutex_unlock (&buffer->mutex);
+}
+
+
+void resume_packet_buffer (packet_buffer* buffer)
+{
+	pthread_mutex_lock (&buffer->mutex);
+	buffer->cancelled      = 0;
+	buffer->push_cancelled = 0;
+	pthread_mutex_unlock (&buffer->mutex);
+}
+
+
+void close_packet_buffer (packet_buffer* buffer)
+{
+	pthread_mutex_lock (&buffer->mutex);
+	buffer->closed = 1;
+	pthread_cond_broadcast (&buffer->not_empty);
+	pthread_mutex_unlock (&buffer->mutex);
+}
+
+
+void reopen_packet_buffer (packet_buffer* buffer)
+{
+	pthread_mutex_lock (&buffer->mutex);
+	buffer->closed = 0;
+	pthread_mutex_unlock (&buffer->mutex);
+}
+
+
+void flush_buffer (packet_buffer* buffer)
+{
+	AVPacket p;
+	// the producer may still be pushing, so drain as the consumer would
+	if (buffer->type == PACKET_BUFFER_SPSC)
+	{
+		while (pop_packet_spsc (buffer, &p) == 0)
+			av_packet_unref (&p);
+		wake_waiters (buffer, &buffer->_push_waiting, &buffer->not_full);
+		return;
+	}
+
+	pthread_mutex_lock (&buffer->mutex);
+	while (pop_packet_locked (buffer, &p) == 0)
+		av_packet_unref (&p);
+	pthread_cond_broadcast (&buffer->not_full);
 	pthread_mutex_unlock (&buffer->mutex);
 }
@@ -0,0 +1,118 @@
+#include "rpi_mp_packet_pool.h"
+
+
+/**
+ *	Allocate a new slab and put all its slots on the free list.
+ */
+static int grow_packet_pool (packet_pool* pool)
+{
+	uint i;
+	packet_slab* slab = (packet_slab*) malloc (sizeof (packet_slab) + pool->slab_size * sizeof (packet_slot));
+	if (!slab)
+		return 1;
+
+	memset (slab, 0x0, sizeof (packet_slab) + pool->slab_size * sizeof (packet_slot));
+	for (i = 0; i < pool->slab_size; i ++)
+	{
+		slab->slots[i].slab = slab;
+		slab->slots[i].next = i + 1 < pool->slab_size ? &slab->slots[i + 1] : pool->free_slots;
+	}
+	pool->free_slots = slab->slots;
+	pool->n_free    += pool->slab_size;
+	slab->next       = pool->slabs;
+	pool->slabs      = slab;
+	pool->n_slabs   ++;
+	return 0;
+}
+
+
+int init_packet_pool (packet_pool* pool, uint slab_size)
+{
+	pool->slab_size  = slab_size ? slab_size : 1;
+	pool->n_slabs    = 0;
+	pool->high_water = 0;
+	pool->n_free     = 0;
+	pool->slabs      = NULL;
+	pool->free_slots = NULL;
+	return grow_packet_pool (pool);
+}
+
+
+void destroy_packet_pool (packet_pool* pool)
+{
+	packet_slab* slab;
+	while ((slab = pool->slabs))
+	{
+		pool->slabs = slab->next;
+		free (slab);
+	}
+	pool->free_slots = NULL;
+	pool->n_slabs    = 0;
+	pool->n_free     = 0;
+}
+
+
+packet_slot* get_packet_slot (packet_pool* pool)
+{
+	packet_slot* slot;
+	if (!pool->free_slots && grow_packet_pool (pool) != 0)
+		return NULL;
+
+	slot             = pool->free_slots;
+	pool->free_slots = slot->next;
+	pool->n_free    --;
+	slot->slab->n_used ++;
+	slot->next       = NULL;
+	return slot;
+}
+
+
+void put_packet_slot (packet_pool* pool, packet_slot* slot)
+{
+	slot->slab->n_used --;
+	slot->next       = pool->free_slots;
+	pool->free_slots = slot;
+	pool->n_free    ++;
+}
+
+
+void shrink_packet_pool (packet_pool* pool)
+{
+	packet_slab **s, *slab;
+	packet_slot **f;
+	int freed = 0;
+
+	if (!pool->high_water || pool->n_slabs <= pool->high_water)
+		return;
+
+	// unlink free slots that belong to slabs about to be released
+	for (slab = pool->slabs; slab && pool->n_slabs - freed > pool->high_water; slab = slab->next)
+		if (slab->n_used == 0)
+		{
+			slab->n_used = (uint) -1; // mark for release
+			freed ++;
+		}
+	if (!freed)
+		return;
+
+	for (f = &pool->free_slots; *f; )
+	{
+		if ((*f)->slab->n_used == (uint) -1)
+			*f = (*f)->next;
+		else
+			f = &(*f)->next;
+	}
+	for (s = &pool->slabs; *s; )
+	{
+		slab = *s;
+		if (slab->n_used == (uint) -1)
+		{
+			*s = slab->next;
+			free (slab);
+			pool->n_slabs --;
+			pool->n_free  -= pool->slab_size;
+		}
+		else
+			s = &slab->next;
+	}
+}
@@ -0,0 +1,301 @@
+#include <pthread.h>
+#include <string.h>
+#include "rpi_mp_cpu.h"
+#include "rpi_mp_pcm.h"
+#include "rpi_mp_mix.h"
+
+// samples per channel converted at a time before interleaving
+#define PCM_BLOCK        256
+
+static const pcm_kernels* kernels = &pcm_kernels_c;
+static pthread_once_t     kernels_once = PTHREAD_ONCE_INIT;
+
+
+static inline int16_t flt_sample (float f)
+{
+	// round half away from zero, the vector kernels do the same
+	float v = f * 32768.0f;
+	v += v < 0 ? -0.5f : 0.5f;
+	if (v >= 32767.0f)
+		return 32767;
+	if (v <= -32768.0f)
+		return -32768;
+	return (int16_t) v;
+}
+
+
+void pcm_flt_to_s16_c (int16_t* out, const float* in, int n)
+{
+	int i;
+	for (i = 0; i < n; i ++)
+		out[i] = flt_sample (in[i]);
+}
+
+
+void pcm_s32_to_s16_c (int16_t* out, const int32_t* in, int n)
+{
+	int i;
+	for (i = 0; i < n; i ++)
+		out[i] = in[i] >> 16;
+}
+
+
+void pcm_mix_c (float* out, const float* in, float gain, int n)
+{
+	int i;
+	for (i = 0; i < n; i ++)
+		out[i] += in[i] * gain;
+}
+
+
+void pcm_gain_c (int16_t* data, int n, int channels, float gain, float step)
+{
+	float v;
+	int i;
+	for (i = 0; i < n; i ++)
+	{
+		v  = data[i] * (gain + (float) (i / channels) * step);
+		v += v < 0 ? -0.5f : 0.5f;
+		data[i] = v >= 32767.0f ? 32767 : v <= -32768.0f ? -32768 : (int16_t) v;
+	}
+}
+
+
+static void dbl_to_s16 (int16_t* out, const double* in, int n)
+{
+	int i;
+	for (i = 0; i < n; i ++)
+		out[i] = flt_sample ((float) in[i]);
+}
+
+
+static void u8_to_s16 (int16_t* out, const uint8_t* in, int n)
+{
+	int i;
+	for (i = 0; i < n; i ++)
+		out[i] = (in[i] - 0x80) << 8;
+}
+
+
+const pcm_kernels pcm_kernels_c =
+{
+	"c",
+	pcm_flt_to_s16_c,
+	pcm_s32_to_s16_c,
+	pcm_mix_c,
+	pcm_gain_c
+};
+
+
+static void pick_kernels ()
+{
+	switch (best_cpu_kernels ())
+	{
+#if defined(__arm__) || defined(__aarch64__)
+		case CPU_KERNELS_NEON:
+			kernels = &pcm_kernels_neon;
+		break;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+		case CPU_KERNELS_AVX2:
+			kernels = &pcm_kernels_avx2;
+		break;
+
+		case CPU_KERNELS_SSE2:
+			kernels = &pcm_kernels_sse2;
+		break;
+#endif
+		default:
+		break;
+	}
+}
+
+
+const char* pcm_kernel_name ()
+{
+	pthread_once (&kernels_once, pick_kernels);
+	return kernels->name;
+}
+
+
+void set_pcm_kernels (const pcm_kernels* chosen)
+{
+	pthread_once (&kernels_once, pick_kernels);
+	kernels = chosen;
+}
+
+
+void pcm_gain (int16_t* data, int n, int channels, float gain, float step)
+{
+	pthread_once (&kernels_once, pick_kernels);
+	kernels->gain (data, n, channels, gain, step);
+}
+
+
+/**
+ *	Convert n contiguous values of a packed sample format.
+ */
+static void convert (int16_t* out, const uint8_t* in, enum AVSampleFormat format, int n)
+{
+	switch (format)
+	{
+		case AV_SAMPLE_FMT_FLT:
+			kernels->flt (out, (const float*) in, n);
+			break;
+
+		case AV_SAMPLE_FMT_S32:
+			kernels->s32 (out, (const int32_t*) in, n);
+			break;
+
+		case AV_SAMPLE_FMT_DBL:
+			dbl_to_s16 (out, (const double*) in, n);
+			break;
+
+		case AV_SAMPLE_FMT_U8:
+			u8_to_s16 (out, in, n);
+			break;
+
+		default:
+			memcpy (out, in, n * sizeof (int16_t));
+			break;
+	}
+}
+
+
+int pcm_to_s16 (int16_t* out, uint8_t* const* in, enum AVSampleFormat format, int channels, int out_channels, int samples)
+{
+	int16_t block[PCM_MAX_CHANNELS * PCM_BLOCK];
+	enum AVSampleFormat packed = av_get_packed_sample_fmt (format);
+	int planar = av_sample_fmt_is_planar (format);
+	int bps    = av_get_bytes_per_sample (format);
+	int used   = channels < out_channels ? channels : out_channels;
+	int i, n, ch, s;
+
+	if ((packed != AV_SAMPLE_FMT_U8  && packed != AV_SAMPLE_FMT_S16 && packed != AV_SAMPLE_FMT_S32 &&
+	     packed != AV_SAMPLE_FMT_FLT && packed != AV_SAMPLE_FMT_DBL) ||
+	    channels <= 0 || out_channels <= 0 || channels > PCM_MAX_CHANNELS || out_channels > PCM_MAX_CHANNELS)
+		return -1;
+
+	pthread_once (&kernels_once, pick_kernels);
+
+	// packed input with the output layout is a single run of values
+	if (!planar && channels == out_channels)
+	{
+		convert (out, in[0], packed, samples * channels);
+		return samples * out_channels * sizeof (int16_t);
+	}
+
+	for (i = 0; i < samples; i += n, out += n * out_channels)
+	{
+		n = samples - i < PCM_BLOCK ? samples - i : PCM_BLOCK;
+		if (planar)
+		{
+			// convert each plane into its row of the block, then weave the rows together
+			for (ch = 0; ch < used; ch ++)
+				convert (block + ch * PCM_BLOCK, in[ch] + (size_t) i * bps, packed, n);
+			for (s = 0; s < n; s ++)
+			{
+				for (ch = 0; ch < used; ch ++)
+					out[s * out_channels + ch] = block[ch * PCM_BLOCK + s];
+				for (; ch < out_channels; ch ++)
+					out[s * out_channels + ch] = 0;
+			}
+		}
+		else
+		{
+			convert (block, in[0] + (size_t) i * channels * bps, packed, n * channels);
+			for (s = 0; s < n; s ++)
+			{
+				for (ch = 0; ch < used; ch ++)
+					out[s * out_channels + ch] = block[s * channels + ch];
+				for (; ch < out_channels; ch ++)
+					out[s * out_channels + ch] = 0;
+			}
+		}
+	}
+	return samples * out_channels * sizeof (int16_t);
+}
+
+
+/**
+ *	Convert n values of a channel, stride values apart, to float in [-1, 1).
+ */
+static void to_float (float* out, const uint8_t* in, enum AVSampleFormat format, int n, int stride)
+{
+	int i;
+	switch (format)
+	{
+		case AV_SAMPLE_FMT_FLT:
+			for (i = 0; i < n; i ++)
+				out[i] = ((const float*) in)[i * stride];
+			break;
+
+		case AV_SAMPLE_FMT_S32:
+			for (i = 0; i < n; i ++)
+				out[i] = ((const int32_t*) in)[i * stride] * (1.0f / 2147483648.0f);
+			break;
+
+		case AV_SAMPLE_FMT_DBL:
+			for (i = 0; i < n; i ++)
+				out[i] = (float) ((const double*) in)[i * stride];
+			break;
+
+		case AV_SAMPLE_FMT_U8:
+			for (i = 0; i < n; i ++)
+				out[i] = (in[i * stride] - 0x80) * (1.0f / 128);
+			break;
+
+		default:
+			for (i = 0; i < n; i ++)
+				out[i] = ((const int16_t*) in)[i * stride] * (1.0f / 32768);
+			break;
+	}
+}
+
+
+int pcm_mix_to_s16 (int16_t* out, uint8_t* const* in, enum AVSampleFormat format, const mix_matrix* matrix, int samples)
+{
+	float   rows[PCM_MAX_CHANNELS][PCM_BLOCK];
+	float   mixed[PCM_BLOCK];
+	int16_t block[PCM_MAX_CHANNELS * PCM_BLOCK];
+	enum AVSampleFormat packed = av_get_packed_sample_fmt (format);
+	int planar   = av_sample_fmt_is_planar (format);
+	int bps      = av_get_bytes_per_sample (format);
+	int channels = matrix->in_channels;
+	int outs     = matrix->out_channels;
+	int i, n, ch, o, s;
+
+	if (packed != AV_SAMPLE_FMT_U8  && packed != AV_SAMPLE_FMT_S16 && packed != AV_SAMPLE_FMT_S32 &&
+	    packed != AV_SAMPLE_FMT_FLT && packed != AV_SAMPLE_FMT_DBL)
+		return -1;
+
+	pthread_once (&kernels_once, pick_kernels);
+
+	for (i = 0; i < samples; i += n, out += n * outs)
+	{
+		n = samples - i < PCM_BLOCK ? samples - i : PCM_BLOCK;
+		// each channel into a row of floats, mixed into the rows of the output and converted
+		// to 16-bit, then the rows are woven together
+		for (ch = 0; ch < channels; ch ++)
+			to_float (rows[ch], planar ? in[ch] + (size_t) i * bps : in[0] + ((size_t) i * channels + ch) * bps,
+			          packed, n, planar ? 1 : channels);
+		for (o = 0; o < outs; o ++)
+		{
+			// a channel passed on as it is needs no mixing
+			if ((ch = matrix->sources[o]) >= 0)
+			{
+				kernels->flt (block + o * PCM_BLOCK, rows[ch], n);
+				continue;
+			}
+			memset (mixed, 0, n * sizeof (float));
+			for (ch = 0; ch < channels; ch ++)
+				if (matrix->gains[o][ch] != 0)
+					kernels->mix (mixed, rows[ch], matrix->gains[o][ch], n);
+			kernels->flt (block + o * PCM_BLOCK, mixed, n);
+		}
+		for (s = 0; s < n; s ++)
+			for (o = 0; o < outs; o ++)
+				out[s * outs + o] = block[o * PCM_BLOCK + s];
+	}
+	return samples * outs * sizeof (int16_t);
+}
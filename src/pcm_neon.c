@@ -0,0 +1,89 @@
+#include "rpi_mp_pcm.h"
+#if defined(__arm__) || defined(__aarch64__)
+// built with NEON enabled even when the rest targets ARMv6, only called if the CPU has it
+#include <arm_neon.h>
+
+static inline int16x4_t flt_to_s16x4 (float32x4_t f)
+{
+	const float32x4_t scale = vdupq_n_f32 (32768.0f);
+	const uint32x4_t  sign  = vdupq_n_u32 (0x80000000);
+	const uint32x4_t  half  = vreinterpretq_u32_f32 (vdupq_n_f32 (0.5f));
+
+	// add 0.5 with the sign of the value and truncate, saturating on the way down
+	f = vmulq_f32 (f, scale);
+	f = vaddq_f32 (f, vreinterpretq_f32_u32 (vorrq_u32 (vandq_u32 (vreinterpretq_u32_f32 (f), sign), half)));
+	return vqmovn_s32 (vcvtq_s32_f32 (f));
+}
+
+
+static void flt_to_s16_neon (int16_t* out, const float* in, int n)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		vst1q_s16 (out + i, vcombine_s16 (flt_to_s16x4 (vld1q_f32 (in + i)), flt_to_s16x4 (vld1q_f32 (in + i + 4))));
+	pcm_flt_to_s16_c (out + i, in + i, n - i);
+}
+
+
+static void s32_to_s16_neon (int16_t* out, const int32_t* in, int n)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		vst1q_s16 (out + i, vcombine_s16 (vshrn_n_s32 (vld1q_s32 (in + i), 16), vshrn_n_s32 (vld1q_s32 (in + i + 4), 16)));
+	pcm_s32_to_s16_c (out + i, in + i, n - i);
+}
+
+
+static void mix_neon (float* out, const float* in, float gain, int n)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		vst1q_f32 (out + i, vmlaq_n_f32 (vld1q_f32 (out + i), vld1q_f32 (in + i), gain));
+	pcm_mix_c (out + i, in + i, gain, n - i);
+}
+
+
+static inline int16x4_t gain_s16x4 (int16x4_t s, float32x4_t g)
+{
+	const uint32x4_t sign = vdupq_n_u32 (0x80000000);
+	const uint32x4_t half = vreinterpretq_u32_f32 (vdupq_n_f32 (0.5f));
+	float32x4_t f = vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (s)), g);
+
+	f = vaddq_f32 (f, vreinterpretq_f32_u32 (vorrq_u32 (vandq_u32 (vreinterpretq_u32_f32 (f), sign), half)));
+	return vqmovn_s32 (vcvtq_s32_f32 (f));
+}
+
+
+static void gain_neon (int16_t* data, int n, int channels, float gain, float step)
+{
+	// sample of each of the 8 values in a vector, moving on by 8 / channels samples
+	const float offsets[8] = { 0, 1 / channels, 2 / channels, 3 / channels, 4 / channels, 5 / channels, 6 / channels, 7 / channels };
+	float32x4_t lo = vld1q_f32 (offsets);
+	float32x4_t hi = vld1q_f32 (offsets + 4);
+	const float32x4_t next = vdupq_n_f32 (8 / channels);
+	const float32x4_t g = vdupq_n_f32 (gain);
+	int16x8_t v;
+	int i = 0;
+
+	if (8 % channels == 0)
+		for (; i + 8 <= n; i += 8)
+		{
+			v = vld1q_s16 (data + i);
+			vst1q_s16 (data + i, vcombine_s16 (gain_s16x4 (vget_low_s16 (v), vmlaq_n_f32 (g, lo, step)),
+			                                   gain_s16x4 (vget_high_s16 (v), vmlaq_n_f32 (g, hi, step))));
+			lo = vaddq_f32 (lo, next);
+			hi = vaddq_f32 (hi, next);
+		}
+	pcm_gain_c (data + i, n - i, channels, gain + (float) (i / channels) * step, step);
+}
+
+
+const pcm_kernels pcm_kernels_neon =
+{
+	"neon",
+	flt_to_s16_neon,
+	s32_to_s16_neon,
+	mix_neon,
+	gain_neon
+};
+#endif
@@ -0,0 +1,255 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rpi_mp_pcm_ring.h"
+
+// marks the unused end of the ring when a frame did not fit before wrapping
+#define RECORD_SKIP  0xFFFFFFFF
+#define RECORD_ALIGN 16
+#define RECORD_SIZE(size) (sizeof (pcm_record) + (((size) + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1)))
+
+/**
+ *	Header in front of every frame in the ring.
+ */
+typedef struct
+{
+	uint32_t size;
+	uint32_t flags;
+	int64_t  time;
+} pcm_record ;
+
+
+/**
+ *	Wake up threads blocked on the other end of the ring, see packet_buffer.c
+ */
+static inline void wake_waiters (pcm_ring* ring, int* waiting, pthread_cond_t* cond)
+{
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	if (__atomic_load_n (waiting, __ATOMIC_RELAXED))
+	{
+		pthread_mutex_lock (&ring->mutex);
+		pthread_cond_broadcast (cond);
+		pthread_mutex_unlock (&ring->mutex);
+	}
+}
+
+
+static void deadline (struct timespec* ts, int timeout)
+{
+	clock_gettime (CLOCK_MONOTONIC, ts);
+	ts->tv_sec  += timeout / 1000;
+	ts->tv_nsec += (timeout % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec  ++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+
+int init_pcm_ring (pcm_ring* ring, uint size)
+{
+	pthread_condattr_t cond_attr;
+	uint capacity = RECORD_ALIGN * 2;
+
+	// positions wrap around with the counters
+	while (capacity < size)
+		capacity <<= 1;
+
+	memset (ring, 0, sizeof (pcm_ring));
+	if (posix_memalign ((void**) &ring->data, RECORD_ALIGN, capacity) != 0)
+	{
+		ring->data = NULL;
+		return 1;
+	}
+	ring->size = capacity;
+	pthread_mutex_init (&ring->mutex, NULL);
+	pthread_condattr_init (&cond_attr);
+	pthread_condattr_setclock (&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init (&ring->not_empty, &cond_attr);
+	pthread_cond_init (&ring->not_full,  &cond_attr);
+	pthread_condattr_destroy (&cond_attr);
+	return 0;
+}
+
+
+void destroy_pcm_ring (pcm_ring* ring)
+{
+	if (!ring->data)
+		return;
+	free (ring->data);
+	ring->data = NULL;
+	pthread_mutex_destroy (&ring->mutex);
+	pthread_cond_destroy (&ring->not_empty);
+	pthread_cond_destroy (&ring->not_full);
+}
+
+
+static inline int has_room (pcm_ring* ring)
+{
+	uint tail = __atomic_load_n (&ring->_tail, __ATOMIC_ACQUIRE);
+	return ring->size - (ring->_head - tail) >= ring->_skip + RECORD_SIZE (ring->_reserved);
+}
+
+
+uint8_t* pcm_ring_reserve (pcm_ring* ring, uint size, int timeout)
+{
+	struct timespec ts;
+	uint position = ring->_head & (ring->size - 1);
+	uint length   = RECORD_SIZE (size);
+	uint ok;
+
+	if (length > ring->size / 2)
+		return NULL;
+	// a frame is never split, skip to the start if it does not fit before the end
+	ring->_reserved = size;
+	ring->_skip     = ring->size - position < length ? ring->size - position : 0;
+
+	if (!(ok = has_room (ring)) && timeout != 0)
+	{
+		deadline (&ts, timeout);
+		pthread_mutex_lock (&ring->mutex);
+		__atomic_add_fetch (&ring->_push_waiting, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence (__ATOMIC_SEQ_CST);
+		while (!ring->cancelled && !(ok = has_room (ring)))
+		{
+			if (timeout < 0)
+				pthread_cond_wait (&ring->not_full, &ring->mutex);
+			else if (pthread_cond_timedwait (&ring->not_full, &ring->mutex, &ts) != 0)
+				break;
+		}
+		__atomic_sub_fetch (&ring->_push_waiting, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock (&ring->mutex);
+	}
+	if (!ok)
+		return NULL;
+	return ring->data + (ring->_skip ? 0 : position) + sizeof (pcm_record);
+}
+
+
+void pcm_ring_commit (pcm_ring* ring, int64_t time, uint flags)
+{
+	uint position = ring->_head & (ring->size - 1);
+	pcm_record* record;
+
+	if (ring->_skip)
+	{
+		((pcm_record*) (ring->data + position))->size = RECORD_SKIP;
+		position = 0;
+	}
+	record        = (pcm_record*) (ring->data + position);
+	record->size  = ring->_reserved;
+	record->flags = flags;
+	record->time  = time;
+
+	__atomic_add_fetch (&ring->queued, record->size, __ATOMIC_RELAXED);
+	__atomic_store_n (&ring->_head, ring->_head + ring->_skip + RECORD_SIZE (ring->_reserved), __ATOMIC_RELEASE);
+	wake_waiters (ring, &ring->_pop_waiting, &ring->not_empty);
+}
+
+
+/**
+ *	Take a look at the oldest frame without waiting, consumer side only.
+ */
+static int peek_frame (pcm_ring* ring, pcm_frame* frame)
+{
+	pcm_record* record;
+	uint position;
+
+	while (__atomic_load_n (&ring->_head, __ATOMIC_ACQUIRE) != ring->_tail)
+	{
+		position = ring->_tail & (ring->size - 1);
+		record   = (pcm_record*) (ring->data + position);
+		if (record->size == RECORD_SKIP)
+		{
+			__atomic_store_n (&ring->_tail, ring->_tail + ring->size - position, __ATOMIC_RELEASE);
+			continue;
+		}
+		frame->data   = (uint8_t*) (record + 1);
+		frame->size   = record->size;
+		frame->time   = record->time;
+		frame->flags  = record->flags;
+		ring->_peeked = RECORD_SIZE (record->size);
+		ring->_started = 1;
+		return 0;
+	}
+	return EMPTY_BUFFER;
+}
+
+
+int pcm_ring_peek (pcm_ring* ring, pcm_frame* frame, int timeout)
+{
+	struct timespec ts;
+	int ret;
+
+	if ((ret = peek_frame (ring, frame)) == 0 || timeout == 0)
+		return ret;
+	// ran dry while playing, unless the producer is done
+	if (ring->_started && !__atomic_load_n (&ring->closed, __ATOMIC_RELAXED))
+		ring->underruns ++;
+	ring->_started = 0;
+
+	deadline (&ts, timeout);
+	pthread_mutex_lock (&ring->mutex);
+	__atomic_add_fetch (&ring->_pop_waiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	while (!ring->cancelled)
+	{
+		// nothing more will arrive once the producer has closed the ring
+		if ((ret = peek_frame (ring, frame)) == 0 || ring->closed)
+			break;
+		if (timeout < 0)
+			pthread_cond_wait (&ring->not_empty, &ring->mutex);
+		else if (pthread_cond_timedwait (&ring->not_empty, &ring->mutex, &ts) != 0)
+			break;
+	}
+	if (ret != 0 && ring->cancelled)
+		ret = CANCELLED_BUFFER;
+	__atomic_sub_fetch (&ring->_pop_waiting, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock (&ring->mutex);
+	return ret;
+}
+
+
+void pcm_ring_release (pcm_ring* ring)
+{
+	pcm_record* record = (pcm_record*) (ring->data + (ring->_tail & (ring->size - 1)));
+	__atomic_sub_fetch (&ring->queued, record->size, __ATOMIC_RELAXED);
+	__atomic_store_n (&ring->_tail, ring->_tail + ring->_peeked, __ATOMIC_RELEASE);
+	wake_waiters (ring, &ring->_push_waiting, &ring->not_full);
+}
+
+
+void cancel_pcm_ring (pcm_ring* ring)
+{
+	pthread_mutex_lock (&ring->mutex);
+	ring->cancelled = 1;
+	pthread_cond_broadcast (&ring->not_empty);
+	pthread_cond_broadcast (&ring->not_full);
+	pthread_mutex_unlock (&ring->mutex);
+}
+
+
+void resume_pcm_ring (pcm_ring* ring)
+{
+	pthread_mutex_lock (&ring->mutex);
+	ring->cancelled = 0;
+	pthread_mutex_unlock (&ring->mutex);
+}
+
+
+void close_pcm_ring (pcm_ring* ring)
+{
+	pthread_mutex_lock (&ring->mutex);
+	ring->closed = 1;
+	pthread_cond_broadcast (&ring->not_empty);
+	pthread_mutex_unlock (&ring->mutex);
+}
+
+
+void flush_pcm_ring (pcm_ring* ring)
+{
+	ring->_tail    = ring->_head;
+	ring->queued   = 0;
+	ring->_started = 0;
+}
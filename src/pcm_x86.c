@@ -0,0 +1,200 @@
+#include "rpi_mp_pcm.h"
+#if defined(__x86_64__) || defined(__i386__)
+// x86 kernels let the conversion be checked on a host, the player itself runs on ARM
+#include <immintrin.h>
+
+__attribute__ ((target ("sse2")))
+static inline __m128i flt_to_s32_sse2 (__m128 f)
+{
+	const __m128 scale = _mm_set1_ps (32768.0f);
+	const __m128 sign  = _mm_set1_ps (-0.0f);
+	const __m128 half  = _mm_set1_ps (0.5f);
+
+	// add 0.5 with the sign of the value, clamp and truncate
+	f = _mm_mul_ps (f, scale);
+	f = _mm_add_ps (f, _mm_or_ps (_mm_and_ps (f, sign), half));
+	f = _mm_min_ps (_mm_max_ps (f, _mm_set1_ps (-32768.0f)), _mm_set1_ps (32767.0f));
+	return _mm_cvttps_epi32 (f);
+}
+
+
+__attribute__ ((target ("sse2")))
+static void flt_to_s16_sse2 (int16_t* out, const float* in, int n)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm_storeu_si128 ((__m128i*) (out + i), _mm_packs_epi32 (flt_to_s32_sse2 (_mm_loadu_ps (in + i)),
+		                                                         flt_to_s32_sse2 (_mm_loadu_ps (in + i + 4))));
+	pcm_flt_to_s16_c (out + i, in + i, n - i);
+}
+
+
+__attribute__ ((target ("sse2")))
+static void s32_to_s16_sse2 (int16_t* out, const int32_t* in, int n)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm_storeu_si128 ((__m128i*) (out + i), _mm_packs_epi32 (_mm_srai_epi32 (_mm_loadu_si128 ((const __m128i*) (in + i)), 16),
+		                                                         _mm_srai_epi32 (_mm_loadu_si128 ((const __m128i*) (in + i + 4)), 16)));
+	pcm_s32_to_s16_c (out + i, in + i, n - i);
+}
+
+
+__attribute__ ((target ("avx2")))
+static inline __m256i flt_to_s32_avx2 (__m256 f)
+{
+	const __m256 scale = _mm256_set1_ps (32768.0f);
+	const __m256 sign  = _mm256_set1_ps (-0.0f);
+	const __m256 half  = _mm256_set1_ps (0.5f);
+
+	f = _mm256_mul_ps (f, scale);
+	f = _mm256_add_ps (f, _mm256_or_ps (_mm256_and_ps (f, sign), half));
+	f = _mm256_min_ps (_mm256_max_ps (f, _mm256_set1_ps (-32768.0f)), _mm256_set1_ps (32767.0f));
+	return _mm256_cvttps_epi32 (f);
+}
+
+
+__attribute__ ((target ("avx2")))
+static void flt_to_s16_avx2 (int16_t* out, const float* in, int n)
+{
+	int i;
+	__m256i packed;
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		// packs works within 128-bit lanes, put the quarters back in order
+		packed = _mm256_packs_epi32 (flt_to_s32_avx2 (_mm256_loadu_ps (in + i)), flt_to_s32_avx2 (_mm256_loadu_ps (in + i + 8)));
+		_mm256_storeu_si256 ((__m256i*) (out + i), _mm256_permute4x64_epi64 (packed, 0xD8));
+	}
+	flt_to_s16_sse2 (out + i, in + i, n - i);
+}
+
+
+__attribute__ ((target ("avx2")))
+static void s32_to_s16_avx2 (int16_t* out, const int32_t* in, int n)
+{
+	int i;
+	__m256i packed;
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		packed = _mm256_packs_epi32 (_mm256_srai_epi32 (_mm256_loadu_si256 ((const __m256i*) (in + i)), 16),
+		                             _mm256_srai_epi32 (_mm256_loadu_si256 ((const __m256i*) (in + i + 8)), 16));
+		_mm256_storeu_si256 ((__m256i*) (out + i), _mm256_permute4x64_epi64 (packed, 0xD8));
+	}
+	s32_to_s16_sse2 (out + i, in + i, n - i);
+}
+
+
+__attribute__ ((target ("sse2")))
+static void mix_sse2 (float* out, const float* in, float gain, int n)
+{
+	const __m128 g = _mm_set1_ps (gain);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_ps (out + i, _mm_add_ps (_mm_loadu_ps (out + i), _mm_mul_ps (_mm_loadu_ps (in + i), g)));
+	pcm_mix_c (out + i, in + i, gain, n - i);
+}
+
+
+__attribute__ ((target ("avx2")))
+static void mix_avx2 (float* out, const float* in, float gain, int n)
+{
+	const __m256 g = _mm256_set1_ps (gain);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps (out + i, _mm256_add_ps (_mm256_loadu_ps (out + i), _mm256_mul_ps (_mm256_loadu_ps (in + i), g)));
+	mix_sse2 (out + i, in + i, gain, n - i);
+}
+
+
+__attribute__ ((target ("sse2")))
+static inline __m128i gain_s32_sse2 (__m128i s, __m128 g)
+{
+	const __m128 sign = _mm_set1_ps (-0.0f);
+	const __m128 half = _mm_set1_ps (0.5f);
+	__m128 f = _mm_mul_ps (_mm_cvtepi32_ps (s), g);
+
+	// packing saturates what is out of range
+	f = _mm_add_ps (f, _mm_or_ps (_mm_and_ps (f, sign), half));
+	return _mm_cvttps_epi32 (f);
+}
+
+
+__attribute__ ((target ("sse2")))
+static void gain_sse2 (int16_t* data, int n, int channels, float gain, float step)
+{
+	// sample of each of the 8 values in a vector, moving on by 8 / channels samples
+	__m128 lo = _mm_set_ps (3 / channels, 2 / channels, 1 / channels, 0);
+	__m128 hi = _mm_set_ps (7 / channels, 6 / channels, 5 / channels, 4 / channels);
+	const __m128 next = _mm_set1_ps (8 / channels);
+	const __m128 g = _mm_set1_ps (gain);
+	const __m128 s = _mm_set1_ps (step);
+	__m128i v;
+	int i = 0;
+
+	if (8 % channels == 0)
+		for (; i + 8 <= n; i += 8)
+		{
+			v = _mm_loadu_si128 ((const __m128i*) (data + i));
+			_mm_storeu_si128 ((__m128i*) (data + i), _mm_packs_epi32 (gain_s32_sse2 (_mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16), _mm_add_ps (g, _mm_mul_ps (lo, s))),
+			                                                          gain_s32_sse2 (_mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16), _mm_add_ps (g, _mm_mul_ps (hi, s)))));
+			lo = _mm_add_ps (lo, next);
+			hi = _mm_add_ps (hi, next);
+		}
+	pcm_gain_c (data + i, n - i, channels, gain + (float) (i / channels) * step, step);
+}
+
+
+__attribute__ ((target ("avx2")))
+static inline __m256i gain_s32_avx2 (__m256i s, __m256 g)
+{
+	const __m256 sign = _mm256_set1_ps (-0.0f);
+	const __m256 half = _mm256_set1_ps (0.5f);
+	__m256 f = _mm256_mul_ps (_mm256_cvtepi32_ps (s), g);
+
+	f = _mm256_add_ps (f, _mm256_or_ps (_mm256_and_ps (f, sign), half));
+	return _mm256_cvttps_epi32 (f);
+}
+
+
+__attribute__ ((target ("avx2")))
+static void gain_avx2 (int16_t* data, int n, int channels, float gain, float step)
+{
+	__m256 lo = _mm256_set_ps (7 / channels, 6 / channels, 5 / channels, 4 / channels, 3 / channels, 2 / channels, 1 / channels, 0);
+	__m256 hi = _mm256_add_ps (lo, _mm256_set1_ps (8 / channels));
+	const __m256 next = _mm256_set1_ps (16 / channels);
+	const __m256 g = _mm256_set1_ps (gain);
+	const __m256 s = _mm256_set1_ps (step);
+	__m256i v;
+	int i = 0;
+
+	if (8 % channels == 0)
+		for (; i + 16 <= n; i += 16)
+		{
+			v = _mm256_packs_epi32 (gain_s32_avx2 (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i*) (data + i))), _mm256_add_ps (g, _mm256_mul_ps (lo, s))),
+			                        gain_s32_avx2 (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i*) (data + i + 8))), _mm256_add_ps (g, _mm256_mul_ps (hi, s))));
+			_mm256_storeu_si256 ((__m256i*) (data + i), _mm256_permute4x64_epi64 (v, 0xD8));
+			lo = _mm256_add_ps (lo, next);
+			hi = _mm256_add_ps (hi, next);
+		}
+	gain_sse2 (data + i, n - i, channels, gain + (float) (i / channels) * step, step);
+}
+
+
+const pcm_kernels pcm_kernels_sse2 =
+{
+	"sse2",
+	flt_to_s16_sse2,
+	s32_to_s16_sse2,
+	mix_sse2,
+	gain_sse2
+};
+
+const pcm_kernels pcm_kernels_avx2 =
+{
+	"avx2",
+	flt_to_s16_avx2,
+	s32_to_s16_avx2,
+	mix_avx2,
+	gain_avx2
+};
+#endif
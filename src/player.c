@@ -3,13 +3,67 @@
 #include <libavutil/avutil.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/samplefmt.h>
+#include <unistd.h>
 #include "bcm_host.h"
 #include "ilclient.h"
 #include "rpi_mp.h"
+#include "rpi_mp_cpu.h"
 #include "rpi_mp_packet_buffer.h"
-#include "rpi_mp_utils.h"
-
-#define FIFO_SLEEPY_TIME               10000
+#include "rpi_mp_demux_scheduler.h"
+#include "rpi_mp_read_ahead.h"
+#include "rpi_mp_mmap_input.h"
+#include "rpi_mp_omx_port.h"
+#include "rpi_mp_omx_submit.h"
+#include "rpi_mp_pcm.h"
+#include "rpi_mp_scratch.h"
+#include "rpi_mp_pcm_ring.h"
+#include "rpi_mp_iec61937.h"
+#include "rpi_mp_codec_route.h"
+#include "rpi_mp_sw_video.h"
+#include "rpi_mp_annexb.h"
+#include "rpi_mp_keyframe_index.h"
+#include "rpi_mp_time_stretch.h"
+#include "rpi_mp_resample.h"
+#include "rpi_mp_mix.h"
+#include "rpi_mp_gain.h"
+#include "rpi_mp_end_of_file.h"
+
+#define FIFO_SLOTS                     1024
+#define FIFO_HIGH_WATER_SLABS          4
+#define FIFO_VIDEO_MAX_SIZE            (1024 * 1024 * 32)
+#define FIFO_AUDIO_MAX_SIZE            (1024 * 1024 * 8)
+#define FIFO_DEFAULT_LOW_MS            1000
+#define FIFO_DEFAULT_HIGH_MS           3000
+#define DEMUX_OVERFLOW_SIZE            (1024 * 1024 * 4)
+#define READ_AHEAD_BLOCK_SIZE          (1024 * 256)
+#define READ_AHEAD_DEPTH               16
+#define MMAP_WINDOW                    (1024 * 1024 * 4)
+#define AUDIO_SCRATCH_SAMPLES          4096
+#define VIDEO_SCRATCH_SIZE             (256 * 1024)
+#define PCM_RING_MS                    500
+#define VIDEO_SHM_NAME                 "/rpi_mp_video"
+#define FRAME_WAIT_STEP                20000
+#define FRAME_MAX_WAIT                 1000000
+#define FRAME_MAX_LATENESS             100000
+#define ACCURATE_SEEK_MAX_TIME         2000000
+// a keyframe shown every 125 ms in trick play, taken at most this many packets from the last seek
+#define TRICK_FRAME_INTERVAL           125000
+#define TRICK_MAX_PACKETS              4096
+#define TRICK_MAX_SPEED                32
+// tempos audio is time-stretched to, Q16 like the clock scale
+#define TEMPO_MIN                      (1 << 15)
+#define TEMPO_MAX                      (2 << 16)
+// audio at a rate the sink does not take is resampled to this one
+#define AUDIO_RATE_AUTO                0
+#define AUDIO_RATE_FALLBACK            48000
+// volume of audio decoded on the CPU, shortest ramp to a new one, and the fades around pause, seek
+// and stop
+#define VOLUME_MAX                     4.0
+#define VOLUME_MIN_RAMP_MS             5
+#define FADE_MS                        20
+// a fade out is waited for until the clock has played it, or for at most FADE_MAX_WAIT
+#define FADE_WAIT_STEP                 5000
+#define FADE_MAX_WAIT                  250000
 #define DIGITAL_AUDIO_DESTINATION_NAME "hdmi"
 #define ANALOG_AUDIO_DESTINATION_NAME  "local"
 
@@ -47,10 +101,21 @@ enum flags
 	VIDEO_STOPPED         = 0x0400,
 	AUDIO_STOPPED         = 0x0800,
 	ANALOG_AUDIO_OUT      = 0x1000,
+	LOCKFREE_BUFFERS      = 0x2000,
+	READ_AHEAD            = 0x4000,
+	MMAP                  = 0x8000,
+	DECODE_AHEAD          = 0x20000,
+	PASSTHROUGH           = 0x40000,
+	INDEX                 = 0x80000,
+	SCAN_INDEX            = 0x100000,
+	SEEKING               = 0x200000,
+	ACCURATE              = 0x400000,
+	TRICK_PLAY            = 0x800000,
+	SPEED_CHANGE          = 0x1000000,
 };
 
 #define OUT_CHANNELS(num_channels) ((num_channels) > 4 ? 8 : (num_channels) > 2 ? 4 : (num_channels))
-#define WAIT_WHILE_PAUSED { pthread_mutex_lock (&pause_mutex); ret = pthread_cond_wait (&pause_condition, &pause_mutex); pthread_mutex_unlock (&pause_mutex); }
+#define WAIT_WHILE_PAUSED { pthread_mutex_lock (&pause_mutex); while (flags & PAUSED) ret = pthread_cond_wait (&pause_condition, &pause_mutex); pthread_mutex_unlock (&pause_mutex); }
 #define SET_FLAG(flag) { pthread_mutex_lock (&flags_mutex); flags |= flag; pthread_mutex_unlock (&flags_mutex); }
 #define UNSET_FLAG(flag) { pthread_mutex_lock (&flags_mutex); flags &= ~flag; pthread_mutex_unlock (&flags_mutex); }
 #define OMX_INIT_PARAM(type) memset (&type, 0x0, sizeof (type)); type.nSize = sizeof (type); type.nVersion.nVersion = OMX_VERSION;
@@ -67,6 +132,109 @@ static AVPacket               av_packet,
                               video_packet,
                               audio_packet;
 static AVFrame              * av_frame;
+static scratch_arena          audio_scratch;
+static scratch_arena          video_scratch;
+static annexb_converter       video_annexb;
+// the current video packet as it goes to the decoder, converted or not
+static uint8_t              * video_data;
+static int                    video_size;
+static keyframe_index         keyframes;
+// the demuxer has read every packet from a point the index covers, e.g. the start
+static int                    demux_contiguous;
+// the keyframes of the index are seeked to by byte, else by time
+static int                    index_by_byte;
+// latest seek request, in microseconds, and when it was made
+static int64_t                seek_target,
+                              seek_requested_at;
+// request of the last seek carried out until its first frame is on the way, else 0
+static int64_t                seek_started;
+// the demuxer is at the end of the file, and decoding threads done with what it read
+static end_of_file_sync       end_of_file;
+static uint64_t               seek_frames;
+static struct
+{
+	uint    seeks;
+	uint    coalesced;
+	int64_t total_us;
+	int64_t max_us;
+}                             seek_stats;
+// accurate seeks: media before the target is decoded but not played, up to the deadline
+static int64_t                accurate_target,
+                              accurate_started,
+                              accurate_deadline;
+static int                    video_discarding,
+                              audio_discarding;
+static struct
+{
+	uint     seeks;
+	uint     gave_up;
+	uint64_t frames;
+	uint64_t samples;
+	int64_t  total_us;
+	int64_t  max_us;
+}                             discard_stats;
+// trick play: speed, where it started, the last keyframe shown and the time stepped to
+static int                    trick_speed = 1,
+                              requested_speed = 1;
+static int64_t                trick_origin,
+                              trick_position,
+                              trick_target;
+static struct
+{
+	uint keyframes;
+	uint packets;
+}                             trick_stats;
+static int64_t                audio_samples_decoded;
+// audio decoded on the CPU is stretched to the tempo the clock runs at, keeping the pitch
+static time_stretcher         audio_stretch;
+static OMX_S32                tempo = 1 << 16;
+// and resampled to a rate the sink takes, AUDIO_RATE_AUTO leaves the rates it takes alone
+static resampler              audio_resampler;
+static int                    resampling,
+                              audio_rate = AUDIO_RATE_AUTO,
+                              resample_quality = RESAMPLE_MEDIUM;
+// channels of audio decoded on the CPU are mixed into the layout of the renderer
+static const mix_matrix*      audio_mix;
+static int                    audio_layout = AUDIO_LAYOUT_AUTO;
+// and scaled to the volume asked for, muted or not, ramping to it over the fade asked with it,
+// by the thread handing it to the renderer, on its request
+enum gain_request
+{
+	GAIN_KEEP,
+	GAIN_VOLUME,
+	GAIN_FADE_OUT,
+	GAIN_FADE_IN
+};
+static gain_ramp              audio_gain;
+static float                  volume = 1;
+static int                    muted,
+                              gain_request;
+// media time the last fade out ends at, AV_NOPTS_VALUE until it is handed to the renderer
+static int64_t                fade_out_end;
+static uint                   volume_ramp_ms = VOLUME_MIN_RAMP_MS;
+// buffer flags of audio held back by stretching or resampling, e.g. the start time
+static OMX_U32                held_flags;
+static pcm_ring               audio_ring;
+static iec61937_packer        audio_packer;
+static codec_route          * video_codec_route,
+                            * audio_codec_route;
+static int                    video_route,
+                              audio_route;
+static sw_video_decoder       sw_video;
+static video_sink             video_out;
+static omx_port               render_input;
+static uint                   render_stride,
+                              render_slice_height;
+static int                    video_sink_type = VIDEO_SINK_RENDER;
+static char                   video_sink_name[64] = VIDEO_SHM_NAME;
+static OMX_TICKS              burst_ticks;
+static uint                   pcm_bytes_per_ms;
+static read_ahead             input;
+static mmap_input             mapped_input;
+static uint                   read_ahead_block_size = READ_AHEAD_BLOCK_SIZE,
+                              read_ahead_depth      = READ_AHEAD_DEPTH;
+// time in microseconds spent waiting in av_read_frame
+static int64_t                demux_read_time;
 
 // Decoding variables (OMX)
 static COMPONENT_T          * video_decode    = NULL,
@@ -82,6 +250,11 @@ static TUNNEL_T               audio_tunnel[3];
 static COMPONENT_T          * list[7];
 static ILCLIENT_T           * client;
 
+static omx_port               video_input,
+                              audio_input,
+                              pcm_input;
+static omx_submitter          video_submit,
+                              pcm_submit;
 static OMX_BUFFERHEADERTYPE * omx_video_buffer,
                             * omx_audio_buffer,
                             * omx_egl_buffer;
@@ -91,13 +264,23 @@ static int32_t                flags     =  0;
 
 // Helpers
 static packet_buffer video_packet_fifo, audio_packet_fifo;
+static demux_scheduler demuxer;
+static int           video_lane = -1,
+                     audio_lane = -1;
+// low and high watermarks of the packet buffers in milliseconds, indexed by stream
+static uint          fifo_watermarks[2][2] = {{ FIFO_DEFAULT_LOW_MS, FIFO_DEFAULT_HIGH_MS },
+                                              { FIFO_DEFAULT_LOW_MS, FIFO_DEFAULT_HIGH_MS }};
 
 // Thread variables
 static pthread_mutex_t flags_mutex        = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t pause_mutex        = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t video_mutex        = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t audio_mutex        = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pcm_mutex          = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t seek_mutex         = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t volume_mutex       = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  pause_condition    = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  seek_condition     = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t buffer_filled_mut  = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  buffer_filled_cond = PTHREAD_COND_INITIALIZER;
 
@@ -114,18 +297,112 @@ static inline OMX_TICKS pts__omx_timestamp (double pts)
 }
 
 /**
- *	Converts AVPacket timestamp to an OMX_TICKS timestamp
+ *	Converts a timestamp in the time base of a stream to an OMX_TICKS timestamp
  */
-static inline OMX_TICKS omx_timestamp (AVPacket p)
+static inline OMX_TICKS stream_timestamp (uint64_t pts, int stream_index)
 {
-	uint64_t pts = p.pts != AV_NOPTS_VALUE ? p.pts : p.dts != AV_NOPTS_VALUE ? p.dts : 0;
-	int      num = fmt_ctx->streams[p.stream_index]->time_base.num;
-	int      den = fmt_ctx->streams[p.stream_index]->time_base.den;
+	int      num = fmt_ctx->streams[stream_index]->time_base.num;
+	int      den = fmt_ctx->streams[stream_index]->time_base.den;
 
 	double timestamp = (double) pts * num / den * AV_TIME_BASE;
 	return pts__omx_timestamp (timestamp);
 }
 
+/**
+ *	Converts AVPacket timestamp to an OMX_TICKS timestamp
+ */
+static inline OMX_TICKS omx_timestamp (AVPacket p)
+{
+	return stream_timestamp (p.pts != AV_NOPTS_VALUE ? p.pts : p.dts != AV_NOPTS_VALUE ? p.dts : 0, p.stream_index);
+}
+
+/**
+ *	Duration of a packet in microseconds, 0 if the demuxer does not know it
+ */
+static inline int64_t packet_duration (AVPacket* p)
+{
+	return p->duration > 0 ? av_rescale_q (p->duration, fmt_ctx->streams[p->stream_index]->time_base, AV_TIME_BASE_Q) : 0;
+}
+
+/**
+ *	Time of a packet in microseconds, AV_NOPTS_VALUE if it has none
+ */
+static inline int64_t packet_time (AVPacket* p)
+{
+	int64_t time = p->pts != AV_NOPTS_VALUE ? p->pts : p->dts;
+	return time != AV_NOPTS_VALUE ? av_rescale_q (time, fmt_ctx->streams[p->stream_index]->time_base, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+}
+
+/**
+ *	A stream got to the target of an accurate seek, account for the time it took once both did.
+ */
+static void end_discarding (int* discarding)
+{
+	int64_t took;
+
+	pthread_mutex_lock (&seek_mutex);
+	*discarding = 0;
+	if (!video_discarding && !audio_discarding && accurate_started)
+	{
+		took = av_gettime_relative () - accurate_started;
+		accurate_started = 0;
+		discard_stats.seeks ++;
+		discard_stats.total_us += took;
+		if (took > discard_stats.max_us)
+			discard_stats.max_us = took;
+		if (took >= ACCURATE_SEEK_MAX_TIME)
+			discard_stats.gave_up ++;
+	}
+	pthread_mutex_unlock (&seek_mutex);
+}
+
+/**
+ *	Whether media up to time, in microseconds, comes before the target of an accurate seek
+ *	and is to be decoded without being played. Past the deadline it is played anyway.
+ */
+static int before_seek_target (int* discarding, int64_t time)
+{
+	if (!*discarding)
+		return 0;
+	if (time != AV_NOPTS_VALUE && time < accurate_target && av_gettime_relative () < accurate_deadline)
+		return 1;
+	end_discarding (discarding);
+	return 0;
+}
+
+/**
+ *	Cut the decoded audio frame starting at *time off at the target of an accurate seek.
+ *  @return int 1 if the whole frame is before the target, 0 if it is to be played from *time
+ */
+static int trim_audio_to_target (int64_t* time)
+{
+	int planar  = av_sample_fmt_is_planar (audio_codec_ctx->sample_fmt);
+	int stride  = av_get_bytes_per_sample (audio_codec_ctx->sample_fmt) * (planar ? 1 : audio_codec_ctx->channels);
+	int planes  = planar ? audio_codec_ctx->channels : 1;
+	int samples, i;
+
+	if (*time == AV_NOPTS_VALUE || audio_codec_ctx->sample_rate <= 0)
+		return before_seek_target (&audio_discarding, AV_NOPTS_VALUE);
+	if (before_seek_target (&audio_discarding, *time + av_rescale (av_frame->nb_samples, AV_TIME_BASE, audio_codec_ctx->sample_rate)))
+	{
+		discard_stats.samples += av_frame->nb_samples;
+		return 1;
+	}
+	// the frame the target is in starts at the sample of the target
+	if (*time < accurate_target)
+	{
+		samples = av_rescale (accurate_target - *time, audio_codec_ctx->sample_rate, AV_TIME_BASE);
+		if (samples > av_frame->nb_samples)
+			samples = av_frame->nb_samples;
+		for (i = 0; i < planes; i ++)
+			av_frame->extended_data[i] += samples * stride;
+		av_frame->nb_samples  -= samples;
+		discard_stats.samples += samples;
+		*time = accurate_target;
+	}
+	return av_frame->nb_samples == 0;
+}
+
 /**
  *  Lock decoding threads, i.e. pause.
  */
@@ -133,6 +410,7 @@ static inline void lock ()
 {
 	pthread_mutex_lock (&video_mutex);
 	pthread_mutex_lock (&audio_mutex);
+	pthread_mutex_lock (&pcm_mutex);
 }
 
 /**
@@ -142,6 +420,7 @@ static inline void unlock ()
 {
 	pthread_mutex_unlock (&video_mutex);
 	pthread_mutex_unlock (&audio_mutex);
+	pthread_mutex_unlock (&pcm_mutex);
 }
 
 /**
@@ -162,248 +441,657 @@ static void fill_egl_texture_buffer (void* data, COMPONENT_T* c)
 }
 
 /**
- *	Decodes the current AVPacket as containing video data.
+ *  Input port operations on an ilclient component.
+ */
+static int ilclient_port_enable (omx_port* port)
+{
+	return ilclient_enable_port_buffers ((COMPONENT_T*) port->component, port->index, NULL, NULL, NULL);
+}
+
+static void ilclient_port_disable (omx_port* port)
+{
+	ilclient_disable_port_buffers ((COMPONENT_T*) port->component, port->index, NULL, NULL, NULL);
+}
+
+static OMX_BUFFERHEADERTYPE* ilclient_port_get_buffer (omx_port* port, int block)
+{
+	return ilclient_get_input_buffer ((COMPONENT_T*) port->component, port->index, block);
+}
+
+static int ilclient_port_empty_buffer (omx_port* port, OMX_BUFFERHEADERTYPE* header)
+{
+	return OMX_EmptyThisBuffer (ILC_GET_HANDLE ((COMPONENT_T*) port->component), header) != OMX_ErrorNone;
+}
+
+static const omx_port_ops ilclient_port =
+{
+	ilclient_port_enable,
+	ilclient_port_disable,
+	ilclient_port_get_buffer,
+	ilclient_port_empty_buffer
+};
+
+/**
+ *	Start the render component once the first frames are on their way.
  *  @return int 0 on success, non-zero on error
  */
-static inline int decode_video_packet ()
+static int start_render ()
 {
-	int packet_size = 0;
-	OMX_TICKS ticks = omx_timestamp (video_packet);
-	// packet data can be larger than decoder buffer
-	while (video_packet.size > 0)
+	// if we are rendering to texture we need to some setup to the egl component
+	if (flags & RENDER_2_TEXTURE)
 	{
-		// feed data to video decoder
-		if ((omx_video_buffer = ilclient_get_input_buffer (video_decode, VIDEO_DECODE_INPUT_PORT, 1)) == NULL)
+		ilclient_change_component_state (egl_render, OMX_StateIdle);
+		// Enable the output port and tell egl_render to use the texture as a buffer
+		//ilclient_enable_port(egl_render, 221); THIS BLOCKS SO CANT BE USED
+		if (OMX_SendCommand (ILC_GET_HANDLE (egl_render), OMX_CommandPortEnable, EGL_RENDER_OUT_PORT, NULL) != OMX_ErrorNone)
+		{
+			fprintf (stderr, "OMX_CommandPortEnable failed.\n");
+			return 1;
+		}
+		if (OMX_UseEGLImage (ILC_GET_HANDLE (egl_render), &omx_egl_buffer, EGL_RENDER_OUT_PORT, NULL, egl_image) != OMX_ErrorNone)
 		{
-			fprintf (stderr, "Error getting buffer to video decoder\n");
+			fprintf (stderr, "OMX_UseEGLImage failed.\n");
 			return 1;
 		}
-		packet_size                  = video_packet.size > omx_video_buffer->nAllocLen ? omx_video_buffer->nAllocLen : video_packet.size;
-		omx_video_buffer->nFilledLen = packet_size;
-		omx_video_buffer->nOffset    = 0;
-		omx_video_buffer->nFlags     = 0;
-		omx_video_buffer->nTimeStamp = ticks;
-		// copy data to buffer
-		memcpy (omx_video_buffer->pBuffer, video_packet.data, packet_size);
-		video_packet.size -= packet_size;
-		video_packet.data += packet_size;
-
-		if (flags & FIRST_VIDEO)
+		// Set egl_render to executing
+		ilclient_change_component_state (egl_render, OMX_StateExecuting);
+		// Request egl_render to write data to the texture buffer
+		if (OMX_FillThisBuffer (ILC_GET_HANDLE (egl_render), omx_egl_buffer) != OMX_ErrorNone)
 		{
-			omx_video_buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
-			UNSET_FLAG (FIRST_VIDEO)
+			fprintf (stderr, "OMX_FillThisBuffer failed for egl buffer.\n");
+			return 1;
 		}
-		else if (omx_video_buffer->nTimeStamp.nLowPart == 0 && omx_video_buffer->nTimeStamp.nHighPart == 0)
-			omx_video_buffer->nFlags |= OMX_BUFFERFLAG_TIME_UNKNOWN;
+	}
+	// if we are not rendering to texture we just need to change the video renderer to excecuting
+	else
+		ilclient_change_component_state (video_render, OMX_StateExecuting);
+	return 0;
+}
+
+/**
+ *	Current media time of the clock in microseconds, AV_NOPTS_VALUE if it can't be read
+ */
+static int64_t media_time ()
+{
+	OMX_TIME_CONFIG_TIMESTAMPTYPE timestamp;
+	OMX_INIT_PARAM (timestamp)
+	timestamp.nPortIndex = CLOCK_VIDEO_PORT;
+	if (OMX_GetConfig (ILC_GET_HANDLE (video_clock), OMX_IndexConfigTimeCurrentMediaTime, &timestamp) != OMX_ErrorNone)
+		return AV_NOPTS_VALUE;
+	return (int64_t) timestamp.nTimestamp.nLowPart | (int64_t) timestamp.nTimestamp.nHighPart << 32;
+}
+
+/**
+ *  Render sink: software decoded frames go to the input port of video_render or egl_render.
+ *  Nothing schedules them against the clock on the way, so they are held back until due here.
+ */
+static int render_sink_open (video_sink* sink, const char* target)
+{
+	OMX_PARAM_PORTDEFINITIONTYPE port;
+	COMPONENT_T* render = list[1];
+
+	OMX_INIT_PARAM (port)
+	port.nPortIndex = flags & RENDER_2_TEXTURE ? EGL_RENDER_INPUT_PORT : VIDEO_RENDER_INPUT_PORT;
+	ilclient_change_component_state (render, OMX_StateIdle);
+	if (OMX_GetParameter (ILC_GET_HANDLE (render), OMX_IndexParamPortDefinition, &port) != OMX_ErrorNone)
+		return 1;
+	render_stride       = (sink->width  + 31) & ~31;
+	render_slice_height = (sink->height + 15) & ~15;
+	port.format.video.nFrameWidth        = sink->width;
+	port.format.video.nFrameHeight       = sink->height;
+	port.format.video.nStride            = render_stride;
+	port.format.video.nSliceHeight       = render_slice_height;
+	port.format.video.eColorFormat       = OMX_COLOR_FormatYUV420PackedPlanar;
+	port.format.video.eCompressionFormat = OMX_VIDEO_CodingUnused;
+	port.nBufferSize                     = render_stride * render_slice_height * 3 / 2;
+	if (OMX_SetParameter (ILC_GET_HANDLE (render), OMX_IndexParamPortDefinition, &port) != OMX_ErrorNone)
+	{
+		fprintf (stderr, "Error setting the frame format on the video renderer\n");
+		return 1;
+	}
+	return open_omx_port (&render_input, &ilclient_port, render, port.nPortIndex);
+}
 
-		// end of frame
-		if (video_packet.size == 0)
-			omx_video_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+static int render_sink_write (video_sink* sink, const AVFrame* frame, int64_t time)
+{
+	OMX_BUFFERHEADERTYPE* header;
+	int64_t now, wait, waited = 0;
 
-		// Check for changes in port settings
-		if ((~flags & PORT_SETTINGS_CHANGED) && (
-		    (packet_size >  0 && ilclient_remove_event   (video_decode, OMX_EventPortSettingsChanged, VIDEO_DECODE_OUT_PORT, 0, 0, 1) == 0 ) ||
-		    (packet_size == 0 && ilclient_wait_for_event (video_decode, OMX_EventPortSettingsChanged, VIDEO_DECODE_OUT_PORT, 0, 0, 1, ILCLIENT_EVENT_ERROR | ILCLIENT_PARAMETER_CHANGED, 10000) == 0)))
+	if (~flags & PORT_SETTINGS_CHANGED)
+	{
+		SET_FLAG (PORT_SETTINGS_CHANGED)
+		if (start_render () != 0)
+			return 1;
+	}
+	// wait until the frame is due, drop it if it is late
+	if (time != AV_NOPTS_VALUE)
+	{
+		while (!(flags & (STOPPED | SEEKING)) && (now = media_time ()) != AV_NOPTS_VALUE && now < time && waited < FRAME_MAX_WAIT)
 		{
-			SET_FLAG (PORT_SETTINGS_CHANGED)
-			// setup tunnel between video decoder and scheduler
-			if (ilclient_setup_tunnel (video_tunnel, 0, 0) != 0)
-			{
-				fprintf (stderr, "Error setting up tunnel between video decoder and scheduler\n");
-				return 1;
-			}
-			ilclient_change_component_state (video_scheduler, OMX_StateExecuting);
-			// setup tunnel between video scheduler and render
-			if (ilclient_setup_tunnel (video_tunnel + 1, 0, 1000) != 0)
-			{
-				fprintf (stderr, "Error setting up tunnel between video scheduler and render\n");
-				return 1;
-			}
-			// if we are rendering to texture we need to some setup to the egl component
-			if (flags & RENDER_2_TEXTURE)
-			{
-				ilclient_change_component_state (egl_render, OMX_StateIdle);
-				// Enable the output port and tell egl_render to use the texture as a buffer
-				//ilclient_enable_port(egl_render, 221); THIS BLOCKS SO CANT BE USED
-				if (OMX_SendCommand (ILC_GET_HANDLE (egl_render), OMX_CommandPortEnable, EGL_RENDER_OUT_PORT, NULL) != OMX_ErrorNone)
-				{
-					fprintf (stderr, "OMX_CommandPortEnable failed.\n");
-					return 1;
-				}
-				if (OMX_UseEGLImage (ILC_GET_HANDLE (egl_render), &omx_egl_buffer, EGL_RENDER_OUT_PORT, NULL, egl_image) != OMX_ErrorNone)
-				{
-					fprintf (stderr, "OMX_UseEGLImage failed.\n");
-					return 1;
-				}
-				// Set egl_render to executing
-				ilclient_change_component_state (egl_render, OMX_StateExecuting);
-				// Request egl_render to write data to the texture buffer
-				if (OMX_FillThisBuffer (ILC_GET_HANDLE (egl_render), omx_egl_buffer) != OMX_ErrorNone)
-				{
-					fprintf (stderr, "OMX_FillThisBuffer failed for egl buffer.\n");
-					return 1;
-				}
-			}
-			// if we are not rendering to texture we just need to change the video renderer to excecuting
-			else
-				ilclient_change_component_state (video_render, OMX_StateExecuting);
+			wait = time - now < FRAME_WAIT_STEP ? time - now : FRAME_WAIT_STEP;
+			usleep (wait);
+			waited += wait;
+		}
+		if ((now = media_time ()) != AV_NOPTS_VALUE && now - time > FRAME_MAX_LATENESS)
+		{
+			sink->dropped ++;
+			return 0;
+		}
+	}
+	if ((header = get_omx_buffer (&render_input, 1)) == NULL)
+	{
+		fprintf (stderr, "Error getting buffer to video renderer\n");
+		return 1;
+	}
+	if (copy_video_frame (header->pBuffer, render_stride, render_slice_height, frame) != 0)
+	{
+		fprintf (stderr, "Pixel format not supported by the %s sink\n", sink->ops->name);
+		return 1;
+	}
+	header->nOffset    = 0;
+	header->nFilledLen = render_stride * render_slice_height * 3 / 2;
+	header->nFlags     = OMX_BUFFERFLAG_ENDOFFRAME;
+	header->nTimeStamp = pts__omx_timestamp (time != AV_NOPTS_VALUE ? time : 0);
+	if (empty_omx_buffer (&render_input, header) != 0)
+	{
+		fprintf (stderr, "Error emptying video render buffer\n");
+		return 1;
+	}
+	sink->frames ++;
+	return 0;
+}
+
+static void render_sink_close (video_sink* sink)
+{
+	close_omx_port (&render_input);
+}
+
+static const video_sink_ops render_video_sink =
+{
+	"render",
+	render_sink_open,
+	render_sink_write,
+	render_sink_close
+};
+
+/**
+ *	Convert the current video packet to Annex-B, leaving the result in video_data.
+ *	A keyframe without its own parameter sets is preceded by those of the stream,
+ *	so decoding can start at any of them, e.g. after a seek.
+ *  @param OMX_U32 * buffer_flags
+ *		of the packet, STARTTIME is taken by the parameter sets
+ *  @return int 0 on success, negative if the packet is dropped, positive on error
+ */
+static int convert_video_packet (OMX_U32* buffer_flags)
+{
+	int parameter_sets;
+
+	if ((video_size = annexb_size (&video_annexb, video_packet.data, video_packet.size, &parameter_sets)) < 0)
+	{
+		fprintf (stderr, "Dropping video packet with malformed NAL units\n");
+		return -1;
+	}
+	// a 4 byte prefix is as long as a start code, so the packet is converted where it is
+	if (video_annexb.length_size == 4 && video_packet.buf && av_buffer_is_writable (video_packet.buf))
+		video_data = video_packet.data;
+	else if ((video_data = scratch_alloc (&video_scratch, video_size)) == NULL)
+	{
+		fprintf (stderr, "Out of memory converting video packet\n");
+		return 1;
+	}
+	annexb_convert (&video_annexb, video_data, video_packet.data, video_packet.size);
+
+	if ((video_packet.flags & AV_PKT_FLAG_KEY) && !parameter_sets && video_annexb.parameter_sets_size > 0)
+	{
+		if (submit_omx_data (&video_submit, video_annexb.parameter_sets, video_annexb.parameter_sets_size, omx_timestamp (video_packet),
+		                     *buffer_flags & ~OMX_BUFFERFLAG_ENDOFFRAME) != 0)
+		{
+			fprintf (stderr, "Error sending parameter sets to video decoder\n");
+			return 1;
+		}
+		*buffer_flags &= ~OMX_BUFFERFLAG_STARTTIME;
+		video_annexb.injected ++;
+	}
+	return 0;
+}
+
+/**
+ *	Decodes the current AVPacket as containing video data.
+ *  @return int 0 on success, non-zero on error
+ */
+static inline int decode_video_packet ()
+{
+	OMX_TICKS ticks = omx_timestamp (video_packet);
+	OMX_U32 buffer_flags = OMX_BUFFERFLAG_ENDOFFRAME;
+	int ret;
+
+	if (video_packet.size <= 0)
+		return 0;
+	video_data = video_packet.data;
+	video_size = video_packet.size;
+
+	// before the target of an accurate seek frames are decoded, to be referred to, but not shown
+	if (before_seek_target (&video_discarding, packet_time (&video_packet)))
+	{
+		buffer_flags |= OMX_BUFFERFLAG_DECODEONLY;
+		discard_stats.frames ++;
+	}
+	else if (flags & FIRST_VIDEO)
+	{
+		buffer_flags |= OMX_BUFFERFLAG_STARTTIME;
+		UNSET_FLAG (FIRST_VIDEO)
+	}
+	else if (ticks.nLowPart == 0 && ticks.nHighPart == 0)
+		buffer_flags |= OMX_BUFFERFLAG_TIME_UNKNOWN;
+
+	// Check for changes in port settings
+	if ((~flags & PORT_SETTINGS_CHANGED) &&
+	    ilclient_remove_event (video_decode, OMX_EventPortSettingsChanged, VIDEO_DECODE_OUT_PORT, 0, 0, 1) == 0)
+	{
+		SET_FLAG (PORT_SETTINGS_CHANGED)
+		// setup tunnel between video decoder and scheduler
+		if (ilclient_setup_tunnel (video_tunnel, 0, 0) != 0)
+		{
+			fprintf (stderr, "Error setting up tunnel between video decoder and scheduler\n");
+			return 1;
 		}
-		// empty buffer
-		if (OMX_EmptyThisBuffer (ILC_GET_HANDLE (video_decode), omx_video_buffer) != OMX_ErrorNone)
+		ilclient_change_component_state (video_scheduler, OMX_StateExecuting);
+		// setup tunnel between video scheduler and render
+		if (ilclient_setup_tunnel (video_tunnel + 1, 0, 1000) != 0)
 		{
-			fprintf (stderr, "Error emptying video decode buffer\n");
+			fprintf (stderr, "Error setting up tunnel between video scheduler and render\n");
 			return 1;
 		}
+		if (start_render () != 0)
+			return 1;
 	}
+	// length prefixed NAL units are turned into Annex-B
+	if (video_annexb.length_size && (ret = convert_video_packet (&buffer_flags)) != 0)
+		return ret;
+	// packet data can be larger than decoder buffer, or share one with others
+	if (submit_omx_data (&video_submit, video_data, video_size, ticks, buffer_flags) != 0)
+	{
+		fprintf (stderr, "Error emptying video decode buffer\n");
+		return 1;
+	}
+	// copies were made into the decoder buffers
+	reset_scratch_arena (&video_scratch);
+	video_packet.size = 0;
 	return 0;
 }
 
+/**
+ *	The first frame after a seek is on its way, account for the time it took.
+ */
+static void seek_reached_frame ()
+{
+	int64_t started = __atomic_exchange_n (&seek_started, 0, __ATOMIC_ACQ_REL);
+	int64_t latency;
+
+	if (!started)
+		return;
+	latency = av_gettime_relative () - started;
+	pthread_mutex_lock (&seek_mutex);
+	seek_stats.seeks ++;
+	seek_stats.total_us += latency;
+	if (latency > seek_stats.max_us)
+		seek_stats.max_us = latency;
+	pthread_mutex_unlock (&seek_mutex);
+}
+
+/**
+ *	Called by a decoding thread once it has decoded everything read up to the end of the
+ *	file, or when it ends. Waits for a seek to rewind the file or for playback to end.
+ *  @return int 1 to go on decoding after a seek, 0 to end the thread
+ */
+static int wait_for_rewind (int drained)
+{
+	int rewound;
+
+	pthread_mutex_lock (&seek_mutex);
+	rewound = decoder_at_end_of_file (&end_of_file, drained);
+	pthread_mutex_unlock (&seek_mutex);
+	return rewound;
+}
+
+/**
+ *	Get the frames a threaded software decoder still holds at the end of the file.
+ */
+static void drain_video_decoder ()
+{
+	if (video_route != ROUTE_SOFTWARE_DECODE)
+		return;
+	// once a seek rewinds the file the decoder is flushed instead, under the same lock
+	pthread_mutex_lock (&video_mutex);
+	if (__atomic_load_n (&end_of_file.end_of_file, __ATOMIC_ACQUIRE))
+		sw_video_decode (&sw_video, NULL);
+	pthread_mutex_unlock (&video_mutex);
+}
+
 /**
  *  Thread for decoding video packets.
- *  Polls the video packet buffer for new packets to decode and
+ *  Waits on the video packet buffer for new packets to decode and
  *  present on screen.
  */
 static void video_decoding_thread ()
 {
 	uint8_t *d;
-	int ret;
-	while (~flags & STOPPED && (~flags & DONE_READING || video_packet_fifo.n_packets))
+	int ret, drained = 0;
+	int64_t cpu;
+	while (~flags & STOPPED)
 	{
 		// check pause
 		if (flags & PAUSED)
 		{
 			WAIT_WHILE_PAUSED
 		}
-		// get packet
+		// get packet, sleeps until the demuxer has pushed one
 		pthread_mutex_lock (&video_mutex);
-		if ((ret = pop_packet (&video_packet_fifo, &video_packet)) != 0)
+		if (pop_packet (&video_packet_fifo, &video_packet) != 0)
+		{
+			// hand over what is held back before sleeping
+			flush_omx_submitter (&video_submit);
+			ret = pop_packet_wait (&video_packet_fifo, &video_packet, -1);
+		}
+		else
+			ret = 0;
+		if (ret != 0)
 		{
 			pthread_mutex_unlock (&video_mutex);
-			usleep (FIFO_SLEEPY_TIME);
+			// demuxing is done and the buffer is drained, unless a seek rewinds the file
+			if (ret == EMPTY_BUFFER)
+			{
+				drain_video_decoder ();
+				if (wait_for_rewind (1))
+					continue;
+				drained = 1;
+				break;
+			}
 			continue;
 		}
 		// decode
 		d = video_packet.data;
-		ret = decode_video_packet ();
+		cpu = thread_cpu_time ();
+		ret = video_route == ROUTE_SOFTWARE_DECODE ? sw_video_decode (&sw_video, &video_packet) : decode_video_packet ();
+		add_codec_route_cost (video_codec_route, video_route, thread_cpu_time () - cpu, packet_duration (&video_packet));
 		video_packet.data = d;
 		av_packet_unref (&video_packet);
+		// the software decoder drops frames before the target of an accurate seek itself
+		if (video_discarding && video_route == ROUTE_SOFTWARE_DECODE)
+		{
+			if (av_gettime_relative () >= accurate_deadline)
+				sw_video.discard_until = AV_NOPTS_VALUE;
+			if (sw_video.discard_until == AV_NOPTS_VALUE)
+				end_discarding (&video_discarding);
+		}
+		if (seek_started && (video_route == ROUTE_SOFTWARE_DECODE ? video_out.frames > seek_frames : (~flags & FIRST_VIDEO)))
+			seek_reached_frame ();
 		pthread_mutex_unlock (&video_mutex);
-		if (ret != 0)
+		// a packet the decoder refused is skipped
+		if (ret < 0)
+			fprintf (stderr, "Error decoding video packet\n");
+		else if (ret > 0)
 		{
 			fprintf (stderr, "Error while decoding, ending thread\n");
 			break;
 		}
 	}
+	// the demuxer no longer waits for this thread
+	if (!drained)
+		wait_for_rewind (0);
 	printf ("stopping video decoding thread\n");
 }
 
 /**
-	Decode audio packet (using FFMPEG) and send it to hardware for rendering
- *	return int 0 on success, non-zero on failure
+ *	Ramp the gain of audio decoded on the CPU to the volume asked for, over ms or, when
+ *	negative, over the ramp asked for with it.
  */
-static inline int decode_audio_packet ()
+static void update_gain (int ms)
 {
-	int got_frame = 0, ret = 0, data_size = 0;
-	uint8_t *audio_data, *audio_data_p = NULL;
-	OMX_TICKS ticks = omx_timestamp (audio_packet);
+	pthread_mutex_lock (&volume_mutex);
+	ramp_gain (&audio_gain, muted ? 0 : volume, ms < 0 ? volume_ramp_ms : (uint) ms);
+	pthread_mutex_unlock (&volume_mutex);
+}
 
-	// some audio decoders only decode part of the data
-	while (audio_packet.size > 0)
+/**
+ *	Ask for a new gain from any thread, the thread submitting PCM ramps to it.
+ *	A fade in asked for before the fade out it follows was carried out cancels it.
+ */
+static void request_gain (int request)
+{
+	__atomic_store_n (&gain_request, request, __ATOMIC_RELEASE);
+}
+
+/**
+ *	Fade out audio decoded on the CPU and wait until the clock has played the fade, before
+ *	it is stopped or the renderer flushed. Nothing is waited for without audio under way,
+ *	and at most FADE_MAX_WAIT when the thread submitting PCM has nothing more to hand over.
+ */
+static void fade_out ()
+{
+	int64_t end, now;
+	int waited = 0;
+
+	if (!audio_mix || (flags & (PAUSED | TRICK_PLAY | FIRST_AUDIO)))
+		return;
+	__atomic_store_n (&fade_out_end, AV_NOPTS_VALUE, __ATOMIC_RELAXED);
+	request_gain (GAIN_FADE_OUT);
+	while (((end = __atomic_load_n (&fade_out_end, __ATOMIC_ACQUIRE)) == AV_NOPTS_VALUE ||
+	        ((now = media_time ()) != AV_NOPTS_VALUE && now < end)) && waited < FADE_MAX_WAIT)
+	{
+		usleep (FADE_WAIT_STEP);
+		waited += FADE_WAIT_STEP;
+	}
+}
+
+/**
+ *	Scale PCM to the volume on its way to the renderer, by the thread submitting it: after
+ *	the ring when decoding ahead, so a new volume or a fade is not held up by what it holds.
+ *	What the renderer holds already is out of reach, it plays at the gain it was given.
+ *  @param int64_t time
+ *		media time of the first sample, in microseconds
+ */
+static void scale_pcm (uint8_t* data, uint size, int64_t time)
+{
+	switch (__atomic_exchange_n (&gain_request, GAIN_KEEP, __ATOMIC_ACQUIRE))
+	{
+		case GAIN_VOLUME:
+			update_gain (-1);
+		break;
+
+		case GAIN_FADE_OUT:
+			ramp_gain (&audio_gain, 0, FADE_MS);
+			// stretched audio covers more or less media time than it takes to play
+			__atomic_store_n (&fade_out_end, time + ((int64_t) FADE_MS * 1000 * __atomic_load_n (&tempo, __ATOMIC_RELAXED) >> 16),
+			                  __ATOMIC_RELEASE);
+		break;
+
+		case GAIN_FADE_IN:
+			update_gain (FADE_MS);
+		break;
+	}
+	apply_gain (&audio_gain, (int16_t *) data, size / (audio_gain.channels * sizeof (int16_t)));
+}
+
+/**
+ *	Convert the decoded frame, stretch it to the tempo and resample it to the rate of the
+ *	renderer. Samples out of both keep the media time they were taken from, so stretched
+ *	audio agrees with the clock running at the tempo.
+ *  @return int bytes of samples to play, 0 if none are ready yet, negative on error
+ */
+static int process_audio_frame (const int16_t** processed, OMX_TICKS* ticks, OMX_U32* buffer_flags)
+{
+	int out_channels = audio_mix->out_channels;
+	int64_t time = (*buffer_flags & OMX_BUFFERFLAG_TIME_UNKNOWN) ? AV_NOPTS_VALUE : (int64_t) ticks->nLowPart | (int64_t) ticks->nHighPart << 32;
+	int16_t* converted;
+	int samples = av_frame->nb_samples;
+
+	if ((converted = scratch_alloc (&audio_scratch, samples * out_channels * sizeof (int16_t))) == NULL)
+	{
+		fprintf (stderr, "Could not allocate audio conversion buffer\n");
+		return -1;
+	}
+	if (pcm_mix_to_s16 (converted, av_frame->extended_data, audio_codec_ctx->sample_fmt, audio_mix, samples) < 0)
+	{
+		fprintf (stderr, "Unsupported audio sample format\n");
+		return -1;
+	}
+	audio_samples_decoded += samples;
+	*processed = converted;
+	// the start time goes with the first samples played
+	held_flags |= *buffer_flags & OMX_BUFFERFLAG_STARTTIME;
+
+	if (__atomic_load_n (&tempo, __ATOMIC_RELAXED) != 1 << 16)
 	{
-		if ((ret = avcodec_decode_audio4 (audio_codec_ctx, av_frame, &got_frame, &audio_packet)) < 0)
+		set_time_stretch_tempo (&audio_stretch, (double) __atomic_load_n (&tempo, __ATOMIC_RELAXED) / (1 << 16));
+		if ((samples = time_stretch (&audio_stretch, *processed, samples, time, processed, &time)) < 0)
 		{
-			fprintf (stderr, "Error decoding audio packet \n");
-			return ret; // we return that it's alright to continue
+			fprintf (stderr, "Could not allocate time stretching buffers\n");
+			return -1;
 		}
-		audio_packet.size -= ret;
-		audio_packet.data += ret;
+	}
+	// back at normal tempo the little held back for stretching is dropped
+	else if (audio_stretch.input_samples > 0)
+		reset_time_stretcher (&audio_stretch);
 
-		if (got_frame)
-		{
-			if ((data_size = av_samples_get_buffer_size (NULL,
-                                                         audio_codec_ctx->channels,
-                                                         av_frame->nb_samples,
-                                                         audio_codec_ctx->sample_fmt,
-                                                         1)) <= 0)
-			{
-				fprintf (stderr, "Error getting samples buffer size\n");
-				break;
-			}
-			int bps = av_get_bytes_per_sample (audio_codec_ctx->sample_fmt);
+	if (samples > 0 && resampling && (samples = resample (&audio_resampler, *processed, samples, time, processed, &time)) < 0)
+	{
+		fprintf (stderr, "Could not allocate resampling buffers\n");
+		return -1;
+	}
+	if (samples == 0)
+		return 0;
 
-			// interleave data if it is planar
-			if (av_sample_fmt_is_planar (audio_codec_ctx->sample_fmt))
-			{
-				int i, ch;
-				audio_data = (uint8_t *) malloc (data_size);
-				audio_data_p = audio_data;
-				for (i = 0; i < av_frame->nb_samples; i ++)
-					for (ch = 0; ch < audio_codec_ctx->channels; ch ++, audio_data_p += bps)
-						memcpy (audio_data_p, av_frame->data[ch] + i * bps, bps);
-				audio_data_p = audio_data;
-			}
-			else
-				audio_data = av_frame->data[0];
+	*buffer_flags = (*buffer_flags & ~(OMX_BUFFERFLAG_TIME_UNKNOWN | OMX_BUFFERFLAG_STARTTIME)) | held_flags;
+	if (time == AV_NOPTS_VALUE)
+		*buffer_flags |= OMX_BUFFERFLAG_TIME_UNKNOWN;
+	else
+		*ticks = pts__omx_timestamp (time);
+	held_flags = 0;
+	return samples * out_channels * sizeof (int16_t);
+}
 
-			// if 32-bit we need to resample to 16-bit
-			// (we are assuming it's floating point in this case)
-			if (bps > 2)
-			{
-				uint8_t *tmp = NULL;
-				flt_to_s16 (audio_data, &tmp, data_size);
+/**
+ *	Convert a decoded frame and send it to hardware for rendering, or queue it in the
+ *	PCM ring when decoding ahead.
+ *	return int 0 on success, non-zero on failure
+ */
+static inline int output_audio_frame (OMX_TICKS ticks, OMX_U32 buffer_flags)
+{
+	int out_channels = audio_mix->out_channels;
+	int data_size    = av_frame->nb_samples * out_channels * sizeof (int16_t);
+	const int16_t* processed = NULL;
+	uint8_t *audio_data;
+
+	// at another tempo or rate the frame goes through the stretcher and resampler first,
+	// and what comes out of them is played instead
+	if (resampling || __atomic_load_n (&tempo, __ATOMIC_RELAXED) != 1 << 16 || audio_stretch.input_samples > 0)
+	{
+		if ((data_size = process_audio_frame (&processed, &ticks, &buffer_flags)) <= 0)
+			return data_size;
+	}
+
+	// convert to 16-bit, mixed into the layout the renderer was set up with and interleaved,
+	// straight into the ring when decoding ahead of the renderer
+	if (flags & DECODE_AHEAD)
+	{
+		if ((audio_data = pcm_ring_reserve (&audio_ring, data_size, -1)) == NULL)
+		{
+			// seeking or stopping, the frame is of no use
+			if (audio_ring.cancelled)
+				return 0;
+			fprintf (stderr, "Audio frame does not fit in the PCM ring\n");
+			return 1;
+		}
+	}
+	else if (processed)
+		audio_data = (uint8_t*) processed;
+	else if ((audio_data = scratch_alloc (&audio_scratch, data_size)) == NULL)
+	{
+		fprintf (stderr, "Could not allocate audio conversion buffer\n");
+		return 1;
+	}
+	if (processed)
+	{
+		if (audio_data != (uint8_t*) processed)
+			memcpy (audio_data, processed, data_size);
+	}
+	else if (pcm_mix_to_s16 ((int16_t *) audio_data, av_frame->extended_data, audio_codec_ctx->sample_fmt, audio_mix, av_frame->nb_samples) < 0)
+	{
+		fprintf (stderr, "Unsupported audio sample format\n");
+		return -1;
+	}
+	else
+		audio_samples_decoded += av_frame->nb_samples;
 
-				if (audio_data_p)
-					free (audio_data_p);
+	if (flags & DECODE_AHEAD)
+	{
+		// the submitting thread takes it from here, and scales it
+		pcm_ring_commit (&audio_ring, (int64_t) ticks.nLowPart | (int64_t) ticks.nHighPart << 32, buffer_flags);
+		return 0;
+	}
+	// at the volume asked for, ramping to a new one sample by sample
+	scale_pcm (audio_data, data_size, (int64_t) ticks.nLowPart | (int64_t) ticks.nHighPart << 32);
+	// send frame data to audio render, frames are packed together in its buffers
+	if (submit_omx_data (&pcm_submit, audio_data, data_size, ticks, buffer_flags) != 0)
+	{
+		fprintf (stderr, "Error emptying audio render buffer\n");
+		return 1; // errors with hardware, stop trying to render audio
+	}
+	return 0;
+}
 
-				data_size /= 2;
-				audio_data = audio_data_p = tmp;
-			}
+/**
+	Decode audio packet (using FFMPEG) and send every frame it yields to hardware for rendering.
+ *	A NULL packet drains the frames the decoder still holds at the end of the stream.
+ *	return int 0 on success, non-zero on failure
+ */
+static inline int decode_audio_packet (AVPacket* packet)
+{
+	int ret;
+	int64_t pts;
+	OMX_TICKS ticks;
+	OMX_U32 buffer_flags;
 
-			// send frame data to audio render
-			while (data_size > 0)
-			{
-				if ((omx_audio_buffer = ilclient_get_input_buffer (audio_render, AUDIO_RENDER_INPUT_PORT, 1)) == NULL)
-				{
-					fprintf ( stderr, "Error getting buffer to audio decoder\n" );
-					return 1; // errors with hardware, stop trying to render audio
-				}
-				omx_audio_buffer->nFilledLen = data_size > omx_audio_buffer->nAllocLen ? omx_audio_buffer->nAllocLen : data_size;
-				omx_audio_buffer->nOffset    = 0;
-				omx_audio_buffer->nFlags	 = 0;
-				// copy data
-				memcpy (omx_audio_buffer->pBuffer, audio_data, omx_audio_buffer->nFilledLen);
-				audio_data += omx_audio_buffer->nFilledLen;
-				data_size  -= omx_audio_buffer->nFilledLen;
-
-				// first audio packet of stream
-				if (flags & FIRST_AUDIO)
-				{
-					omx_audio_buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
-					UNSET_FLAG (FIRST_AUDIO)
-				}
-				else
-				{
-					omx_audio_buffer->nTimeStamp = ticks;
-					if (omx_audio_buffer->nTimeStamp.nLowPart == 0 && omx_audio_buffer->nTimeStamp.nHighPart == 0)
-						omx_audio_buffer->nFlags |= OMX_BUFFERFLAG_TIME_UNKNOWN;
-				}
-				// last packet of frame
-				if (data_size == 0 && audio_packet.size == 0)
-					omx_audio_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
-				// empty the buffer for render
-				if (OMX_EmptyThisBuffer (ILC_GET_HANDLE (audio_render), omx_audio_buffer) != OMX_ErrorNone)
-				{
-					fprintf (stderr, "Error emptying audio render buffer\n");
-					return 1; // errors with hardware, stop trying to render audio
-				}
-			}
+	if ((ret = avcodec_send_packet (audio_codec_ctx, packet)) < 0 && ret != AVERROR_EOF)
+	{
+		fprintf (stderr, "Error decoding audio packet \n");
+		return ret; // we return that it's alright to continue
+	}
+
+	// one round of conversion memory for all frames of the packet
+	reset_scratch_arena (&audio_scratch);
+	while ((ret = avcodec_receive_frame (audio_codec_ctx, av_frame)) == 0)
+	{
+		// a threaded decoder hands frames out later, time them by the frame and not the packet
+		buffer_flags = OMX_BUFFERFLAG_ENDOFFRAME;
+		pts          = av_frame_get_best_effort_timestamp (av_frame);
+		ticks        = stream_timestamp (pts != AV_NOPTS_VALUE ? pts : 0, audio_stream_idx);
+		// up to the target of an accurate seek audio is cut off, to the sample
+		if (audio_discarding)
+		{
+			int64_t time = pts != AV_NOPTS_VALUE ? av_rescale_q (pts, audio_stream->time_base, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+			if (trim_audio_to_target (&time))
+				continue;
+			if (time != AV_NOPTS_VALUE)
+				ticks = pts__omx_timestamp (time);
 		}
+		// first audio packet of stream
+		if (flags & FIRST_AUDIO)
+		{
+			buffer_flags |= OMX_BUFFERFLAG_STARTTIME;
+			UNSET_FLAG (FIRST_AUDIO)
+		}
+		else if (pts == AV_NOPTS_VALUE)
+			buffer_flags |= OMX_BUFFERFLAG_TIME_UNKNOWN;
+
+		if ((ret = output_audio_frame (ticks, buffer_flags)) != 0)
+			break;
 	}
-	if (audio_data_p)
-		free (audio_data_p);
-	audio_packet.size = 0;
-	audio_packet.data = NULL;
-	return 0;
+	av_frame_unref (av_frame);
+	if (ret == AVERROR (EAGAIN) || ret == AVERROR_EOF)
+		return 0;
+	return ret;
 }
 
 
@@ -413,19 +1101,17 @@ static int hardwaredecode_audio_packet ()
 	while (audio_packet.size > 0)
 	{
 		// get buffer handler to audio decoder
-		if ((omx_audio_buffer = ilclient_get_input_buffer (audio_decode, 120, 1)) == NULL)
+		if ((omx_audio_buffer = get_omx_buffer (&audio_input, 1)) == NULL)
 		{
 			fprintf (stderr, "Error getting buffer to audio decoder\n");
 			return 1;
 		}
 		// copy data to the buffer
-		omx_audio_buffer->nFilledLen = audio_packet.size < omx_audio_buffer->nAllocLen ? audio_packet.size : omx_audio_buffer->nAllocLen;
-		memcpy (omx_audio_buffer->pBuffer, audio_packet.data, omx_audio_buffer->nFilledLen);
+		fill_omx_buffer (&audio_input, omx_audio_buffer, audio_packet.data, audio_packet.size);
 
 		audio_packet.size -= omx_audio_buffer->nFilledLen;
 		audio_packet.data += omx_audio_buffer->nFilledLen;
 
-		omx_audio_buffer->nOffset = 0;
 		omx_audio_buffer->nFlags  = OMX_BUFFERFLAG_TIME_UNKNOWN;
 
 		// first audio packet
@@ -437,7 +1123,7 @@ static int hardwaredecode_audio_packet ()
 		ticks.nLowPart  = audio_packet.pts;
 		ticks.nHighPart = audio_packet.pts >> 32;
 		omx_audio_buffer->nTimeStamp = ticks;
-		if (OMX_EmptyThisBuffer (ILC_GET_HANDLE (audio_decode), omx_audio_buffer) != OMX_ErrorNone)
+		if (empty_omx_buffer (&audio_input, omx_audio_buffer) != 0)
 		{
 			fprintf (stderr, "Error emptying audio render buffer\n");
 			return 1; // errors with hardware, stop trying to render audio
@@ -446,52 +1132,225 @@ static int hardwaredecode_audio_packet ()
 	return 0;
 }
 
+/**
+ *	Pack compressed audio into IEC 61937 bursts for the receiver to decode, and send
+ *	them to audio render as they fill up.
+ *	return int 0 on success, non-zero on failure
+ */
+static int passthrough_audio_packet ()
+{
+	OMX_U32 buffer_flags = OMX_BUFFERFLAG_ENDOFFRAME;
+	int ret;
+
+	// a burst is timed by its first frame
+	if (audio_packer.frames == 0)
+		burst_ticks = omx_timestamp (audio_packet);
+	if ((ret = iec61937_pack (&audio_packer, audio_packet.data, audio_packet.size)) < 0)
+	{
+		fprintf (stderr, "Could not pack audio frame for passthrough\n");
+		return ret; // we return that it's alright to continue
+	}
+	if (ret == 0)
+		return 0;
+
+	// first audio packet of stream
+	if (flags & FIRST_AUDIO)
+	{
+		buffer_flags |= OMX_BUFFERFLAG_STARTTIME;
+		UNSET_FLAG (FIRST_AUDIO)
+	}
+	if (submit_omx_data (&pcm_submit, audio_packer.burst, audio_packer.burst_size, burst_ticks, buffer_flags) != 0)
+	{
+		fprintf (stderr, "Error emptying audio render buffer\n");
+		return 1; // errors with hardware, stop trying to render audio
+	}
+	return 0;
+}
+
+/**
+ *	Get the frames a threaded decoder still holds at the end of the file.
+ */
+static void drain_audio_decoder ()
+{
+	if (flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH))
+		return;
+	// once a seek rewinds the file the decoder is flushed instead, under the same lock
+	pthread_mutex_lock (&audio_mutex);
+	if (__atomic_load_n (&end_of_file.end_of_file, __ATOMIC_ACQUIRE))
+	{
+		decode_audio_packet (NULL);
+		if (~flags & DECODE_AHEAD)
+			flush_omx_submitter (&pcm_submit);
+	}
+	pthread_mutex_unlock (&audio_mutex);
+}
+
 /**
  *  Audio decoding thread.
- *  Polls the audio packet buffer for new packets to decode
+ *  Waits on the audio packet buffer for new packets to decode
  *  and send for playback.
  */
 static void audio_decoding_thread ()
 {
 	// AVPacket tmp_pack;
 	uint8_t *d;
-	int ret;
+	int ret, drained = 0;
+	int64_t cpu;
 	while (~flags & STOPPED)
 	{
-		// check if we are done demuxing
-		if (flags & DONE_READING && !audio_packet_fifo.n_packets)
-			break;
 		// paused
 		if (flags & PAUSED)
 		{
 			WAIT_WHILE_PAUSED
 		}
-		// pop a audio packet from the decoding queue
+		// pop a audio packet from the decoding queue, sleeps until there is one
 		pthread_mutex_lock (&audio_mutex);
-		if ((ret = pop_packet (&audio_packet_fifo, &audio_packet)) != 0)
+		if (pop_packet (&audio_packet_fifo, &audio_packet) != 0)
+		{
+			// hand over what is held back before sleeping
+			if (~flags & DECODE_AHEAD)
+				flush_omx_submitter (&pcm_submit);
+			ret = pop_packet_wait (&audio_packet_fifo, &audio_packet, -1);
+		}
+		else
+			ret = 0;
+		if (ret != 0)
 		{
 			pthread_mutex_unlock (&audio_mutex);
-			usleep (FIFO_SLEEPY_TIME);
+			// demuxing is done and the buffer is drained, unless a seek rewinds the file
+			if (ret == EMPTY_BUFFER)
+			{
+				drain_audio_decoder ();
+				if (wait_for_rewind (1))
+					continue;
+				drained = 1;
+				break;
+			}
 			continue;
 		}
 		// send data for decoding
 		d = audio_packet.data;
-		ret = flags & HARDWARE_DECODE_AUDIO ? hardwaredecode_audio_packet () : decode_audio_packet () ;
+		cpu = thread_cpu_time ();
+		// compressed audio can't be cut, packets ending before the target of an accurate seek are dropped
+		if (audio_discarding && (flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)) &&
+		    before_seek_target (&audio_discarding, packet_time (&audio_packet) + packet_duration (&audio_packet)))
+			ret = 0;
+		else
+			ret = flags & HARDWARE_DECODE_AUDIO ? hardwaredecode_audio_packet () :
+			      flags & PASSTHROUGH           ? passthrough_audio_packet ()   : decode_audio_packet (&audio_packet) ;
+		add_codec_route_cost (audio_codec_route, audio_route, thread_cpu_time () - cpu, packet_duration (&audio_packet));
 		audio_packet.data = d;
+		// without video the first audio after a seek is its first frame
+		if (seek_started && video_stream_idx < 0 && (~flags & FIRST_AUDIO))
+			seek_reached_frame ();
 		pthread_mutex_unlock (&audio_mutex);
 
-		// deallocate packet
-		if (ret == 0)
+		// deallocate packet, a packet the decoder refused is skipped
+		if (ret <= 0)
 			av_packet_unref (&audio_packet);
-		else if (ret > 0)
+		else
 		{
 			fprintf (stderr, "Error while decoding audio packet, ending thread\n");
 			break;
 		}
 	}
+	// the demuxer no longer waits for this thread
+	if (!drained)
+		wait_for_rewind (0);
+	// let the submitting thread play out what is left
+	if (flags & DECODE_AHEAD)
+		close_pcm_ring (&audio_ring);
 	printf ("stopping audio decoding thread\n");
 }
 
+/**
+ *  PCM submitting thread.
+ *  Feeds audio render from the ring the audio decoding thread fills, so a slow
+ *  buffer return from the renderer does not hold up decoding, and the other way round.
+ */
+static void pcm_submitting_thread ()
+{
+	pcm_frame frame;
+	OMX_TICKS ticks;
+	int ret;
+	int64_t cpu;
+	while (~flags & STOPPED)
+	{
+		// paused
+		if (flags & PAUSED)
+		{
+			WAIT_WHILE_PAUSED
+		}
+		pthread_mutex_lock (&pcm_mutex);
+		if (pcm_ring_peek (&audio_ring, &frame, 0) != 0)
+		{
+			// hand over what is held back before sleeping
+			flush_omx_submitter (&pcm_submit);
+			ret = pcm_ring_peek (&audio_ring, &frame, -1);
+		}
+		else
+			ret = 0;
+		if (ret != 0)
+		{
+			pthread_mutex_unlock (&pcm_mutex);
+			// decoding is done and the ring is drained
+			if (ret == EMPTY_BUFFER)
+				break;
+			continue;
+		}
+		// frames are packed together in full render buffers
+		ticks.nLowPart  = frame.time;
+		ticks.nHighPart = frame.time >> 32;
+		cpu = thread_cpu_time ();
+		scale_pcm (frame.data, frame.size, frame.time);
+		ret = submit_omx_data (&pcm_submit, frame.data, frame.size, ticks, frame.flags);
+		// part of what the route costs, the media was counted when decoded
+		add_codec_route_cost (audio_codec_route, audio_route, thread_cpu_time () - cpu, 0);
+		pcm_ring_release (&audio_ring);
+		pthread_mutex_unlock (&pcm_mutex);
+		if (ret != 0)
+		{
+			fprintf (stderr, "Error emptying audio render buffer, ending thread\n");
+			// don't leave the decoding thread waiting for room
+			cancel_pcm_ring (&audio_ring);
+			break;
+		}
+	}
+	printf ("stopping audio submitting thread\n");
+}
+
+/**
+ *	Add the current packet, a video keyframe, to the keyframe index.
+ */
+static void index_keyframe ()
+{
+	int64_t time = av_packet.pts != AV_NOPTS_VALUE ? av_packet.pts : av_packet.dts;
+	if (time != AV_NOPTS_VALUE)
+		add_keyframe (&keyframes, av_rescale_q (time, video_stream->time_base, AV_TIME_BASE_Q),
+		              index_by_byte ? av_packet.pos : -1, demux_contiguous);
+}
+
+/**
+ *	Set up the keyframe index of the source, mapping its sidecar if it is up to date,
+ *	otherwise starting to build it.
+ */
+static void open_keyframe_index (const char* source)
+{
+	demux_contiguous = 1;
+	index_by_byte    = byte_seekable (fmt_ctx);
+	if (init_keyframe_index (&keyframes, source, video_stream->id) != 0)
+	{
+		fprintf (stderr, "Could not set up keyframe index\n");
+		destroy_keyframe_index (&keyframes);
+		UNSET_FLAG (INDEX)
+		return;
+	}
+	if (load_keyframe_index (&keyframes) == 0)
+		printf ("Loaded index of %u keyframes from %s\n", keyframes.count, keyframes.sidecar);
+	else if ((flags & SCAN_INDEX) && start_keyframe_scanner (&keyframes) != 0)
+		fprintf (stderr, "Could not start keyframe scanner\n");
+}
+
 /**
  *  Takes the current demuxed packet and sorts it to the correct buffer polled
  *  by decoding threads.
@@ -499,37 +1358,79 @@ static void audio_decoding_thread ()
 static inline int process_packet ()
 {
 	int ret = 0;
-	packet_buffer* buf = NULL;
+	int lane;
 	// negative size ???
 	if (av_packet.size < 0)
 		return ret;
 
 	// current packet is video
 	if (av_packet.stream_index == video_stream_idx)
-		buf = &video_packet_fifo;
+	{
+		lane = video_lane;
+		if ((flags & INDEX) && (av_packet.flags & AV_PKT_FLAG_KEY))
+			index_keyframe ();
+	}
 	// current packet is audio
 	else if (av_packet.stream_index == audio_stream_idx)
-		buf = &audio_packet_fifo;
+		lane = audio_lane;
 	// not interrested
 	else
 		return ret;
 
-	// the buffer might be full therefor we need to keep trying until there room has been
-	// made by either decoding threads, hence the while loop
-	while (~flags & STOPPED)
-	{
-		if (flags & PAUSED)
+	if (flags & PAUSED)
 		WAIT_WHILE_PAUSED
-		ret = push_packet (buf, av_packet);
-		// if we successfully added the packet break
-		if (ret == 0)
-			break;
-		// sleep a little to save CPU
-		usleep (FIFO_SLEEPY_TIME);
+	// the buffer might be full, in which case this sleeps until room has been made by the
+	// decoding thread, unless the other decoder is running dry. if it is cancelled (stop
+	// or seek) the packet is dropped as it is not wanted anymore.
+	schedule_packet (&demuxer, lane, av_packet);
+	return 0;
+}
+
+/**
+ *	Open video decoded by FFmpeg, for codecs the hardware can't decode.
+ *	Frames go to the sink picked with rpi_mp_set_video_sink.
+ */
+static int open_software_video ()
+{
+	const video_sink_ops* ops = video_sink_type == VIDEO_SINK_NULL          ? &null_video_sink :
+	                            video_sink_type == VIDEO_SINK_SHARED_MEMORY ? &shm_video_sink  : &render_video_sink;
+
+	// the renderer takes frames in its own buffers, without decoder and scheduler in front
+	if (ops == &render_video_sink)
+	{
+		if (flags & RENDER_2_TEXTURE)
+		{
+			if (ilclient_create_component (client, &egl_render, "egl_render", ILCLIENT_DISABLE_ALL_PORTS | ILCLIENT_ENABLE_INPUT_BUFFERS | ILCLIENT_ENABLE_OUTPUT_BUFFERS) != 0)
+			{
+				fprintf (stderr, "Error creating IL COMPONENT egl render\n");
+				return -14;
+			}
+			list[1] = egl_render;
+		}
+		else
+		{
+			if (ilclient_create_component (client, &video_render, "video_render", ILCLIENT_DISABLE_ALL_PORTS | ILCLIENT_ENABLE_INPUT_BUFFERS) != 0)
+			{
+				fprintf (stderr, "Error creating IL COMPONENT video render\n");
+				return -14;
+			}
+			list[1] = video_render;
+		}
+	}
+	if (open_video_sink (&video_out, ops, video_codec_ctx->width, video_codec_ctx->height, video_sink_name) != 0)
+	{
+		fprintf (stderr, "Could not open the %s video sink\n", ops->name);
+		return 1;
+	}
+	if (open_sw_video_decoder (&sw_video, video_codec_ctx, video_stream->time_base, &video_out) != 0)
+	{
+		close_video_sink (&video_out);
+		return 1;
 	}
 	return 0;
 }
 
+
 /**
  *	Open video.
  *	Create components and setup tunnels and buffers between them.
@@ -541,6 +1442,19 @@ static int open_video ()
 	OMX_VIDEO_PARAM_PORTFORMATTYPE video_format;
 	int render_input_port = VIDEO_RENDER_INPUT_PORT;
 
+	// pick how to play the stream
+	video_codec_route = find_codec_route (video_codec_ctx->codec_id, AVMEDIA_TYPE_VIDEO);
+	video_route       = select_codec_route (video_codec_route, ROUTE_BIT (ROUTE_HARDWARE_DECODE) | ROUTE_BIT (ROUTE_SOFTWARE_DECODE), ROUTE_NONE);
+	if (video_route == ROUTE_NONE)
+	{
+		fprintf (stderr, "No route to play %s video\n", avcodec_get_name (video_codec_ctx->codec_id));
+		return 1;
+	}
+	printf ("Playing %s video by %s%s\n", avcodec_get_name (video_codec_ctx->codec_id), codec_route_name (video_route),
+	        video_codec_route->codec_id == AV_CODEC_ID_NONE && video_route == ROUTE_HARDWARE_DECODE ? ", letting the decoder detect the codec" : "");
+	if (video_route == ROUTE_SOFTWARE_DECODE)
+		return open_software_video ();
+
 	memset (video_tunnel, 0, sizeof (video_tunnel));
 	// create video decode component
 	if (ilclient_create_component (client, &video_decode, "video_decode", ILCLIENT_DISABLE_ALL_PORTS | ILCLIENT_ENABLE_INPUT_BUFFERS) != 0)
@@ -602,23 +1516,12 @@ static int open_video ()
 	if (video_stream->r_frame_rate.den > 0)
 		video_format.xFramerate	= (long long) (video_stream->r_frame_rate.num / video_stream->r_frame_rate.den) * (1 << 16);
 
-	switch (video_codec_ctx->codec_id)
+	video_format.eCompressionFormat = video_codec_route->coding;
+	if (init_annexb_converter (&video_annexb, video_codec_ctx->codec_id, video_codec_ctx->extradata, video_codec_ctx->extradata_size) != 0 ||
+	    init_scratch_arena (&video_scratch, VIDEO_SCRATCH_SIZE) != 0)
 	{
-		case AV_CODEC_ID_H264:
-			video_format.eCompressionFormat = OMX_VIDEO_CodingAVC;
-			break;
-
-		case AV_CODEC_ID_MPEG4:
-			video_format.eCompressionFormat = OMX_VIDEO_CodingMPEG4;
-			break;
-
-		case AV_CODEC_ID_MPEG2VIDEO:
-			video_format.eCompressionFormat = OMX_VIDEO_CodingMPEG2;
-			break;
-
-		default:
-			video_format.eCompressionFormat = OMX_VIDEO_CodingAutoDetect;
-			break;
+		fprintf (stderr, "Could not read the decoder configuration of the video stream\n");
+		return 1;
 	}
 	// set format parameters for video decoder
 	if (OMX_SetParameter (ILC_GET_HANDLE (video_decode), OMX_IndexParamVideoPortFormat, &video_format) != OMX_ErrorNone)
@@ -627,24 +1530,24 @@ static int open_video ()
 		return 1;
 	}
 	// enable video decoder buffers
-	if (ilclient_enable_port_buffers (video_decode, VIDEO_DECODE_INPUT_PORT, NULL, NULL, NULL) == 0)
+	if (open_omx_port (&video_input, &ilclient_port, video_decode, VIDEO_DECODE_INPUT_PORT) == 0)
 	{
+		init_omx_submitter (&video_submit, &video_input, 0);
 		ilclient_change_component_state (video_decode, OMX_StateExecuting);
-		// send decoding extra information
-		if (video_codec_ctx->extradata)
+		// send decoding extra information, as Annex-B for H.264 and HEVC out of MP4 or Matroska
+		if (video_annexb.parameter_sets_size > 0)
 		{
-			if ((omx_video_buffer = ilclient_get_input_buffer (video_decode, VIDEO_DECODE_INPUT_PORT, 1)) == NULL)
+			if ((omx_video_buffer = get_omx_buffer (&video_input, 1)) == NULL)
 			{
 				fprintf (stderr, "Error getting input buffer to video decoder to send decoding information\n");
 				return 1;
 			}
-			omx_video_buffer->nOffset = 0;
-			omx_video_buffer->nFilledLen = video_codec_ctx->extradata_size;
+			omx_video_buffer->nFilledLen = video_annexb.parameter_sets_size;
 			memset (omx_video_buffer->pBuffer, 0x0, omx_video_buffer->nAllocLen);
-			memcpy (omx_video_buffer->pBuffer, video_codec_ctx->extradata, video_codec_ctx->extradata_size);
+			memcpy (omx_video_buffer->pBuffer, video_annexb.parameter_sets, video_annexb.parameter_sets_size);
 			omx_video_buffer->nFlags = OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_ENDOFFRAME;
 
-			if (OMX_EmptyThisBuffer (ILC_GET_HANDLE (video_decode), omx_video_buffer) != OMX_ErrorNone)
+			if (empty_omx_buffer (&video_input, omx_video_buffer) != 0)
 			{
 				fprintf (stderr, "Error emptying buffer with extra decoder information\n");
 				return 1;
@@ -665,14 +1568,15 @@ static int open_video ()
  */
 static void close_video ()
 {
-	if ((omx_video_buffer = ilclient_get_input_buffer (video_decode, VIDEO_DECODE_INPUT_PORT, 1)) != NULL)
+	if (video_route == ROUTE_SOFTWARE_DECODE)
 	{
-		omx_video_buffer->nFilledLen = 0;
-		omx_video_buffer->nFlags 	 = OMX_BUFFERFLAG_ENDOFFRAME | OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_TIME_UNKNOWN;
-		if (OMX_EmptyThisBuffer (ILC_GET_HANDLE (video_decode), omx_video_buffer) != OMX_ErrorNone)
-            fprintf (stderr, "error emptying last buffer =/\n");
+		close_sw_video_decoder (&sw_video);
+		close_video_sink       (&video_out);
+		if (video_codec_ctx)
+			avcodec_close (video_codec_ctx);
+		return;
 	}
-	else
+	if (end_omx_submitter (&video_submit, OMX_BUFFERFLAG_ENDOFFRAME | OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_TIME_UNKNOWN) != 0)
         fprintf (stderr, "Could not send EOS flag to video decoder\n");
 
 	// wait for EOS from render
@@ -681,16 +1585,86 @@ static void close_video ()
 
 	// need to flush the renderer to allow video_decode to disable its input port
 	ilclient_flush_tunnels        (video_tunnel, 0);
-	ilclient_disable_port_buffers (video_decode, VIDEO_DECODE_INPUT_PORT, NULL, NULL, NULL);
+	close_omx_port                (&video_input);
 	ilclient_disable_tunnel       (video_tunnel);
 	ilclient_disable_tunnel       (video_tunnel + 1);
 	ilclient_disable_tunnel       (video_tunnel + 2);
 	ilclient_teardown_tunnels     (video_tunnel);
+	destroy_annexb_converter      (&video_annexb);
+	destroy_scratch_arena         (&video_scratch);
 
 	if (video_codec_ctx)
         avcodec_close (video_codec_ctx);
 }
 
+/**
+ *	Whether the receiver on HDMI takes the audio stream as it is, according to its EDID.
+ */
+static int hdmi_passthrough_supported ()
+{
+	uint32_t format, rate;
+	switch (audio_codec_ctx->codec_id)
+	{
+		case AV_CODEC_ID_AC3:    format = EDID_AudioFormat_eAC3;    break;
+		case AV_CODEC_ID_EAC3:   format = EDID_AudioFormat_eDDPlus; break;
+		case AV_CODEC_ID_DTS:    format = EDID_AudioFormat_eDTS;    break;
+		case AV_CODEC_ID_TRUEHD: format = EDID_AudioFormat_eMLP;    break;
+		default:                 return 0;
+	}
+	switch (audio_codec_ctx->sample_rate)
+	{
+		case 32000:  rate = EDID_AudioSampleRate_e32KHz;  break;
+		case 44100:  rate = EDID_AudioSampleRate_e44KHz;  break;
+		case 48000:  rate = EDID_AudioSampleRate_e48KHz;  break;
+		case 88200:  rate = EDID_AudioSampleRate_e88KHz;  break;
+		case 96000:  rate = EDID_AudioSampleRate_e96KHz;  break;
+		case 176400: rate = EDID_AudioSampleRate_e176KHz; break;
+		case 192000: rate = EDID_AudioSampleRate_e192KHz; break;
+		default:     return 0;
+	}
+	return vc_tv_hdmi_audio_supported (format, audio_codec_ctx->channels, rate, 0) == 0;
+}
+
+
+/**
+ *	Whether PCM at rate plays as it is: HDMI receivers say which rates they take in their
+ *	EDID, the others get resampled by the firmware, or not at all.
+ */
+static int pcm_rate_supported (int rate)
+{
+	uint32_t edid_rate;
+	switch (rate)
+	{
+		case 32000: edid_rate = EDID_AudioSampleRate_e32KHz; break;
+		case 44100: edid_rate = EDID_AudioSampleRate_e44KHz; break;
+		case 48000: edid_rate = EDID_AudioSampleRate_e48KHz; break;
+		default:    return 0;
+	}
+	return (flags & ANALOG_AUDIO_OUT) ||
+	       vc_tv_hdmi_audio_supported (EDID_AudioFormat_ePCM, audio_mix->out_channels, edid_rate, EDID_AudioSampleSize_16bit) == 0;
+}
+
+
+/**
+ *	Channel of audio_render for an FFmpeg speaker.
+ */
+static OMX_AUDIO_CHANNELTYPE omx_channel (uint64_t speaker)
+{
+	switch (speaker)
+	{
+		case AV_CH_FRONT_LEFT:    return OMX_AUDIO_ChannelLF;
+		case AV_CH_FRONT_RIGHT:   return OMX_AUDIO_ChannelRF;
+		case AV_CH_FRONT_CENTER:  return OMX_AUDIO_ChannelCF;
+		case AV_CH_LOW_FREQUENCY: return OMX_AUDIO_ChannelLFE;
+		case AV_CH_BACK_LEFT:     return OMX_AUDIO_ChannelLR;
+		case AV_CH_BACK_RIGHT:    return OMX_AUDIO_ChannelRR;
+		case AV_CH_SIDE_LEFT:     return OMX_AUDIO_ChannelLS;
+		case AV_CH_SIDE_RIGHT:    return OMX_AUDIO_ChannelRS;
+		default:                  return OMX_AUDIO_ChannelNone;
+	}
+}
+
+
 /**
  *	Open audio
  *	Create audio components and tunnels with their buffers.
@@ -698,6 +1672,8 @@ static void close_video ()
 static int open_audio ()
 {
 	int ret = 0;
+	uint ring_size, channels;
+	int available;
 	OMX_CONFIG_BRCMAUDIODESTINATIONTYPE audio_destination;
 	OMX_ERRORTYPE omx_error;
 	OMX_AUDIO_PARAM_PCMMODETYPE pcm;
@@ -720,26 +1696,24 @@ static int open_audio ()
 	audio_format.nVersion.nVersion 	= OMX_VERSION;
 	audio_format.nPortIndex 		= 120;
 
-	// check if we can decode audio on hardware
-	switch (audio_codec_ctx->codec_id)
+	// pick how to play the stream, passthrough needs a receiver on HDMI that decodes the codec
+	audio_codec_route = find_codec_route (audio_codec_ctx->codec_id, AVMEDIA_TYPE_AUDIO);
+	available = ROUTE_BIT (ROUTE_HARDWARE_DECODE) | ROUTE_BIT (ROUTE_SOFTWARE_DECODE);
+	if ((~flags & ANALOG_AUDIO_OUT) && hdmi_passthrough_supported ())
+		available |= ROUTE_BIT (ROUTE_PASSTHROUGH);
+	audio_route = select_codec_route (audio_codec_route, available, flags & PASSTHROUGH ? ROUTE_PASSTHROUGH : ROUTE_NONE);
+	if (audio_route == ROUTE_PASSTHROUGH &&
+	    init_iec61937_packer (&audio_packer, audio_codec_ctx->codec_id, audio_codec_ctx->sample_rate) != 0)
+		audio_route = select_codec_route (audio_codec_route, available & ~ROUTE_BIT (ROUTE_PASSTHROUGH), ROUTE_NONE);
+	printf ("Playing %s audio by %s\n", avcodec_get_name (audio_codec_ctx->codec_id), codec_route_name (audio_route));
+
+	UNSET_FLAG (PASSTHROUGH)
+	if (audio_route == ROUTE_PASSTHROUGH)
+		SET_FLAG (PASSTHROUGH)
+	else if (audio_route == ROUTE_HARDWARE_DECODE)
 	{
-		case AV_CODEC_ID_MP2:
-		case AV_CODEC_ID_MP3:
-			audio_format.eEncoding = OMX_AUDIO_CodingMP3;
-		break;
-
-		case AV_CODEC_ID_DTS:
-			audio_format.eEncoding = OMX_AUDIO_CodingDTS;
-			SET_FLAG ( HARDWARE_DECODE_AUDIO )
-		break;
-
-    	case AV_CODEC_ID_AC3:
-    	case AV_CODEC_ID_EAC3:
-			audio_format.eEncoding = OMX_AUDIO_CodingDDP;
-		break;
-
-		default:
-            break;
+		audio_format.eEncoding = audio_codec_route->coding;
+		SET_FLAG (HARDWARE_DECODE_AUDIO)
 	}
 
 	// if the hardware supports the audio encoder we setup new IL components to handle audio decoding
@@ -764,7 +1738,7 @@ static int open_audio ()
 
 		// set parameters and enable its buffers
 		if ((omx_error = OMX_SetParameter (ILC_GET_HANDLE (audio_decode), OMX_IndexParamAudioPortFormat, &audio_format)) != OMX_ErrorNone ||
-		     ilclient_enable_port_buffers (audio_decode, 120, NULL, NULL, NULL) != 0)
+		     open_omx_port (&audio_input, &ilclient_port, audio_decode, 120) != 0)
 		{
 			if (omx_error != OMX_ErrorNone)
 				fprintf (stderr, "Error setting parameters for audio decoder. OMX ERROR: 0x%08x\n", omx_error);
@@ -820,28 +1794,95 @@ static int open_audio ()
 	pcm.eNumData 			= OMX_NumericalDataSigned;
 	pcm.eEndian 			= OMX_EndianLittle;
 	pcm.nSamplingRate 		= audio_codec_ctx->sample_rate;
+	channels 				= audio_codec_ctx->channels;
+	// bursts are played as plain PCM at the rate and channels the format takes
+	if (flags & PASSTHROUGH)
+	{
+		pcm.nChannels 		= audio_packer.channels;
+		pcm.nSamplingRate 	= audio_packer.sample_rate;
+		channels 			= audio_packer.channels;
+	}
 	pcm.bInterleaved 		= OMX_TRUE;
 	pcm.ePCMMode 			= OMX_AUDIO_PCMModeLinear;
 
-	switch (audio_codec_ctx->sample_fmt)
+	// audio decoded here is mixed into the layout asked for
+	audio_mix = NULL;
+	if (!(flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)))
+	{
+		if ((audio_mix = get_mix_matrix (audio_codec_ctx->channel_layout, audio_codec_ctx->channels, audio_layout)) == NULL)
+		{
+			fprintf (stderr, "Could not mix %d audio channels\n", audio_codec_ctx->channels);
+			return 1;
+		}
+		pcm.nChannels = audio_mix->out_channels;
+	}
+
+	// and resampled to the rate asked for, or to one the sink takes
+	resampling = 0;
+	if (!(flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)))
+	{
+		int rate = audio_rate != AUDIO_RATE_AUTO ? audio_rate : pcm_rate_supported (pcm.nSamplingRate) ? (int) pcm.nSamplingRate : AUDIO_RATE_FALLBACK;
+		if (rate != (int) pcm.nSamplingRate)
+		{
+			if (init_resampler (&audio_resampler, pcm.nChannels, pcm.nSamplingRate, rate, resample_quality) != 0)
+				fprintf (stderr, "Could not resample audio from %u to %d Hz\n", pcm.nSamplingRate, rate);
+			else
+			{
+				printf ("Resampling audio from %u to %d Hz with %s kernels\n", pcm.nSamplingRate, rate, resample_kernel_name ());
+				pcm.nSamplingRate = rate;
+				resampling        = 1;
+			}
+		}
+	}
+
+	// fading in from silence to the volume asked for
+	if (!(flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)))
+	{
+		init_gain_ramp (&audio_gain, pcm.nChannels, pcm.nSamplingRate, 0);
+		__atomic_store_n (&gain_request, GAIN_KEEP, __ATOMIC_RELAXED);
+		update_gain (FADE_MS);
+	}
+
+	// every sample format is converted to 16-bit before rendering
+	pcm.nBitPerSample 						= 16;
+	audio_codec_ctx->bits_per_coded_sample 	= 16;
+	printf ("Converting audio with %s kernels\n", pcm_kernel_name ());
+
+	// decode ahead of the renderer into a ring of PCM, with room for a few frames at least
+	pcm_bytes_per_ms = pcm.nSamplingRate * pcm.nChannels * sizeof (int16_t) / 1000;
+	ring_size = (audio_codec_ctx->frame_size > 0 ? audio_codec_ctx->frame_size : AUDIO_SCRATCH_SAMPLES) * pcm.nChannels * sizeof (int16_t) * 4;
+	if (ring_size < PCM_RING_MS * pcm_bytes_per_ms)
+		ring_size = PCM_RING_MS * pcm_bytes_per_ms;
+	if ((flags & DECODE_AHEAD) && ((flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)) || init_pcm_ring (&audio_ring, ring_size) != 0))
+	{
+		if (!(flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)))
+			fprintf (stderr, "Could not allocate PCM ring, decoding audio on the submitting thread\n");
+		UNSET_FLAG (DECODE_AHEAD)
+	}
+
+	// conversion memory for a frame, grows if the decoder hands out larger ones
+	audio_samples_decoded = 0;
+	if (init_scratch_arena (&audio_scratch, (audio_codec_ctx->frame_size > 0 ? audio_codec_ctx->frame_size : AUDIO_SCRATCH_SAMPLES) *
+	                                        pcm.nChannels * sizeof (int16_t)) != 0)
+	{
+		fprintf (stderr, "Could not allocate audio conversion buffer\n");
+		return 1;
+	}
+	// audio decoded here can be played at another tempo
+	if (!(flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)) && init_time_stretcher (&audio_stretch, pcm.nChannels, audio_codec_ctx->sample_rate) != 0)
+	{
+		fprintf (stderr, "Could not allocate time stretching buffers\n");
+		return 1;
+	}
+	held_flags = 0;
+	// setup channel mapping, by the speakers of the mix for audio decoded here
+	if (audio_mix)
 	{
-		case AV_SAMPLE_FMT_U8:
-		case AV_SAMPLE_FMT_U8P:
-			pcm.nBitPerSample 						= 8;
-			audio_codec_ctx->bits_per_coded_sample 	= 8;
-		break;
-
-		case AV_SAMPLE_FMT_S16:
-		case AV_SAMPLE_FMT_S16P:
-		case AV_SAMPLE_FMT_S32:
-		case AV_SAMPLE_FMT_S32P:
-		default:
-			pcm.nBitPerSample 						= 16;
-			audio_codec_ctx->bits_per_coded_sample 	= 16;
-		break;
+		for (channels = 0; channels < pcm.nChannels; channels ++)
+			pcm.eChannelMapping[channels] = omx_channel (audio_mix->speakers[channels]);
 	}
-	// setup channel mapping
-    switch (audio_codec_ctx->channels)
+	else
+    switch (channels)
     {
         case 1:
             pcm.eChannelMapping[0] = OMX_AUDIO_ChannelCF;
@@ -876,7 +1917,8 @@ static int open_audio ()
     	return 1;
     }
     // change audio renderer state to executing
-    ilclient_enable_port_buffers    (audio_render, AUDIO_RENDER_INPUT_PORT, NULL, NULL, NULL);
+    open_omx_port                   (&pcm_input, &ilclient_port, audio_render, AUDIO_RENDER_INPUT_PORT);
+    init_omx_submitter (&pcm_submit, &pcm_input, 1);
     ilclient_change_component_state (audio_render, OMX_StateExecuting);
 
 	return ret;
@@ -885,24 +1927,24 @@ static int open_audio ()
 
 static void close_audio ()
 {
-	if ((omx_audio_buffer = ilclient_get_input_buffer (audio_render, AUDIO_RENDER_INPUT_PORT, 1)) != NULL)
-	{
-		omx_audio_buffer->nFilledLen = 0;
-		omx_audio_buffer->nFlags 	 = OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_TIME_UNKNOWN;
-		if (OMX_EmptyThisBuffer (ILC_GET_HANDLE (audio_render), omx_audio_buffer) != OMX_ErrorNone)
-            fprintf ( stderr, "error emptying last audio buffer =/\n" );
-	}
-	else
+	if (end_omx_submitter (&pcm_submit, OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_TIME_UNKNOWN) != 0)
         fprintf (stderr, "Could not send EOS flag to audio renderer\n");
 
 	// wait for EOS from render
 	ilclient_wait_for_event (audio_render, OMX_EventBufferFlag, AUDIO_RENDER_INPUT_PORT, 0, OMX_BUFFERFLAG_EOS, 0, ILCLIENT_BUFFER_FLAG_EOS, 10000);
 	// need to flush the tunnel to allow audio_render to disable its input port
 	ilclient_flush_tunnels        (audio_tunnel, 0);
-	ilclient_disable_port_buffers (audio_render, AUDIO_RENDER_INPUT_PORT, NULL, NULL, NULL);
+	close_omx_port                (&pcm_input);
+	if (flags & HARDWARE_DECODE_AUDIO)
+		close_omx_port (&audio_input);
 	ilclient_disable_tunnel       (audio_tunnel);
 	ilclient_teardown_tunnels     (audio_tunnel);
 
+	destroy_scratch_arena (&audio_scratch);
+	destroy_time_stretcher (&audio_stretch);
+	destroy_resampler (&audio_resampler);
+	destroy_pcm_ring (&audio_ring);
+	destroy_iec61937_packer (&audio_packer);
 	if (audio_codec_ctx)
         avcodec_close (audio_codec_ctx);
 }
@@ -932,6 +1974,14 @@ static int open_codec_context (int* stream_idx, enum AVMediaType type)
 		fprintf (stderr, "Failed to find %s codec\n", type == AVMEDIA_TYPE_VIDEO ? "video" : "audio");
 		return 1;
 	}
+	// spread software audio decoding over the cores for decoders that can
+	if (type == AVMEDIA_TYPE_AUDIO && (codec->capabilities & (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS)))
+	{
+		codec_ctx->thread_count = sysconf (_SC_NPROCESSORS_ONLN) > 1 ? sysconf (_SC_NPROCESSORS_ONLN) : 1;
+		codec_ctx->thread_type  = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS ? FF_THREAD_FRAME : 0) |
+		                          (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS ? FF_THREAD_SLICE : 0);
+		printf ("Decoding %s with %d threads\n", codec->name, codec_ctx->thread_count);
+	}
 	if ((ret = avcodec_open2 (codec_ctx, codec, NULL)) < 0)
 	{
 		fprintf (stderr, "Failed to open %s codec\n", type == AVMEDIA_TYPE_VIDEO ? "video" : "audio");
@@ -970,10 +2020,15 @@ static int setup_clock ()
 	clock_state.eState            = OMX_TIME_ClockStateWaitingForStartTime;
 	clock_state.nWaitMask         = 0;
 
-	if (video_stream_idx != AVERROR_STREAM_NOT_FOUND)
+	// software decoded video is not tunnelled to the clock and sends it no start time
+	if (video_stream_idx != AVERROR_STREAM_NOT_FOUND && video_route == ROUTE_HARDWARE_DECODE)
 		clock_state.nWaitMask |= OMX_CLOCKPORT0;
-	if (audio_stream_idx != AVERROR_STREAM_NOT_FOUND)
+	// audio is muted in trick play
+	if (audio_stream_idx != AVERROR_STREAM_NOT_FOUND && (~flags & TRICK_PLAY))
 		clock_state.nWaitMask |= OMX_CLOCKPORT1;
+	// nothing to wait for
+	if (clock_state.nWaitMask == 0)
+		clock_state.eState = OMX_TIME_ClockStateRunning;
 
 	if (video_clock != NULL && OMX_SetParameter (ILC_GET_HANDLE (video_clock), OMX_IndexConfigTimeClockState, &clock_state) != OMX_ErrorNone)
 	{
@@ -986,9 +2041,37 @@ static int setup_clock ()
 
 static void cleanup ()
 {
+	if (~flags & LOCKFREE_BUFFERS)
+		printf ("  packet buffer contention: video %u, audio %u\n", video_packet_fifo.contended, audio_packet_fifo.contended);
+	printf ("  demuxer: %u packets put aside, %u stalls\n", demuxer.overflowed, demuxer.stalls);
+	destroy_demux_scheduler (&demuxer);
 	destroy_packet_buffer (&video_packet_fifo);
 	destroy_packet_buffer (&audio_packet_fifo);
 
+	if (seek_stats.seeks > 0)
+		printf ("  seeks: %u, %u replaced by later ones, %.1f ms to the first frame on average, %.1f ms at most\n",
+		        seek_stats.seeks, seek_stats.coalesced, (double) seek_stats.total_us / seek_stats.seeks / 1000, (double) seek_stats.max_us / 1000);
+	if (discard_stats.seeks > 0)
+		printf ("  accurate seeks: %llu video frames and %llu audio samples dropped, %.1f ms on average, %.1f ms at most, %u cut short\n",
+		        (unsigned long long) (discard_stats.frames + sw_video.discarded), (unsigned long long) discard_stats.samples,
+		        (double) discard_stats.total_us / discard_stats.seeks / 1000, (double) discard_stats.max_us / 1000, discard_stats.gave_up);
+	if (trick_stats.keyframes > 0)
+		printf ("  trick play: %u keyframes shown, %u packets read\n", trick_stats.keyframes, trick_stats.packets);
+	memset (&trick_stats, 0, sizeof (trick_stats));
+	trick_speed = requested_speed = 1;
+	tempo = 1 << 16;
+	memset (&seek_stats, 0, sizeof (seek_stats));
+	memset (&discard_stats, 0, sizeof (discard_stats));
+	video_discarding = audio_discarding = 0;
+	seek_started = 0;
+	if (flags & INDEX)
+	{
+		stop_keyframe_scanner (&keyframes);
+		printf ("  keyframe index: %u keyframes%s\n", keyframes.count, keyframes.complete ? "" : ", incomplete");
+		save_keyframe_index (&keyframes);
+		destroy_keyframe_index (&keyframes);
+	}
+
 	printf ("  closing streams\n");
 	if (video_stream_idx != AVERROR_STREAM_NOT_FOUND)
 	{
@@ -1000,10 +2083,53 @@ static void cleanup ()
 		close_audio ();
 		printf ("    audio closed\n");
 	}
+	printf ("  decoder input buffers: video %.0f%% full, %.1f/s, audio render %.0f%% full, %.1f/s\n",
+	        omx_submitter_fill_ratio (&video_submit) * 100, omx_submitter_call_rate (&video_submit),
+	        omx_submitter_fill_ratio (&pcm_submit) * 100, omx_submitter_call_rate (&pcm_submit));
+	if (audio_samples_decoded > 0 && audio_codec_ctx->sample_rate > 0)
+	{
+		double seconds = (double) audio_samples_decoded / audio_codec_ctx->sample_rate;
+		printf ("  audio scratch: %u allocations in %.1f s of audio, %.3f/s\n", audio_scratch.allocations, seconds, audio_scratch.allocations / seconds);
+		audio_samples_decoded = 0;
+	}
+	if (flags & DECODE_AHEAD)
+		printf ("  PCM ring ran dry %u times\n", audio_ring.underruns);
+	if (audio_stretch.samples_in > 0 && audio_stretch.sample_rate > 0)
+		printf ("  time stretch by %s kernels: %.2f s of audio played in %.2f s, %.2f ms of CPU per s\n", time_stretch_kernel_name (),
+		        (double) audio_stretch.samples_in / audio_stretch.sample_rate, (double) audio_stretch.samples_out / audio_stretch.sample_rate,
+		        audio_stretch.cpu / 1000.0 / audio_stretch.samples_in * audio_stretch.sample_rate / 1000);
+	memset (&audio_stretch, 0, sizeof (audio_stretch));
+	if (resampling && audio_resampler.samples_in > 0)
+		printf ("  resampling by %s kernels: %.1f ns of CPU per sample\n", resample_kernel_name (),
+		        (double) audio_resampler.cpu / audio_resampler.samples_out);
+	memset (&audio_resampler, 0, sizeof (audio_resampler));
+	resampling = 0;
+	audio_mix  = NULL;
+	if (video_stream_idx >= 0)
+		printf ("  video by %s: %.3f s of CPU per s\n", codec_route_name (video_route), codec_route_cost (video_codec_route, video_route));
+	if (video_stream_idx >= 0 && video_route == ROUTE_SOFTWARE_DECODE)
+		printf ("  video %s sink: %llu frames shown, %llu dropped\n", video_out.ops ? video_out.ops->name : "closed",
+		        (unsigned long long) video_out.frames, (unsigned long long) video_out.dropped);
+	if (video_annexb.units > 0)
+	{
+		printf ("  video converted to Annex-B: %llu NAL units, parameter sets put before %llu keyframes\n",
+		        (unsigned long long) video_annexb.units, (unsigned long long) video_annexb.injected);
+		video_annexb.units = 0;
+	}
+	if (audio_stream_idx >= 0)
+		printf ("  audio by %s: %.3f s of CPU per s\n", codec_route_name (audio_route), codec_route_cost (audio_codec_route, audio_route));
 
 	printf ("  freeing ffmpeg structs\n");
 	av_frame_free (&av_frame);
 	avformat_close_input (&fmt_ctx);
+	printf ("  demuxer waited %lld ms for input\n", (long long) demux_read_time / 1000);
+	if (flags & READ_AHEAD)
+	{
+		printf ("  read ahead ran dry %u times, %lld ms\n", input.stalls, (long long) input.stall_time / 1000);
+		close_read_ahead (&input);
+	}
+	if (flags & MMAP)
+		close_mmap_input (&mapped_input);
 
 	printf ("  cleaning up components\n");
 	ilclient_state_transition   (list, OMX_StateIdle);
@@ -1016,6 +2142,14 @@ static void cleanup ()
 
 uint64_t rpi_mp_current_time ()
 {
+	int64_t start = fmt_ctx && fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+	// until the clock runs again after a seek, the time is where it goes to
+	if ((flags & SEEKING) || seek_started)
+		return (seek_target - start) / AV_TIME_BASE;
+	// in trick play the clock runs on keyframe timestamps of its own
+	if (flags & TRICK_PLAY)
+		return trick_position > start ? (trick_position - start) / AV_TIME_BASE : 0;
+
 	OMX_TIME_CONFIG_TIMESTAMPTYPE timestamp;
 	memset (&timestamp, 0x0, sizeof (timestamp));
 	timestamp.nVersion.nVersion = OMX_VERSION;
@@ -1028,106 +2162,538 @@ uint64_t rpi_mp_current_time ()
 		fprintf (stderr, "Could not get timestamp config from clock component. Error 0x%08x\n", omx_error);
 		return 0;
 	}
-	uint64_t pts = (uint64_t) (timestamp.nTimestamp.nLowPart | (uint64_t) timestamp.nTimestamp.nHighPart << 32);
-	return pts / AV_TIME_BASE;
+	int64_t pts = (int64_t) (timestamp.nTimestamp.nLowPart | (uint64_t) timestamp.nTimestamp.nHighPart << 32);
+	// timestamps are those of the streams, seeks are from the start of the media
+	return pts > start ? (pts - start) / AV_TIME_BASE : 0;
 }
 
 
-// TODO implement correctly
-int rpi_mp_seek (int64_t position)
+/**
+ *	Flush everything between the demuxer and the screen and speakers, for a seek.
+ *	The decoding threads must be locked out.
+ */
+static void flush_pipeline ()
 {
 	OMX_ERRORTYPE omx_error;
-	// make sure we are paused first
-	// if ( ~flags & PAUSED ) pause_playback ();
-	lock();
 
+	flush_demux_scheduler (&demuxer);
+	flush_buffer (&video_packet_fifo);
+	flush_buffer (&audio_packet_fifo);
+	if (flags & DECODE_AHEAD)
+		flush_pcm_ring (&audio_ring);
+	discard_omx_submitter (&video_submit);
+	discard_omx_submitter (&pcm_submit);
+
+	if (video_stream_idx >= 0 && video_route == ROUTE_SOFTWARE_DECODE)
+	{
+		// frames held by the decoder, and those waiting in the renderer
+		flush_sw_video_decoder (&sw_video);
+		if (video_out.ops == &render_video_sink &&
+		    (omx_error = OMX_SendCommand (ILC_GET_HANDLE (list[1]), OMX_CommandFlush, render_input.index, NULL)) != OMX_ErrorNone)
+			fprintf (stderr, "Could not flush video render input (0x%08x)\n", omx_error);
+	}
+	else if (video_stream_idx >= 0)
+	{
+		if ((omx_error = OMX_SendCommand (ILC_GET_HANDLE (video_decode), OMX_CommandFlush, VIDEO_DECODE_INPUT_PORT, NULL)) != OMX_ErrorNone)
+			fprintf (stderr, "Could not flush video decoder input (0x%08x)\n", omx_error);
+		// the render is egl_render when rendering to texture
+		if ((omx_error = OMX_SendCommand (ILC_GET_HANDLE (list[1]), OMX_CommandFlush,
+		                                  flags & RENDER_2_TEXTURE ? EGL_RENDER_INPUT_PORT : VIDEO_RENDER_INPUT_PORT, NULL)) != OMX_ErrorNone)
+			fprintf (stderr, "Could not flush video render input (0x%08x)\n", omx_error);
+		ilclient_flush_tunnels (video_tunnel, 0);
+	}
+
+	if (audio_stream_idx >= 0)
+	{
+		if ((omx_error = OMX_SendCommand (ILC_GET_HANDLE (audio_render), OMX_CommandFlush, AUDIO_RENDER_INPUT_PORT, NULL)) != OMX_ErrorNone)
+			fprintf (stderr, "Could not flush audio render input (0x%08x)\n", omx_error);
+		ilclient_flush_tunnels (audio_tunnel, 0);
+		// drop frames the audio decoder still holds from before the seek
+		if (audio_codec_ctx && (~flags & HARDWARE_DECODE_AUDIO))
+			avcodec_flush_buffers (audio_codec_ctx);
+		// and audio held back for stretching
+		reset_time_stretcher (&audio_stretch);
+		if (resampling)
+			reset_resampler (&audio_resampler);
+		held_flags = 0;
+		// and frames gathered for a burst
+		if (flags & PASSTHROUGH)
+			reset_iec61937_packer (&audio_packer);
+	}
+}
+
+/**
+ *	Move the demuxer to a keyframe of the index, by its byte offset where the format allows,
+ *	else by its time.
+ *	@return int 0 on success, negative on error
+ */
+static int seek_keyframe (const keyframe* found)
+{
+	if (found->position >= 0)
+		return av_seek_frame (fmt_ctx, -1, found->position, AVSEEK_FLAG_BYTE);
+	return av_seek_frame (fmt_ctx, video_stream_idx, av_rescale_q (found->time, AV_TIME_BASE_Q, video_stream->time_base), AVSEEK_FLAG_BACKWARD);
+}
+
+/**
+ *	Move the demuxer to the keyframe at or before target, in microseconds.
+ *	@return int 0 on success, negative on error
+ */
+static int reposition_demuxer (int64_t target)
+{
+	keyframe found;
+	int ret;
+
+	// straight to the keyframe when the index knows where it is
+	if ((flags & INDEX) && find_keyframe (&keyframes, target, &found) == 0 && seek_keyframe (&found) >= 0)
+	{
+		// demuxing carries on from a keyframe the index covers
+		demux_contiguous = 1;
+		return 0;
+	}
+	demux_contiguous = 0;
+	if ((ret = av_seek_frame (fmt_ctx, -1, target, AVSEEK_FLAG_BACKWARD)) < 0)
+		ret = av_seek_frame (fmt_ctx, -1, target, AVSEEK_FLAG_ANY);
+	return ret;
+}
+
+/**
+ *	Lock the decoding threads out, stop the clock and flush the pipeline, for a seek
+ *	or a change of speed.
+ */
+static void stop_pipeline ()
+{
 	OMX_TIME_CONFIG_CLOCKSTATETYPE clock;
-	memset ( & clock, 0x0, sizeof ( OMX_TIME_CONFIG_CLOCKSTATETYPE ) );
-	clock.nVersion.nVersion = OMX_VERSION;
-	clock.nSize 			= sizeof ( OMX_TIME_CONFIG_TIMESTAMPTYPE );
-	clock.eState    		= OMX_TIME_ClockStateStopped;
-	clock.nOffset			= pts__omx_timestamp (-1000LL * 200);
-	// clock.nOffset     = ToOMXTime(-1000LL * OMX_PRE_ROLL);
+	OMX_ERRORTYPE omx_error;
+
+	// what the renderer plays until the clock stops fades out
+	fade_out ();
+	// wake up threads waiting on the fifos so they let go of their locks
+	cancel_packet_buffer (&video_packet_fifo);
+	cancel_packet_buffer (&audio_packet_fifo);
+	if (flags & DECODE_AHEAD)
+		cancel_pcm_ring (&audio_ring);
+	lock ();
+
+	// stop the clock, it starts again with the first frames after the seek
+	OMX_INIT_PARAM (clock)
+	clock.eState = OMX_TIME_ClockStateStopped;
+	if ((omx_error = OMX_SetConfig (ILC_GET_HANDLE (video_clock), OMX_IndexConfigTimeClockState, &clock)) != OMX_ErrorNone)
+		fprintf (stderr, "Could not stop clock. Error 0x%08x\n", omx_error);
+
+	flush_pipeline ();
+}
+
+/**
+ *	Let the decoding threads go again, with the clock waiting for the first frames.
+ */
+static void restart_pipeline ()
+{
+	// the first frames played carry the time the clock starts at
+	SET_FLAG (FIRST_VIDEO | FIRST_AUDIO)
+	if (setup_clock () != 0)
+		fprintf (stderr, "Could not restart clock\n");
+	// the renderer is empty, the first audio decoded fades in
+	if (audio_mix)
+	{
+		ramp_gain (&audio_gain, 0, 0);
+		update_gain (FADE_MS);
+		__atomic_store_n (&gain_request, GAIN_KEEP, __ATOMIC_RELAXED);
+	}
 
-	if (( omx_error = OMX_SetConfig ( ILC_GET_HANDLE ( video_clock ), OMX_IndexConfigTimeClockState, & clock )) != OMX_ErrorNone )
+	resume_packet_buffer (&video_packet_fifo);
+	resume_packet_buffer (&audio_packet_fifo);
+	if (flags & DECODE_AHEAD)
+		resume_pcm_ring (&audio_ring);
+	unlock ();
+}
+
+/**
+ *	Carry out the latest seek request, on the demuxing thread.
+ *	Requests coming in while it is under way only move the demuxer again, the
+ *	pipeline is flushed once.
+ */
+static void perform_seek ()
+{
+	int64_t target, requested_at;
+	int ret;
+
+	stop_pipeline ();
+	do
+	{
+		pthread_mutex_lock (&seek_mutex);
+		target       = seek_target;
+		requested_at = seek_requested_at;
+		UNSET_FLAG (SEEKING)
+		pthread_mutex_unlock (&seek_mutex);
+
+		if ((ret = reposition_demuxer (target)) < 0)
+			fprintf (stderr, "could not seek to position: %lld (%d)\n", (long long) target, ret);
+	}
+	while (flags & SEEKING);
+
+	// an accurate seek plays from the target itself, what comes before it is decoded and dropped
+	if (flags & ACCURATE)
 	{
-		fprintf ( stderr, "Could not stop clock. Error 0x%08x\n", omx_error );
-	 	return 0;
+		accurate_target        = target;
+		accurate_started       = av_gettime_relative ();
+		accurate_deadline      = accurate_started + ACCURATE_SEEK_MAX_TIME;
+		video_discarding       = video_stream_idx >= 0;
+		audio_discarding       = audio_stream_idx >= 0;
+		sw_video.discard_until = video_route == ROUTE_SOFTWARE_DECODE ? target : AV_NOPTS_VALUE;
 	}
+	// trick play goes on from the target
+	trick_origin = trick_position = trick_target = target;
+	seek_frames  = video_out.frames;
+	__atomic_store_n (&seek_started, requested_at, __ATOMIC_RELEASE);
+	restart_pipeline ();
+}
 
-	position *= AV_TIME_BASE;
-	position += fmt_ctx->start_time;
+/**
+ *	Scale the clock, 1 << 16 being normal speed and 0 standing still.
+ */
+static void set_clock_scale (OMX_S32 scale)
+{
+	OMX_TIME_CONFIG_SCALETYPE config;
+	OMX_ERRORTYPE omx_error;
 
-	printf ( "trying to seek to position %llu\n", position );
+	OMX_INIT_PARAM (config)
+	config.xScale = scale;
+	if ((omx_error = OMX_SetConfig (ILC_GET_HANDLE (video_clock), OMX_IndexConfigTimeScale, &config)) != OMX_ErrorNone)
+		fprintf (stderr, "Could not set scale parameter on video clock. Error 0x%08x\n", omx_error);
+}
 
-	// clear fifo queues
-	flush_buffer ( & video_packet_fifo );
-	flush_buffer ( & audio_packet_fifo );
+/**
+ *	Scale the clock runs at when playing: the trick play speed, else the tempo.
+ */
+static OMX_S32 playback_scale ()
+{
+	if (flags & TRICK_PLAY)
+		return (trick_speed > 0 ? trick_speed : -trick_speed) << 16;
+	return __atomic_load_n (&tempo, __ATOMIC_RELAXED);
+}
 
-	// flush video buffer
-	//*
-	if ( ( omx_error = OMX_SendCommand ( ILC_GET_HANDLE ( video_decode ), OMX_CommandFlush, VIDEO_DECODE_INPUT_PORT, NULL ) != OMX_ErrorNone ) )
+/**
+ *	Ask the demuxing thread for a change of speed.
+ *  @return int 0 on success, non-zero once playback has ended
+ */
+static int request_speed (int speed)
+{
+	pthread_mutex_lock (&seek_mutex);
+	if (flags & (STOPPED | DONE_READING))
 	{
-		fprintf ( stderr, "Could not flush video decoder input (0x%08x)\n", omx_error );
+		pthread_mutex_unlock (&seek_mutex);
 		return 1;
 	}
-	if ( ( omx_error = OMX_SendCommand ( ILC_GET_HANDLE ( video_render ), OMX_CommandFlush, VIDEO_RENDER_INPUT_PORT, NULL ) != OMX_ErrorNone ) )
+	requested_speed = speed;
+	SET_FLAG (SPEED_CHANGE)
+	// let the demuxer go if it waits for room in the buffers, the decoders wait on
+	cancel_packet_buffer_push (&video_packet_fifo);
+	cancel_packet_buffer_push (&audio_packet_fifo);
+	pthread_cond_broadcast (&seek_condition);
+	pthread_mutex_unlock (&seek_mutex);
+	return 0;
+}
+
+/**
+ *	Go into, out of or between speeds of trick play, on the demuxing thread.
+ */
+static void change_speed ()
+{
+	int64_t now;
+	int speed;
+
+	pthread_mutex_lock (&seek_mutex);
+	speed = requested_speed;
+	UNSET_FLAG (SPEED_CHANGE)
+	pthread_mutex_unlock (&seek_mutex);
+	if (speed == trick_speed)
 	{
-		fprintf ( stderr, "Could not flush video render input (0x%08x)\n", omx_error );
-		return 1;
+		// nothing to flush, the demuxer may wait for room again
+		resume_packet_buffer (&video_packet_fifo);
+		resume_packet_buffer (&audio_packet_fifo);
+		return;
 	}
-	ilclient_flush_tunnels ( video_tunnel, 0 );
-	//*/
 
-	// flush audio buffer
-	//*
-	if ( ( omx_error = OMX_SendCommand ( ILC_GET_HANDLE ( audio_render ), OMX_CommandFlush, AUDIO_RENDER_INPUT_PORT, NULL ) != OMX_ErrorNone ) )
+	if (speed == 1)
 	{
-		fprintf ( stderr, "Could not flush video decoder input (0x%08x)\n", omx_error );
-		return 1;
+		// normal playback carries on from the last keyframe shown, by an ordinary seek
+		UNSET_FLAG (TRICK_PLAY)
+		trick_speed = 1;
+		if (~flags & PAUSED)
+			set_clock_scale (playback_scale ());
+		pthread_mutex_lock (&seek_mutex);
+		seek_target       = trick_position;
+		seek_requested_at = av_gettime_relative ();
+		SET_FLAG (SEEKING)
+		pthread_mutex_unlock (&seek_mutex);
+		return;
+	}
+	// from normal playback trick play starts where the clock is
+	if (~flags & TRICK_PLAY)
+	{
+		now = media_time ();
+		trick_origin = trick_position = trick_target = now != AV_NOPTS_VALUE ? now : seek_target;
 	}
-	ilclient_flush_tunnels ( audio_tunnel, 0 );
-	//*/
+	stop_pipeline ();
+	SET_FLAG (TRICK_PLAY)
+	trick_speed = speed;
+	// the keyframes read from here on leave the index with gaps
+	demux_contiguous = 0;
+	// keyframes are timed by their distance from where trick play started, so the clock
+	// runs forward at the speed either way
+	trick_origin = trick_position;
+	// an accurate seek under way is given up, every keyframe is shown
+	video_discarding = audio_discarding = 0;
+	sw_video.discard_until = AV_NOPTS_VALUE;
+	// a paused clock gets the speed when it is resumed
+	if (~flags & PAUSED)
+		set_clock_scale (playback_scale ());
+	restart_pipeline ();
+}
 
-	// avcodec_flush_buffers ( video_codec_ctx );
-	// avcodec_flush_buffers ( audio_codec_ctx );
+/**
+ *	Find the keyframe at or before time, in microseconds, in the keyframe index or else in
+ *	the index of the container (e.g. Matroska cues, MP4 sample tables).
+ *  @param int * by_byte
+ *		set when found.position is a byte offset, else it is a timestamp of the video stream
+ *  @return int 0 if found, non-zero if neither index has one
+ */
+static int find_trick_keyframe (int64_t time, keyframe* found, int* by_byte)
+{
+	AVIndexEntry* entry;
+	int i;
 
-	// seek to frame
-	int ret = av_seek_frame ( fmt_ctx, -1, position, AVSEEK_FLAG_ANY );
+	if ((flags & INDEX) && find_keyframe (&keyframes, time, found) == 0)
+	{
+		// keyframes of formats that can't be seeked by byte are found by their time
+		if (!(*by_byte = found->position >= 0))
+			found->position = av_rescale_q (found->time, AV_TIME_BASE_Q, video_stream->time_base);
+		return 0;
+	}
+	if ((i = av_index_search_timestamp (video_stream, av_rescale_q (time, AV_TIME_BASE_Q, video_stream->time_base), AVSEEK_FLAG_BACKWARD)) >= 0)
+	{
+		entry           = &video_stream->index_entries[i];
+		found->time     = av_rescale_q (entry->timestamp, video_stream->time_base, AV_TIME_BASE_Q);
+		found->position = entry->timestamp;
+		*by_byte        = 0;
+		return 0;
+	}
+	return 1;
+}
 
-	double t = (double) position * audio_stream->r_frame_rate.num / audio_stream->r_frame_rate.den;
+/**
+ *	Show the next keyframe of trick play: move the time along by a step of the speed, seek
+ *	to the keyframe there and read only as far as it, leaving audio and the frames between.
+ */
+static void trick_play_step ()
+{
+	int64_t start = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+	int64_t time;
+	keyframe found;
+	int by_byte, packets = 0, ret;
+
+	trick_target += trick_speed * TRICK_FRAME_INTERVAL;
+	// at either end playback carries on normally
+	if (trick_target < start || (fmt_ctx->duration > 0 && trick_target > start + fmt_ctx->duration))
+	{
+		request_speed (1);
+		return;
+	}
+	if (find_trick_keyframe (trick_target, &found, &by_byte) == 0)
+	{
+		// no other keyframe until there, the next step goes further
+		if (trick_speed > 0 ? found.time <= trick_position : found.time >= trick_position)
+			return;
+		ret = by_byte ? av_seek_frame (fmt_ctx, -1, found.position, AVSEEK_FLAG_BYTE) :
+		                av_seek_frame (fmt_ctx, video_stream_idx, found.position, AVSEEK_FLAG_BACKWARD);
+	}
+	// without an index the demuxer looks for it
+	else
+		ret = av_seek_frame (fmt_ctx, video_stream_idx, av_rescale_q (trick_target, AV_TIME_BASE_Q, video_stream->time_base), AVSEEK_FLAG_BACKWARD);
+
+	while (ret >= 0 && (ret = av_read_frame (fmt_ctx, &av_packet)) >= 0)
+	{
+		trick_stats.packets ++;
+		if (av_packet.stream_index == video_stream_idx && (av_packet.flags & AV_PKT_FLAG_KEY))
+			break;
+		av_packet_unref (&av_packet);
+		if (++ packets >= TRICK_MAX_PACKETS)
+			ret = AVERROR_INVALIDDATA;
+	}
+	if (ret < 0)
+	{
+		fprintf (stderr, "No keyframe found for trick play, playing normally\n");
+		request_speed (1);
+		return;
+	}
+	// the demuxer landed on a keyframe shown already
+	time = packet_time (&av_packet);
+	if (time == AV_NOPTS_VALUE || (trick_speed > 0 ? time <= trick_position : time >= trick_position))
+	{
+		av_packet_unref (&av_packet);
+		return;
+	}
+	trick_position = time;
+	time = trick_origin + (time > trick_origin ? time - trick_origin : trick_origin - time);
+	av_packet.pts = av_packet.dts = av_rescale_q (time, AV_TIME_BASE_Q, video_stream->time_base);
+	trick_stats.keyframes ++;
+
+	if (flags & PAUSED)
+		WAIT_WHILE_PAUSED
+	schedule_packet (&demuxer, video_lane, av_packet);
+}
+
+/**
+ *	At the end of the file, on the demuxing thread: let the decoders play out what was read
+ *	and wait for a seek or change of speed to rewind the file until they are done.
+ *  @param int ret
+ *		what reading the last packet returned
+ *  @return int 1 to go on reading, 0 once playback has ended
+ */
+static int wait_for_seek (int ret)
+{
+	int rewound;
+
+	// every keyframe has been seen
+	if ((flags & INDEX) && ret == AVERROR_EOF && demux_contiguous)
+		finish_keyframe_index (&keyframes);
+	// hand over what the demuxer has put aside, a request cancels waiting for room
+	if (drain_demux_scheduler (&demuxer) == CANCELLED_BUFFER && (flags & (SEEKING | SPEED_CHANGE)))
+		return 1;
+
+	pthread_mutex_lock (&seek_mutex);
+	reach_end_of_file (&end_of_file);
+	close_packet_buffer (&video_packet_fifo);
+	close_packet_buffer (&audio_packet_fifo);
+	if ((rewound = demuxer_at_end_of_file (&end_of_file)))
+	{
+		reopen_packet_buffer (&video_packet_fifo);
+		reopen_packet_buffer (&audio_packet_fifo);
+	}
+	else
+		SET_FLAG (DONE_READING)
+	pthread_cond_broadcast (&seek_condition);
+	pthread_mutex_unlock (&seek_mutex);
+	return rewound;
+}
 
-	// reset hardware clock
-	OMX_TIME_CONFIG_TIMESTAMPTYPE timestamp;
-	memset ( & timestamp, 0x0, sizeof ( timestamp ) );
-	timestamp.nVersion.nVersion 	= OMX_VERSION;
-	timestamp.nSize 				= sizeof ( OMX_TIME_CONFIG_TIMESTAMPTYPE );
-	timestamp.nPortIndex			= CLOCK_AUDIO_PORT;
-	timestamp.nTimestamp 			= pts__omx_timestamp ( t );
-	// timestamp.nTimestamp.nLowPart 	= 0;
-	// timestamp.nTimestamp.nHighPart 	= 0;
 
-	if (( omx_error = OMX_SetConfig ( ILC_GET_HANDLE ( video_clock ), OMX_IndexConfigTimeCurrentAudioReference, & timestamp )) != OMX_ErrorNone )
+int rpi_mp_seek (int64_t position)
+{
+	int64_t target;
+
+	if (!fmt_ctx)
+		return 1;
+	target = (position > 0 ? position : 0) * AV_TIME_BASE;
+	if (fmt_ctx->duration > 0 && target > fmt_ctx->duration)
+		target = fmt_ctx->duration;
+	if (fmt_ctx->start_time != AV_NOPTS_VALUE)
+		target += fmt_ctx->start_time;
+
+	// the latest request wins over one not carried out yet, at the end of the file it
+	// rewinds it until playback has ended
+	pthread_mutex_lock (&seek_mutex);
+	if (flags & (STOPPED | DONE_READING))
 	{
-		fprintf ( stderr, "Could not set timestamp for clock component. Error 0x%08x\n", omx_error );
-	 	return 0;
+		pthread_mutex_unlock (&seek_mutex);
+		return 1;
 	}
-	// SET_FLAG ( FIRST_AUDIO );
-	// SET_FLAG ( FIRST_VIDEO );
+	if (flags & SEEKING)
+		seek_stats.coalesced ++;
+	seek_target       = target;
+	seek_requested_at = av_gettime_relative ();
+	SET_FLAG (SEEKING)
+	// let the demuxer go if it waits for room in the buffers, the decoders wait on.
+	// Done before the demuxer can take the request, which clears it with the pipeline.
+	cancel_packet_buffer_push (&video_packet_fifo);
+	cancel_packet_buffer_push (&audio_packet_fifo);
+	pthread_cond_broadcast (&seek_condition);
+	pthread_mutex_unlock (&seek_mutex);
+	return 0;
+}
 
 
-	// if (( omx_error = OMX_SetParameter ( ILC_GET_HANDLE ( video_clock ), OMX_IndexConfigTimeCurrentVideoReference, & timestamp )) != OMX_ErrorNone )
-	// {
-	// 	fprintf ( stderr, "Could not set timestamp for clock component. Error 0x%08x\n", omx_error );
-	//  	return 0;
-	// }
+int rpi_mp_set_speed (int speed)
+{
+	if (!fmt_ctx || video_stream_idx < 0 ||
+	    (speed != 1 && (speed < -TRICK_MAX_SPEED || speed > TRICK_MAX_SPEED || (speed > -2 && speed < 2))))
+		return 1;
+	return request_speed (speed);
+}
 
-	// resume playback
-	// pause_playback ();
-	unlock();
-	if (ret < 0)
-		fprintf (stderr, "could not seek to position: %llu\n (%d)", position, AVERROR (ret));
-	return ret;
+
+int rpi_mp_set_audio_layout (int layout)
+{
+	if (layout != AUDIO_LAYOUT_AUTO && layout != AUDIO_LAYOUT_STEREO && layout != AUDIO_LAYOUT_5POINT1 && layout != AUDIO_LAYOUT_7POINT1)
+		return 1;
+	audio_layout = layout;
+	return 0;
+}
+
+
+int rpi_mp_set_audio_rate (unsigned int rate, int quality)
+{
+	if ((rate != AUDIO_RATE_AUTO && (rate < 8000 || rate > 192000)) || quality < RESAMPLE_LOW || quality > RESAMPLE_HIGH)
+		return 1;
+	audio_rate       = rate;
+	resample_quality = quality;
+	return 0;
+}
+
+
+int rpi_mp_set_tempo (double value)
+{
+	OMX_S32 scale = (OMX_S32) (value * (1 << 16) + 0.5);
+
+	// compressed audio can't be stretched
+	if (!fmt_ctx || (flags & (STOPPED | DONE_READING)) || scale < TEMPO_MIN || scale > TEMPO_MAX ||
+	    (audio_stream_idx >= 0 && (flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH))))
+		return 1;
+	__atomic_store_n (&tempo, scale, __ATOMIC_RELAXED);
+	// trick play keeps its own speed, a paused clock gets it when resumed
+	if (!(flags & (TRICK_PLAY | PAUSED)))
+		set_clock_scale (scale);
+	return 0;
+}
+
+
+int rpi_mp_set_volume (double value, unsigned int ramp_ms)
+{
+	// audio decoded by the renderer or passed through never comes by as PCM
+	if (value < 0 || value > VOLUME_MAX || (fmt_ctx && audio_stream_idx >= 0 && (flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH))))
+		return 1;
+	pthread_mutex_lock (&volume_mutex);
+	volume         = value;
+	volume_ramp_ms = ramp_ms > VOLUME_MIN_RAMP_MS ? ramp_ms : VOLUME_MIN_RAMP_MS;
+	pthread_mutex_unlock (&volume_mutex);
+	// the thread submitting PCM ramps to it from the next frame it hands over
+	request_gain (GAIN_VOLUME);
+	return 0;
+}
+
+
+int rpi_mp_set_mute (int mute)
+{
+	if (fmt_ctx && audio_stream_idx >= 0 && (flags & (HARDWARE_DECODE_AUDIO | PASSTHROUGH)))
+		return 1;
+	pthread_mutex_lock (&volume_mutex);
+	muted          = mute != 0;
+	volume_ramp_ms = FADE_MS;
+	pthread_mutex_unlock (&volume_mutex);
+	request_gain (GAIN_VOLUME);
+	return 0;
+}
+
+
+int rpi_mp_seek_status (unsigned int* seeks, unsigned int* coalesced, double* average_ms, double* max_ms)
+{
+	pthread_mutex_lock (&seek_mutex);
+	*seeks      = seek_stats.seeks;
+	*coalesced  = seek_stats.coalesced;
+	*average_ms = seek_stats.seeks ? (double) seek_stats.total_us / seek_stats.seeks / 1000 : 0;
+	*max_ms     = (double) seek_stats.max_us / 1000;
+	pthread_mutex_unlock (&seek_mutex);
+	return 0;
 }
 
 
@@ -1166,16 +2732,52 @@ int rpi_mp_open (const char* source, int* image_width, int* image_height, int64_
 	flags = FIRST_VIDEO |
 			FIRST_AUDIO |
 			(init_flags & RENDER_VIDEO_TO_TEXTURE ? RENDER_2_TEXTURE : 0) |
-			(init_flags & ANALOG_AUDIO ? ANALOG_AUDIO_OUT : 0);
+			(init_flags & ANALOG_AUDIO ? ANALOG_AUDIO_OUT : 0) |
+			(init_flags & LOCKFREE_PACKET_BUFFERS ? LOCKFREE_BUFFERS : 0) |
+			(init_flags & READ_AHEAD_INPUT ? READ_AHEAD : 0) |
+			(init_flags & MMAP_INPUT ? MMAP : 0) |
+			(init_flags & DECODE_AHEAD_AUDIO ? DECODE_AHEAD : 0) |
+			(init_flags & PASSTHROUGH_AUDIO ? PASSTHROUGH : 0) |
+			(init_flags & KEYFRAME_INDEX ? INDEX : 0) |
+			(init_flags & SCAN_KEYFRAMES ? INDEX | SCAN_INDEX : 0) |
+			(init_flags & ACCURATE_SEEK ? ACCURATE : 0);
 
 	// egl callback in case we are rendering to texture
 	if (flags & RENDER_2_TEXTURE)
 		ilclient_set_fill_buffer_done_callback (client, fill_egl_texture_buffer, 0);
 
+	// serve local files from memory, anything else is left to libavformat
+	if (flags & MMAP)
+	{
+		UNSET_FLAG (READ_AHEAD)
+		if (open_mmap_input (&mapped_input, source, MMAP_WINDOW) == 0)
+		{
+			fmt_ctx         = avformat_alloc_context ();
+			fmt_ctx->pb     = mapped_input.avio;
+			fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+		}
+		else
+			UNSET_FLAG (MMAP)
+	}
+	else if (flags & READ_AHEAD)
+	{
+		if (open_read_ahead (&input, source, read_ahead_block_size, read_ahead_depth) == 0)
+		{
+			fmt_ctx         = avformat_alloc_context ();
+			fmt_ctx->pb     = input.avio;
+			fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+		}
+		else
+			UNSET_FLAG (READ_AHEAD)
+	}
     // open source
 	if (avformat_open_input (&fmt_ctx, source, NULL, NULL) < 0)
 	{
 		fprintf (stderr, "Could not open source %s\n", source);
+		if (flags & READ_AHEAD)
+			close_read_ahead (&input);
+		if (flags & MMAP)
+			close_mmap_input (&mapped_input);
 		return 1;
 	}
     // search for streams
@@ -1197,6 +2799,9 @@ int rpi_mp_open (const char* source, int* image_width, int* image_height, int64_
 				*image_width  = video_codec_ctx->width;
 				*image_height = video_codec_ctx->height;
 			}
+			// nothing can play it, leave the stream out
+			else if (video_route == ROUTE_NONE)
+				video_stream_idx = AVERROR_STREAM_NOT_FOUND;
 		}
 		// open audio
 		if (open_codec_context (&audio_stream_idx, AVMEDIA_TYPE_AUDIO) == 0)
@@ -1215,6 +2820,12 @@ int rpi_mp_open (const char* source, int* image_width, int* image_height, int64_
 
 		*duration = fmt_ctx->duration / AV_TIME_BASE;
 
+		// keyframes are indexed for the video stream only
+		if ((flags & INDEX) && video_stream_idx >= 0)
+			open_keyframe_index (source);
+		else
+			UNSET_FLAG (INDEX)
+
 		if (setup_clock() != 0)
 		{
 			fprintf (stderr, "Could not setup HW clock\n");
@@ -1241,13 +2852,52 @@ int rpi_mp_open (const char* source, int* image_width, int* image_height, int64_
 	av_packet.data = NULL;
 	av_packet.size = 0;
 	// init buffers
-	init_packet_buffer (&video_packet_fifo, 1024 * 1024 * 5);
-	init_packet_buffer (&audio_packet_fifo, 1024 * 1024 * 5);
+	// there is exactly one demuxer pushing and one decoding thread popping per fifo
+	enum packet_buffer_type fifo_type = flags & LOCKFREE_BUFFERS ? PACKET_BUFFER_SPSC : PACKET_BUFFER_MUTEX;
+	init_packet_buffer (&video_packet_fifo, FIFO_VIDEO_MAX_SIZE, FIFO_SLOTS, fifo_type);
+	init_packet_buffer (&audio_packet_fifo, FIFO_AUDIO_MAX_SIZE, FIFO_SLOTS, fifo_type);
+	set_packet_buffer_high_water (&video_packet_fifo, FIFO_HIGH_WATER_SLABS);
+	set_packet_buffer_high_water (&audio_packet_fifo, FIFO_HIGH_WATER_SLABS);
+	// demuxing pauses once a buffer holds high_ms of media and resumes below low_ms
+	if (video_stream_idx >= 0)
+		set_packet_buffer_watermarks (&video_packet_fifo,
+		                              video_stream->time_base,
+		                              fifo_watermarks[VIDEO_STREAM][0],
+		                              fifo_watermarks[VIDEO_STREAM][1]);
+	if (audio_stream_idx >= 0)
+		set_packet_buffer_watermarks (&audio_packet_fifo,
+		                              audio_stream->time_base,
+		                              fifo_watermarks[AUDIO_STREAM][0],
+		                              fifo_watermarks[AUDIO_STREAM][1]);
+	// one lane per stream that is played
+	init_demux_scheduler (&demuxer, DEMUX_OVERFLOW_SIZE);
+	video_lane = video_stream_idx >= 0 ? add_demux_lane (&demuxer, &video_packet_fifo) : -1;
+	audio_lane = audio_stream_idx >= 0 ? add_demux_lane (&demuxer, &audio_packet_fifo) : -1;
 end:
 	return ret;
 }
 
 
+int rpi_mp_set_read_ahead (unsigned int block_size, unsigned int depth)
+{
+	if (!block_size || !depth)
+		return 1;
+	read_ahead_block_size = block_size;
+	read_ahead_depth      = depth;
+	return 0;
+}
+
+
+int rpi_mp_set_buffering (int stream, unsigned int low_ms, unsigned int high_ms)
+{
+	if (stream != VIDEO_STREAM && stream != AUDIO_STREAM)
+		return 1;
+	fifo_watermarks[stream][0] = low_ms;
+	fifo_watermarks[stream][1] = high_ms;
+	return 0;
+}
+
+
 void rpi_mp_setup_render_buffer (void* _egl_image, pthread_mutex_t** draw_mutex, pthread_cond_t** draw_cond)
 {
 	egl_image   = _egl_image;
@@ -1259,25 +2909,66 @@ void rpi_mp_setup_render_buffer (void* _egl_image, pthread_mutex_t** draw_mutex,
 int rpi_mp_start ()
 {
 	// start threads
-	pthread_t video_decoding, audio_decoding;
+	pthread_t video_decoding, audio_decoding, pcm_submitting;
+	init_end_of_file_sync (&end_of_file, &seek_mutex, &seek_condition, &flags, STOPPED, DONE_READING,
+	                       SEEKING | SPEED_CHANGE, 2);
 	pthread_create (&video_decoding, NULL, (void*) &video_decoding_thread, NULL);
 	pthread_create (&audio_decoding, NULL, (void*) &audio_decoding_thread, NULL);
+	if (flags & DECODE_AHEAD)
+		pthread_create (&pcm_submitting, NULL, (void*) &pcm_submitting_thread, NULL);
 
 	// start clock
 	ilclient_change_component_state (video_clock, OMX_StateExecuting);
 
 	// read packets from source
-	while (~flags & STOPPED && (av_read_frame (fmt_ctx, &av_packet) >= 0))
+	int ret = 0;
+	demux_read_time = 0;
+	while (~flags & STOPPED)
 	{
-		if (process_packet() != 0)
+		// seeks are carried out here, between packets, so callers never wait on them
+		if (flags & SPEED_CHANGE)
+		{
+			change_speed ();
+			continue;
+		}
+		if (flags & SEEKING)
+		{
+			perform_seek ();
+			continue;
+		}
+		if (flags & TRICK_PLAY)
+		{
+			trick_play_step ();
+			continue;
+		}
+		int64_t t = av_gettime_relative ();
+		ret = av_read_frame (fmt_ctx, &av_packet);
+		demux_read_time += av_gettime_relative () - t;
+		// a seek asked for at the end of the file is still carried out
+		if (ret < 0 && (flags & SEEKING))
+			continue;
+		if (ret >= 0 && process_packet () != 0)
+			break;
+		// what is queued plays out, seeks may still rewind the file
+		if (ret < 0 && !wait_for_seek (ret))
 			break;
 	}
-	SET_FLAG (DONE_READING);
+	// hand over what the demuxer has put aside
+	if (!(flags & (STOPPED | DONE_READING)))
+		drain_demux_scheduler (&demuxer);
+	pthread_mutex_lock (&seek_mutex);
+	SET_FLAG (DONE_READING)
+	pthread_cond_broadcast (&seek_condition);
+	pthread_mutex_unlock (&seek_mutex);
+	close_packet_buffer (&video_packet_fifo);
+	close_packet_buffer (&audio_packet_fifo);
 	printf ("done reading\n");
 
 	// wait for all threads to end
 	pthread_join (video_decoding, NULL);
 	pthread_join (audio_decoding, NULL);
+	if (flags & DECODE_AHEAD)
+		pthread_join (pcm_submitting, NULL);
 	SET_FLAG (STOPPED);
 
 	// cleanup
@@ -1290,12 +2981,23 @@ int rpi_mp_start ()
 
 void rpi_mp_stop ()
 {
+	// what is still handed to the renderer fades out before it is flushed
+	fade_out ();
+	// the demuxer may wait for a seek at the end of the file
+	pthread_mutex_lock (&seek_mutex);
 	SET_FLAG (STOPPED);
+	pthread_cond_broadcast (&seek_condition);
+	pthread_mutex_unlock (&seek_mutex);
 	// make sure to unpause otherwise threads won't exit
 	if (flags & PAUSED)
         rpi_mp_pause();
+	// wake up threads waiting on the packet buffers
+	cancel_packet_buffer (&video_packet_fifo);
+	cancel_packet_buffer (&audio_packet_fifo);
+	if (flags & DECODE_AHEAD)
+		cancel_pcm_ring (&audio_ring);
 	// flush video component
-	if (video_stream_idx != AVERROR_STREAM_NOT_FOUND)
+	if (video_stream_idx != AVERROR_STREAM_NOT_FOUND && video_route == ROUTE_HARDWARE_DECODE)
 	{
 		OMX_ERRORTYPE omx_error;
 		if ((omx_error = OMX_SendCommand (ILC_GET_HANDLE (video_decode), OMX_CommandFlush, 130, NULL) != OMX_ErrorNone))
@@ -1310,8 +3012,14 @@ void rpi_mp_pause ()
 	memset (&scale, 0x0, sizeof (OMX_TIME_CONFIG_SCALETYPE));
 	scale.nSize 			= sizeof (OMX_TIME_CONFIG_SCALETYPE);
 	scale.nVersion.nVersion = OMX_VERSION;
-	scale.xScale 			= (flags & PAUSED ? 1 << 16 : 0);
+	scale.xScale 			= (flags & PAUSED ? playback_scale () : 0);
 
+	// audio fades out before the clock stops, and back in when resuming unless unpausing
+	// to stop
+	if (~flags & PAUSED)
+		fade_out ();
+	else if (~flags & STOPPED)
+		request_gain (GAIN_FADE_IN);
 	OMX_ERRORTYPE omx_error;
 	if ((omx_error = OMX_SetParameter (ILC_GET_HANDLE (video_clock), OMX_IndexConfigTimeScale, &scale)) != OMX_ErrorNone)
 	{
@@ -1343,11 +3051,58 @@ void rpi_mp_pause ()
 	}
 	else
 	{
+		pthread_mutex_lock (&pause_mutex);
 		UNSET_FLAG (PAUSED);
 		pthread_cond_broadcast (&pause_condition);
+		pthread_mutex_unlock (&pause_mutex);
+	}
+}
+
+int rpi_mp_audio_ring_status (unsigned int* fill_ms, unsigned int* underruns)
+{
+	if (~flags & DECODE_AHEAD)
+		return 1;
+	*fill_ms   = __atomic_load_n (&audio_ring.queued, __ATOMIC_RELAXED) / (pcm_bytes_per_ms ? pcm_bytes_per_ms : 1);
+	*underruns = audio_ring.underruns;
+	return 0;
+}
+
+int rpi_mp_set_video_sink (int sink, const char* name)
+{
+	if (sink != VIDEO_SINK_RENDER && sink != VIDEO_SINK_SHARED_MEMORY && sink != VIDEO_SINK_NULL)
+		return 1;
+	video_sink_type = sink;
+	snprintf (video_sink_name, sizeof (video_sink_name), "%s", name ? name : VIDEO_SHM_NAME);
+	return 0;
+}
+
+
+int rpi_mp_set_codec_route (const char* codec, int route)
+{
+	return set_codec_route (codec, route);
+}
+
+
+int rpi_mp_codec_route (int stream, int* route, double* cpu_per_second)
+{
+	codec_route* entry;
+	if (stream == VIDEO_STREAM && video_stream_idx >= 0)
+	{
+		entry  = video_codec_route;
+		*route = video_route;
+	}
+	else if (stream == AUDIO_STREAM && audio_stream_idx >= 0)
+	{
+		entry  = audio_codec_route;
+		*route = audio_route;
 	}
+	else
+		return 1;
+	*cpu_per_second = codec_route_cost (entry, *route);
+	return 0;
 }
 
+
 int rpi_mp_metadata (const char* key, char** title)
 {
 	AVDictionaryEntry* entry = NULL;
@@ -0,0 +1,227 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "rpi_mp_read_ahead.h"
+
+
+static inline int64_t now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/**
+ *	Reading thread. Fills free blocks of the ring in file order and hints the kernel
+ *	about the window that is going to be read next.
+ */
+static void* read_ahead_thread (void* arg)
+{
+	read_ahead* input = (read_ahead*) arg;
+	uint     slot, generation;
+	int64_t  position;
+	ssize_t  n;
+
+	pthread_mutex_lock (&input->mutex);
+	while (!input->stop)
+	{
+		if (input->count == input->depth || input->eof || input->error)
+		{
+			pthread_cond_wait (&input->cond, &input->mutex);
+			continue;
+		}
+		slot       = input->head;
+		position   = input->fill_position;
+		generation = input->generation;
+		pthread_mutex_unlock (&input->mutex);
+
+		// the slot is not visible to the demuxer until it is published below
+		n = pread (input->fd, input->blocks + (size_t) slot * input->block_size, input->block_size, position);
+		posix_fadvise (input->fd, position + input->block_size, (off_t) input->block_size * input->depth, POSIX_FADV_WILLNEED);
+
+		pthread_mutex_lock (&input->mutex);
+		// a seek happened while reading, the block belongs to the old position
+		if (generation != input->generation)
+			continue;
+		if (n < 0)
+			input->error = 1;
+		else if (n == 0)
+			input->eof = 1;
+		else
+		{
+			input->offsets[slot]  = position;
+			input->lengths[slot]  = n;
+			input->head           = (slot + 1) % input->depth;
+			input->count         ++;
+			input->fill_position += n;
+		}
+		pthread_cond_broadcast (&input->cond);
+	}
+	pthread_mutex_unlock (&input->mutex);
+	return NULL;
+}
+
+
+/**
+ *	AVIOContext read callback, serves data from the ring.
+ */
+static int read_packet (void* opaque, uint8_t* buf, int size)
+{
+	read_ahead* input = (read_ahead*) opaque;
+	int n;
+	int64_t t;
+
+	pthread_mutex_lock (&input->mutex);
+	if (input->count == 0 && !input->eof && !input->error)
+	{
+		t = now ();
+		while (input->count == 0 && !input->eof && !input->error)
+			pthread_cond_wait (&input->cond, &input->mutex);
+		input->stall_time += now () - t;
+		input->stalls ++;
+	}
+	if (input->count == 0)
+	{
+		n = input->error ? AVERROR (EIO) : AVERROR_EOF;
+		goto end;
+	}
+	n = input->lengths[input->tail] - input->read_offset;
+	if (n > size)
+		n = size;
+	memcpy (buf, input->blocks + (size_t) input->tail * input->block_size + input->read_offset, n);
+	input->read_offset += n;
+	// block consumed, give it back to the reading thread
+	if (input->read_offset == input->lengths[input->tail])
+	{
+		input->tail        = (input->tail + 1) % input->depth;
+		input->count      --;
+		input->read_offset = 0;
+		pthread_cond_broadcast (&input->cond);
+	}
+end:
+	pthread_mutex_unlock (&input->mutex);
+	return n;
+}
+
+
+/**
+ *	AVIOContext seek callback.
+ *	Seeking forward within what has been read ahead just drops blocks, anything else
+ *	cancels the blocks in the ring and refills it from the new position.
+ */
+static int64_t seek (void* opaque, int64_t offset, int whence)
+{
+	read_ahead* input = (read_ahead*) opaque;
+	int64_t position;
+
+	if (whence & AVSEEK_SIZE)
+		return input->file_size;
+
+	pthread_mutex_lock (&input->mutex);
+	switch (whence & ~AVSEEK_FORCE)
+	{
+		case SEEK_SET:
+			position = offset;
+			break;
+		case SEEK_CUR:
+			position = (input->count ? input->offsets[input->tail] + input->read_offset : input->fill_position) + offset;
+			break;
+		case SEEK_END:
+			position = input->file_size + offset;
+			break;
+		default:
+			pthread_mutex_unlock (&input->mutex);
+			return AVERROR (EINVAL);
+	}
+	if (position < 0)
+	{
+		pthread_mutex_unlock (&input->mutex);
+		return AVERROR (EINVAL);
+	}
+
+	// skip blocks that are before the new position
+	while (input->count && position >= input->offsets[input->tail] + input->lengths[input->tail])
+	{
+		input->tail   = (input->tail + 1) % input->depth;
+		input->count --;
+	}
+	if (input->count && position >= input->offsets[input->tail])
+		input->read_offset = position - input->offsets[input->tail];
+	else
+	{
+		// not read ahead, start over
+		input->generation ++;
+		input->count         = 0;
+		input->head          = input->tail;
+		input->read_offset   = 0;
+		input->fill_position = position;
+		input->eof           = 0;
+		input->error         = 0;
+	}
+	pthread_cond_broadcast (&input->cond);
+	pthread_mutex_unlock (&input->mutex);
+	return position;
+}
+
+
+int open_read_ahead (read_ahead* input, const char* file, uint block_size, uint depth)
+{
+	struct stat st;
+	unsigned char* avio_buffer;
+
+	memset (input, 0x0, sizeof (read_ahead));
+	if ((input->fd = open (file, O_RDONLY)) < 0)
+		return 1;
+	if (fstat (input->fd, &st) != 0 || !S_ISREG (st.st_mode) || !block_size || !depth)
+	{
+		close (input->fd);
+		return 1;
+	}
+	input->file_size  = st.st_size;
+	input->block_size = block_size;
+	input->depth      = depth;
+	input->blocks     = (uint8_t*) malloc ((size_t) block_size * depth);
+	input->offsets    = (int64_t*) malloc (sizeof (int64_t) * depth);
+	input->lengths    = (int*)     malloc (sizeof (int) * depth);
+	avio_buffer       = (unsigned char*) av_malloc (block_size);
+	if (!input->blocks || !input->offsets || !input->lengths || !avio_buffer ||
+		!(input->avio = avio_alloc_context (avio_buffer, block_size, 0, input, read_packet, NULL, seek)))
+	{
+		av_free (avio_buffer);
+		free (input->blocks);
+		free (input->offsets);
+		free (input->lengths);
+		close (input->fd);
+		return 1;
+	}
+	posix_fadvise (input->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	pthread_mutex_init (&input->mutex, NULL);
+	pthread_cond_init (&input->cond, NULL);
+	pthread_create (&input->thread, NULL, read_ahead_thread, input);
+	return 0;
+}
+
+
+void close_read_ahead (read_ahead* input)
+{
+	if (!input->avio)
+		return;
+
+	pthread_mutex_lock (&input->mutex);
+	input->stop = 1;
+	pthread_cond_broadcast (&input->cond);
+	pthread_mutex_unlock (&input->mutex);
+	pthread_join (input->thread, NULL);
+
+	av_freep (&input->avio->buffer);
+	av_freep (&input->avio);
+	free (input->blocks);
+	free (input->offsets);
+	free (input->lengths);
+	close (input->fd);
+	pthread_mutex_destroy (&input->mutex);
+	pthread_cond_destroy (&input->cond);
+}
@@ -0,0 +1,328 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/avutil.h>
+#include "rpi_mp.h"
+#include "rpi_mp_cpu.h"
+#include "rpi_mp_pcm.h"
+#include "rpi_mp_resample.h"
+
+static const resample_kernels* kernels = &resample_kernels_c;
+static pthread_once_t          kernels_once = PTHREAD_ONCE_INIT;
+static resample_bank*          banks;
+static pthread_mutex_t         banks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// taps, Kaiser beta and passband, as a fraction of the lower Nyquist frequency, per quality
+static const struct
+{
+	int   taps;
+	float beta;
+	float cutoff;
+}
+qualities[] =
+{
+	{ 16, 5.0f, 0.88f },
+	{ 32, 7.0f, 0.93f },
+	{ 64, 9.0f, 0.96f },
+};
+
+
+float resample_dot_c (const float* a, const float* b, int n)
+{
+	float dot = 0;
+	int i;
+	for (i = 0; i < n; i ++)
+		dot += a[i] * b[i];
+	return dot;
+}
+
+
+const resample_kernels resample_kernels_c =
+{
+	"c",
+	resample_dot_c
+};
+
+
+static void pick_kernels ()
+{
+	switch (best_cpu_kernels ())
+	{
+#if defined(__arm__) || defined(__aarch64__)
+		case CPU_KERNELS_NEON:
+			kernels = &resample_kernels_neon;
+		break;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+		case CPU_KERNELS_AVX2:
+			kernels = &resample_kernels_avx2;
+		break;
+
+		case CPU_KERNELS_SSE2:
+			kernels = &resample_kernels_sse2;
+		break;
+#endif
+		default:
+		break;
+	}
+}
+
+
+const char* resample_kernel_name ()
+{
+	pthread_once (&kernels_once, pick_kernels);
+	return kernels->name;
+}
+
+
+void set_resample_kernels (const resample_kernels* chosen)
+{
+	pthread_once (&kernels_once, pick_kernels);
+	kernels = chosen;
+}
+
+
+static int gcd (int a, int b)
+{
+	int t;
+	while (b)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+
+/**
+ *	Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+ */
+static double bessel_i0 (double x)
+{
+	double sum = 1, term = 1;
+	int k;
+	for (k = 1; k < 50 && term > sum * 1e-12; k ++)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum  += term;
+	}
+	return sum;
+}
+
+
+/**
+ *	Design the filter bank: phase p sits p / phases of an input sample after tap taps / 2 - 1,
+ *	each phase is normalized to unity gain.
+ */
+static resample_bank* design_bank (int in_rate, int out_rate, int quality)
+{
+	resample_bank* bank;
+	int g = gcd (in_rate, out_rate);
+	int taps = qualities[quality].taps;
+	double cutoff = qualities[quality].cutoff * (out_rate < in_rate ? (double) out_rate / in_rate : 1);
+	double beta = qualities[quality].beta;
+	double x, w, sum;
+	float* phase;
+	int p, k;
+
+	if ((bank = calloc (1, sizeof (resample_bank))) == NULL)
+		return NULL;
+	bank->in_rate  = in_rate;
+	bank->out_rate = out_rate;
+	bank->quality  = quality;
+	bank->up       = out_rate / g;
+	bank->down     = in_rate / g;
+	bank->phases   = bank->up < RESAMPLE_MAX_PHASES ? bank->up : RESAMPLE_MAX_PHASES;
+	bank->taps     = taps;
+	if ((bank->coefficients = malloc ((size_t) bank->phases * taps * sizeof (float))) == NULL)
+	{
+		free (bank);
+		return NULL;
+	}
+	for (p = 0; p < bank->phases; p ++)
+	{
+		phase = bank->coefficients + (size_t) p * taps;
+		sum   = 0;
+		for (k = 0; k < taps; k ++)
+		{
+			x = k - (taps / 2 - 1) - (double) p / bank->phases;
+			w = 1 - (x / (taps / 2)) * (x / (taps / 2));
+			phase[k] = (x == 0 ? cutoff : sin (M_PI * cutoff * x) / (M_PI * x)) * (w > 0 ? bessel_i0 (beta * sqrt (w)) / bessel_i0 (beta) : 0);
+			sum += phase[k];
+		}
+		for (k = 0; k < taps; k ++)
+			phase[k] /= sum;
+	}
+	return bank;
+}
+
+
+/**
+ *	The cached bank for the rates and quality, designed on first use.
+ */
+static const resample_bank* get_bank (int in_rate, int out_rate, int quality)
+{
+	resample_bank* bank;
+
+	pthread_mutex_lock (&banks_mutex);
+	for (bank = banks; bank; bank = bank->next)
+		if (bank->in_rate == in_rate && bank->out_rate == out_rate && bank->quality == quality)
+			break;
+	if (!bank && (bank = design_bank (in_rate, out_rate, quality)) != NULL)
+	{
+		bank->next = banks;
+		banks      = bank;
+	}
+	pthread_mutex_unlock (&banks_mutex);
+	return bank;
+}
+
+
+int init_resampler (resampler* resampler, int channels, int in_rate, int out_rate, int quality)
+{
+	memset (resampler, 0, sizeof (*resampler));
+	if (channels <= 0 || channels > RESAMPLE_MAX_CHANNELS || in_rate <= 0 || out_rate <= 0 ||
+	    quality < RESAMPLE_LOW || quality > RESAMPLE_HIGH)
+		return 1;
+	pthread_once (&kernels_once, pick_kernels);
+	resampler->channels = channels;
+	if ((resampler->bank = get_bank (in_rate, out_rate, quality)) == NULL)
+		return 1;
+	reset_resampler (resampler);
+	return 0;
+}
+
+
+void destroy_resampler (resampler* resampler)
+{
+	int c;
+	for (c = 0; c < RESAMPLE_MAX_CHANNELS; c ++)
+	{
+		free (resampler->input[c]);
+		resampler->input[c] = NULL;
+	}
+	free (resampler->output);
+	free (resampler->output_s16);
+	resampler->output     = NULL;
+	resampler->output_s16 = NULL;
+	resampler->bank       = NULL;
+}
+
+
+void reset_resampler (resampler* resampler)
+{
+	// half a filter of silence before the first sample, so it is the first one out
+	resampler->input_samples = 0;
+	resampler->index         = 0;
+	resampler->phase         = 0;
+	resampler->input_time    = AV_NOPTS_VALUE;
+	if (resampler->bank && resampler->input_capacity >= resampler->bank->taps)
+	{
+		int c;
+		resampler->input_samples = resampler->bank->taps / 2 - 1;
+		for (c = 0; c < resampler->channels; c ++)
+			memset (resampler->input[c], 0, resampler->input_samples * sizeof (float));
+	}
+}
+
+
+/**
+ *	Make room for the input and for the output it can give.
+ */
+static int grow (resampler* resampler, int samples)
+{
+	const resample_bank* bank = resampler->bank;
+	int needed = resampler->input_samples + samples + bank->taps;
+	int capacity, c, fresh = resampler->input_capacity == 0;
+	float* input;
+
+	if (needed > resampler->input_capacity)
+	{
+		capacity = needed * 2;
+		for (c = 0; c < resampler->channels; c ++)
+		{
+			if ((input = realloc (resampler->input[c], capacity * sizeof (float))) == NULL)
+				return 1;
+			resampler->input[c] = input;
+		}
+		resampler->input_capacity = capacity;
+		if (fresh)
+			reset_resampler (resampler);
+	}
+	capacity = (int) ((int64_t) needed * bank->up / bank->down) + 1;
+	if (capacity > resampler->output_capacity)
+	{
+		free (resampler->output);
+		free (resampler->output_s16);
+		resampler->output     = malloc ((size_t) capacity * resampler->channels * sizeof (float));
+		resampler->output_s16 = malloc ((size_t) capacity * resampler->channels * sizeof (int16_t));
+		if (!resampler->output || !resampler->output_s16)
+		{
+			resampler->output_capacity = 0;
+			return 1;
+		}
+		resampler->output_capacity = capacity;
+	}
+	return 0;
+}
+
+
+int resample (resampler* resampler, const int16_t* in, int samples, int64_t time,
+              const int16_t** out, int64_t* out_time)
+{
+	const resample_bank* bank = resampler->bank;
+	int ch = resampler->channels;
+	int64_t cpu = thread_cpu_time ();
+	int i, c, used, produced = 0;
+	const float* phase;
+	float* output;
+
+	if (grow (resampler, samples) != 0)
+		return -1;
+	// the input is timed by its first sample, from each new timestamp so rounding does not add up
+	if (time != AV_NOPTS_VALUE)
+		resampler->input_time = time - (int64_t) resampler->input_samples * 1000000 / bank->in_rate;
+	for (c = 0; c < ch; c ++)
+		for (i = 0; i < samples; i ++)
+			resampler->input[c][resampler->input_samples + i] = in[i * ch + c] * (1.0f / 32768);
+	resampler->input_samples += samples;
+	resampler->samples_in    += samples;
+
+	// an output sample is timed by the input sample its phase follows
+	*out_time = resampler->input_time != AV_NOPTS_VALUE ?
+	            resampler->input_time + (int64_t) (resampler->index + bank->taps / 2 - 1) * 1000000 / bank->in_rate +
+	            (int64_t) resampler->phase * 1000000 / ((int64_t) bank->up * bank->in_rate) : AV_NOPTS_VALUE;
+	output = resampler->output;
+	while (resampler->index + bank->taps <= resampler->input_samples)
+	{
+		phase = bank->coefficients + (size_t) (bank->phases == bank->up ? resampler->phase :
+		                                       (int64_t) resampler->phase * bank->phases / bank->up) * bank->taps;
+		for (c = 0; c < ch; c ++)
+			*output ++ = kernels->dot (resampler->input[c] + resampler->index, phase, bank->taps);
+		produced ++;
+		resampler->phase += bank->down;
+		resampler->index += resampler->phase / bank->up;
+		resampler->phase %= bank->up;
+	}
+
+	// let go of the input before the next output sample
+	// when decimating by more than the filter is long it may lie beyond what was given
+	if ((used = resampler->index < resampler->input_samples ? resampler->index : resampler->input_samples) > 0)
+	{
+		for (c = 0; c < ch; c ++)
+			memmove (resampler->input[c], resampler->input[c] + used, (resampler->input_samples - used) * sizeof (float));
+		resampler->input_samples -= used;
+		resampler->index         -= used;
+		if (resampler->input_time != AV_NOPTS_VALUE)
+			resampler->input_time += (int64_t) used * 1000000 / bank->in_rate;
+	}
+
+	if (produced > 0)
+		pcm_to_s16 (resampler->output_s16, (uint8_t* const*) &resampler->output, AV_SAMPLE_FMT_FLT, ch, ch, produced);
+	*out = resampler->output_s16;
+	resampler->samples_out += produced;
+	resampler->cpu         += thread_cpu_time () - cpu;
+	return produced;
+}
@@ -0,0 +1,32 @@
+#include "rpi_mp_resample.h"
+#if defined(__arm__) || defined(__aarch64__)
+// built with NEON enabled even when the rest targets ARMv6, only called if the CPU has it
+#include <arm_neon.h>
+
+static float dot_neon (const float* a, const float* b, int n)
+{
+	float32x4_t sum0 = vdupq_n_f32 (0), sum1 = vdupq_n_f32 (0);
+	float32x4_t sum2 = vdupq_n_f32 (0), sum3 = vdupq_n_f32 (0);
+	float32x2_t half;
+	int i;
+
+	// four sums so the multiply-accumulates don't wait on each other
+	for (i = 0; i < n; i += 16)
+	{
+		sum0 = vmlaq_f32 (sum0, vld1q_f32 (a + i),      vld1q_f32 (b + i));
+		sum1 = vmlaq_f32 (sum1, vld1q_f32 (a + i + 4),  vld1q_f32 (b + i + 4));
+		sum2 = vmlaq_f32 (sum2, vld1q_f32 (a + i + 8),  vld1q_f32 (b + i + 8));
+		sum3 = vmlaq_f32 (sum3, vld1q_f32 (a + i + 12), vld1q_f32 (b + i + 12));
+	}
+	sum0 = vaddq_f32 (vaddq_f32 (sum0, sum1), vaddq_f32 (sum2, sum3));
+	half = vadd_f32 (vget_low_f32 (sum0), vget_high_f32 (sum0));
+	return vget_lane_f32 (vpadd_f32 (half, half), 0);
+}
+
+
+const resample_kernels resample_kernels_neon =
+{
+	"neon",
+	dot_neon
+};
+#endif
@@ -0,0 +1,60 @@
+#include "rpi_mp_resample.h"
+#if defined(__x86_64__) || defined(__i386__)
+// x86 kernels let the resampling be checked and measured on a host, the player itself runs on ARM
+#include <immintrin.h>
+
+__attribute__ ((target ("sse2")))
+static inline float add_across_sse2 (__m128 v)
+{
+	v = _mm_add_ps (v, _mm_movehl_ps (v, v));
+	v = _mm_add_ss (v, _mm_shuffle_ps (v, v, 1));
+	return _mm_cvtss_f32 (v);
+}
+
+
+__attribute__ ((target ("sse2")))
+static float dot_sse2 (const float* a, const float* b, int n)
+{
+	__m128 sum0 = _mm_setzero_ps (), sum1 = _mm_setzero_ps ();
+	__m128 sum2 = _mm_setzero_ps (), sum3 = _mm_setzero_ps ();
+	int i;
+
+	for (i = 0; i < n; i += 16)
+	{
+		sum0 = _mm_add_ps (sum0, _mm_mul_ps (_mm_loadu_ps (a + i),      _mm_loadu_ps (b + i)));
+		sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_loadu_ps (a + i + 4),  _mm_loadu_ps (b + i + 4)));
+		sum2 = _mm_add_ps (sum2, _mm_mul_ps (_mm_loadu_ps (a + i + 8),  _mm_loadu_ps (b + i + 8)));
+		sum3 = _mm_add_ps (sum3, _mm_mul_ps (_mm_loadu_ps (a + i + 12), _mm_loadu_ps (b + i + 12)));
+	}
+	return add_across_sse2 (_mm_add_ps (_mm_add_ps (sum0, sum1), _mm_add_ps (sum2, sum3)));
+}
+
+
+__attribute__ ((target ("avx2")))
+static float dot_avx2 (const float* a, const float* b, int n)
+{
+	__m256 sum0 = _mm256_setzero_ps (), sum1 = _mm256_setzero_ps ();
+	int i;
+
+	for (i = 0; i < n; i += 16)
+	{
+		sum0 = _mm256_add_ps (sum0, _mm256_mul_ps (_mm256_loadu_ps (a + i),     _mm256_loadu_ps (b + i)));
+		sum1 = _mm256_add_ps (sum1, _mm256_mul_ps (_mm256_loadu_ps (a + i + 8), _mm256_loadu_ps (b + i + 8)));
+	}
+	sum0 = _mm256_add_ps (sum0, sum1);
+	return add_across_sse2 (_mm_add_ps (_mm256_castps256_ps128 (sum0), _mm256_extractf128_ps (sum0, 1)));
+}
+
+
+const resample_kernels resample_kernels_sse2 =
+{
+	"sse2",
+	dot_sse2
+};
+
+const resample_kernels resample_kernels_avx2 =
+{
+	"avx2",
+	dot_avx2
+};
+#endif
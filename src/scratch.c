@@ -0,0 +1,88 @@
+#include <libavutil/mem.h>
+#include "rpi_mp_scratch.h"
+
+// alignment of every allocation, enough for NEON and AVX
+#define SCRATCH_ALIGN 32
+
+#define ALIGN_UP(n) (((n) + SCRATCH_ALIGN - 1) & ~(size_t) (SCRATCH_ALIGN - 1))
+
+/**
+ *	Heap allocation made when the block ran out, the data follows the header.
+ */
+typedef struct scratch_chunk
+{
+	struct scratch_chunk * next;
+} scratch_chunk ;
+
+
+int init_scratch_arena (scratch_arena* arena, size_t size)
+{
+	arena->size        = ALIGN_UP (size);
+	arena->used        = 0;
+	arena->wanted      = 0;
+	arena->overflow    = NULL;
+	arena->allocations = 0;
+	if ((arena->block = av_malloc (arena->size)) == NULL)
+	{
+		arena->size = 0;
+		return 1;
+	}
+	return 0;
+}
+
+
+void destroy_scratch_arena (scratch_arena* arena)
+{
+	reset_scratch_arena (arena);
+	av_freep (&arena->block);
+	arena->size = 0;
+}
+
+
+void* scratch_alloc (scratch_arena* arena, size_t size)
+{
+	scratch_chunk* chunk;
+	void* memory;
+
+	size = ALIGN_UP (size);
+	arena->wanted += size;
+	if (arena->used + size <= arena->size)
+	{
+		memory       = arena->block + arena->used;
+		arena->used += size;
+		return memory;
+	}
+
+	// keep what was handed out valid, the block only grows on reset
+	if ((chunk = av_malloc (SCRATCH_ALIGN + size)) == NULL)
+		return NULL;
+	arena->allocations ++;
+	chunk->next     = arena->overflow;
+	arena->overflow = chunk;
+	return (uint8_t*) chunk + SCRATCH_ALIGN;
+}
+
+
+void reset_scratch_arena (scratch_arena* arena)
+{
+	scratch_chunk* chunk;
+	uint8_t* block;
+	size_t size;
+
+	while ((chunk = arena->overflow))
+	{
+		arena->overflow = chunk->next;
+		av_free (chunk);
+	}
+	// grow with some room so a slowly rising peak does not grow it every round
+	size = ALIGN_UP (arena->wanted + arena->wanted / 4);
+	if (arena->wanted > arena->size && (block = av_malloc (size)) != NULL)
+	{
+		av_free (arena->block);
+		arena->block = block;
+		arena->size  = size;
+		arena->allocations ++;
+	}
+	arena->used   = 0;
+	arena->wanted = 0;
+}
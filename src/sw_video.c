@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "rpi_mp_sw_video.h"
+
+
+int open_sw_video_decoder (sw_video_decoder* decoder, AVCodecContext* codec_ctx, AVRational time_base, video_sink* sink)
+{
+	const AVCodec* codec = codec_ctx->codec ? codec_ctx->codec : avcodec_find_decoder (codec_ctx->codec_id);
+	long cores = sysconf (_SC_NPROCESSORS_ONLN);
+
+	memset (decoder, 0, sizeof (sw_video_decoder));
+	if (!codec)
+		return 1;
+	// threading is set up when the codec is opened
+	if (codec_ctx->codec)
+		avcodec_close (codec_ctx);
+	codec_ctx->thread_count = cores > 1 ? cores : 1;
+	codec_ctx->thread_type  = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS ? FF_THREAD_FRAME : 0) |
+	                          (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS ? FF_THREAD_SLICE : 0);
+	if (avcodec_open2 (codec_ctx, codec, NULL) < 0)
+	{
+		fprintf (stderr, "Failed to open %s for software decoding\n", codec->name);
+		return 1;
+	}
+	if ((decoder->frame = av_frame_alloc ()) == NULL)
+		return 1;
+	printf ("Decoding %s on the CPU with %d threads into the %s sink\n", codec->name, codec_ctx->thread_count, sink->ops->name);
+
+	decoder->codec_ctx     = codec_ctx;
+	decoder->time_base     = time_base;
+	decoder->sink          = sink;
+	decoder->discard_until = AV_NOPTS_VALUE;
+	return 0;
+}
+
+
+int sw_video_decode (sw_video_decoder* decoder, const AVPacket* packet)
+{
+	int64_t pts;
+	int ret;
+
+	if ((ret = avcodec_send_packet (decoder->codec_ctx, packet)) < 0 && ret != AVERROR_EOF)
+		return ret;
+	while ((ret = avcodec_receive_frame (decoder->codec_ctx, decoder->frame)) == 0)
+	{
+		// frames come out in presentation order, later than their packets with frame threading
+		pts = av_frame_get_best_effort_timestamp (decoder->frame);
+		if (pts != AV_NOPTS_VALUE)
+			pts = av_rescale_q (pts, decoder->time_base, AV_TIME_BASE_Q);
+		decoder->frames ++;
+		if (decoder->discard_until != AV_NOPTS_VALUE)
+		{
+			if (pts != AV_NOPTS_VALUE && pts < decoder->discard_until)
+			{
+				decoder->discarded ++;
+				continue;
+			}
+			decoder->discard_until = AV_NOPTS_VALUE;
+		}
+		if (write_video_sink (decoder->sink, decoder->frame, pts) != 0)
+		{
+			av_frame_unref (decoder->frame);
+			return 1;
+		}
+	}
+	av_frame_unref (decoder->frame);
+	if (ret == AVERROR (EAGAIN) || ret == AVERROR_EOF)
+		return 0;
+	return ret;
+}
+
+
+void flush_sw_video_decoder (sw_video_decoder* decoder)
+{
+	if (decoder->codec_ctx)
+		avcodec_flush_buffers (decoder->codec_ctx);
+}
+
+
+void close_sw_video_decoder (sw_video_decoder* decoder)
+{
+	av_frame_free (&decoder->frame);
+	decoder->codec_ctx = NULL;
+}
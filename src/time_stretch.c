@@ -0,0 +1,269 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/avutil.h>
+#include "rpi_mp_cpu.h"
+#include "rpi_mp_pcm.h"
+#include "rpi_mp_time_stretch.h"
+
+// milliseconds of a segment, of the overlap and of the window searched, as in SoundTouch
+#define SEQUENCE_MS 40
+#define OVERLAP_MS  8
+#define SEARCH_MS   15
+#define MIN_TEMPO   0.25
+#define MAX_TEMPO   4.0
+
+static const time_stretch_kernels* kernels = &time_stretch_kernels_c;
+static pthread_once_t              kernels_once = PTHREAD_ONCE_INIT;
+
+
+float time_stretch_correlate_c (const float* a, const float* b, int n, float* energy)
+{
+	float dot = 0, e = 0;
+	int i;
+	for (i = 0; i < n; i ++)
+	{
+		dot += a[i] * b[i];
+		e   += b[i] * b[i];
+	}
+	*energy = e;
+	return dot;
+}
+
+
+void time_stretch_cross_fade_c (float* out, const float* a, const float* b, const float* fade, int n)
+{
+	int i;
+	for (i = 0; i < n; i ++)
+		out[i] = a[i] + (b[i] - a[i]) * fade[i];
+}
+
+
+const time_stretch_kernels time_stretch_kernels_c =
+{
+	"c",
+	time_stretch_correlate_c,
+	time_stretch_cross_fade_c
+};
+
+
+static void pick_kernels ()
+{
+	switch (best_cpu_kernels ())
+	{
+#if defined(__arm__) || defined(__aarch64__)
+		case CPU_KERNELS_NEON:
+			kernels = &time_stretch_kernels_neon;
+		break;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+		case CPU_KERNELS_AVX2:
+			kernels = &time_stretch_kernels_avx2;
+		break;
+
+		case CPU_KERNELS_SSE2:
+			kernels = &time_stretch_kernels_sse2;
+		break;
+#endif
+		default:
+		break;
+	}
+}
+
+
+const char* time_stretch_kernel_name ()
+{
+	pthread_once (&kernels_once, pick_kernels);
+	return kernels->name;
+}
+
+
+void set_time_stretch_kernels (const time_stretch_kernels* chosen)
+{
+	pthread_once (&kernels_once, pick_kernels);
+	kernels = chosen;
+}
+
+
+int init_time_stretcher (time_stretcher* stretcher, int channels, int sample_rate)
+{
+	int i, c;
+
+	memset (stretcher, 0, sizeof (time_stretcher));
+	if (channels <= 0 || sample_rate <= 0)
+		return 1;
+	stretcher->channels    = channels;
+	stretcher->sample_rate = sample_rate;
+	stretcher->tempo       = 1;
+	stretcher->sequence    = sample_rate * SEQUENCE_MS / 1000;
+	stretcher->overlap     = sample_rate * OVERLAP_MS  / 1000;
+	stretcher->search      = sample_rate * SEARCH_MS   / 1000;
+	stretcher->input_time  = AV_NOPTS_VALUE;
+	if ((stretcher->tail = malloc (stretcher->overlap * channels * sizeof (float))) == NULL ||
+	    (stretcher->fade = malloc (stretcher->overlap * channels * sizeof (float))) == NULL)
+	{
+		destroy_time_stretcher (stretcher);
+		return 1;
+	}
+	for (i = 0; i < stretcher->overlap; i ++)
+		for (c = 0; c < channels; c ++)
+			stretcher->fade[i * channels + c] = (i + 0.5f) / stretcher->overlap;
+	pthread_once (&kernels_once, pick_kernels);
+	return 0;
+}
+
+
+void destroy_time_stretcher (time_stretcher* stretcher)
+{
+	free (stretcher->input);
+	free (stretcher->tail);
+	free (stretcher->fade);
+	free (stretcher->output);
+	free (stretcher->output_s16);
+	stretcher->input      = NULL;
+	stretcher->tail       = NULL;
+	stretcher->fade       = NULL;
+	stretcher->output     = NULL;
+	stretcher->output_s16 = NULL;
+}
+
+
+void reset_time_stretcher (time_stretcher* stretcher)
+{
+	stretcher->input_samples = 0;
+	stretcher->position      = 0;
+	stretcher->input_time    = AV_NOPTS_VALUE;
+	stretcher->has_tail      = 0;
+}
+
+
+void set_time_stretch_tempo (time_stretcher* stretcher, double tempo)
+{
+	stretcher->tempo = tempo < MIN_TEMPO ? MIN_TEMPO : tempo > MAX_TEMPO ? MAX_TEMPO : tempo;
+}
+
+
+/**
+ *	Offset in the search window from p at which the input matches the tail best, by
+ *	correlation normalized by the energy of the input.
+ */
+static int best_offset (time_stretcher* stretcher, int p)
+{
+	int n = stretcher->overlap * stretcher->channels;
+	const float* in = stretcher->input + (size_t) p * stretcher->channels;
+	float dot, energy, score, best_score = -INFINITY;
+	int k, best = 0;
+
+	for (k = 0; k < stretcher->search; k ++, in += stretcher->channels)
+	{
+		dot = kernels->correlate (stretcher->tail, in, n, &energy);
+		score = dot / sqrtf (energy + 1e-9f);
+		if (score > best_score)
+		{
+			best_score = score;
+			best       = k;
+		}
+	}
+	return best;
+}
+
+
+/**
+ *	Make room for the input and for the output it can give.
+ */
+static int grow (time_stretcher* stretcher, int samples)
+{
+	int ch = stretcher->channels;
+	int step = stretcher->sequence - stretcher->overlap;
+	int capacity;
+	float* input;
+
+	if (stretcher->input_samples + samples > stretcher->input_capacity)
+	{
+		capacity = (stretcher->input_samples + samples) * 2;
+		if ((input = realloc (stretcher->input, (size_t) capacity * ch * sizeof (float))) == NULL)
+			return 1;
+		stretcher->input          = input;
+		stretcher->input_capacity = capacity;
+	}
+	// at most a segment per step of the tempo over what is buffered
+	capacity = ((stretcher->input_samples + samples) / (step * MIN_TEMPO) + 1) * step;
+	if (capacity > stretcher->output_capacity)
+	{
+		free (stretcher->output);
+		free (stretcher->output_s16);
+		stretcher->output     = malloc ((size_t) capacity * ch * sizeof (float));
+		stretcher->output_s16 = malloc ((size_t) capacity * ch * sizeof (int16_t));
+		if (!stretcher->output || !stretcher->output_s16)
+		{
+			stretcher->output_capacity = 0;
+			return 1;
+		}
+		stretcher->output_capacity = capacity;
+	}
+	return 0;
+}
+
+
+int time_stretch (time_stretcher* stretcher, const int16_t* in, int samples, int64_t time,
+                  const int16_t** out, int64_t* out_time)
+{
+	int ch   = stretcher->channels;
+	int step = stretcher->sequence - stretcher->overlap;
+	int64_t cpu = thread_cpu_time ();
+	int i, p, k, used, produced = 0;
+	float* input;
+	float* output;
+	const float* segment;
+
+	if (grow (stretcher, samples) != 0)
+		return -1;
+	// the input is timed by its first sample, from each new timestamp so rounding does not add up
+	if (time != AV_NOPTS_VALUE)
+		stretcher->input_time = time - (int64_t) stretcher->input_samples * 1000000 / stretcher->sample_rate;
+	input = stretcher->input + (size_t) stretcher->input_samples * ch;
+	for (i = 0; i < samples * ch; i ++)
+		input[i] = in[i] * (1.0f / 32768);
+	stretcher->input_samples += samples;
+	stretcher->samples_in    += samples;
+
+	*out_time = stretcher->input_time != AV_NOPTS_VALUE ?
+	            stretcher->input_time + (int64_t) stretcher->position * 1000000 / stretcher->sample_rate : AV_NOPTS_VALUE;
+	output = stretcher->output;
+	while ((p = (int) stretcher->position) + stretcher->search + stretcher->sequence <= stretcher->input_samples)
+	{
+		// the first segment has nothing to match and is taken as it is
+		k = stretcher->has_tail ? best_offset (stretcher, p) : 0;
+		segment = stretcher->input + (size_t) (p + k) * ch;
+		if (stretcher->has_tail)
+			kernels->cross_fade (output, stretcher->tail, segment, stretcher->fade, stretcher->overlap * ch);
+		else
+			memcpy (output, segment, stretcher->overlap * ch * sizeof (float));
+		memcpy (output + stretcher->overlap * ch, segment + stretcher->overlap * ch, (step - stretcher->overlap) * ch * sizeof (float));
+		memcpy (stretcher->tail, segment + step * ch, stretcher->overlap * ch * sizeof (float));
+		stretcher->has_tail = 1;
+		output   += step * ch;
+		produced += step;
+		stretcher->position += step * stretcher->tempo;
+	}
+
+	// let go of the input before the next segment
+	if ((used = (int) stretcher->position) > stretcher->input_samples)
+		used = stretcher->input_samples;
+	if (used > 0)
+	{
+		memmove (stretcher->input, stretcher->input + (size_t) used * ch, (size_t) (stretcher->input_samples - used) * ch * sizeof (float));
+		stretcher->input_samples -= used;
+		stretcher->position      -= used;
+		if (stretcher->input_time != AV_NOPTS_VALUE)
+			stretcher->input_time += (int64_t) used * 1000000 / stretcher->sample_rate;
+	}
+
+	if (produced > 0)
+		pcm_to_s16 (stretcher->output_s16, (uint8_t* const*) &stretcher->output, AV_SAMPLE_FMT_FLT, ch, ch, produced);
+	*out = stretcher->output_s16;
+	stretcher->samples_out += produced;
+	stretcher->cpu         += thread_cpu_time () - cpu;
+	return produced;
+}
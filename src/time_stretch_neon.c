@@ -0,0 +1,56 @@
+#include "rpi_mp_time_stretch.h"
+#if defined(__arm__) || defined(__aarch64__)
+// built with NEON enabled even when the rest targets ARMv6, only called if the CPU has it
+#include <arm_neon.h>
+
+static inline float add_across (float32x4_t v)
+{
+	float32x2_t half = vadd_f32 (vget_low_f32 (v), vget_high_f32 (v));
+	return vget_lane_f32 (vpadd_f32 (half, half), 0);
+}
+
+
+static float correlate_neon (const float* a, const float* b, int n, float* energy)
+{
+	float32x4_t dot0 = vdupq_n_f32 (0), dot1 = vdupq_n_f32 (0);
+	float32x4_t e0   = vdupq_n_f32 (0), e1   = vdupq_n_f32 (0);
+	float32x4_t b0, b1;
+	float dot, tail_energy;
+	int i;
+
+	// two sets of sums so the multiply-accumulates of one don't wait on the other
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		b0   = vld1q_f32 (b + i);
+		b1   = vld1q_f32 (b + i + 4);
+		dot0 = vmlaq_f32 (dot0, vld1q_f32 (a + i), b0);
+		dot1 = vmlaq_f32 (dot1, vld1q_f32 (a + i + 4), b1);
+		e0   = vmlaq_f32 (e0, b0, b0);
+		e1   = vmlaq_f32 (e1, b1, b1);
+	}
+	dot = time_stretch_correlate_c (a + i, b + i, n - i, &tail_energy);
+	*energy = add_across (vaddq_f32 (e0, e1)) + tail_energy;
+	return add_across (vaddq_f32 (dot0, dot1)) + dot;
+}
+
+
+static void cross_fade_neon (float* out, const float* a, const float* b, const float* fade, int n)
+{
+	float32x4_t va;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		va = vld1q_f32 (a + i);
+		vst1q_f32 (out + i, vmlaq_f32 (va, vsubq_f32 (vld1q_f32 (b + i), va), vld1q_f32 (fade + i)));
+	}
+	time_stretch_cross_fade_c (out + i, a + i, b + i, fade + i, n - i);
+}
+
+
+const time_stretch_kernels time_stretch_kernels_neon =
+{
+	"neon",
+	correlate_neon,
+	cross_fade_neon
+};
+#endif
@@ -0,0 +1,111 @@
+#include "rpi_mp_time_stretch.h"
+#if defined(__x86_64__) || defined(__i386__)
+// x86 kernels let the stretching be checked and measured on a host, the player itself runs on ARM
+#include <immintrin.h>
+
+__attribute__ ((target ("sse2")))
+static inline float add_across_sse2 (__m128 v)
+{
+	v = _mm_add_ps (v, _mm_movehl_ps (v, v));
+	v = _mm_add_ss (v, _mm_shuffle_ps (v, v, 1));
+	return _mm_cvtss_f32 (v);
+}
+
+
+__attribute__ ((target ("sse2")))
+static float correlate_sse2 (const float* a, const float* b, int n, float* energy)
+{
+	__m128 dot0 = _mm_setzero_ps (), dot1 = _mm_setzero_ps ();
+	__m128 e0   = _mm_setzero_ps (), e1   = _mm_setzero_ps ();
+	__m128 b0, b1;
+	float dot, tail_energy;
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		b0   = _mm_loadu_ps (b + i);
+		b1   = _mm_loadu_ps (b + i + 4);
+		dot0 = _mm_add_ps (dot0, _mm_mul_ps (_mm_loadu_ps (a + i), b0));
+		dot1 = _mm_add_ps (dot1, _mm_mul_ps (_mm_loadu_ps (a + i + 4), b1));
+		e0   = _mm_add_ps (e0, _mm_mul_ps (b0, b0));
+		e1   = _mm_add_ps (e1, _mm_mul_ps (b1, b1));
+	}
+	dot = time_stretch_correlate_c (a + i, b + i, n - i, &tail_energy);
+	*energy = add_across_sse2 (_mm_add_ps (e0, e1)) + tail_energy;
+	return add_across_sse2 (_mm_add_ps (dot0, dot1)) + dot;
+}
+
+
+__attribute__ ((target ("sse2")))
+static void cross_fade_sse2 (float* out, const float* a, const float* b, const float* fade, int n)
+{
+	__m128 va;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		va = _mm_loadu_ps (a + i);
+		_mm_storeu_ps (out + i, _mm_add_ps (va, _mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (b + i), va), _mm_loadu_ps (fade + i))));
+	}
+	time_stretch_cross_fade_c (out + i, a + i, b + i, fade + i, n - i);
+}
+
+
+__attribute__ ((target ("avx2")))
+static inline float add_across_avx2 (__m256 v)
+{
+	return add_across_sse2 (_mm_add_ps (_mm256_castps256_ps128 (v), _mm256_extractf128_ps (v, 1)));
+}
+
+
+__attribute__ ((target ("avx2")))
+static float correlate_avx2 (const float* a, const float* b, int n, float* energy)
+{
+	__m256 dot0 = _mm256_setzero_ps (), dot1 = _mm256_setzero_ps ();
+	__m256 e0   = _mm256_setzero_ps (), e1   = _mm256_setzero_ps ();
+	__m256 b0, b1;
+	float dot, tail_energy;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		b0   = _mm256_loadu_ps (b + i);
+		b1   = _mm256_loadu_ps (b + i + 8);
+		dot0 = _mm256_add_ps (dot0, _mm256_mul_ps (_mm256_loadu_ps (a + i), b0));
+		dot1 = _mm256_add_ps (dot1, _mm256_mul_ps (_mm256_loadu_ps (a + i + 8), b1));
+		e0   = _mm256_add_ps (e0, _mm256_mul_ps (b0, b0));
+		e1   = _mm256_add_ps (e1, _mm256_mul_ps (b1, b1));
+	}
+	dot = correlate_sse2 (a + i, b + i, n - i, &tail_energy);
+	*energy = add_across_avx2 (_mm256_add_ps (e0, e1)) + tail_energy;
+	return add_across_avx2 (_mm256_add_ps (dot0, dot1)) + dot;
+}
+
+
+__attribute__ ((target ("avx2")))
+static void cross_fade_avx2 (float* out, const float* a, const float* b, const float* fade, int n)
+{
+	__m256 va;
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		va = _mm256_loadu_ps (a + i);
+		_mm256_storeu_ps (out + i, _mm256_add_ps (va, _mm256_mul_ps (_mm256_sub_ps (_mm256_loadu_ps (b + i), va), _mm256_loadu_ps (fade + i))));
+	}
+	cross_fade_sse2 (out + i, a + i, b + i, fade + i, n - i);
+}
+
+
+const time_stretch_kernels time_stretch_kernels_sse2 =
+{
+	"sse2",
+	correlate_sse2,
+	cross_fade_sse2
+};
+
+const time_stretch_kernels time_stretch_kernels_avx2 =
+{
+	"avx2",
+	correlate_avx2,
+	cross_fade_avx2
+};
+#endif
@@ -0,0 +1,218 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "rpi_mp_video_sink.h"
+
+#define SHM_ALIGN 64
+
+/**
+ *	Shared memory sink state.
+ */
+typedef struct
+{
+	video_shm_header  * header;
+	size_t 				size;
+	char 				name[64];
+} shm_sink ;
+
+
+static void copy_plane (uint8_t* out, uint out_stride, const uint8_t* in, int in_stride, uint width, uint height)
+{
+	uint y;
+	for (y = 0; y < height; y ++)
+		memcpy (out + y * out_stride, in + y * in_stride, width);
+}
+
+
+/**
+ *	Copy 10-bit samples, keeping their top 8 bits.
+ */
+static void copy_plane_10 (uint8_t* out, uint out_stride, const uint8_t* in, int in_stride, uint width, uint height)
+{
+	const uint16_t* row;
+	uint x, y;
+	for (y = 0; y < height; y ++)
+	{
+		row = (const uint16_t*) (in + y * in_stride);
+		for (x = 0; x < width; x ++)
+			out[y * out_stride + x] = row[x] >> 2;
+	}
+}
+
+
+int copy_video_frame (uint8_t* out, uint stride, uint slice_height, const AVFrame* frame)
+{
+	void (*copy) (uint8_t*, uint, const uint8_t*, int, uint, uint);
+	uint8_t* u = out + stride * slice_height;
+	uint8_t* v = u + (stride / 2) * (slice_height / 2);
+	uint width = frame->width, height = frame->height;
+
+	switch (frame->format)
+	{
+		case AV_PIX_FMT_YUV420P:
+		case AV_PIX_FMT_YUVJ420P:
+			copy = copy_plane;
+		break;
+
+		case AV_PIX_FMT_YUV420P10LE:
+			copy = copy_plane_10;
+		break;
+
+		default:
+			return 1;
+	}
+	copy (out, stride,     frame->data[0], frame->linesize[0], width,           height);
+	copy (u,   stride / 2, frame->data[1], frame->linesize[1], (width + 1) / 2, (height + 1) / 2);
+	copy (v,   stride / 2, frame->data[2], frame->linesize[2], (width + 1) / 2, (height + 1) / 2);
+	return 0;
+}
+
+
+int open_video_sink (video_sink* sink, const video_sink_ops* ops, uint width, uint height, const char* target)
+{
+	memset (sink, 0, sizeof (video_sink));
+	sink->ops    = ops;
+	sink->width  = width;
+	sink->height = height;
+	return ops->open (sink, target);
+}
+
+
+int write_video_sink (video_sink* sink, const AVFrame* frame, int64_t time)
+{
+	// a sink is set up for one size
+	if ((uint) frame->width != sink->width || (uint) frame->height != sink->height)
+	{
+		sink->dropped ++;
+		return 0;
+	}
+	return sink->ops->write (sink, frame, time);
+}
+
+
+void close_video_sink (video_sink* sink)
+{
+	if (sink->ops)
+		sink->ops->close (sink);
+	sink->ops = NULL;
+}
+
+
+/**
+ *	Null sink.
+ */
+static int null_open (video_sink* sink, const char* target)
+{
+	return 0;
+}
+
+static int null_write (video_sink* sink, const AVFrame* frame, int64_t time)
+{
+	sink->frames ++;
+	return 0;
+}
+
+static void null_close (video_sink* sink)
+{
+}
+
+const video_sink_ops null_video_sink =
+{
+	"null",
+	null_open,
+	null_write,
+	null_close
+};
+
+
+/**
+ *	Shared memory sink.
+ */
+static int shm_open_sink (video_sink* sink, const char* target)
+{
+	shm_sink* shm;
+	uint stride = (sink->width + 1) & ~1;
+	uint height = (sink->height + 1) & ~1;
+	uint frame_size  = stride * height * 3 / 2;
+	uint data_offset = (sizeof (video_shm_header) + SHM_ALIGN - 1) & ~(SHM_ALIGN - 1);
+	int fd;
+
+	if ((shm = calloc (1, sizeof (shm_sink))) == NULL)
+		return 1;
+	snprintf (shm->name, sizeof (shm->name), "%s", target);
+	shm->size = data_offset + (size_t) frame_size * VIDEO_SHM_SLOTS;
+
+	if ((fd = shm_open (shm->name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		fprintf (stderr, "Could not open shared memory %s\n", shm->name);
+		free (shm);
+		return 1;
+	}
+	if (ftruncate (fd, shm->size) != 0 ||
+	    (shm->header = mmap (NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		fprintf (stderr, "Could not map shared memory %s\n", shm->name);
+		close (fd);
+		shm_unlink (shm->name);
+		free (shm);
+		return 1;
+	}
+	close (fd);
+
+	shm->header->width       = sink->width;
+	shm->header->height      = sink->height;
+	shm->header->stride      = stride;
+	shm->header->frame_size  = frame_size;
+	shm->header->data_offset = data_offset;
+	shm->header->slots       = VIDEO_SHM_SLOTS;
+	// readers check the magic last
+	__atomic_store_n (&shm->header->magic, VIDEO_SHM_MAGIC, __ATOMIC_RELEASE);
+	sink->context = shm;
+	return 0;
+}
+
+static int shm_write (video_sink* sink, const AVFrame* frame, int64_t time)
+{
+	shm_sink* shm = sink->context;
+	video_shm_header* header = shm->header;
+	uint latest = header->latest;
+	uint slot   = latest % VIDEO_SHM_SLOTS;
+
+	__atomic_add_fetch (&header->slot[slot].sequence, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	if (copy_video_frame ((uint8_t*) header + header->data_offset + (size_t) slot * header->frame_size,
+	                      header->stride, (sink->height + 1) & ~1, frame) != 0)
+	{
+		// nothing was written, the frame in the slot is still whole
+		__atomic_add_fetch (&header->slot[slot].sequence, 1, __ATOMIC_RELEASE);
+		fprintf (stderr, "Pixel format not supported by the %s sink\n", sink->ops->name);
+		return 1;
+	}
+	header->slot[slot].time = time;
+	__atomic_add_fetch (&header->slot[slot].sequence, 1, __ATOMIC_RELEASE);
+	__atomic_store_n (&header->latest, latest + 1, __ATOMIC_RELEASE);
+	sink->frames ++;
+	return 0;
+}
+
+static void shm_close (video_sink* sink)
+{
+	shm_sink* shm = sink->context;
+	if (!shm)
+		return;
+	munmap (shm->header, shm->size);
+	shm_unlink (shm->name);
+	free (shm);
+	sink->context = NULL;
+}
+
+const video_sink_ops shm_video_sink =
+{
+	"shared memory",
+	shm_open_sink,
+	shm_write,
+	shm_close
+};
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpi_mp_annexb.h"
+
+/**
+ *	Converts length prefixed H.264 and HEVC to Annex-B: avcC and hvcC records, prefixes of
+ *	1 to 4 bytes, in place and while copying, malformed records and lengths, and the
+ *	parameter sets put in front of keyframes that don't carry their own.
+ */
+
+static int failures;
+
+#define CHECK(condition) do { if (!(condition)) { fprintf (stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); failures ++; } } while (0)
+
+static const uint8_t sps[] = { 0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9 };
+static const uint8_t pps[] = { 0x68, 0xEB, 0xE3, 0xCB };
+static const uint8_t idr[] = { 0x65, 0x88, 0x84, 0x00, 0x33, 0xFF, 0x10 };
+static const uint8_t sei[] = { 0x06, 0x05 };
+static const uint8_t vps[] = { 0x40, 0x01, 0x0C, 0x01 };
+static const uint8_t hevc_sps[] = { 0x42, 0x01, 0x01, 0x01, 0x60 };
+static const uint8_t hevc_pps[] = { 0x44, 0x01, 0xC1 };
+
+
+/**
+ *	Append a NAL unit with a prefix of length_size bytes, or a start code if 0.
+ */
+static uint put_nal (uint8_t* out, const uint8_t* nal, uint size, uint length_size)
+{
+	uint i;
+	if (length_size == 0)
+	{
+		memcpy (out, "\0\0\0\1", 4);
+		length_size = 4;
+	}
+	else
+		for (i = 0; i < length_size; i ++)
+			out[i] = size >> (8 * (length_size - 1 - i));
+	memcpy (out + length_size, nal, size);
+	return length_size + size;
+}
+
+
+static uint make_avcc (uint8_t* out, uint length_size, int sps_count)
+{
+	uint n = 0;
+	out[n ++] = 1;
+	out[n ++] = sps[1];
+	out[n ++] = sps[2];
+	out[n ++] = sps[3];
+	out[n ++] = 0xFC | (length_size - 1);
+	out[n ++] = 0xE0 | sps_count;
+	while (sps_count --)
+		n += put_nal (out + n, sps, sizeof (sps), 2);
+	out[n ++] = 1;
+	n += put_nal (out + n, pps, sizeof (pps), 2);
+	return n;
+}
+
+
+static void check_avcc ()
+{
+	annexb_converter converter;
+	uint8_t record[64], expected[64];
+	uint size, n = 0;
+
+	size = make_avcc (record, 4, 1);
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, size) == 0);
+	CHECK (converter.length_size == 4 && !converter.hevc);
+	n += put_nal (expected + n, sps, sizeof (sps), 0);
+	n += put_nal (expected + n, pps, sizeof (pps), 0);
+	CHECK (converter.parameter_sets_size == n && memcmp (converter.parameter_sets, expected, n) == 0);
+	destroy_annexb_converter (&converter);
+
+	// no parameter sets at all
+	size = make_avcc (record, 2, 0);
+	record[size - 7] = 0;
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, size - 6) == 0);
+	CHECK (converter.length_size == 2 && converter.parameter_sets_size == 0);
+	destroy_annexb_converter (&converter);
+
+	// malformed: wrong version, an SPS running past the end, no PPS count
+	size = make_avcc (record, 4, 1);
+	record[0] = 0;
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, size) != 0);
+	record[0] = 1;
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, 10) != 0);
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, 8 + sizeof (sps)) != 0);
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, size - 1) != 0);
+	CHECK (converter.parameter_sets == NULL);
+}
+
+
+static void check_hvcc ()
+{
+	annexb_converter converter;
+	uint8_t record[96], expected[64];
+	uint size = 0, n = 0;
+
+	memset (record, 0, 23);
+	record[0]  = 1;
+	record[21] = 0xFC | 3;
+	record[22] = 3;
+	size = 23;
+	record[size ++] = 32;
+	record[size ++] = 0;
+	record[size ++] = 1;
+	size += put_nal (record + size, vps, sizeof (vps), 2);
+	record[size ++] = 33;
+	record[size ++] = 0;
+	record[size ++] = 1;
+	size += put_nal (record + size, hevc_sps, sizeof (hevc_sps), 2);
+	record[size ++] = 34;
+	record[size ++] = 0;
+	record[size ++] = 1;
+	size += put_nal (record + size, hevc_pps, sizeof (hevc_pps), 2);
+
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_HEVC, record, size) == 0);
+	CHECK (converter.length_size == 4 && converter.hevc);
+	n += put_nal (expected + n, vps, sizeof (vps), 0);
+	n += put_nal (expected + n, hevc_sps, sizeof (hevc_sps), 0);
+	n += put_nal (expected + n, hevc_pps, sizeof (hevc_pps), 0);
+	CHECK (converter.parameter_sets_size == n && memcmp (converter.parameter_sets, expected, n) == 0);
+	destroy_annexb_converter (&converter);
+
+	// malformed: too short for the header, an array header or a NAL unit cut off
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_HEVC, record, 22) != 0);
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_HEVC, record, 25) != 0);
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_HEVC, record, size - 1) != 0);
+}
+
+
+/**
+ *	Packets with prefixes of every size, converted while copying and, for 4 bytes, in place.
+ */
+static void check_packets ()
+{
+	annexb_converter converter;
+	uint8_t record[64], packet[64], expected[64], out[64];
+	uint length_size, size, n, record_size;
+	int parameter_sets;
+
+	for (length_size = 1; length_size <= 4; length_size ++)
+	{
+		record_size = make_avcc (record, length_size, 1);
+		CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, record_size) == 0);
+		CHECK (converter.length_size == length_size);
+
+		size = n = 0;
+		size += put_nal (packet + size, sei, sizeof (sei), length_size);
+		size += put_nal (packet + size, idr, sizeof (idr), length_size);
+		n    += put_nal (expected + n, sei, sizeof (sei), 0);
+		n    += put_nal (expected + n, idr, sizeof (idr), 0);
+
+		CHECK (annexb_size (&converter, packet, size, &parameter_sets) == (int) n);
+		// a keyframe without an SPS, the parameter sets are put in front of it
+		CHECK (!parameter_sets);
+		CHECK (annexb_convert (&converter, out, packet, size) == (int) n);
+		CHECK (memcmp (out, expected, n) == 0);
+		if (length_size == 4)
+		{
+			CHECK (annexb_convert (&converter, packet, packet, size) == (int) n);
+			CHECK (memcmp (packet, expected, n) == 0);
+		}
+
+		// one that carries its own
+		size = 0;
+		size += put_nal (packet + size, sps, sizeof (sps), length_size);
+		size += put_nal (packet + size, pps, sizeof (pps), length_size);
+		size += put_nal (packet + size, idr, sizeof (idr), length_size);
+		CHECK (annexb_size (&converter, packet, size, &parameter_sets) > 0 && parameter_sets);
+
+		// a length running past the end, and a prefix cut off
+		size = put_nal (packet, idr, sizeof (idr), length_size);
+		CHECK (annexb_size (&converter, packet, size - 1, &parameter_sets) < 0);
+		if (length_size > 1)
+		{
+			memset (packet + size, 0, length_size - 1);
+			CHECK (annexb_size (&converter, packet, size + length_size - 1, &parameter_sets) < 0);
+		}
+		destroy_annexb_converter (&converter);
+	}
+
+	// an empty NAL unit still gets its start code
+	record_size = make_avcc (record, 4, 1);
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, record, record_size) == 0);
+	memset (packet, 0, 4);
+	CHECK (annexb_size (&converter, packet, 4, &parameter_sets) == 4);
+	CHECK (annexb_convert (&converter, out, packet, 4) == 4 && memcmp (out, "\0\0\0\1", 4) == 0);
+	destroy_annexb_converter (&converter);
+
+	// HEVC SPS in a packet
+	memset (record, 0, 23);
+	record[0]  = 1;
+	record[21] = 0xFC | 3;
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_HEVC, record, 23) == 0);
+	size = put_nal (packet, hevc_sps, sizeof (hevc_sps), 4);
+	CHECK (annexb_size (&converter, packet, size, &parameter_sets) > 0 && parameter_sets);
+	destroy_annexb_converter (&converter);
+}
+
+
+/**
+ *	Extradata in Annex-B already: nothing to convert, it is passed on as it is.
+ */
+static void check_annexb ()
+{
+	annexb_converter converter;
+	uint8_t extradata[32];
+	uint size = 0;
+
+	size += put_nal (extradata + size, sps, sizeof (sps), 0);
+	size += put_nal (extradata + size, pps, sizeof (pps), 0);
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, extradata, size) == 0);
+	CHECK (converter.length_size == 0);
+	CHECK (converter.parameter_sets_size == size && memcmp (converter.parameter_sets, extradata, size) == 0);
+	destroy_annexb_converter (&converter);
+
+	CHECK (init_annexb_converter (&converter, AV_CODEC_ID_H264, NULL, 0) == 0);
+	CHECK (converter.length_size == 0 && converter.parameter_sets_size == 0);
+	destroy_annexb_converter (&converter);
+}
+
+
+int main ()
+{
+	check_avcc ();
+	check_hvcc ();
+	check_packets ();
+	check_annexb ();
+	if (failures)
+		fprintf (stderr, "annexb_test: %d failures\n", failures);
+	else
+		printf ("annexb_test: avcC, hvcC and 1 to 4 byte prefixes converted, malformed input refused\n");
+	return failures != 0;
+}
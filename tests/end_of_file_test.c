@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "rpi_mp_end_of_file.h"
+
+/**
+ *	Two decoding threads and the demuxing thread meeting at the end of the file, as the
+ *	player has them: playback that reaches the end, a seek that rewinds the file while a
+ *	decoder is still busy, a decoder that ends early and a stop. A hang is a failure, the
+ *	test is killed after TIMEOUT seconds.
+ */
+
+#define STOPPED      0x01
+#define DONE_READING 0x40
+#define SEEKING      0x02
+#define SPEED_CHANGE 0x80
+#define TIMEOUT      10
+
+static int failures;
+
+#define CHECK(condition) do { if (!(condition)) { fprintf (stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); failures ++; } } while (0)
+
+static pthread_mutex_t  mutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   condition = PTHREAD_COND_INITIALIZER;
+static int32_t          flags;
+static end_of_file_sync at_end;
+// times the demuxer reached the end of the file
+static int              ends;
+
+typedef struct
+{
+	pthread_t thread;
+	int 	  drained;
+	// times it was done with what was read, and what it was told the last time
+	int 	  rounds;
+	int 	  rewound;
+} decoder ;
+
+
+static void* decode (void* arg)
+{
+	decoder* d = arg;
+
+	pthread_mutex_lock (&mutex);
+	do
+	{
+		// what was read is decoded once the demuxer has closed the packet buffers
+		while (ends <= d->rounds && !(flags & STOPPED))
+			pthread_cond_wait (&condition, &mutex);
+		d->rounds ++;
+	}
+	while ((d->rewound = decoder_at_end_of_file (&at_end, d->drained)));
+	pthread_mutex_unlock (&mutex);
+	return NULL;
+}
+
+
+static void start (decoder* d, int drained, int rounds)
+{
+	d->drained = drained;
+	d->rounds  = rounds;
+	d->rewound = -1;
+	pthread_create (&d->thread, NULL, decode, d);
+}
+
+
+static void reset ()
+{
+	flags = 0;
+	ends  = 0;
+	init_end_of_file_sync (&at_end, &mutex, &condition, &flags, STOPPED, DONE_READING, SEEKING | SPEED_CHANGE, 2);
+}
+
+
+/**
+ *	The demuxer reads the last packet and closes the packet buffers. Call with the mutex
+ *	held, as the demuxer does, and wait_at_end after.
+ */
+static void reach_end ()
+{
+	reach_end_of_file (&at_end);
+	ends ++;
+	pthread_cond_broadcast (&condition);
+}
+
+
+/**
+ *	@return int what demuxer_at_end_of_file returns, done is set when 0
+ */
+static int wait_at_end ()
+{
+	int rewound;
+
+	if (!(rewound = demuxer_at_end_of_file (&at_end)))
+		flags |= DONE_READING;
+	pthread_cond_broadcast (&condition);
+	return rewound;
+}
+
+
+/**
+ *	Both decoders play out what was read and playback ends.
+ */
+static void check_end ()
+{
+	decoder a, b;
+
+	reset ();
+	start (&a, 1, 0);
+	start (&b, 1, 0);
+	pthread_mutex_lock (&mutex);
+	reach_end ();
+	CHECK (wait_at_end () == 0);
+	CHECK (flags == DONE_READING);
+	pthread_mutex_unlock (&mutex);
+	pthread_join (a.thread, NULL);
+	pthread_join (b.thread, NULL);
+	CHECK (a.rounds == 1 && a.rewound == 0);
+	CHECK (b.rounds == 1 && b.rewound == 0);
+	CHECK (at_end.idle == 2 && at_end.end_of_file);
+}
+
+
+/**
+ *	A request while one decoder is done and the other still busy rewinds the file, then
+ *	playback reaches the end again.
+ */
+static void check_rewind (int32_t request)
+{
+	decoder a, b;
+
+	reset ();
+	start (&a, 1, 0);
+	pthread_mutex_lock (&mutex);
+	reach_end ();
+	while (at_end.idle < 1)
+		pthread_cond_wait (&condition, &mutex);
+	// a is waiting, b is still busy with what was read
+	flags |= request;
+	CHECK (wait_at_end () == 1);
+	CHECK (!at_end.end_of_file && !(flags & DONE_READING));
+	// the demuxer carries out the request, a goes on decoding what is read after it
+	flags &= ~request;
+	while (at_end.idle > 0)
+	{
+		pthread_mutex_unlock (&mutex);
+		usleep (1000);
+		pthread_mutex_lock (&mutex);
+	}
+	CHECK (a.rewound == 1);
+	pthread_mutex_unlock (&mutex);
+	start (&b, 1, 1);
+	pthread_mutex_lock (&mutex);
+	reach_end ();
+	CHECK (wait_at_end () == 0);
+	pthread_mutex_unlock (&mutex);
+	pthread_join (a.thread, NULL);
+	pthread_join (b.thread, NULL);
+	CHECK (a.rounds == 2 && a.rewound == 0);
+	CHECK (b.rounds == 2 && b.rewound == 0);
+}
+
+
+/**
+ *	A decoder that ends on an error counts as done, the other still plays out.
+ */
+static void check_decoder_ending ()
+{
+	decoder a, b;
+
+	reset ();
+	start (&a, 0, 0);
+	start (&b, 1, 0);
+	pthread_mutex_lock (&mutex);
+	reach_end ();
+	CHECK (wait_at_end () == 0);
+	pthread_mutex_unlock (&mutex);
+	pthread_join (a.thread, NULL);
+	pthread_join (b.thread, NULL);
+	CHECK (a.rounds == 1 && a.rewound == 0);
+	CHECK (b.rounds == 1 && b.rewound == 0);
+}
+
+
+static void* stop (void* arg)
+{
+	usleep (10000);
+	pthread_mutex_lock (&mutex);
+	flags |= STOPPED | *(int32_t*) arg;
+	pthread_cond_broadcast (&condition);
+	pthread_mutex_unlock (&mutex);
+	return NULL;
+}
+
+
+/**
+ *	A stop while a decoder is still busy ends playback, also when it comes with a request.
+ */
+static void check_stop (int32_t request)
+{
+	decoder a;
+	pthread_t stopping;
+
+	reset ();
+	start (&a, 1, 0);
+	pthread_create (&stopping, NULL, stop, &request);
+	pthread_mutex_lock (&mutex);
+	reach_end ();
+	CHECK (wait_at_end () == 0);
+	pthread_mutex_unlock (&mutex);
+	pthread_join (stopping, NULL);
+	pthread_join (a.thread, NULL);
+	CHECK (a.rounds == 1 && a.rewound == 0);
+}
+
+
+int main ()
+{
+	alarm (TIMEOUT);
+	check_end ();
+	check_rewind (SEEKING);
+	check_rewind (SPEED_CHANGE);
+	check_decoder_ending ();
+	check_stop (0);
+	check_stop (SEEKING);
+	if (failures)
+		fprintf (stderr, "end_of_file_test: %d failures\n", failures);
+	else
+		printf ("end_of_file_test: end of file reached, rewound by seeks and changes of speed, stopped\n");
+	return failures != 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "rpi_mp_pcm.h"
+#include "rpi_mp_gain.h"
+#include "kernel_bench.h"
+
+/**
+ *	CPU time apply_gain takes per second of stereo 48 kHz audio with each gain kernel, while
+ *	ramping and at a fixed gain, fed in frames of 1024 samples as the audio is submitted.
+ *	At unity gain and when muted it uses no kernel, which is measured once. A ramp must give
+ *	what the C kernel gives to within 1, and unity gain must leave the samples as they are.
+ *	usage: gain_bench [seconds]
+ */
+
+#define CHANNELS    2
+#define SAMPLE_RATE 48000
+#define FRAME       1024
+
+static const pcm_kernels* const candidates[] =
+{
+	&pcm_kernels_c,
+#if defined(__arm__) || defined(__aarch64__)
+	&pcm_kernels_neon,
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	&pcm_kernels_sse2,
+	&pcm_kernels_avx2,
+#endif
+};
+
+
+/**
+ *	Apply the gain to a copy of the signal, ramping from gain to target over all of it if
+ *	they differ.
+ *	@return double us
+ *		microseconds of CPU per second of audio
+ */
+static double run (int16_t* data, const int16_t* signal, int samples, float gain, float target)
+{
+	gain_ramp ramp;
+	int64_t cpu;
+	int i;
+
+	memcpy (data, signal, (size_t) samples * CHANNELS * sizeof (int16_t));
+	init_gain_ramp (&ramp, CHANNELS, SAMPLE_RATE, gain);
+	if (target != gain)
+		ramp_gain (&ramp, target, (uint) ((int64_t) samples * 1000 / SAMPLE_RATE));
+	cpu = thread_cpu_time ();
+	for (i = 0; i + FRAME <= samples; i += FRAME)
+		apply_gain (&ramp, data + (size_t) i * CHANNELS, FRAME);
+	return (thread_cpu_time () - cpu) / 1e3 / ((double) samples / SAMPLE_RATE);
+}
+
+
+int main (int argc, char** argv)
+{
+	int seconds = argc > 1 ? atoi (argv[1]) : 60;
+	int samples = seconds * SAMPLE_RATE / FRAME * FRAME;
+	int16_t* signal    = malloc ((size_t) samples * CHANNELS * sizeof (int16_t));
+	int16_t* data      = malloc ((size_t) samples * CHANNELS * sizeof (int16_t));
+	int16_t* reference = malloc ((size_t) samples * CHANNELS * sizeof (int16_t));
+	double ramping, fixed, unity, muted;
+	int i, worst, failed = 0;
+	uint k;
+
+	if (!signal || !data || !reference || samples < FRAME)
+		return 1;
+	make_signal (signal, samples, CHANNELS, SAMPLE_RATE);
+	printf ("%d s of %d channel %d Hz audio, kernels picked for this CPU: %s\n",
+	        seconds, CHANNELS, SAMPLE_RATE, pcm_kernel_name ());
+
+	set_pcm_kernels (&pcm_kernels_c);
+	run (reference, signal, samples, 1, 0);
+	for (k = 0; k < sizeof (candidates) / sizeof (candidates[0]); k ++)
+	{
+		if (!cpu_runs_kernels (candidates[k]->name))
+		{
+			printf ("  %-4s not supported by this CPU\n", candidates[k]->name);
+			continue;
+		}
+		set_pcm_kernels (candidates[k]);
+		fixed   = run (data, signal, samples, 0.5f, 0.5f);
+		ramping = run (data, signal, samples, 1, 0);
+		for (i = worst = 0; i < samples * CHANNELS; i ++)
+			if (abs (data[i] - reference[i]) > worst)
+				worst = abs (data[i] - reference[i]);
+		printf ("  %-4s %8.1f us of CPU per second of audio ramping, %8.1f us at a fixed gain\n",
+		        candidates[k]->name, ramping, fixed);
+		if (worst > 1)
+		{
+			fprintf (stderr, "%s: ramp off the C kernel by up to %d\n", candidates[k]->name, worst);
+			failed = 1;
+		}
+	}
+
+	unity = run (data, signal, samples, 1, 1);
+	if (memcmp (data, signal, (size_t) samples * CHANNELS * sizeof (int16_t)) != 0)
+	{
+		fprintf (stderr, "unity gain changed the samples\n");
+		failed = 1;
+	}
+	muted = run (data, signal, samples, 0, 0);
+	printf ("  no kernel: %8.1f us of CPU per second of audio at unity gain, %8.1f us muted\n", unity, muted);
+
+	free (signal);
+	free (data);
+	free (reference);
+	return failed;
+}
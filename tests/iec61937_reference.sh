@@ -0,0 +1,20 @@
+#!/bin/sh
+# Make the elementary streams iec61937_test packs and what the FFmpeg spdif muxer writes
+# for them, in tests/data/iec61937 or the directory given. Needs an ffmpeg with the ac3,
+# eac3, dca and truehd encoders.
+set -e
+dir=${1:-tests/data/iec61937}
+ffmpeg=${FFMPEG:-ffmpeg}
+mkdir -p "$dir"
+signal="sine=frequency=997:sample_rate=48000:duration=2"
+
+encode ()
+{
+	"$ffmpeg" -v error -y -f lavfi -i "$signal" -ac "$3" -c:a "$2" -strict -2 -f "$4" "$dir/$1.$5"
+	"$ffmpeg" -v error -y -f "$4" -i "$dir/$1.$5" -c copy -f spdif "$dir/$1.spdif"
+}
+
+encode ac3    ac3    2 ac3    ac3
+encode eac3   eac3   2 eac3   eac3
+encode dts    dca    2 dts    dts
+encode truehd truehd 2 truehd thd
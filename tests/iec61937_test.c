@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpi_mp_iec61937.h"
+
+/**
+ *	Packs AC3, E-AC3, DTS and TrueHD into IEC 61937 bursts and checks them against what
+ *	the FFmpeg spdif muxer writes.
+ *	Elementary streams and the output of `ffmpeg -i <stream> -c copy -f spdif` for them are
+ *	compared byte for byte when found in the directory given (tests/iec61937_reference.sh
+ *	makes them). Synthetic frames are always checked for the rules of the muxer.
+ *	usage: iec61937_test [directory]
+ */
+
+#define SYNC_WORD_1 0xF872
+#define SYNC_WORD_2 0x4E1F
+
+typedef struct
+{
+	const char* name;
+	const char* extension;
+	enum AVCodecID codec_id;
+	int sample_rate;
+} reference ;
+
+static const reference references[] =
+{
+	{ "ac3",    "ac3",  AV_CODEC_ID_AC3,    48000 },
+	{ "eac3",   "eac3", AV_CODEC_ID_EAC3,   48000 },
+	{ "dts",    "dts",  AV_CODEC_ID_DTS,    48000 },
+	{ "truehd", "thd",  AV_CODEC_ID_TRUEHD, 48000 }
+};
+
+static const uint16_t ac3_bitrates[19] = { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 576, 640 };
+
+static int failures;
+
+#define CHECK(condition) do { if (!(condition)) { fprintf (stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); failures ++; } } while (0)
+
+
+static inline uint le16 (const uint8_t* p)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+/**
+ *	Size of the frame at the start of data, from its header, 0 if there is none.
+ */
+static uint frame_size (enum AVCodecID codec_id, const uint8_t* data, uint size)
+{
+	uint code;
+	switch (codec_id)
+	{
+		// AC3 and E-AC3 share the sync word, E-AC3 has the size in its header
+		case AV_CODEC_ID_AC3:
+		case AV_CODEC_ID_EAC3:
+			if (size < 6 || data[0] != 0x0B || data[1] != 0x77)
+				return 0;
+			if (data[5] >> 3 > 10)
+				return (((data[2] & 0x7) << 8 | data[3]) + 1) * 2;
+			if ((code = data[4] & 0x3F) >= 38)
+				return 0;
+			switch (data[4] >> 6)
+			{
+				case 0:  return ac3_bitrates[code >> 1] * 4;
+				case 1:  return (ac3_bitrates[code >> 1] * 320 / 147 + (code & 1)) * 2;
+				case 2:  return ac3_bitrates[code >> 1] * 6;
+				default: return 0;
+			}
+
+		case AV_CODEC_ID_DTS:
+			if (size < 8 || data[0] != 0x7F || data[1] != 0xFE || data[2] != 0x80 || data[3] != 0x01)
+				return 0;
+			return ((data[5] & 0x3) << 12 | data[6] << 4 | data[7] >> 4) + 1;
+
+		// access units are counted in 16-bit words
+		case AV_CODEC_ID_TRUEHD:
+			return size < 2 ? 0 : ((data[0] & 0xF) << 8 | data[1]) * 2;
+
+		default:
+			return 0;
+	}
+}
+
+
+static uint8_t* read_file (const char* path, uint* size)
+{
+	FILE* f;
+	uint8_t* data = NULL;
+	long length;
+
+	if ((f = fopen (path, "rb")) == NULL)
+		return NULL;
+	if (fseek (f, 0, SEEK_END) == 0 && (length = ftell (f)) > 0 && fseek (f, 0, SEEK_SET) == 0 &&
+	    (data = malloc (length)) != NULL && fread (data, 1, length, f) != (size_t) length)
+	{
+		free (data);
+		data = NULL;
+	}
+	*size = data ? length : 0;
+	fclose (f);
+	return data;
+}
+
+
+/**
+ *	Pack the frames of an elementary stream and compare the bursts with the muxer's.
+ *	@return int 1 if compared, 0 if there is no reference
+ */
+static int compare_reference (const char* directory, const reference* r)
+{
+	char path[1024];
+	iec61937_packer packer;
+	uint8_t* stream, * expected;
+	uint stream_size, expected_size, offset = 0, written = 0, size, frames = 0, bursts = 0;
+
+	snprintf (path, sizeof (path), "%s/%s.%s", directory, r->name, r->extension);
+	if ((stream = read_file (path, &stream_size)) == NULL)
+		return 0;
+	snprintf (path, sizeof (path), "%s/%s.spdif", directory, r->name);
+	if ((expected = read_file (path, &expected_size)) == NULL)
+	{
+		free (stream);
+		return 0;
+	}
+
+	CHECK (init_iec61937_packer (&packer, r->codec_id, r->sample_rate) == 0);
+	while (offset < stream_size && (size = frame_size (r->codec_id, stream + offset, stream_size - offset)) > 0 &&
+	       offset + size <= stream_size)
+	{
+		frames ++;
+		if (iec61937_pack (&packer, stream + offset, size) == 1)
+		{
+			bursts ++;
+			if (written + packer.burst_size > expected_size || memcmp (packer.burst, expected + written, packer.burst_size) != 0)
+			{
+				fprintf (stderr, "%s: burst %u differs from the spdif muxer's\n", r->name, bursts);
+				failures ++;
+				break;
+			}
+			written += packer.burst_size;
+		}
+		offset += size;
+	}
+	CHECK (frames > 0 && offset == stream_size);
+	// the muxer drops frames gathered for a burst never finished as well
+	if (written != expected_size)
+	{
+		fprintf (stderr, "%s: %u bytes of bursts, the spdif muxer wrote %u\n", r->name, written, expected_size);
+		failures ++;
+	}
+	printf ("  %-6s %u frames, %u bursts, same as ffmpeg -f spdif\n", r->name, frames, bursts);
+	destroy_iec61937_packer (&packer);
+	free (stream);
+	free (expected);
+	return 1;
+}
+
+
+/**
+ *	Check a burst: preamble, the payload as swapped 16-bit words with an odd last byte in
+ *	the high half of its word, then zeros.
+ */
+static void check_burst (iec61937_packer* packer, uint period, uint data_type, uint length_code, const uint8_t* payload, uint length)
+{
+	const uint8_t* p = packer->burst + 8;
+	uint i;
+
+	CHECK (packer->burst_size == period);
+	CHECK (le16 (packer->burst) == SYNC_WORD_1 && le16 (packer->burst + 2) == SYNC_WORD_2);
+	CHECK (le16 (packer->burst + 4) == data_type);
+	CHECK (le16 (packer->burst + 6) == length_code);
+	for (i = 0; i + 1 < length; i += 2)
+		CHECK (p[i] == payload[i + 1] && p[i + 1] == payload[i]);
+	if (length & 1)
+		CHECK (p[length - 1] == 0 && p[length] == payload[length - 1]);
+	for (i = (length + 1) & ~1; i < period - 8; i ++)
+		if (p[i] != 0)
+			break;
+	CHECK (i == period - 8);
+}
+
+
+static void check_ac3 ()
+{
+	iec61937_packer packer;
+	uint8_t frame[601];
+	uint i;
+
+	for (i = 0; i < sizeof (frame); i ++)
+		frame[i] = i * 13 + 1;
+	frame[0] = 0x0B;
+	frame[1] = 0x77;
+	// bitstream mode 5, odd size
+	frame[5] = 8 << 3 | 5;
+	CHECK (init_iec61937_packer (&packer, AV_CODEC_ID_AC3, 48000) == 0);
+	CHECK (iec61937_pack (&packer, frame, sizeof (frame)) == 1);
+	check_burst (&packer, 1536 * 4, 1 | 5 << 8, 602 << 3, frame, sizeof (frame));
+	CHECK (packer.sample_rate == 48000 && packer.channels == 2);
+	destroy_iec61937_packer (&packer);
+}
+
+
+static void check_eac3 ()
+{
+	iec61937_packer packer;
+	uint8_t frames[2][300];
+	uint8_t gathered[600];
+	uint i;
+
+	for (i = 0; i < sizeof (gathered); i ++)
+		gathered[i] = i * 7 + 3;
+	// 3 blocks per frame, two frames to a burst of 1536 samples
+	for (i = 0; i < 2; i ++)
+	{
+		gathered[i * 300]     = 0x0B;
+		gathered[i * 300 + 1] = 0x77;
+		gathered[i * 300 + 4] = 0x2 << 4;
+		gathered[i * 300 + 5] = 16 << 3;
+		memcpy (frames[i], gathered + i * 300, 300);
+	}
+	CHECK (init_iec61937_packer (&packer, AV_CODEC_ID_EAC3, 48000) == 0);
+	CHECK (iec61937_pack (&packer, frames[0], 300) == 0);
+	CHECK (iec61937_pack (&packer, frames[1], 300) == 1);
+	// the length is in bytes, not bits, for E-AC3
+	check_burst (&packer, 6144 * 4, 21, 600, gathered, sizeof (gathered));
+	CHECK (packer.sample_rate == 48000 * 4);
+	destroy_iec61937_packer (&packer);
+}
+
+
+static void check_dts ()
+{
+	iec61937_packer packer;
+	uint8_t frame[2048];
+	uint i, blocks = 16, core = 1005;
+
+	for (i = 0; i < sizeof (frame); i ++)
+		frame[i] = i * 5 + 2;
+	frame[0] = 0x7F;
+	frame[1] = 0xFE;
+	frame[2] = 0x80;
+	frame[3] = 0x01;
+	frame[4] = (blocks - 1) >> 6;
+	frame[5] = ((blocks - 1) & 0x3F) << 2 | (core - 1) >> 12;
+	frame[6] = (core - 1) >> 4;
+	frame[7] = ((core - 1) & 0xF) << 4;
+	CHECK (init_iec61937_packer (&packer, AV_CODEC_ID_DTS, 48000) == 0);
+
+	// an odd core with an extension after it: the extension is dropped, the length is the core's
+	CHECK (iec61937_pack (&packer, frame, 1200) == 1);
+	check_burst (&packer, 2048, 11, core << 3, frame, core);
+
+	// a frame filling its period goes without preamble
+	core = 2048;
+	frame[5] = ((blocks - 1) & 0x3F) << 2 | (core - 1) >> 12;
+	frame[6] = (core - 1) >> 4;
+	frame[7] = ((core - 1) & 0xF) << 4;
+	CHECK (iec61937_pack (&packer, frame, core) == 1);
+	CHECK (packer.burst_size == 2048);
+	for (i = 0; i < 2048; i += 2)
+		if (packer.burst[i] != frame[i + 1] || packer.burst[i + 1] != frame[i])
+			break;
+	CHECK (i == 2048);
+
+	// 2 blocks is no period the format has
+	frame[4] = 0;
+	frame[5] = 1 << 2;
+	CHECK (iec61937_pack (&packer, frame, 1200) < 0);
+	destroy_iec61937_packer (&packer);
+}
+
+
+static void check_truehd ()
+{
+	static const uint8_t start[4]  = { 0x07, 0x9E, 0x00, 0x03 };
+	static const uint8_t middle[4] = { 0xC3, 0xC1, 0x42, 0x49 };
+	static const uint8_t end[4]    = { 0xC3, 0xC2, 0xC0, 0xC4 };
+	iec61937_packer packer;
+	uint8_t frame[1000], mat[61424];
+	uint i, offset, length;
+
+	memset (frame, 0xA5, sizeof (frame));
+	CHECK (init_iec61937_packer (&packer, AV_CODEC_ID_TRUEHD, 48000) == 0);
+	for (i = 0; i < 23; i ++)
+		CHECK (iec61937_pack (&packer, frame, sizeof (frame)) == 0);
+	CHECK (iec61937_pack (&packer, frame, sizeof (frame)) == 1);
+	CHECK (packer.burst_size == 15360 * 4 && packer.sample_rate == 192000 && packer.channels == 8);
+	CHECK (le16 (packer.burst + 4) == 22 && le16 (packer.burst + 6) == 61424);
+
+	// the MAT frame as it was before swapping: codes, then the frames at multiples of 2560
+	for (i = 0; i < sizeof (mat); i += 2)
+	{
+		mat[i]     = packer.burst[8 + i + 1];
+		mat[i + 1] = packer.burst[8 + i];
+	}
+	CHECK (memcmp (mat, start, sizeof (start)) == 0);
+	CHECK (memcmp (mat + 12 * 2560 - 8 - 4, middle, sizeof (middle)) == 0);
+	CHECK (memcmp (mat + sizeof (mat) - 16, end, sizeof (end)) == 0);
+	for (i = 0; i < 24; i ++)
+	{
+		length = i == 0 ? 28 : i == 12 ? 8 : 0;
+		offset = i * 2560 - 8 + length;
+		CHECK (memcmp (mat + offset, frame, sizeof (frame)) == 0);
+	}
+
+	// a frame too large for its place drops what was gathered
+	CHECK (iec61937_pack (&packer, frame, 2560) < 0);
+	CHECK (packer.frames == 0);
+	destroy_iec61937_packer (&packer);
+}
+
+
+int main (int argc, char** argv)
+{
+	const char* directory = argc > 1 ? argv[1] : "tests/data/iec61937";
+	uint i, compared = 0;
+
+	check_ac3 ();
+	check_eac3 ();
+	check_dts ();
+	check_truehd ();
+	for (i = 0; i < sizeof (references) / sizeof (references[0]); i ++)
+		compared += compare_reference (directory, &references[i]);
+
+	if (failures)
+		fprintf (stderr, "iec61937_test: %d failures\n", failures);
+	else if (compared < sizeof (references) / sizeof (references[0]))
+		printf ("iec61937_test: bursts follow the spdif muxer, %u of %u compared with its output in %s\n",
+		        compared, (uint) (sizeof (references) / sizeof (references[0])), directory);
+	else
+		printf ("iec61937_test: bursts are the same as ffmpeg -f spdif writes\n");
+	return failures != 0;
+}
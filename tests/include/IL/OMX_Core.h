@@ -0,0 +1,64 @@
+#ifndef OMX_Core_h
+#define OMX_Core_h
+#include <stdint.h>
+
+/**
+ *	The part of the OpenMAX IL core the host tests build against, so they need no
+ *	VideoCore headers. Laid out as the VideoCore ones are with OMX_SKIP64BIT, which the
+ *	player is built with.
+ */
+
+typedef uint8_t  OMX_U8;
+typedef uint32_t OMX_U32;
+typedef int32_t  OMX_S32;
+typedef void   * OMX_PTR;
+
+typedef union OMX_VERSIONTYPE
+{
+	struct
+	{
+		OMX_U8 nVersionMajor;
+		OMX_U8 nVersionMinor;
+		OMX_U8 nRevision;
+		OMX_U8 nStep;
+	} s;
+	OMX_U32 nVersion;
+} OMX_VERSIONTYPE;
+
+typedef struct OMX_TICKS
+{
+	OMX_U32 nLowPart;
+	OMX_U32 nHighPart;
+} OMX_TICKS;
+
+typedef struct OMX_BUFFERHEADERTYPE
+{
+	OMX_U32 		nSize;
+	OMX_VERSIONTYPE nVersion;
+	OMX_U8 		  * pBuffer;
+	OMX_U32 		nAllocLen;
+	OMX_U32 		nFilledLen;
+	OMX_U32 		nOffset;
+	OMX_PTR 		pAppPrivate;
+	OMX_PTR 		pPlatformPrivate;
+	OMX_PTR 		pInputPortPrivate;
+	OMX_PTR 		pOutputPortPrivate;
+	OMX_PTR 		hMarkTargetComponent;
+	OMX_PTR 		pMarkData;
+	OMX_U32 		nTickCount;
+	OMX_TICKS 		nTimeStamp;
+	OMX_U32 		nFlags;
+	OMX_U32 		nOutputPortIndex;
+	OMX_U32 		nInputPortIndex;
+} OMX_BUFFERHEADERTYPE;
+
+#define OMX_BUFFERFLAG_EOS           0x00000001
+#define OMX_BUFFERFLAG_STARTTIME     0x00000002
+#define OMX_BUFFERFLAG_DECODEONLY    0x00000004
+#define OMX_BUFFERFLAG_DATACORRUPT   0x00000008
+#define OMX_BUFFERFLAG_ENDOFFRAME    0x00000010
+#define OMX_BUFFERFLAG_SYNCFRAME     0x00000020
+#define OMX_BUFFERFLAG_EXTRADATA     0x00000040
+#define OMX_BUFFERFLAG_CODECCONFIG   0x00000080
+#define OMX_BUFFERFLAG_TIME_UNKNOWN  0x00000100
+#endif
@@ -0,0 +1,39 @@
+#ifndef KERNEL_BENCH_H
+#define KERNEL_BENCH_H
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpi_mp_cpu.h"
+
+/**
+ *	Shared by the benchmarks comparing the C, NEON, SSE2 and AVX2 kernels of a module: a
+ *	test signal. Which of them this CPU runs and the CPU clock come from rpi_mp_cpu.h.
+ */
+
+
+/**
+ *	Interleaved S16 music-like test signal: a few partials on each channel with some noise,
+ *	at about -6 dBFS.
+ */
+static inline void make_signal (int16_t* out, int samples, int channels, int sample_rate)
+{
+	static const double partials[] = { 220, 330, 440, 1250, 3100 };
+	double t, v;
+	int i, c, k;
+
+	srand (1);
+	for (i = 0; i < samples; i ++)
+	{
+		t = (double) i / sample_rate;
+		for (c = 0; c < channels; c ++)
+		{
+			v = 0;
+			for (k = 0; k < 5; k ++)
+				v += sin (2 * M_PI * partials[k] * (1 + 0.01 * c) * t) / (k + 2);
+			v += (rand () / (double) RAND_MAX - 0.5) * 0.02;
+			out[i * channels + c] = (int16_t) (v * 12000);
+		}
+	}
+}
+#endif
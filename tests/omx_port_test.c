@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "omx_stub.h"
+
+/**
+ *	Drives an omx_port with the stub component: every header must still point at the
+ *	memory the component allocated for it when emptied, and data arrives intact.
+ */
+
+static int failures;
+
+
+int main ()
+{
+	static stub_component stub;
+	uint8_t source[1024];
+	omx_port port;
+	OMX_BUFFERHEADERTYPE* header;
+	uint i, offset, size, n, sent = 0;
+
+	for (i = 0; i < sizeof (source); i ++)
+		source[i] = i * 7 + 3;
+
+	CHECK (open_omx_port (&port, &stub_ops, &stub, 100) == 0);
+	CHECK (port.enabled && stub.enabled);
+
+	// payloads at odd offsets and of every size up to more than two buffers
+	for (offset = 1, size = 1; offset + size <= sizeof (source) && sent + size <= sizeof (stub.received); offset += size + 3, size = size * 3 % 150 + 1)
+	{
+		for (n = 0; n < size; n += header->nFilledLen)
+		{
+			if ((header = get_omx_buffer (&port, 0)) == NULL)
+				break;
+			CHECK (header->nFilledLen == 0 && header->nFlags == 0);
+			CHECK (fill_omx_buffer (&port, header, source + offset + n, size - n) == (size - n < STUB_BUFFER_SIZE ? size - n : STUB_BUFFER_SIZE));
+			CHECK (empty_omx_buffer (&port, header) == 0);
+		}
+		CHECK (n == size);
+		CHECK (memcmp (stub.received + sent, source + offset, size) == 0);
+		sent += size;
+	}
+	CHECK (sent > 0 && stub.received_size == sent);
+	CHECK (port.copied == sent);
+	CHECK (stub.moved == 0);
+
+	// every buffer taken without giving one back, then none is left
+	for (i = 0; i < STUB_BUFFERS; i ++)
+		CHECK (get_omx_buffer (&port, 0) != NULL);
+	CHECK (get_omx_buffer (&port, 0) == NULL);
+	stub.n_free = STUB_BUFFERS;
+
+	close_omx_port (&port);
+	CHECK (!stub.enabled && !port.enabled);
+
+	if (failures)
+		fprintf (stderr, "omx_port_test: %d failures\n", failures);
+	else
+		printf ("omx_port_test: %u bytes through %d buffers, headers never moved\n", sent, STUB_BUFFERS);
+	return failures != 0;
+}
@@ -0,0 +1,103 @@
+#ifndef OMX_STUB_H
+#define OMX_STUB_H
+#include <stdlib.h>
+#include <string.h>
+#include "rpi_mp_omx_port.h"
+
+/**
+ *	Stub component standing in for ilclient behind an omx_port: buffers are allocated
+ *	aligned the way OMX_AllocateBuffer does, every header emptied into it is checked to
+ *	still point at the memory it was allocated with, and its payload and flags are recorded.
+ */
+
+#define STUB_BUFFERS     4
+#define STUB_BUFFER_SIZE 64
+#define STUB_ALIGNMENT   16
+#define STUB_MAX_EMPTIED 256
+
+typedef struct
+{
+	OMX_BUFFERHEADERTYPE  headers[STUB_BUFFERS];
+	OMX_U8 				* registered[STUB_BUFFERS];
+	// headers handed back to us, as a stack
+	OMX_BUFFERHEADERTYPE* free[STUB_BUFFERS];
+	int 				  n_free;
+	int 				  enabled;
+	// what was emptied into the component, and the size, flags and time of each buffer
+	uint8_t 			  received[4096];
+	uint 				  received_size;
+	uint 				  sizes[STUB_MAX_EMPTIED];
+	OMX_U32 			  flags[STUB_MAX_EMPTIED];
+	OMX_U32 			  times[STUB_MAX_EMPTIED];
+	int 				  emptied;
+	int 				  moved;
+} stub_component ;
+
+
+static int stub_enable (omx_port* port)
+{
+	stub_component* stub = port->component;
+	int i;
+	for (i = 0; i < STUB_BUFFERS; i ++)
+	{
+		memset (stub->headers + i, 0, sizeof (OMX_BUFFERHEADERTYPE));
+		if (posix_memalign ((void**) &stub->headers[i].pBuffer, STUB_ALIGNMENT, STUB_BUFFER_SIZE) != 0)
+			return 1;
+		stub->headers[i].nAllocLen = STUB_BUFFER_SIZE;
+		stub->registered[i]        = stub->headers[i].pBuffer;
+		stub->free[i]              = stub->headers + i;
+	}
+	stub->n_free  = STUB_BUFFERS;
+	stub->enabled = 1;
+	return 0;
+}
+
+
+static void stub_disable (omx_port* port)
+{
+	stub_component* stub = port->component;
+	int i;
+	for (i = 0; i < STUB_BUFFERS; i ++)
+		free (stub->headers[i].pBuffer);
+	stub->enabled = 0;
+}
+
+
+static OMX_BUFFERHEADERTYPE* stub_get_buffer (omx_port* port, int block)
+{
+	stub_component* stub = port->component;
+	return stub->n_free > 0 ? stub->free[-- stub->n_free] : NULL;
+}
+
+
+static int stub_empty_buffer (omx_port* port, OMX_BUFFERHEADERTYPE* header)
+{
+	stub_component* stub = port->component;
+	int i = header - stub->headers;
+
+	if (i < 0 || i >= STUB_BUFFERS || header->nOffset + header->nFilledLen > header->nAllocLen ||
+	    stub->received_size + header->nFilledLen > sizeof (stub->received) || stub->emptied == STUB_MAX_EMPTIED)
+		return 1;
+	if (header->pBuffer != stub->registered[i])
+		stub->moved ++;
+	memcpy (stub->received + stub->received_size, header->pBuffer + header->nOffset, header->nFilledLen);
+	stub->received_size          += header->nFilledLen;
+	stub->sizes[stub->emptied]    = header->nFilledLen;
+	stub->times[stub->emptied]    = header->nTimeStamp.nLowPart;
+	stub->flags[stub->emptied ++] = header->nFlags;
+	// consumed at once
+	stub->free[stub->n_free ++] = header;
+	return 0;
+}
+
+
+static const omx_port_ops stub_ops =
+{
+	stub_enable,
+	stub_disable,
+	stub_get_buffer,
+	stub_empty_buffer
+};
+
+#define CHECK(condition) do { if (!(condition)) { fprintf (stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); failures ++; } } while (0)
+#endif
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "rpi_mp_omx_submit.h"
+#include "omx_stub.h"
+
+/**
+ *	Packs units through an omx_submitter into the stub component and checks which ones
+ *	shared a buffer: a frame ends its buffer on the video port, parameter sets join the
+ *	frame after them when it has their timestamp or none, PCM is packed up to the buffer
+ *	size.
+ */
+
+#define EOF_FLAG     OMX_BUFFERFLAG_ENDOFFRAME
+#define UNKNOWN_FLAG OMX_BUFFERFLAG_TIME_UNKNOWN
+
+static int failures;
+
+
+static OMX_TICKS ticks (OMX_U32 t)
+{
+	OMX_TICKS ticks;
+	ticks.nLowPart  = t;
+	ticks.nHighPart = 0;
+	return ticks;
+}
+
+
+static void open_submitter (omx_submitter* submitter, omx_port* port, stub_component* stub, int continuous)
+{
+	memset (stub, 0, sizeof (stub_component));
+	CHECK (open_omx_port (port, &stub_ops, stub, 130) == 0);
+	init_omx_submitter (submitter, port, continuous);
+}
+
+
+int main ()
+{
+	static stub_component stub;
+	omx_port port;
+	omx_submitter submitter;
+	uint8_t unit[200];
+	int i;
+
+	for (i = 0; i < sizeof (unit); i ++)
+		unit[i] = i;
+
+	// small frames without a timestamp each end their own buffer
+	open_submitter (&submitter, &port, &stub, 0);
+	for (i = 0; i < 5; i ++)
+		CHECK (submit_omx_data (&submitter, unit, 10, ticks (0), UNKNOWN_FLAG | EOF_FLAG) == 0);
+	CHECK (flush_omx_submitter (&submitter) == 0);
+	CHECK (stub.emptied == 5);
+	for (i = 0; i < stub.emptied; i ++)
+		CHECK (stub.sizes[i] == 10 && (stub.flags[i] & EOF_FLAG));
+	close_omx_port (&port);
+
+	// parameter sets join the keyframe after them, which has their timestamp as the player
+	// injects them, with the start time they took from it
+	open_submitter (&submitter, &port, &stub, 0);
+	CHECK (submit_omx_data (&submitter, unit, 8, ticks (5000), OMX_BUFFERFLAG_STARTTIME) == 0);
+	CHECK (submit_omx_data (&submitter, unit, 12, ticks (5000), EOF_FLAG) == 0);
+	CHECK (submit_omx_data (&submitter, unit, 12, ticks (5000), EOF_FLAG) == 0);
+	CHECK (flush_omx_submitter (&submitter) == 0);
+	CHECK (stub.emptied == 2);
+	CHECK (stub.sizes[0] == 20 && stub.flags[0] == (OMX_BUFFERFLAG_STARTTIME | EOF_FLAG));
+	CHECK (stub.sizes[1] == 12 && (stub.flags[1] & EOF_FLAG));
+	CHECK (stub.times[0] == 5000);
+	close_omx_port (&port);
+
+	// and one without a timestamp, the next frame starts a buffer
+	open_submitter (&submitter, &port, &stub, 0);
+	CHECK (submit_omx_data (&submitter, unit, 8, ticks (1000), 0) == 0);
+	CHECK (submit_omx_data (&submitter, unit, 12, ticks (0), UNKNOWN_FLAG | EOF_FLAG) == 0);
+	CHECK (submit_omx_data (&submitter, unit, 12, ticks (0), UNKNOWN_FLAG | EOF_FLAG) == 0);
+	CHECK (flush_omx_submitter (&submitter) == 0);
+	CHECK (stub.emptied == 2);
+	CHECK (stub.sizes[0] == 20 && (stub.flags[0] & EOF_FLAG));
+	CHECK (stub.sizes[1] == 12 && (stub.flags[1] & EOF_FLAG));
+	close_omx_port (&port);
+
+	// a frame with a timestamp of its own never joins a buffer, a large one ends only its last
+	open_submitter (&submitter, &port, &stub, 0);
+	CHECK (submit_omx_data (&submitter, unit, 8, ticks (1000), 0) == 0);
+	CHECK (submit_omx_data (&submitter, unit, 8, ticks (2000), EOF_FLAG) == 0);
+	CHECK (submit_omx_data (&submitter, unit, 150, ticks (3000), EOF_FLAG) == 0);
+	CHECK (flush_omx_submitter (&submitter) == 0);
+	CHECK (stub.emptied == 5);
+	CHECK (stub.sizes[0] == 8 && stub.sizes[1] == 8);
+	CHECK (stub.sizes[2] == 64 && !(stub.flags[2] & EOF_FLAG));
+	CHECK (stub.sizes[3] == 64 && !(stub.flags[3] & EOF_FLAG));
+	CHECK (stub.sizes[4] == 22 && (stub.flags[4] & EOF_FLAG));
+	close_omx_port (&port);
+
+	// PCM packs up to a full buffer whatever its flags
+	open_submitter (&submitter, &port, &stub, 1);
+	for (i = 0; i < 8; i ++)
+		CHECK (submit_omx_data (&submitter, unit + i * 16, 16, ticks (i * 100), EOF_FLAG) == 0);
+	CHECK (flush_omx_submitter (&submitter) == 0);
+	CHECK (stub.emptied == 2);
+	CHECK (stub.sizes[0] == 64 && stub.sizes[1] == 64);
+	CHECK (stub.received_size == 128 && memcmp (stub.received, unit, 128) == 0);
+	close_omx_port (&port);
+
+	CHECK (stub.moved == 0);
+	if (failures)
+		fprintf (stderr, "omx_submit_test: %d failures\n", failures);
+	else
+		printf ("omx_submit_test: frames end their buffers, parameter sets are packed with keyframes, PCM up to the buffer size\n");
+	return failures != 0;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "rpi_mp_packet_buffer.h"
+
+/**
+ *	One producer and one consumer thread passing packets through a packet_buffer, with
+ *	the mutex and the lock-free ring, as the demuxing and a decoding thread do.
+ *	usage: packet_buffer_bench [packets]
+ */
+
+#define SLOTS       1024
+#define PACKET_SIZE 1024
+
+typedef struct
+{
+	packet_buffer fifo;
+	int 		  packets;
+	// work per packet on the consuming side, in iterations of a dummy loop
+	int 		  work;
+	volatile uint sink;
+} bench ;
+
+
+static inline double now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void* produce (void* arg)
+{
+	bench* b = arg;
+	AVPacket p;
+	int i;
+
+	for (i = 0; i < b->packets; i ++)
+	{
+		av_init_packet (&p);
+		p.data = NULL;
+		p.size = PACKET_SIZE;
+		p.pts  = p.dts = AV_NOPTS_VALUE;
+		p.pos  = i;
+		if (push_packet_wait (&b->fifo, p, -1) != 0)
+		{
+			fprintf (stderr, "push failed at packet %d\n", i);
+			break;
+		}
+	}
+	close_packet_buffer (&b->fifo);
+	return NULL;
+}
+
+
+/**
+ *	@return int number of packets out of order, -1 on error
+ */
+static int run (enum packet_buffer_type type, int packets, int work, double* seconds, uint* contended)
+{
+	bench b;
+	pthread_t producer;
+	AVPacket p;
+	int i, received = 0, misordered = 0;
+	double start;
+
+	b.packets = packets;
+	b.work    = work;
+	if (init_packet_buffer (&b.fifo, SLOTS * PACKET_SIZE, SLOTS, type) != 0)
+		return -1;
+	start = now ();
+	pthread_create (&producer, NULL, produce, &b);
+	while (pop_packet_wait (&b.fifo, &p, -1) == 0)
+	{
+		if (p.pos != received)
+			misordered ++;
+		for (i = 0; i < b.work; i ++)
+			b.sink += i;
+		received ++;
+	}
+	pthread_join (producer, NULL);
+	*seconds   = now () - start;
+	*contended = b.fifo.contended;
+	destroy_packet_buffer (&b.fifo);
+	return received == packets ? misordered : -1;
+}
+
+
+int main (int argc, char** argv)
+{
+	static const char* names[] = { "mutex", "spsc" };
+	static const int work[] = { 0, 200 };
+	int packets = argc > 1 ? atoi (argv[1]) : 1000000;
+	int t, w, ret, failed = 0;
+	double seconds;
+	uint contended;
+
+	printf ("%d packets, one producer and one consumer thread\n", packets);
+	for (w = 0; w < 2; w ++)
+		for (t = PACKET_BUFFER_MUTEX; t <= PACKET_BUFFER_SPSC; t ++)
+		{
+			if ((ret = run (t, packets, work[w], &seconds, &contended)) != 0)
+			{
+				fprintf (stderr, "%s: %s\n", names[t], ret < 0 ? "packets lost" : "packets out of order");
+				failed = 1;
+				continue;
+			}
+			printf ("  %-5s consumer work %3d: %7.1f ns per packet, %5.2f M packets/s, %u contended locks\n",
+			        names[t], work[w], seconds * 1e9 / packets, packets / seconds / 1e6, contended);
+		}
+	return failed;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <libavutil/avutil.h>
+#include "rpi_mp.h"
+#include "rpi_mp_resample.h"
+#include "kernel_bench.h"
+
+/**
+ *	CPU time resample takes per output sample with each of its kernels and qualities,
+ *	upsampling 44.1 to 48 kHz and downsampling 96 to 48 kHz, fed in frames of 1024 samples.
+ *	The output of a sine is checked against the sine at the output rate: below min_snr dB
+ *	for a quality the kernel or the filter is broken.
+ *	usage: resample_bench [seconds]
+ */
+
+#define CHANNELS  2
+#define FRAME     1024
+#define FREQUENCY 1000.0
+
+static const resample_kernels* const candidates[] =
+{
+	&resample_kernels_c,
+#if defined(__arm__) || defined(__aarch64__)
+	&resample_kernels_neon,
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	&resample_kernels_sse2,
+	&resample_kernels_avx2,
+#endif
+};
+
+static const char* const qualities[] = { "low", "medium", "high" };
+static const double min_snr[] = { 55, 70, 80 };
+static const int rates[][2] = { { 44100, 48000 }, { 96000, 48000 } };
+
+
+static void make_sine (int16_t* out, int samples, int sample_rate)
+{
+	int i, c;
+	for (i = 0; i < samples; i ++)
+		for (c = 0; c < CHANNELS; c ++)
+			out[i * CHANNELS + c] = (int16_t) lrint (16384 * sin (2 * M_PI * FREQUENCY * i / sample_rate));
+}
+
+
+/**
+ *	@param double * snr
+ *		set to the signal to noise ratio of the output, in dB
+ *	@return int ret
+ *		0 on success, non-zero on error
+ */
+static int run (const int16_t* sine, int samples, int in_rate, int out_rate, int quality, double* ns_per_sample, double* snr)
+{
+	resampler resampler;
+	const int16_t* out;
+	int64_t out_time;
+	double signal = 0, noise = 0, ref;
+	int i, j, c, n, taps, skip, total = 0;
+
+	if (init_resampler (&resampler, CHANNELS, in_rate, out_rate, quality) != 0)
+		return 1;
+	taps = resampler.bank->taps;
+	// leave out where the filter runs into the silence before the first sample
+	skip = taps * out_rate / in_rate + 1;
+	for (i = 0; i + FRAME <= samples; i += FRAME)
+	{
+		if ((n = resample (&resampler, sine + (size_t) i * CHANNELS, FRAME, AV_NOPTS_VALUE, &out, &out_time)) < 0)
+		{
+			destroy_resampler (&resampler);
+			return 1;
+		}
+		// output sample j lies where input sample j * in_rate / out_rate does
+		for (j = 0; j < n; j ++, total ++)
+			if (total >= skip)
+			{
+				ref = 16384 * sin (2 * M_PI * FREQUENCY * total / out_rate);
+				for (c = 0; c < CHANNELS; c ++)
+				{
+					signal += ref * ref;
+					noise  += (out[j * CHANNELS + c] - ref) * (out[j * CHANNELS + c] - ref);
+				}
+			}
+	}
+	*ns_per_sample = (double) resampler.cpu / (resampler.samples_out * CHANNELS);
+	*snr           = 10 * log10 (signal / (noise + 1e-9));
+	destroy_resampler (&resampler);
+	return total <= skip;
+}
+
+
+int main (int argc, char** argv)
+{
+	int seconds = argc > 1 ? atoi (argv[1]) : 5;
+	int16_t* sine[2];
+	double ns, snr;
+	uint k, r;
+	int q, samples, failed = 0;
+
+	for (r = 0; r < 2; r ++)
+	{
+		samples = seconds * rates[r][0];
+		if (samples < FRAME || (sine[r] = malloc ((size_t) samples * CHANNELS * sizeof (int16_t))) == NULL)
+			return 1;
+		make_sine (sine[r], samples, rates[r][0]);
+	}
+	printf ("%d s of a %.0f Hz sine, %d channels, kernels picked for this CPU: %s\n",
+	        seconds, FREQUENCY, CHANNELS, resample_kernel_name ());
+	for (k = 0; k < sizeof (candidates) / sizeof (candidates[0]); k ++)
+	{
+		if (!cpu_runs_kernels (candidates[k]->name))
+		{
+			printf ("  %-4s not supported by this CPU\n", candidates[k]->name);
+			continue;
+		}
+		set_resample_kernels (candidates[k]);
+		for (r = 0; r < 2; r ++)
+			for (q = RESAMPLE_LOW; q <= RESAMPLE_HIGH; q ++)
+			{
+				if (run (sine[r], seconds * rates[r][0], rates[r][0], rates[r][1], q, &ns, &snr) != 0)
+				{
+					fprintf (stderr, "%s: resampling failed\n", candidates[k]->name);
+					failed = 1;
+					continue;
+				}
+				printf ("  %-4s %5d -> %5d Hz %-6s: %6.1f ns per sample, SNR %5.1f dB\n",
+				        candidates[k]->name, rates[r][0], rates[r][1], qualities[q], ns, snr);
+				if (snr < min_snr[q])
+				{
+					fprintf (stderr, "%s %s: SNR below %.0f dB\n", candidates[k]->name, qualities[q], min_snr[q]);
+					failed = 1;
+				}
+			}
+	}
+	free (sine[0]);
+	free (sine[1]);
+	return failed;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <libavutil/avutil.h>
+#include "rpi_mp_time_stretch.h"
+#include "kernel_bench.h"
+
+/**
+ *	CPU time time_stretch takes per second of stereo 48 kHz audio with each of its kernels,
+ *	slowed down to 0.5x and sped up to 2x, fed in frames of 1024 samples as a decoder does.
+ *	usage: time_stretch_bench [seconds]
+ */
+
+#define CHANNELS    2
+#define SAMPLE_RATE 48000
+#define FRAME       1024
+
+static const time_stretch_kernels* const candidates[] =
+{
+	&time_stretch_kernels_c,
+#if defined(__arm__) || defined(__aarch64__)
+	&time_stretch_kernels_neon,
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	&time_stretch_kernels_sse2,
+	&time_stretch_kernels_avx2,
+#endif
+};
+
+
+/**
+ *	@return int ret
+ *		0 if the output is as long as the tempo makes it, non-zero otherwise
+ */
+static int run (const int16_t* signal, int samples, double tempo, double* ms_per_second)
+{
+	time_stretcher stretcher;
+	const int16_t* out;
+	int64_t out_time;
+	double expected;
+	int i, ret;
+
+	if (init_time_stretcher (&stretcher, CHANNELS, SAMPLE_RATE) != 0)
+		return 1;
+	set_time_stretch_tempo (&stretcher, tempo);
+	for (i = 0; i + FRAME <= samples; i += FRAME)
+		if (time_stretch (&stretcher, signal + (size_t) i * CHANNELS, FRAME, AV_NOPTS_VALUE, &out, &out_time) < 0)
+		{
+			destroy_time_stretcher (&stretcher);
+			return 1;
+		}
+	*ms_per_second = stretcher.cpu / 1e6 / ((double) stretcher.samples_in / SAMPLE_RATE);
+	// all but the audio held back, some 60 ms
+	expected = stretcher.samples_in / tempo;
+	ret      = fabs (stretcher.samples_out - expected) > SAMPLE_RATE * 0.1 / tempo;
+	destroy_time_stretcher (&stretcher);
+	return ret;
+}
+
+
+int main (int argc, char** argv)
+{
+	static const double tempos[] = { 0.5, 2 };
+	int seconds = argc > 1 ? atoi (argv[1]) : 10;
+	int samples = seconds * SAMPLE_RATE;
+	int16_t* signal = malloc ((size_t) samples * CHANNELS * sizeof (int16_t));
+	double ms[2];
+	uint k, t;
+	int failed = 0;
+
+	if (signal == NULL || samples < FRAME)
+		return 1;
+	make_signal (signal, samples, CHANNELS, SAMPLE_RATE);
+	printf ("%d s of %d channel %d Hz audio, kernels picked for this CPU: %s\n",
+	        seconds, CHANNELS, SAMPLE_RATE, time_stretch_kernel_name ());
+	for (k = 0; k < sizeof (candidates) / sizeof (candidates[0]); k ++)
+	{
+		if (!cpu_runs_kernels (candidates[k]->name))
+		{
+			printf ("  %-4s not supported by this CPU\n", candidates[k]->name);
+			continue;
+		}
+		set_time_stretch_kernels (candidates[k]);
+		for (t = 0; t < 2; t ++)
+			if (run (signal, samples, tempos[t], &ms[t]) != 0)
+			{
+				fprintf (stderr, "%s at %.1fx: output not as long as the tempo makes it\n", candidates[k]->name, tempos[t]);
+				failed = 1;
+			}
+		printf ("  %-4s %6.2f ms of CPU per second of audio at 0.5x, %6.2f ms at 2x\n", candidates[k]->name, ms[0], ms[1]);
+	}
+	free (signal);
+	return failed;
+}